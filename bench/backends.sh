@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Builds the library once with expat and once with libxml2 under
+# BUILDDIR (default: bench-build) and runs "make bench" for both, so
+# that the two XML backends can be compared on the same corpus.
+#
+#   usage: bench/backends.sh [BUILDDIR]
+#
+# The source tree must have been bootstrapped with ./buildconf.
+
+srcdir=`cd \`dirname "$0"\`/.. && pwd`
+builddir=${1:-bench-build}
+
+for backend in expat libxml2; do
+  if test "$backend" = expat; then
+    options="--with-libexpat"
+  else
+    options="--without-libexpat --with-libxml2"
+  fi
+  mkdir -p "$builddir/$backend" || exit 1
+  echo "building with $backend in $builddir/$backend"
+  (cd "$builddir/$backend" &&
+   "$srcdir/configure" $options > configure.log 2>&1 &&
+   make > make.log 2>&1) || {
+    echo "cannot build with $backend, see $builddir/$backend" >&2
+    exit 1
+  }
+  (cd "$builddir/$backend" && make -s bench) || exit 1
+done
@@ -0,0 +1,227 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+/*
+ * Reports the throughput of each digest backend supported by this CPU,
+ * and the rate at which RFC 3339 dates are parsed. It is built by
+ * "make metalinkbench" and is not run by "make check".
+ *
+ *   usage: metalinkbench [MEBIBYTES]
+ */
+/* for strptime and timegm of the reference date parser */
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include "metalink_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "metalink_digest.h"
+#include "metalink_date.h"
+
+#define BENCH_BUFFER_LENGTH (1024 * 1024)
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void report(const char *backend, const char *algorithm, size_t bytes,
+                   double seconds) {
+  printf("%-8s %-12s %8.3f GB/s\n", backend, algorithm,
+         seconds > 0 ? (double)bytes / seconds / 1e9 : 0.0);
+}
+
+/* Hashes mebibytes MiB of buf as a single message. */
+static double bench_single(metalink_digest_algo_t algo,
+                           const unsigned char *buf, size_t mebibytes) {
+  metalink_digest_t digest;
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  double start;
+  size_t i;
+
+  start = now();
+  metalink_digest_init(&digest, algo);
+  for (i = 0; i < mebibytes; ++i) {
+    metalink_digest_update(&digest, buf, BENCH_BUFFER_LENGTH);
+  }
+  metalink_digest_final(&digest, md);
+  return now() - start;
+}
+
+/* Hashes mebibytes MiB of buf split into 8 messages hashed at once. */
+static double bench_multi(metalink_digest_algo_t algo,
+                          const unsigned char *buf, size_t mebibytes) {
+  metalink_digest_t digests[8];
+  metalink_digest_t *digest_ptrs[8];
+  const unsigned char *data[8];
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  double start;
+  size_t i;
+
+  start = now();
+  for (i = 0; i < 8; ++i) {
+    metalink_digest_init(&digests[i], algo);
+    digest_ptrs[i] = &digests[i];
+    data[i] = buf + i * (BENCH_BUFFER_LENGTH / 8);
+  }
+  for (i = 0; i < mebibytes; ++i) {
+    metalink_digest_update_multi(digest_ptrs, data, 8,
+                                 BENCH_BUFFER_LENGTH / 8);
+  }
+  for (i = 0; i < 8; ++i) {
+    metalink_digest_final(&digests[i], md);
+  }
+  return now() - start;
+}
+
+#define BENCH_DATE_COUNT 1000000
+
+static const char *bench_dates[] = {
+    "2009-05-15T12:23:23Z", "2010-05-01T12:16:02+01:00",
+    "2012-02-29T23:59:59.123-05:30", "1999-12-31T00:00:00Z"};
+
+static void report_dates(const char *parser, double seconds) {
+  printf("%-8s %-12s %8.1f M/s\n", parser, "date",
+         seconds > 0 ? BENCH_DATE_COUNT / seconds / 1e6 : 0.0);
+}
+
+static double bench_date(time_t *sum) {
+  time_t t;
+  double start;
+  size_t i;
+
+  start = now();
+  for (i = 0; i < BENCH_DATE_COUNT; ++i) {
+    if (metalink_parse_date(&t, bench_dates[i % 4]) == 0) {
+      *sum += t;
+    }
+  }
+  return now() - start;
+}
+
+#if defined(HAVE_STRPTIME) && defined(HAVE_TIMEGM)
+/* The strptime and timegm based parser that metalink_parse_date
+   replaced, which ignores fractions of a second. */
+static double bench_date_strptime(time_t *sum) {
+  struct tm tm, offset;
+  const char *rest;
+  time_t t;
+  double start;
+  size_t i;
+
+  start = now();
+  for (i = 0; i < BENCH_DATE_COUNT; ++i) {
+    memset(&tm, 0, sizeof(tm));
+    rest = strptime(bench_dates[i % 4], "%Y-%m-%dT%H:%M:%S", &tm);
+    if (rest == NULL) {
+      continue;
+    }
+    t = timegm(&tm);
+    while (*rest != 'Z' && *rest != '+' && *rest != '-' && *rest != '\0') {
+      rest++;
+    }
+    if (*rest == '+' || *rest == '-') {
+      memset(&offset, 0, sizeof(offset));
+      if (strptime(rest + 1, "%H:%M", &offset) != NULL) {
+        t += (*rest == '+' ? -1 : 1) *
+             (offset.tm_hour * 3600 + offset.tm_min * 60);
+      }
+    }
+    *sum += t;
+  }
+  return now() - start;
+}
+#endif /* HAVE_STRPTIME && HAVE_TIMEGM */
+
+int main(int argc, char **argv) {
+  static const char *backends[] = {"scalar", "sha-ni", "avx2"};
+  static const struct {
+    const char *name;
+    metalink_digest_algo_t algo;
+  } algorithms[] = {{"md5", METALINK_DIGEST_MD5},
+                    {"sha-1", METALINK_DIGEST_SHA1},
+                    {"sha-256", METALINK_DIGEST_SHA256},
+                    {"sha-512", METALINK_DIGEST_SHA512}};
+  unsigned char *buf;
+  time_t sum = 0;
+  size_t mebibytes = 256;
+  size_t bytes, i, j;
+
+  if (argc > 1) {
+    mebibytes = (size_t)strtoul(argv[1], NULL, 10);
+    if (mebibytes == 0) {
+      fprintf(stderr, "usage: %s [MEBIBYTES]\n", argv[0]);
+      return 1;
+    }
+  }
+  bytes = mebibytes * BENCH_BUFFER_LENGTH;
+  buf = malloc(BENCH_BUFFER_LENGTH);
+  if (!buf) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (i = 0; i < BENCH_BUFFER_LENGTH; ++i) {
+    buf[i] = (unsigned char)(i * 7 + i / 251);
+  }
+
+  for (i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+    if (metalink_digest_set_backend(backends[i]) != 0) {
+      printf("%-8s not supported\n", backends[i]);
+      continue;
+    }
+    for (j = 0; j < sizeof(algorithms) / sizeof(algorithms[0]); ++j) {
+      /* other backends only replace SHA-1 and SHA-256 */
+      if (strcmp(metalink_digest_get_backend(algorithms[j].algo),
+                 backends[i]) != 0) {
+        continue;
+      }
+      if (metalink_digest_lanes(algorithms[j].algo) > 1) {
+        report(backends[i], algorithms[j].name, bytes,
+               bench_multi(algorithms[j].algo, buf, mebibytes));
+      } else {
+        report(backends[i], algorithms[j].name, bytes,
+               bench_single(algorithms[j].algo, buf, mebibytes));
+      }
+    }
+  }
+  free(buf);
+
+  report_dates("metalink", bench_date(&sum));
+#if defined(HAVE_STRPTIME) && defined(HAVE_TIMEGM)
+  report_dates("strptime", bench_date_strptime(&sum));
+#endif /* HAVE_STRPTIME && HAVE_TIMEGM */
+  /* keeps the results alive */
+  return sum == 1;
+}
@@ -0,0 +1,316 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+/*
+ * Writes a synthetic Metalink document for benchmarking the parser.
+ *
+ *   usage: metalinkgen [-3] [-z] [-f FILES] [-r RESOURCES] [-p PIECES]
+ *                      [-s SIGNATURE_BYTES] [-o OUTPUT]
+ *
+ * -3 writes Metalink 3.0 instead of Metalink 4 (RFC 5854), and -z
+ * compresses the output with gzip. Each file has RESOURCES urls,
+ * PIECES piece hashes and, if SIGNATURE_BYTES is not 0, a signature of
+ * about that size. The output goes to stdout unless OUTPUT is given.
+ */
+#include "metalink_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#define GEN_PIECE_LENGTH 262144
+
+static const char *countries[] = {"us", "de", "jp", "fr", "br", "gb", "cn",
+                                  "au"};
+
+typedef struct _generator {
+  FILE *fp;
+#ifdef HAVE_ZLIB
+  gzFile gz;
+#endif /* HAVE_ZLIB */
+  /* state of the xorshift generator for hashes and signatures */
+  unsigned long long state;
+  int failed;
+} generator_t;
+
+static void emit(generator_t *gen, const char *format, ...) {
+  char buf[1024];
+  va_list ap;
+  int len;
+
+  va_start(ap, format);
+  len = vsnprintf(buf, sizeof(buf), format, ap);
+  va_end(ap);
+  if (len < 0 || (size_t)len >= sizeof(buf)) {
+    gen->failed = 1;
+    return;
+  }
+#ifdef HAVE_ZLIB
+  if (gen->gz) {
+    if (gzwrite(gen->gz, buf, (unsigned int)len) != len) {
+      gen->failed = 1;
+    }
+    return;
+  }
+#endif /* HAVE_ZLIB */
+  if (fwrite(buf, 1, (size_t)len, gen->fp) != (size_t)len) {
+    gen->failed = 1;
+  }
+}
+
+static unsigned long long next_random(generator_t *gen) {
+  gen->state ^= gen->state << 13;
+  gen->state ^= gen->state >> 7;
+  gen->state ^= gen->state << 17;
+  return gen->state;
+}
+
+/* Writes a random hash of len bytes in hex. */
+static void emit_hex(generator_t *gen, size_t len) {
+  static const char digits[] = "0123456789abcdef";
+  char buf[129];
+  size_t i;
+
+  for (i = 0; i < len * 2; ++i) {
+    buf[i] = digits[next_random(gen) & 0xf];
+  }
+  buf[i] = '\0';
+  emit(gen, "%s", buf);
+}
+
+/* Writes about len bytes of random base64 in lines of 64 characters. */
+static void emit_signature(generator_t *gen, size_t len) {
+  static const char digits[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char line[65];
+  size_t i, n;
+
+  emit(gen, "-----BEGIN PGP SIGNATURE-----\n\n");
+  while (len > 0) {
+    n = len < 64 ? len : 64;
+    for (i = 0; i < n; ++i) {
+      line[i] = digits[next_random(gen) & 0x3f];
+    }
+    line[n] = '\0';
+    emit(gen, "%s\n", line);
+    len -= n;
+  }
+  emit(gen, "-----END PGP SIGNATURE-----\n");
+}
+
+static void emit_file_v4(generator_t *gen, size_t index, size_t resources,
+                         size_t pieces, size_t signature) {
+  size_t i;
+
+  emit(gen, "  <file name=\"dir%lu/file-%06lu.bin\">\n",
+       (unsigned long)(index % 16), (unsigned long)index);
+  emit(gen, "    <size>%llu</size>\n",
+       (unsigned long long)pieces * GEN_PIECE_LENGTH);
+  emit(gen, "    <identity>file-%lu</identity>\n", (unsigned long)index);
+  emit(gen, "    <version>1.%lu</version>\n", (unsigned long)(index % 10));
+  emit(gen, "    <description>Synthetic file %lu</description>\n",
+       (unsigned long)index);
+  emit(gen, "    <hash type=\"sha-256\">");
+  emit_hex(gen, 32);
+  emit(gen, "</hash>\n");
+  if (pieces > 0) {
+    emit(gen, "    <pieces length=\"%d\" type=\"sha-1\">\n", GEN_PIECE_LENGTH);
+    for (i = 0; i < pieces; ++i) {
+      emit(gen, "      <hash>");
+      emit_hex(gen, 20);
+      emit(gen, "</hash>\n");
+    }
+    emit(gen, "    </pieces>\n");
+  }
+  if (signature > 0) {
+    emit(gen, "    <signature mediatype=\"application/pgp-signature\">");
+    emit_signature(gen, signature);
+    emit(gen, "</signature>\n");
+  }
+  for (i = 0; i < resources; ++i) {
+    emit(gen,
+         "    <url location=\"%s\" priority=\"%lu\">"
+         "http://mirror%lu.example.org/dir%lu/file-%06lu.bin</url>\n",
+         countries[i % 8], (unsigned long)(i + 1), (unsigned long)i,
+         (unsigned long)(index % 16), (unsigned long)index);
+  }
+  emit(gen, "  </file>\n");
+}
+
+static void emit_file_v3(generator_t *gen, size_t index, size_t resources,
+                         size_t pieces, size_t signature) {
+  size_t i;
+
+  emit(gen, "    <file name=\"dir%lu/file-%06lu.bin\">\n",
+       (unsigned long)(index % 16), (unsigned long)index);
+  emit(gen, "      <size>%llu</size>\n",
+       (unsigned long long)pieces * GEN_PIECE_LENGTH);
+  emit(gen, "      <identity>file-%lu</identity>\n", (unsigned long)index);
+  emit(gen, "      <version>1.%lu</version>\n", (unsigned long)(index % 10));
+  emit(gen, "      <verification>\n");
+  emit(gen, "        <hash type=\"sha256\">");
+  emit_hex(gen, 32);
+  emit(gen, "</hash>\n");
+  if (pieces > 0) {
+    emit(gen, "        <pieces length=\"%d\" type=\"sha1\">\n",
+         GEN_PIECE_LENGTH);
+    for (i = 0; i < pieces; ++i) {
+      emit(gen, "          <hash piece=\"%lu\">", (unsigned long)i);
+      emit_hex(gen, 20);
+      emit(gen, "</hash>\n");
+    }
+    emit(gen, "        </pieces>\n");
+  }
+  if (signature > 0) {
+    emit(gen, "        <signature type=\"pgp\">");
+    emit_signature(gen, signature);
+    emit(gen, "</signature>\n");
+  }
+  emit(gen, "      </verification>\n");
+  emit(gen, "      <resources>\n");
+  for (i = 0; i < resources; ++i) {
+    emit(gen,
+         "        <url type=\"http\" location=\"%s\" preference=\"%lu\">"
+         "http://mirror%lu.example.org/dir%lu/file-%06lu.bin</url>\n",
+         countries[i % 8], (unsigned long)(100 - i % 100), (unsigned long)i,
+         (unsigned long)(index % 16), (unsigned long)index);
+  }
+  emit(gen, "      </resources>\n");
+  emit(gen, "    </file>\n");
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-3] [-z] [-f FILES] [-r RESOURCES] [-p PIECES]\n"
+          "       [-s SIGNATURE_BYTES] [-o OUTPUT]\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  generator_t gen;
+  size_t files = 100, resources = 8, pieces = 16, signature = 0;
+  const char *output = NULL;
+  int v3 = 0, compress = 0;
+  size_t i;
+  int c;
+
+  while ((c = getopt(argc, argv, "3zf:r:p:s:o:")) != -1) {
+    switch (c) {
+    case '3':
+      v3 = 1;
+      break;
+    case 'z':
+      compress = 1;
+      break;
+    case 'f':
+      files = (size_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      resources = (size_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      pieces = (size_t)strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      signature = (size_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  memset(&gen, 0, sizeof(gen));
+  gen.state = 0x9e3779b97f4a7c15ULL;
+  if (compress) {
+#ifdef HAVE_ZLIB
+    gen.gz = output ? gzopen(output, "wb") : gzdopen(STDOUT_FILENO, "wb");
+    if (!gen.gz) {
+      perror(output ? output : "stdout");
+      return 1;
+    }
+#else  /* !HAVE_ZLIB */
+    fprintf(stderr, "%s: built without zlib, -z is not supported\n", argv[0]);
+    return 1;
+#endif /* !HAVE_ZLIB */
+  } else if (output) {
+    gen.fp = fopen(output, "wb");
+    if (!gen.fp) {
+      perror(output);
+      return 1;
+    }
+  } else {
+    gen.fp = stdout;
+  }
+
+  if (v3) {
+    emit(&gen, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+               "<metalink version=\"3.0\" xmlns=\"http://www.metalinker.org/\""
+               " type=\"dynamic\" pubdate=\"Fri, 15 May 2009 12:23:23 GMT\">\n"
+               "  <files>\n");
+    for (i = 0; i < files; ++i) {
+      emit_file_v3(&gen, i, resources, pieces, signature);
+    }
+    emit(&gen, "  </files>\n</metalink>\n");
+  } else {
+    emit(&gen, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">\n"
+               "  <published>2009-05-15T12:23:23Z</published>\n"
+               "  <updated>2010-05-01T12:15:02Z</updated>\n");
+    for (i = 0; i < files; ++i) {
+      emit_file_v4(&gen, i, resources, pieces, signature);
+    }
+    emit(&gen, "</metalink>\n");
+  }
+
+#ifdef HAVE_ZLIB
+  if (gen.gz) {
+    if (gzclose(gen.gz) != Z_OK) {
+      gen.failed = 1;
+    }
+  } else
+#endif /* HAVE_ZLIB */
+  if (gen.fp != stdout ? fclose(gen.fp) != 0 : fflush(gen.fp) != 0) {
+    gen.failed = 1;
+  }
+  if (gen.failed) {
+    fprintf(stderr, "%s: cannot write %s\n", argv[0],
+            output ? output : "stdout");
+    return 1;
+  }
+  return 0;
+}
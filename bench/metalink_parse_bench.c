@@ -0,0 +1,388 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+/*
+ * Measures how fast the library parses Metalink documents, e.g. those
+ * written by metalinkgen, through each entry point: metalink_parse_memory
+ * ("memory"), metalink_parse_fd ("fd"), metalink_parse_file ("file") and
+ * metalink_parse_update in 16 KiB chunks ("update"). gzip compressed
+ * documents are inflated in chunks and fed to metalink_parse_update
+ * ("gzip"). Every mode runs in a child process, which reports the
+ * throughput, the heap allocations per document and its peak RSS.
+ *
+ *   usage: metalinkparsebench [-n ITERATIONS] [-t THREADS]
+ *                             [-m MODE[,MODE...]] FILE...
+ *
+ * Without -n, each mode is repeated for about a second. -t sets the
+ * number of threads the memory and file modes parse a document with,
+ * see metalink_parse_options_set_threads.
+ */
+#include "metalink_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#include <metalink/metalink.h>
+
+#define BENCH_CHUNK_LENGTH 16384
+
+#ifdef HAVE_LIBXML2
+#define BENCH_BACKEND "libxml2"
+#else /* !HAVE_LIBXML2 */
+#define BENCH_BACKEND "expat"
+#endif /* !HAVE_LIBXML2 */
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+/* glibc lets a program replace malloc and friends, which is used here
+   to count the allocations made by the library and the XML parser. */
+#define BENCH_COUNT_ALLOCATIONS 1
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+static size_t allocations;
+static size_t allocated_bytes;
+
+/* The library may allocate on several threads with -t. */
+static void count_allocation(size_t size) {
+  __sync_fetch_and_add(&allocations, 1);
+  __sync_fetch_and_add(&allocated_bytes, size);
+}
+
+void *malloc(size_t size) {
+  count_allocation(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  count_allocation(nmemb * size);
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count_allocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+#endif /* __GLIBC__ && !__SANITIZE_ADDRESS__ */
+
+typedef struct _document {
+  const char *path;
+  /* whole document, uncompressed */
+  char *data;
+  size_t length;
+  int compressed;
+} document_t;
+
+static double now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/* Reads the whole file at path, inflating it if it is gzip compressed. */
+static int load_document(document_t *doc, const char *path) {
+  char buf[BENCH_CHUNK_LENGTH];
+  char *data;
+  FILE *fp;
+  size_t n, capacity = 0;
+
+  memset(doc, 0, sizeof(*doc));
+  doc->path = path;
+  fp = fopen(path, "rb");
+  if (!fp) {
+    return -1;
+  }
+  n = fread(buf, 1, 2, fp);
+  doc->compressed = n == 2 && (unsigned char)buf[0] == 0x1f &&
+                    (unsigned char)buf[1] == 0x8b;
+  fclose(fp);
+
+#ifdef HAVE_ZLIB
+  {
+    gzFile gz;
+    int len;
+
+    gz = gzopen(path, "rb");
+    if (!gz) {
+      return -1;
+    }
+    while ((len = gzread(gz, buf, sizeof(buf))) > 0) {
+      if (doc->length + (size_t)len > capacity) {
+        capacity = capacity ? capacity * 2 : sizeof(buf);
+        data = realloc(doc->data, capacity);
+        if (!data) {
+          gzclose(gz);
+          return -1;
+        }
+        doc->data = data;
+      }
+      memcpy(doc->data + doc->length, buf, (size_t)len);
+      doc->length += (size_t)len;
+    }
+    gzclose(gz);
+    return len < 0 ? -1 : 0;
+  }
+#else  /* !HAVE_ZLIB */
+  if (doc->compressed) {
+    return -1;
+  }
+  fp = fopen(path, "rb");
+  if (!fp) {
+    return -1;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    if (doc->length + n > capacity) {
+      capacity = capacity ? capacity * 2 : sizeof(buf);
+      data = realloc(doc->data, capacity);
+      if (!data) {
+        fclose(fp);
+        return -1;
+      }
+      doc->data = data;
+    }
+    memcpy(doc->data + doc->length, buf, n);
+    doc->length += n;
+  }
+  fclose(fp);
+  return 0;
+#endif /* !HAVE_ZLIB */
+}
+
+static metalink_error_t parse_update(const char *data, size_t length,
+                                     metalink_t **res) {
+  metalink_parser_context_t *ctx;
+  metalink_error_t r;
+  size_t n;
+
+  ctx = metalink_parser_context_new();
+  if (!ctx) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  for (; length > BENCH_CHUNK_LENGTH; data += n, length -= n) {
+    n = BENCH_CHUNK_LENGTH;
+    r = metalink_parse_update(ctx, data, n);
+    if (r != 0) {
+      metalink_parser_context_delete(ctx);
+      return r;
+    }
+  }
+  return metalink_parse_final(ctx, data, length, res);
+}
+
+#ifdef HAVE_ZLIB
+static metalink_error_t parse_gzip(const char *path, metalink_t **res) {
+  char buf[BENCH_CHUNK_LENGTH];
+  metalink_parser_context_t *ctx;
+  metalink_error_t r = 0;
+  gzFile gz;
+  int len;
+
+  gz = gzopen(path, "rb");
+  if (!gz) {
+    return METALINK_ERR_CANNOT_OPEN_FILE;
+  }
+  ctx = metalink_parser_context_new();
+  if (!ctx) {
+    gzclose(gz);
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  while ((len = gzread(gz, buf, sizeof(buf))) > 0) {
+    r = metalink_parse_update(ctx, buf, (size_t)len);
+    if (r != 0) {
+      break;
+    }
+  }
+  gzclose(gz);
+  if (r != 0 || len < 0) {
+    metalink_parser_context_delete(ctx);
+    return r != 0 ? r : METALINK_ERR_PARSER_ERROR;
+  }
+  return metalink_parse_final(ctx, NULL, 0, res);
+}
+#endif /* HAVE_ZLIB */
+
+static metalink_error_t parse_once(const document_t *doc, const char *mode,
+                                   const metalink_parse_options_t *opts,
+                                   metalink_t **res) {
+  metalink_error_t r;
+  int fd;
+
+  if (strcmp(mode, "memory") == 0) {
+    return metalink_parse_memory_ex(doc->data, doc->length, res, opts);
+  } else if (strcmp(mode, "fd") == 0) {
+    fd = open(doc->path, O_RDONLY);
+    if (fd == -1) {
+      return METALINK_ERR_CANNOT_OPEN_FILE;
+    }
+    r = metalink_parse_fd(fd, res);
+    close(fd);
+    return r;
+  } else if (strcmp(mode, "file") == 0) {
+    return metalink_parse_file_ex(doc->path, res, opts);
+  } else if (strcmp(mode, "update") == 0) {
+    return parse_update(doc->data, doc->length, res);
+#ifdef HAVE_ZLIB
+  } else if (strcmp(mode, "gzip") == 0) {
+    return parse_gzip(doc->path, res);
+#endif /* HAVE_ZLIB */
+  }
+  return METALINK_ERR_PARSER_ERROR;
+}
+
+/* Runs mode on doc and prints a line of results. Called in a child. */
+static int run_mode(const document_t *doc, const char *mode,
+                    const metalink_parse_options_t *opts, long iterations) {
+  metalink_t *metalink;
+  metalink_error_t r;
+  struct rusage usage;
+  double start, elapsed;
+  size_t allocs = 0, bytes = 0;
+  long i;
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+  allocations = 0;
+  allocated_bytes = 0;
+#endif /* BENCH_COUNT_ALLOCATIONS */
+  start = now();
+  for (i = 0; iterations > 0 ? i < iterations : (i < 1 || now() - start < 1);
+       ++i) {
+    r = parse_once(doc, mode, opts, &metalink);
+    if (r != 0) {
+      fprintf(stderr, "%s: %s: %s\n", doc->path, mode, metalink_strerror(r));
+      return 1;
+    }
+    metalink_delete(metalink);
+  }
+  elapsed = now() - start;
+#ifdef BENCH_COUNT_ALLOCATIONS
+  allocs = allocations;
+  bytes = allocated_bytes;
+#endif /* BENCH_COUNT_ALLOCATIONS */
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("%-8s %-7s %-24s %9.1f %10.1f", BENCH_BACKEND, mode, doc->path,
+         (double)doc->length * i / elapsed / 1e6, i / elapsed);
+#ifdef BENCH_COUNT_ALLOCATIONS
+  printf(" %11.1f %10.1f", (double)allocs / i, (double)bytes / i / 1024);
+#else  /* !BENCH_COUNT_ALLOCATIONS */
+  printf(" %11s %10s", "n/a", "n/a");
+#endif /* !BENCH_COUNT_ALLOCATIONS */
+  printf(" %10ld\n", (long)usage.ru_maxrss);
+  fflush(stdout);
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-n ITERATIONS] [-t THREADS] [-m MODE[,MODE...]] "
+          "FILE...\n"
+          "modes: memory, fd, file, update, gzip\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  char modes_buf[256];
+  const char *modes = "memory,fd,file,update,gzip";
+  const char *mode;
+  metalink_parse_options_t *opts;
+  document_t doc;
+  long iterations = 0;
+  pid_t pid;
+  int status, c, failed = 0;
+
+  opts = metalink_parse_options_new();
+  if (!opts) {
+    return 1;
+  }
+  while ((c = getopt(argc, argv, "n:t:m:")) != -1) {
+    switch (c) {
+    case 'n':
+      iterations = strtol(optarg, NULL, 10);
+      break;
+    case 't':
+      metalink_parse_options_set_threads(opts,
+                                         (int)strtol(optarg, NULL, 10));
+      break;
+    case 'm':
+      modes = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind == argc || strlen(modes) >= sizeof(modes_buf)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  printf("%-8s %-7s %-24s %9s %10s %11s %10s %10s\n", "backend", "mode",
+         "document", "MB/s", "docs/s", "allocs/doc", "KiB/doc",
+         "maxrss KiB");
+  fflush(stdout);
+  for (; optind < argc; ++optind) {
+    if (load_document(&doc, argv[optind]) != 0) {
+      fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[optind]);
+      failed = 1;
+      continue;
+    }
+    strcpy(modes_buf, modes);
+    for (mode = strtok(modes_buf, ","); mode; mode = strtok(NULL, ",")) {
+      /* compressed documents are only parsed by the gzip mode, and
+         uncompressed ones by all the others */
+      if (doc.compressed != (strcmp(mode, "gzip") == 0)) {
+        continue;
+      }
+      pid = fork();
+      if (pid == -1) {
+        perror("fork");
+        return 1;
+      }
+      if (pid == 0) {
+        _exit(run_mode(&doc, mode, opts, iterations));
+      }
+      if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+          WEXITSTATUS(status) != 0) {
+        failed = 1;
+      }
+    }
+    free(doc.data);
+  }
+  metalink_parse_options_delete(opts);
+  return failed;
+}
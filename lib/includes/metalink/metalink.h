@@ -32,6 +32,11 @@
 #include <metalink/metalink_error.h>
 #include <metalink/metalink_types.h>
 #include <metalink/metalink_parser.h>
+#include <metalink/metalink_verify.h>
+#include <metalink/metalink_mirror.h>
+#include <metalink/metalink_plan.h>
+#include <metalink/metalink_health.h>
+#include <metalink/metalink_snapshot.h>
 
 #ifdef __cplusplus
 extern "C" {
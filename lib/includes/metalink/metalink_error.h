@@ -36,6 +36,10 @@ typedef enum metalink_error_e {
 
   METALINK_ERR_CANNOT_OPEN_FILE = 902,
 
+  METALINK_ERR_CANNOT_READ_FILE = 903,
+
+  METALINK_ERR_CANNOT_WRITE_FILE = 904,
+
   /* 1xx: XML semantic error */
   METALINK_ERR_MISSING_REQUIRED_ATTR = 101,
 
@@ -44,6 +48,8 @@ typedef enum metalink_error_e {
   /* 2xx: parser error */
   METALINK_ERR_PARSER_ERROR = 201,
 
+  METALINK_ERR_DOCUMENT_TOO_LARGE = 202,
+
   /* 3xx transaction error */
   METALINK_ERR_NO_FILE_TRANSACTION = 301,
 
@@ -55,7 +61,25 @@ typedef enum metalink_error_e {
 
   METALINK_ERR_NO_PIECE_HASH_TRANSACTION = 305,
 
-  METALINK_ERR_NO_SIGNATURE_TRANSACTION = 306
+  METALINK_ERR_NO_SIGNATURE_TRANSACTION = 306,
+
+  /* 4xx: application error */
+  METALINK_ERR_CALLBACK_FAILURE = 401,
+
+  /* 5xx: verification error */
+  METALINK_ERR_NO_PIECE_HASHES = 501,
+
+  METALINK_ERR_UNSUPPORTED_HASH = 502,
+
+  METALINK_ERR_NO_CHECKSUMS = 503,
+
+  /* 6xx: download planning error */
+  METALINK_ERR_UNKNOWN_FILE_SIZE = 601,
+
+  METALINK_ERR_NO_RESOURCES = 602,
+
+  /* 7xx: snapshot error */
+  METALINK_ERR_BAD_SNAPSHOT = 701
 } metalink_error_t;
 
 #ifdef __cplusplus
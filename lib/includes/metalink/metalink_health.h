@@ -0,0 +1,118 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_HEALTH_H_
+#define _D_METALINK_HEALTH_H_
+
+#include <metalink/metalink_types.h>
+#include <metalink/metalink_error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * What has been observed about the hosts of resources at run time:
+ * moving averages of latency and throughput, and consecutive failures.
+ * Hosts are taken from resource URLs and compared case insensitively.
+ * Reports are lock free and may come from any number of threads.
+ */
+typedef struct _metalink_health metalink_health_t;
+
+/*
+ * Creates a health table with room for at least capacity hosts. If
+ * capacity is 0, a default of 1024 is used. Reports about further
+ * hosts are dropped.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_health_new(metalink_health_t **res,
+                                     size_t capacity);
+
+/* Frees health. Passing NULL is legal. */
+void metalink_health_delete(metalink_health_t *health);
+
+/*
+ * Reports a successful transfer from the host of url. latency_ms is
+ * the time to the first byte, or negative if it was not measured.
+ * bytes were received in elapsed_ms milliseconds; pass 0 for either if
+ * there is no throughput to report. Reporting every few seconds during
+ * long transfers lets the averages follow a mirror which slows down.
+ */
+void metalink_health_report(metalink_health_t *health, const char *url,
+                            int latency_ms, long long bytes,
+                            int elapsed_ms);
+
+/*
+ * Reports a failed connection or transfer from the host of url. The
+ * host is left out of rotation for a second, doubling with each further
+ * failure in a row up to a minute.
+ */
+void metalink_health_report_failure(metalink_health_t *health,
+                                    const char *url);
+
+/*
+ * Reorders the count indexes into file->resources in resources by the
+ * expected time to fetch a megabyte from their hosts, fastest first.
+ * Hosts without throughput samples are assumed to be average, and ties
+ * keep their order, so resources should be passed in static rank
+ * order, e.g., as returned by metalink_mirror_index_select. Resources
+ * whose host is more than 4 times slower than the fastest, and then
+ * those whose host is backed off after a failure, are moved to the
+ * end.
+ * @param usable receives the number of resources before those moved
+ * to the end.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_health_rank(const metalink_health_t *health,
+                                      const metalink_file_t *file,
+                                      size_t *resources, size_t count,
+                                      size_t *usable);
+
+/*
+ * Writes the averages and failure counts of all hosts to the file at
+ * path, replacing it.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_health_save(const metalink_health_t *health,
+                                      const char *path);
+
+/*
+ * Reads hosts saved by metalink_health_save into health, replacing
+ * what it knows about them. Hosts which failed last time are backed off
+ * again. Malformed lines are skipped.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_health_load(metalink_health_t *health,
+                                      const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _D_METALINK_HEALTH_H_ */
@@ -0,0 +1,85 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_MIRROR_H_
+#define _D_METALINK_MIRROR_H_
+
+#include <metalink/metalink_types.h>
+#include <metalink/metalink_error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A ranking of the resources of a file, built once and queried for the
+ * best mirrors of a client. Resources are ranked by priority, lower
+ * first, and by their position in file->resources between equal
+ * priorities. Queries do not modify the index, so it may be shared by
+ * several threads.
+ */
+typedef struct _metalink_mirror_index metalink_mirror_index_t;
+
+/*
+ * Builds the ranking index of file->resources. The index keeps its own
+ * copy of what it needs, so file may be deleted afterwards; results
+ * are still indexes into file->resources.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_mirror_index_new(metalink_mirror_index_t **res,
+                                           const metalink_file_t *file);
+
+/* Frees index. Passing NULL is legal. */
+void metalink_mirror_index_delete(metalink_mirror_index_t *index);
+
+/*
+ * Stores the indexes into file->resources of at most max best
+ * resources in out, best first. Resources located in country come
+ * first, then all others; each group is in rank order.
+ * @param country a country code, like "JP", compared case
+ * insensitively. NULL ranks all resources together.
+ * @param protocols a NULL terminated list of resource types, like
+ * "https" and "http", compared case insensitively. Resources of other
+ * types are skipped. NULL accepts every type.
+ * @param excluded a bitmap of resources to skip, e.g., the ones which
+ * failed, one bit per resource with the most significant bit of the
+ * first byte being file->resources[0]. May be NULL.
+ * @return the number of indexes stored in out.
+ */
+size_t metalink_mirror_index_select(const metalink_mirror_index_t *index,
+                                    const char *country,
+                                    const char *const *protocols,
+                                    const unsigned char *excluded,
+                                    size_t *out, size_t max);
+
+/* Returns the number of resources in index. */
+size_t metalink_mirror_index_get_count(const metalink_mirror_index_t *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _D_METALINK_MIRROR_H_ */
@@ -77,6 +77,315 @@ metalink_error_t metalink_parse_fd(int docfd, metalink_t **res);
 metalink_error_t metalink_parse_memory(const char *buf, size_t len,
                                        metalink_t **res);
 
+/**
+ * Options to tune how metalink_parse_*_ex functions read and parse the
+ * document. Passing NULL instead of options uses the default values.
+ */
+typedef struct _metalink_parse_options metalink_parse_options_t;
+
+/**
+ * Hints given to the kernel through posix_fadvise(2) for the file being
+ * parsed. They can be OR-ed together. If the file is mapped,
+ * SEQUENTIAL and NOREUSE become madvise(2) MADV_SEQUENTIAL, and
+ * DONTNEED is applied once the mapping is gone.
+ */
+typedef enum metalink_fadvise_e {
+  /* don't give any hint */
+  METALINK_FADVISE_NONE = 0,
+  /* the file is read sequentially (POSIX_FADV_SEQUENTIAL) */
+  METALINK_FADVISE_SEQUENTIAL = 1,
+  /* the file is read only once (POSIX_FADV_NOREUSE) */
+  METALINK_FADVISE_NOREUSE = 1 << 1,
+  /* drop the cached pages of the file after parsing it
+     (POSIX_FADV_DONTNEED) */
+  METALINK_FADVISE_DONTNEED = 1 << 2
+} metalink_fadvise_t;
+
+/**
+ * How much of the file the kernel should read ahead.
+ */
+typedef enum metalink_readahead_e {
+  /* leave it to the kernel */
+  METALINK_READAHEAD_DEFAULT,
+  /* disable readahead (POSIX_FADV_RANDOM, MADV_RANDOM) */
+  METALINK_READAHEAD_NONE,
+  /* schedule reading the whole file as soon as it is opened
+     (POSIX_FADV_WILLNEED, MADV_WILLNEED) */
+  METALINK_READAHEAD_WHOLE_FILE
+} metalink_readahead_t;
+
+/*
+ * Allocates and returns parse options initialized with the default
+ * values.
+ * @return parse options on success, otherwise NULL.
+ */
+metalink_parse_options_t *metalink_parse_options_new(void);
+
+/**
+ * Deallocates parse options opts. If opts is NULL, this function does
+ * nothing.
+ */
+void metalink_parse_options_delete(metalink_parse_options_t *opts);
+
+/**
+ * Sets the number of bytes read from a file at once. 0 restores the
+ * default, which is 64 KiB. The value is capped at INT_MAX.
+ */
+void metalink_parse_options_set_read_size(metalink_parse_options_t *opts,
+                                          size_t read_size);
+
+/**
+ * Sets posix_fadvise(2) hints, bitwise OR of metalink_fadvise_t
+ * values. The default is METALINK_FADVISE_SEQUENTIAL.
+ */
+void metalink_parse_options_set_fadvise(metalink_parse_options_t *opts,
+                                        int fadvise);
+
+/**
+ * Sets the readahead policy. The default is
+ * METALINK_READAHEAD_DEFAULT.
+ */
+void metalink_parse_options_set_readahead(metalink_parse_options_t *opts,
+                                          metalink_readahead_t readahead);
+
+/**
+ * Sets the maximum size of the document in bytes. Parsing a larger
+ * document fails with METALINK_ERR_DOCUMENT_TOO_LARGE. 0, the default,
+ * means no limit.
+ */
+void metalink_parse_options_set_max_size(metalink_parse_options_t *opts,
+                                         size_t max_size);
+
+/**
+ * If use_mmap is nonzero, metalink_parse_file_ex maps regular files
+ * into memory instead of reading them. The default is 1.
+ */
+void metalink_parse_options_set_mmap(metalink_parse_options_t *opts,
+                                     int use_mmap);
+
+/**
+ * Parts of file entries which can be left out of the result. They can be
+ * OR-ed together.
+ */
+typedef enum metalink_field_e {
+  /* <url> elements, the resources member of metalink_file_t */
+  METALINK_FIELD_RESOURCES = 1,
+  /* <metaurl> elements, the metaurls member of metalink_file_t */
+  METALINK_FIELD_METAURLS = 1 << 1,
+  /* <hash> elements of a file, the checksums member of
+     metalink_file_t */
+  METALINK_FIELD_CHECKSUMS = 1 << 2,
+  /* <pieces> elements, the chunk_checksum member of metalink_file_t */
+  METALINK_FIELD_PIECES = 1 << 3,
+  /* <signature> elements, the signature member of metalink_file_t */
+  METALINK_FIELD_SIGNATURE = 1 << 4
+} metalink_field_t;
+
+/**
+ * Sets the parts of file entries to skip, bitwise OR of
+ * metalink_field_t values. Skipped elements and their children are
+ * passed over without allocating anything for them. The default is 0,
+ * which keeps everything.
+ */
+void metalink_parse_options_set_skip_fields(metalink_parse_options_t *opts,
+                                            int fields);
+
+/**
+ * Callback function called with each file entry as soon as its </file>
+ * end tag is parsed. The callee takes ownership of file and must free
+ * it with metalink_file_delete. Return 0 to continue parsing. Any other
+ * value stops parsing right away with METALINK_ERR_CALLBACK_FAILURE;
+ * the rest of the document is not read.
+ */
+typedef int (*metalink_file_callback)(metalink_file_t *file, void *user_data);
+
+/**
+ * Sets the callback function which receives file entries while the
+ * document is being parsed. user_data is passed to callback as is. If
+ * callback is set, the files member of the resulting metalink_t is
+ * NULL, so memory usage is bounded by the largest single file entry
+ * rather than by the whole document. Passing NULL as callback restores
+ * the default behaviour.
+ */
+void metalink_parse_options_set_file_callback(metalink_parse_options_t *opts,
+                                              metalink_file_callback callback,
+                                              void *user_data);
+
+/**
+ * If use_arena is nonzero, the resulting metalink_t and all objects
+ * and strings it refers to are carved out of a few large blocks instead
+ * of being allocated one by one, and metalink_delete releases them all
+ * at once. This greatly reduces allocation overhead for large
+ * documents. The objects of such a metalink_t must not be freed or
+ * modified through the individual *_delete and *_set_* functions; only
+ * metalink_delete may be called on it. This option has no effect if a
+ * file callback is set, because the callee owns each file entry. The
+ * default is 0.
+ */
+void metalink_parse_options_set_arena(metalink_parse_options_t *opts,
+                                      int use_arena);
+
+/**
+ * If compact_pieces is nonzero, piece hashes are only stored in the
+ * binary digest table of metalink_chunk_checksum_t, and its
+ * piece_hashes member is NULL. This saves two allocations and more than
+ * half of the memory per piece. Pieces whose hashes cannot be decoded
+ * are dropped, i.e., chunk_checksum is NULL for such a file. The
+ * default is 0.
+ */
+void metalink_parse_options_set_compact_pieces(metalink_parse_options_t *opts,
+                                               int compact_pieces);
+
+/**
+ * If index_files is nonzero, a hash index of the files is built once
+ * they are all parsed, so that metalink_find_file,
+ * metalink_find_file_by_identity and metalink_find_file_by_checksum
+ * take constant time. This option has no effect if a file callback is
+ * set. The default is 0.
+ */
+void metalink_parse_options_set_file_index(metalink_parse_options_t *opts,
+                                           int index_files);
+
+/**
+ * Kinds of objects built by the parser, for counting their allocations
+ * in metalink_parse_stats_t.
+ */
+typedef enum metalink_object_type_e {
+  METALINK_OBJECT_METALINK,
+  METALINK_OBJECT_FILE,
+  METALINK_OBJECT_RESOURCE,
+  METALINK_OBJECT_METAURL,
+  METALINK_OBJECT_CHECKSUM,
+  METALINK_OBJECT_CHUNK_CHECKSUM,
+  METALINK_OBJECT_PIECE_HASH,
+  METALINK_OBJECT_SIGNATURE,
+  /* strings held by the objects above */
+  METALINK_OBJECT_STRING,
+  /* the NULL terminated arrays of the objects above, and piece digest
+     tables */
+  METALINK_OBJECT_ARRAY,
+  METALINK_OBJECT_MAX
+} metalink_object_type_t;
+
+/* The number of element kinds counted in metalink_parse_stats_t. */
+#define METALINK_PARSE_STATS_ELEMENTS 25
+
+/**
+ * Statistics of a single parse, filled in by the parse functions if
+ * set with metalink_parse_options_set_stats.
+ */
+typedef struct _metalink_parse_stats {
+  /* bytes of XML fed to the XML parser */
+  size_t input_bytes;
+  /* elements seen, by element name; see
+     metalink_parse_stats_element_name */
+  size_t elements[METALINK_PARSE_STATS_ELEMENTS];
+  /* elements passed over because they are unknown, out of place or
+     excluded by the skip_fields option, including their descendants */
+  size_t skipped_elements;
+  /* bytes of character data buffered for the elements in use */
+  size_t text_bytes;
+  /* objects allocated for the result, by metalink_object_type_t, and
+     their size in bytes. In arena mode, they come from the arena. */
+  size_t allocations[METALINK_OBJECT_MAX];
+  size_t allocated_bytes[METALINK_OBJECT_MAX];
+  /* wall time in nanoseconds spent reading the document, in the XML
+     parser, and building the result from the parsed elements */
+  unsigned long long io_ns;
+  unsigned long long xml_ns;
+  unsigned long long pstate_ns;
+} metalink_parse_stats_t;
+
+/**
+ * Sets stats to be cleared and filled in by every parse using opts,
+ * or stops collecting statistics if stats is NULL, the default. For a
+ * metalink_parser_context_t, stats is cleared when the context is
+ * created or reset, and accumulates over metalink_parse_update calls.
+ * stats must not be shared by parses running at the same time.
+ * Collecting statistics slows parsing down a little, mostly by reading
+ * the clock around every element.
+ */
+void metalink_parse_options_set_stats(metalink_parse_options_t *opts,
+                                      metalink_parse_stats_t *stats);
+
+/**
+ * Returns the name of the element counted in
+ * metalink_parse_stats_t.elements[index], e.g. "file". The last kind,
+ * "(other)", counts elements unknown to this library. Returns NULL if
+ * index is out of range.
+ */
+const char *metalink_parse_stats_element_name(size_t index);
+
+/**
+ * Returns the name of type, e.g. "resource", or NULL if type is out of
+ * range.
+ */
+const char *metalink_object_type_name(metalink_object_type_t type);
+
+/**
+ * Sets the number of threads parsing a document in memory, i.e., with
+ * metalink_parse_memory_ex, or with metalink_parse_file_ex if the file
+ * is mapped into memory. If nthreads is less than or equal to 0, one
+ * thread per online processor is used. Large documents are split at
+ * the boundaries of their file elements, and the parts are parsed at
+ * the same time and joined in document order. Documents which cannot be
+ * split safely, e.g. because of comments or CDATA sections, or which
+ * are too small to benefit, are parsed on the calling thread, as they
+ * are if a file callback is set. The result is the same either way.
+ * With statistics, the elements outside the file entries are counted
+ * once per thread, and the times are summed over the threads. The
+ * default is 1, which always parses on the calling thread.
+ * metalink_parse_batch uses this many worker threads, each of which
+ * parses a whole document at a time.
+ */
+void metalink_parse_options_set_threads(metalink_parse_options_t *opts,
+                                        int nthreads);
+
+/**
+ * Sets the directory in which metalink_parse_file_ex,
+ * metalink_parse_memory_ex and metalink_parse_batch keep the results of
+ * earlier parses as snapshots (see metalink_save_snapshot), so that a
+ * document which was parsed before, by this or any other process, is
+ * loaded from its snapshot instead of being parsed again. The directory
+ * must exist. A file is looked up by its path, and its snapshot is
+ * only used while the device, inode, size and modification time of the
+ * file are those it was made from; any change to the file, such as a
+ * new updated element, invalidates it. A document in memory is looked
+ * up by the SHA-256 digest of its contents. Entries are written to a
+ * temporary file and renamed into place, so several processes may
+ * share the directory. Results are always made as if
+ * metalink_parse_options_set_arena and
+ * metalink_parse_options_set_compact_pieces were set, whether they come
+ * from the cache or not. The cache is not used if a file callback is
+ * set, or by parser contexts. If the directory cannot be written, the
+ * documents are parsed as usual. In the statistics, a document loaded
+ * from the cache has no input bytes or elements, and the time it took
+ * counts as I/O. dir is copied; NULL, the default, disables the cache.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t
+metalink_parse_options_set_cache_dir(metalink_parse_options_t *opts,
+                                     const char *dir);
+
+/*
+ * Same as metalink_parse_file, metalink_parse_fp, metalink_parse_fd and
+ * metalink_parse_memory respectively, but take parse options opts. If
+ * opts is NULL, the default options are used.
+ */
+metalink_error_t metalink_parse_file_ex(const char *filename, metalink_t **res,
+                                        const metalink_parse_options_t *opts);
+
+metalink_error_t metalink_parse_fp_ex(FILE *docfp, metalink_t **res,
+                                      const metalink_parse_options_t *opts);
+
+metalink_error_t metalink_parse_fd_ex(int docfd, metalink_t **res,
+                                      const metalink_parse_options_t *opts);
+
+metalink_error_t metalink_parse_memory_ex(const char *buf, size_t len,
+                                          metalink_t **res,
+                                          const metalink_parse_options_t *opts);
+
 /**
  * a parser context to keep current progress of XML parser.
  */
@@ -88,6 +397,16 @@ typedef struct _metalink_parser_context metalink_parser_context_t;
  */
 metalink_parser_context_t *metalink_parser_context_new(void);
 
+/*
+ * Same as metalink_parser_context_new, but the parser context parses
+ * documents with parse options opts. opts is copied, so it can be
+ * deallocated after this call. If opts is NULL, the default options are
+ * used.
+ * @return a parser context on success, otherwise NULL.
+ */
+metalink_parser_context_t *
+metalink_parser_context_new_ex(const metalink_parse_options_t *opts);
+
 /**
  * Deallocates a parser context ctx.
  * @param ctx a parser context to deallocate. If ctx is NULL, this function does
@@ -95,6 +414,17 @@ metalink_parser_context_t *metalink_parser_context_new(void);
  */
 void metalink_parser_context_delete(metalink_parser_context_t *ctx);
 
+/**
+ * Discards the progress of ctx and makes it ready to parse the next
+ * document. The XML parser and the internal structures of ctx are
+ * reused, which is much cheaper than creating a new parser context for
+ * each document.
+ * @param ctx a parser context to reset.
+ * @return 0 on success, non-zero for error. See metalink_error.h for the
+ * meaning of error code.
+ */
+metalink_error_t metalink_parser_context_reset(metalink_parser_context_t *ctx);
+
 /**
  * Processes len bytes of data at buf. This function can be called several times
  * to parse entire XML data.
@@ -123,6 +453,54 @@ metalink_error_t metalink_parse_final(metalink_parser_context_t *ctx,
                                       const char *buf, size_t len,
                                       metalink_t **res);
 
+/**
+ * Processes len bytes of data at buf and places metalink_t to res,
+ * like metalink_parse_final does, but leaves ctx alive. Call
+ * metalink_parser_context_reset to parse another document with ctx, and
+ * metalink_parser_context_delete when it is no longer used.
+ * @param ctx a parser context.
+ * @param buf a pointer to the XML data.
+ * @param len length of XML data in bytes.
+ * @param res a dynamically allocated metalink_t structure as a result of
+ * parsing.
+ * @return 0 on success, non-zero for error. See metalink_error_h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_parse_finish(metalink_parser_context_t *ctx,
+                                       const char *buf, size_t len,
+                                       metalink_t **res);
+
+/**
+ * The outcome of parsing one document with metalink_parse_batch.
+ */
+typedef struct _metalink_batch_result {
+  /* the resulting metalink_t, which the caller frees with
+     metalink_delete, or NULL if error is not 0 */
+  metalink_t *metalink;
+  /* 0 on success, otherwise the error code metalink_parse_file_ex
+     would return for the document. See metalink_error.h. */
+  metalink_error_t error;
+} metalink_batch_result_t;
+
+/**
+ * Parses the n files in paths with parse options opts on a pool of
+ * worker threads, and stores the outcome for paths[i] in results[i].
+ * The number of threads is set with metalink_parse_options_set_threads;
+ * set it to 0 to use every processor. Each worker parses one document
+ * at a time with a parser context of its own, which it resets for the
+ * next document, and takes documents from the other workers once its
+ * own share is done. If opts has statistics, they are summed over all
+ * documents. If opts has a file callback, it may be called on several
+ * threads at the same time. If opts is NULL, the default options are
+ * used.
+ * @return 0 if every document was parsed, whether or not it succeeded,
+ * or METALINK_ERR_BAD_ALLOC if the workers could not be set up. Then
+ * results is left untouched.
+ */
+metalink_error_t metalink_parse_batch(const char *const *paths, size_t n,
+                                      const metalink_parse_options_t *opts,
+                                      metalink_batch_result_t *results);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,108 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_PLAN_H_
+#define _D_METALINK_PLAN_H_
+
+#include <metalink/metalink_types.h>
+#include <metalink/metalink_error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A download plan splits a file into piece aligned segments and queues
+ * them on connections to its resources. Each connection is served by
+ * one worker thread, which takes segments from its own queue and, once
+ * that is empty, steals half of the longest queue of another
+ * connection. Taking a segment does not lock.
+ */
+typedef struct _metalink_plan metalink_plan_t;
+
+typedef struct _metalink_segment {
+  /* index into file->resources of the resource to download from */
+  size_t resource;
+  /* the number of this segment, from 0 in file order */
+  size_t index;
+  /* the pieces of the segment */
+  size_t first_piece;
+  size_t piece_count;
+  /* the byte range of the segment */
+  long long offset;
+  long long length;
+} metalink_segment_t;
+
+/*
+ * Plans the download of file from resources.
+ * @param resources the indexes into file->resources to download from,
+ * best first, e.g., as returned by metalink_mirror_index_select. If it
+ * is NULL, all resources are used in priority order.
+ * @param nresources the number of indexes in resources.
+ * @param max_connections the maximum number of connections in total.
+ * If it is less than or equal to 0, only file->maxconnections and the
+ * maxconnections of each resource limit the connections; a resource
+ * without a limit then gets a single connection.
+ * The piece length is file->chunk_checksum->length, or 1 MiB if there
+ * is no chunk checksum. file->size must be known. file may be deleted
+ * afterwards.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_plan_new(metalink_plan_t **res,
+                                   const metalink_file_t *file,
+                                   const size_t *resources, size_t nresources,
+                                   int max_connections);
+
+/* Frees plan. Passing NULL is legal. */
+void metalink_plan_delete(metalink_plan_t *plan);
+
+/* Returns the number of connections, which are numbered from 0. */
+size_t metalink_plan_get_connection_count(const metalink_plan_t *plan);
+
+/*
+ * Returns the index into file->resources of the resource of
+ * connection.
+ */
+size_t metalink_plan_get_connection_resource(const metalink_plan_t *plan,
+                                             size_t connection);
+
+/* Returns the number of segments. */
+size_t metalink_plan_get_segment_count(const metalink_plan_t *plan);
+
+/*
+ * Takes the next segment to be downloaded on connection and stores it
+ * in segment. Only the worker of connection may call this for it;
+ * workers of different connections may call it concurrently.
+ * @return 1 if a segment was stored, or 0 if no segment is left.
+ */
+int metalink_plan_next(metalink_plan_t *plan, size_t connection,
+                       metalink_segment_t *segment);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _D_METALINK_PLAN_H_ */
@@ -0,0 +1,73 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_SNAPSHOT_H_
+#define _D_METALINK_SNAPSHOT_H_
+
+#include <metalink/metalink_types.h>
+#include <metalink/metalink_error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Writes metalink to the file at path in a compact binary form which
+ * metalink_load_snapshot maps back into memory far faster than the
+ * XML can be parsed again. The file is written next to path and then
+ * renamed over it, so that a process which has the old snapshot loaded
+ * keeps a consistent copy. Several threads may save to the same path
+ * at once; the last one wins. Snapshots are only meant to be read on
+ * machines with the same byte order, by the same version of the
+ * format. Piece hashes are kept as in
+ * metalink_parse_options_set_compact_pieces: if the binary digest table
+ * of a chunk checksum is available, only the table is written.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code. METALINK_ERR_DOCUMENT_TOO_LARGE is
+ * returned if the snapshot would exceed 4GiB.
+ */
+metalink_error_t metalink_save_snapshot(const metalink_t *metalink,
+                                        const char *path);
+
+/*
+ * Maps the snapshot at path written by metalink_save_snapshot into
+ * memory, checks it, and stores a metalink_t describing it in *res.
+ * The strings and digest tables of the result point into the mapping,
+ * which stays until metalink_delete is called on *res. Like the
+ * result of a parse with metalink_parse_options_set_arena, the objects
+ * must not be freed or modified individually. If the snapshot was
+ * saved from a metalink_t with a file index, the index is built again.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code. METALINK_ERR_BAD_SNAPSHOT is returned if
+ * the file is not a snapshot this version can read, in which case the
+ * caller should fall back to parsing the XML.
+ */
+metalink_error_t metalink_load_snapshot(const char *path, metalink_t **res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _D_METALINK_SNAPSHOT_H_ */
@@ -158,6 +158,13 @@ typedef struct _metalink_chunk_checksum {
   int length;
   /* list of hash. Iterate until you get NULL */
   metalink_piece_hash_t **piece_hashes;
+  /* The piece hashes decoded into binary, piece_count * digest_length
+     bytes in piece order. NULL if the piece hashes are not hex strings
+     of the same length, or if the pieces are not numbered 0 to
+     piece_count - 1 exactly once. Use the accessor functions below. */
+  unsigned char *digests;
+  size_t digest_length;
+  size_t piece_count;
 } metalink_chunk_checksum_t;
 
 /* constructor */
@@ -178,6 +185,27 @@ void metalink_chunk_checksum_set_piece_hashes(
     metalink_chunk_checksum_t *chunk_checksum,
     metalink_piece_hash_t **piece_hashes);
 
+/* accessors for the binary piece digest table */
+
+/*
+ * Returns the number of pieces in the digest table, or 0 if the table
+ * is not available.
+ */
+size_t metalink_chunk_checksum_get_piece_count(
+    const metalink_chunk_checksum_t *chunk_checksum);
+
+/* Returns the length of each digest in bytes, e.g., 20 for sha1. */
+size_t metalink_chunk_checksum_get_digest_length(
+    const metalink_chunk_checksum_t *chunk_checksum);
+
+/*
+ * Returns the binary digest of the index-th piece, which is
+ * metalink_chunk_checksum_get_digest_length bytes long, or NULL if
+ * index is out of range.
+ */
+const unsigned char *metalink_chunk_checksum_get_digest(
+    const metalink_chunk_checksum_t *chunk_checksum, size_t index);
+
 /**
  *  signature of a file
  */
@@ -317,6 +345,13 @@ typedef struct _metalink {
   metalink_file_t **files;
   char *identity;
   char *tags;
+
+  /* private: if not NULL, this metalink_t and everything it refers to
+     are allocated from this arena and freed together by
+     metalink_delete. */
+  struct _metalink_arena *arena;
+  /* private: hash index of files, or NULL. See metalink_index_files. */
+  struct _metalink_file_index *file_index;
 } metalink_t;
 
 metalink_error_t metalink_set_identity(metalink_t *metalink,
@@ -334,6 +369,41 @@ metalink_t *metalink_new(void);
 
 void metalink_delete(metalink_t *metalink);
 
+/*
+ * Builds a hash index of metalink->files, replacing any previous one,
+ * so that the metalink_find_file* functions below take constant time
+ * instead of scanning all files. The parser builds it if
+ * metalink_parse_options_set_file_index is set. Call this again after
+ * modifying files.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_index_files(metalink_t *metalink);
+
+/*
+ * Returns the first file whose name is name, or NULL if there is
+ * none.
+ */
+metalink_file_t *metalink_find_file(const metalink_t *metalink,
+                                    const char *name);
+
+/*
+ * Returns the first file with identity and version, or NULL if there
+ * is none. A NULL version matches files without a version.
+ */
+metalink_file_t *metalink_find_file_by_identity(const metalink_t *metalink,
+                                                const char *identity,
+                                                const char *version);
+
+/*
+ * Returns the first file with a checksum of type whose value is hash,
+ * or NULL if there is none. Case and hyphens are ignored in both, so
+ * "SHA-256" matches "sha256".
+ */
+metalink_file_t *metalink_find_file_by_checksum(const metalink_t *metalink,
+                                                const char *type,
+                                                const char *hash);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,155 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_VERIFY_H_
+#define _D_METALINK_VERIFY_H_
+
+#include <metalink/metalink_types.h>
+#include <metalink/metalink_error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Verifies the local copy of file against its chunk checksum.
+ * @param file a file entry whose chunk_checksum lists the piece hashes.
+ * The piece hash type must be one of md5, sha-1, sha-256, sha-384 or
+ * sha-512.
+ * @param path path to the local file to be verified.
+ * @param nthreads the number of threads hashing pieces in parallel. If
+ * it is less than or equal to 0, one thread per online processor is
+ * used.
+ * @param bitmap_out a dynamically allocated bitmap of bad pieces, one
+ * bit per piece with the most significant bit of the first byte being
+ * the first piece. A bit is set if the piece does not match its hash,
+ * including pieces which lie beyond the end of the local file. Free it
+ * with free().
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code. A mismatching piece is not an error.
+ */
+metalink_error_t metalink_verify_pieces(const metalink_file_t *file,
+                                        const char *path, int nthreads,
+                                        unsigned char **bitmap_out);
+
+/*
+ * Verifies pieces while a file is being downloaded. Data may be
+ * written in any order and from several sources; each piece is checked
+ * as soon as all of its bytes have arrived. A verifier is not thread
+ * safe.
+ */
+typedef struct _metalink_verifier metalink_verifier_t;
+
+typedef enum metalink_piece_status_e {
+  /* some bytes of the piece have not been written yet */
+  METALINK_PIECE_INCOMPLETE = 0,
+  /* the piece matches its hash */
+  METALINK_PIECE_GOOD = 1,
+  /* the piece does not match its hash */
+  METALINK_PIECE_BAD = 2
+} metalink_piece_status_t;
+
+/**
+ * Called when the index-th piece is complete. good is nonzero if it
+ * matches its hash. A bad piece can be reset with
+ * metalink_verifier_reset_piece, also from within the callback, and
+ * written again. Return 0 to continue. Any other value makes
+ * metalink_verifier_write return METALINK_ERR_CALLBACK_FAILURE.
+ */
+typedef int (*metalink_piece_callback)(size_t index, int good,
+                                       void *user_data);
+
+/*
+ * Creates a verifier for the pieces of file->chunk_checksum, which
+ * must be one of the piece hash types supported by
+ * metalink_verify_pieces. file->size should be set; otherwise the last
+ * piece is expected to be full length. Pieces which start at or beyond
+ * file->size are not counted, and data beyond the last piece is
+ * ignored. file may be deleted afterwards.
+ * callback may be NULL. user_data is passed to callback as is.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_verifier_new(metalink_verifier_t **res,
+                                       const metalink_file_t *file,
+                                       metalink_piece_callback callback,
+                                       void *user_data);
+
+/* Frees verifier. Passing NULL is legal. */
+void metalink_verifier_delete(metalink_verifier_t *verifier);
+
+/*
+ * Adds len bytes at buf, which were downloaded at offset in the file.
+ * Bytes which continue a piece from its start, or from the end of the
+ * data already hashed, are hashed right away; others are buffered until
+ * the gap before them is filled. Bytes of completed pieces and beyond
+ * the end of file are ignored. The callback is invoked for each piece
+ * completed by this write.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code.
+ */
+metalink_error_t metalink_verifier_write(metalink_verifier_t *verifier,
+                                         long long offset, const void *buf,
+                                         size_t len);
+
+/*
+ * Discards the data of the index-th piece so that it can be written
+ * again, e.g., after it turned out to be bad.
+ */
+void metalink_verifier_reset_piece(metalink_verifier_t *verifier,
+                                   size_t index);
+
+/* Returns the number of pieces which lie within the file. */
+size_t metalink_verifier_get_piece_count(const metalink_verifier_t *verifier);
+
+/* Returns the status of the index-th piece. */
+metalink_piece_status_t
+metalink_verifier_get_piece_status(const metalink_verifier_t *verifier,
+                                   size_t index);
+
+/*
+ * Verifies the local copy of file against all of its checksums, reading
+ * it only once. Every distinct digest algorithm in file->checksums, and
+ * the piece hashes if requested, are computed from the same read buffer
+ * on a thread of their own. Checksums of unsupported types are ignored.
+ * @param file a file entry listing checksums, chunk_checksum or both.
+ * @param path path to the local file to be verified.
+ * @param bad_checksums the number of supported checksums in
+ * file->checksums which do not match the local file.
+ * @param bitmap_out if not NULL, the piece hashes are verified too and a
+ * bitmap of bad pieces is stored as in metalink_verify_pieces.
+ * @return 0 for success, non-zero for error. See metalink_error.h for
+ * the meaning of error code. METALINK_ERR_NO_CHECKSUMS is returned if
+ * there is nothing to verify.
+ */
+metalink_error_t metalink_verify_file(const metalink_file_t *file,
+                                      const char *path, int *bad_checksums,
+                                      unsigned char **bitmap_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _D_METALINK_VERIFY_H_ */
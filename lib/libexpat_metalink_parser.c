@@ -30,6 +30,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <assert.h>
 
 #include <expat.h>
@@ -41,6 +42,11 @@
 #include "metalink_stack.h"
 #include "metalink_string_buffer.h"
 #include "metalink_helper.h"
+#include "metalink_mmap.h"
+#include "metalink_parse_options.h"
+#include "metalink_parse_stats.h"
+#include "metalink_parse_cache.h"
+#include "metalink_parse_parallel.h"
 
 #define NAMESPACE_SEPARATOR '\t'
 
@@ -57,16 +63,29 @@ static int split_ns_name(const char **localname, const char *src) {
   return metalink_match_ns(src, sep - src);
 }
 
+/*
+ * Stops the parser once the document has failed, e.g., because the
+ * file callback asked to, so that the rest of the input is neither
+ * tokenized nor read.
+ */
+static void stop_on_error(metalink_session_data_t *session_data) {
+  if (metalink_pctrl_get_error(session_data->stm->ctrl) != 0) {
+    XML_StopParser((XML_Parser)session_data->parser, XML_FALSE);
+  }
+}
+
 static void start_element_handler(void *user_data, const char *name,
                                   const char **attrs) {
   const char *localname = NULL;
   const char *mattrs[METALINK_ATTR_TOKEN_MAX];
   const char **p;
+  metalink_stats_timer_t timer;
 
   metalink_session_data_t *session_data = (metalink_session_data_t *)user_data;
 
   session_data->ns_uri = split_ns_name(&localname, name);
   session_data->name = metalink_lookup_token(localname, strlen(localname));
+  metalink_parse_stats_count_element(session_data->stats, session_data->name);
 
   memset(mattrs, 0, sizeof(mattrs));
 
@@ -78,31 +97,43 @@ static void start_element_handler(void *user_data, const char *name,
     mattrs[key] = *(p + 1);
   }
 
+  metalink_parse_stats_start(session_data->stats, &timer);
   session_data->stm->state->start_fun(session_data->stm, session_data->name,
                                       session_data->ns_uri, mattrs);
+  metalink_parse_stats_stop(session_data->stats, &timer,
+                            METALINK_STATS_PSTATE);
 
   if (metalink_pstm_character_buffering_enabled(session_data->stm)) {
-    metalink_string_buffer_t *str_buf = metalink_string_buffer_new(128);
-    /* TODO evaluate return value of stack_push; non-zero value is error. */
-    metalink_stack_push(session_data->characters_stack, str_buf);
+    if (metalink_session_data_push_characters(session_data) != 0) {
+      metalink_pctrl_set_error(session_data->stm->ctrl,
+                               METALINK_ERR_BAD_ALLOC);
+    }
   }
+  stop_on_error(session_data);
 }
 
 static void end_element_handler(void *user_data, const char *name) {
   metalink_session_data_t *session_data = (metalink_session_data_t *)user_data;
   metalink_string_buffer_t *str_buf = NULL;
+  metalink_stats_timer_t timer;
 
   (void)name;
 
   if (metalink_pstm_character_buffering_enabled(session_data->stm)) {
-    str_buf = metalink_stack_pop(session_data->characters_stack);
+    str_buf = metalink_session_data_pop_characters(session_data);
   }
 
+  session_data->stm->characters = str_buf;
+  metalink_parse_stats_start(session_data->stats, &timer);
   session_data->stm->state->end_fun(
       session_data->stm, session_data->name, session_data->ns_uri,
       str_buf ? metalink_string_buffer_str(str_buf) : "");
+  metalink_parse_stats_stop(session_data->stats, &timer,
+                            METALINK_STATS_PSTATE);
+  session_data->stm->characters = NULL;
 
-  metalink_string_buffer_delete(str_buf);
+  metalink_session_data_recycle_characters(session_data, str_buf);
+  stop_on_error(session_data);
 }
 
 static void characters_handler(void *user_data, const char *chars, int length) {
@@ -116,49 +147,153 @@ static void characters_handler(void *user_data, const char *chars, int length) {
   str_buf = metalink_stack_top(session_data->characters_stack);
 
   metalink_string_buffer_append(str_buf, (const char *)chars, length);
+  if (session_data->stats) {
+    session_data->stats->text_bytes += (size_t)length;
+  }
+}
+
+static void init_parser(XML_Parser parser,
+                        metalink_session_data_t *session_data) {
+  XML_SetUserData(parser, session_data);
+  session_data->parser = parser;
+  XML_SetElementHandler(parser, &start_element_handler, &end_element_handler);
+  XML_SetCharacterDataHandler(parser, &characters_handler);
 }
 
 static XML_Parser setup_parser(metalink_session_data_t *session_data) {
   XML_Parser parser;
 
   parser = XML_ParserCreateNS(NULL, NAMESPACE_SEPARATOR);
-
-  XML_SetUserData(parser, session_data);
-  XML_SetElementHandler(parser, &start_element_handler, &end_element_handler);
-  XML_SetCharacterDataHandler(parser, &characters_handler);
+  if (parser) {
+    init_parser(parser, session_data);
+  }
 
   return parser;
 }
 
+/*
+ * XML_Parse takes the length of data as int, so feed buffers larger
+ * than INT_MAX in several calls. The work is counted in stats, which
+ * may be NULL. Returns 0 on success.
+ */
+static int parse_buffer(XML_Parser parser, metalink_parse_stats_t *stats,
+                        const char *buf, size_t len, int is_final) {
+  metalink_stats_timer_t timer;
+  int rv = 0;
+
+  metalink_parse_stats_start(stats, &timer);
+  if (stats) {
+    stats->input_bytes += len;
+  }
+  for (; len > INT_MAX; buf += INT_MAX, len -= INT_MAX) {
+    if (!XML_Parse(parser, buf, INT_MAX, 0)) {
+      rv = -1;
+      break;
+    }
+  }
+  if (rv == 0 && !XML_Parse(parser, buf, (int)len, is_final)) {
+    rv = -1;
+  }
+  metalink_parse_stats_stop(stats, &timer, METALINK_STATS_XML);
+  return rv;
+}
+
+/*
+ * Parses len bytes placed in the buffer returned by XML_GetBuffer,
+ * counting the work in stats. Returns 0 on success.
+ */
+static int parse_read_buffer(XML_Parser parser, metalink_parse_stats_t *stats,
+                             size_t len) {
+  metalink_stats_timer_t timer;
+  int rv;
+
+  metalink_parse_stats_start(stats, &timer);
+  if (stats) {
+    stats->input_bytes += len;
+  }
+  rv = XML_ParseBuffer(parser, (int)len, 0) ? 0 : -1;
+  metalink_parse_stats_stop(stats, &timer, METALINK_STATS_XML);
+  return rv;
+}
+
 metalink_error_t METALINK_PUBLIC
-metalink_parse_file(const char *filename, metalink_t **res) {
+metalink_parse_file_ex(const char *filename, metalink_t **res,
+                       const metalink_parse_options_t *opts) {
   metalink_error_t r;
-  FILE *docfp = fopen(filename, "rb");
-  if (docfp == NULL)
+  metalink_mmap_t map;
+  metalink_stats_timer_t timer;
+  unsigned long long open_ns;
+  int fd, mapped;
+
+  opts = metalink_parse_options_get(opts);
+  if (metalink_parse_cache_file(&r, filename, res, opts) == 0) {
+    return r;
+  }
+
+  metalink_parse_stats_clear(opts->stats);
+  metalink_parse_stats_start(opts->stats, &timer);
+  while ((fd = open(filename, O_RDONLY | O_BINARY)) == -1 && errno == EINTR)
+    ;
+  if (fd == -1) {
     return METALINK_ERR_CANNOT_OPEN_FILE;
-  r = metalink_parse_fp(docfp, res);
-  fclose(docfp);
+  }
+  /* Regular files are mapped and handed to expat as a whole, which
+     avoids copying them through a read buffer. Fall back to read(2)
+     for pipes, special files or if mmap fails. */
+  mapped = opts->use_mmap && metalink_mmap_file(&map, fd) == 0;
+  /* The parse below clears the statistics, so the time to open and
+     map the file is added afterwards. */
+  open_ns = metalink_parse_stats_elapsed(opts->stats, &timer);
+  if (mapped) {
+    metalink_parse_options_advise_mmap(opts, &map);
+    r = metalink_parse_memory_ex(map.addr, map.length, res, opts);
+    metalink_munmap_file(&map);
+    metalink_parse_options_release_fd(opts, fd);
+  } else {
+    r = metalink_parse_fd_ex(fd, res, opts);
+  }
+  close(fd);
+  if (opts->stats) {
+    opts->stats->io_ns += open_ns;
+  }
   return r;
 }
 
 metalink_error_t METALINK_PUBLIC
-metalink_parse_fp(FILE *docfp, metalink_t **res) {
+metalink_parse_file(const char *filename, metalink_t **res) {
+  return metalink_parse_file_ex(filename, res, NULL);
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_fp_ex(FILE *docfp, metalink_t **res,
+                     const metalink_parse_options_t *opts) {
   metalink_session_data_t *session_data;
   metalink_error_t r = 0, retval;
   XML_Parser parser;
+  metalink_stats_timer_t timer;
+  size_t total = 0;
 
-  session_data = metalink_session_data_new();
+  opts = metalink_parse_options_get(opts);
+
+  session_data = metalink_session_data_new_ex(opts);
+  if (session_data == NULL) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
 
   parser = setup_parser(session_data);
 
+  metalink_parse_options_advise_fd(opts, fileno(docfp));
+
   while (!feof(docfp)) {
     size_t num_read;
-    void *buff = XML_GetBuffer(parser, BUFSIZ);
+    void *buff = XML_GetBuffer(parser, (int)opts->read_size);
     if (buff == NULL) {
       r = METALINK_ERR_PARSER_ERROR;
       break;
     }
-    num_read = fread(buff, 1, BUFSIZ, docfp);
+    metalink_parse_stats_start(opts->stats, &timer);
+    num_read = fread(buff, 1, opts->read_size, docfp);
+    metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_IO);
     if (num_read == 0) {
       if (feof(docfp)) {
         break;
@@ -169,70 +304,130 @@ metalink_parse_fp(FILE *docfp, metalink_t **res) {
         assert(0);
       }
     }
-    if (!XML_ParseBuffer(parser, (int)num_read, 0)) {
+    total += num_read;
+    if (metalink_parse_options_exceeds_max_size(opts, total)) {
+      r = METALINK_ERR_DOCUMENT_TOO_LARGE;
+      break;
+    }
+    if (parse_read_buffer(parser, opts->stats, num_read) != 0) {
       r = METALINK_ERR_PARSER_ERROR;
       break;
     }
   }
+  /* Tell expat that the document ends here so that truncated input
+     is reported as an error. */
+  if (r == 0 && parse_buffer(parser, opts->stats, NULL, 0, 1) != 0) {
+    r = METALINK_ERR_PARSER_ERROR;
+  }
   XML_ParserFree(parser);
 
-  retval = metalink_handle_parse_result(res, session_data, r);
+  metalink_parse_options_release_fd(opts, fileno(docfp));
+
+  if (r == METALINK_ERR_DOCUMENT_TOO_LARGE) {
+    retval = r;
+  } else {
+    retval = metalink_handle_parse_result(res, session_data, r);
+  }
 
   metalink_session_data_delete(session_data);
 
   return retval;
 }
 
-metalink_error_t METALINK_PUBLIC metalink_parse_fd(int fd, metalink_t **res) {
+metalink_error_t METALINK_PUBLIC
+metalink_parse_fp(FILE *docfp, metalink_t **res) {
+  return metalink_parse_fp_ex(docfp, res, NULL);
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_fd_ex(int fd, metalink_t **res,
+                     const metalink_parse_options_t *opts) {
   metalink_session_data_t *session_data;
   metalink_error_t r = 0;
   metalink_error_t retval;
   XML_Parser parser;
+  size_t total = 0;
 
-  session_data = metalink_session_data_new();
+  opts = metalink_parse_options_get(opts);
+
+  session_data = metalink_session_data_new_ex(opts);
+  if (session_data == NULL) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
 
   parser = setup_parser(session_data);
 
+  metalink_parse_options_advise_fd(opts, fd);
+
   while (1) {
-    ssize_t num_read;
-    void *buff = XML_GetBuffer(parser, BUFSIZ);
+    size_t num_read;
+    char *buff = XML_GetBuffer(parser, (int)opts->read_size);
     if (buff == NULL) {
       r = METALINK_ERR_PARSER_ERROR;
       break;
     }
-    while ((num_read = read(fd, buff, BUFSIZ)) == -1 && errno == EINTR)
-      ;
-    if (num_read == -1) {
-      r = METALINK_ERR_PARSER_ERROR;
-      break;
-    } else if (num_read == 0) {
+    /* Read straight into the buffer of expat rather than through
+       metalink_feed_fd, which would copy. */
+    r = metalink_read_chunk(fd, buff, &num_read, &total, opts, opts->stats);
+    if (r != 0 || num_read == 0) {
       break;
     }
-    if (!XML_ParseBuffer(parser, (int)num_read, 0)) {
+    if (parse_read_buffer(parser, opts->stats, num_read) != 0) {
       r = METALINK_ERR_PARSER_ERROR;
       break;
     }
   }
+  /* Tell expat that the document ends here so that truncated input
+     is reported as an error. */
+  if (r == 0 && parse_buffer(parser, opts->stats, NULL, 0, 1) != 0) {
+    r = METALINK_ERR_PARSER_ERROR;
+  }
   XML_ParserFree(parser);
 
-  retval = metalink_handle_parse_result(res, session_data, r);
+  metalink_parse_options_release_fd(opts, fd);
+
+  if (r == METALINK_ERR_DOCUMENT_TOO_LARGE) {
+    retval = r;
+  } else {
+    retval = metalink_handle_parse_result(res, session_data, r);
+  }
 
   metalink_session_data_delete(session_data);
 
   return retval;
 }
 
+metalink_error_t METALINK_PUBLIC metalink_parse_fd(int fd, metalink_t **res) {
+  return metalink_parse_fd_ex(fd, res, NULL);
+}
+
 metalink_error_t METALINK_PUBLIC
-metalink_parse_memory(const char *buf, size_t len, metalink_t **res) {
+metalink_parse_memory_ex(const char *buf, size_t len, metalink_t **res,
+                         const metalink_parse_options_t *opts) {
   metalink_session_data_t *session_data;
   metalink_error_t r = 0, retval;
   XML_Parser parser;
 
-  session_data = metalink_session_data_new();
+  opts = metalink_parse_options_get(opts);
+
+  if (metalink_parse_options_exceeds_max_size(opts, len)) {
+    return METALINK_ERR_DOCUMENT_TOO_LARGE;
+  }
+  if (metalink_parse_cache_memory(&r, buf, len, res, opts) == 0) {
+    return r;
+  }
+  if (metalink_parse_parallel(&r, buf, len, res, opts) == 0) {
+    return r;
+  }
+
+  session_data = metalink_session_data_new_ex(opts);
+  if (session_data == NULL) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
 
   parser = setup_parser(session_data);
 
-  if (!XML_Parse(parser, buf, (int)len, 1)) {
+  if (parse_buffer(parser, session_data->stats, buf, len, 1) != 0) {
     r = METALINK_ERR_PARSER_ERROR;
   }
 
@@ -245,13 +440,19 @@ metalink_parse_memory(const char *buf, size_t len, metalink_t **res) {
   return retval;
 }
 
+metalink_error_t METALINK_PUBLIC
+metalink_parse_memory(const char *buf, size_t len, metalink_t **res) {
+  return metalink_parse_memory_ex(buf, len, res, NULL);
+}
+
 struct _metalink_parser_context {
   metalink_session_data_t *session_data;
   XML_Parser parser;
   metalink_t *res;
 };
 
-metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
+metalink_parser_context_t METALINK_PUBLIC *
+metalink_parser_context_new_ex(const metalink_parse_options_t *opts) {
   metalink_parser_context_t *ctx;
   ctx = malloc(sizeof(metalink_parser_context_t));
   if (ctx == NULL) {
@@ -259,7 +460,7 @@ metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
   }
   memset(ctx, 0, sizeof(metalink_parser_context_t));
 
-  ctx->session_data = metalink_session_data_new();
+  ctx->session_data = metalink_session_data_new_ex(opts);
   if (ctx->session_data == NULL) {
     metalink_parser_context_delete(ctx);
     return NULL;
@@ -273,6 +474,10 @@ metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
   return ctx;
 }
 
+metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
+  return metalink_parser_context_new_ex(NULL);
+}
+
 void METALINK_PUBLIC
 metalink_parser_context_delete(metalink_parser_context_t *ctx) {
   if (ctx == NULL) {
@@ -283,31 +488,50 @@ metalink_parser_context_delete(metalink_parser_context_t *ctx) {
   free(ctx);
 }
 
+metalink_error_t METALINK_PUBLIC
+metalink_parser_context_reset(metalink_parser_context_t *ctx) {
+  /* XML_ParserReset clears the handlers and the user data, too. */
+  if (!XML_ParserReset(ctx->parser, NULL)) {
+    return METALINK_ERR_PARSER_ERROR;
+  }
+  init_parser(ctx->parser, ctx->session_data);
+  return metalink_session_data_reset(ctx->session_data);
+}
+
 metalink_error_t METALINK_PUBLIC
 metalink_parse_update(metalink_parser_context_t *ctx, const char *buf,
                       size_t len) {
   metalink_error_t r = 0;
 
-  if (!XML_Parse(ctx->parser, buf, (int)len, 0)) {
+  if (parse_buffer(ctx->parser, ctx->session_data->stats, buf, len, 0) != 0) {
     r = METALINK_ERR_PARSER_ERROR;
   }
 
-  if (r == 0) {
+  /* An error of pctrl is what stops the parser, if it was stopped. */
+  if (metalink_pctrl_get_error(ctx->session_data->stm->ctrl) != 0) {
     r = metalink_pctrl_get_error(ctx->session_data->stm->ctrl);
   }
   return r;
 }
 
 metalink_error_t METALINK_PUBLIC
-metalink_parse_final(metalink_parser_context_t *ctx, const char *buf,
-                     size_t len, metalink_t **res) {
-  metalink_error_t r = 0, retval;
+metalink_parse_finish(metalink_parser_context_t *ctx, const char *buf,
+                      size_t len, metalink_t **res) {
+  metalink_error_t r = 0;
 
-  if (!XML_Parse(ctx->parser, buf, (int)len, 1)) {
+  if (parse_buffer(ctx->parser, ctx->session_data->stats, buf, len, 1) != 0) {
     r = METALINK_ERR_PARSER_ERROR;
   }
 
-  retval = metalink_handle_parse_result(res, ctx->session_data, r);
+  return metalink_handle_parse_result(res, ctx->session_data, r);
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_final(metalink_parser_context_t *ctx, const char *buf,
+                     size_t len, metalink_t **res) {
+  metalink_error_t retval;
+
+  retval = metalink_parse_finish(ctx, buf, len, res);
 
   metalink_parser_context_delete(ctx);
 
@@ -29,8 +29,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
 
 #include <libxml/parser.h>
+#include <libxml/parserInternals.h>
 
 #include "metalink_pstm.h"
 #include "metalink_pstate.h"
@@ -39,6 +44,31 @@
 #include "metalink_stack.h"
 #include "metalink_string_buffer.h"
 #include "metalink_helper.h"
+#include "metalink_mmap.h"
+#include "metalink_parse_options.h"
+#include "metalink_parse_stats.h"
+#include "metalink_parse_cache.h"
+#include "metalink_parse_parallel.h"
+
+/*
+ * The number of bytes passed to xmlParseChunk at once when parsing a
+ * memory buffer, e.g., a mapped file, larger than INT_MAX. The push
+ * parser copies every chunk into its own input buffer, so feeding the
+ * buffer piecewise keeps that copy bounded.
+ */
+#define MMAP_CHUNK_SIZE (1024 * 1024)
+
+/*
+ * Stops the parser once the document has failed, e.g., because the
+ * file callback asked to, so that the rest of the input is neither
+ * tokenized nor read.
+ */
+static void stop_on_error(metalink_session_data_t *session_data) {
+  if (session_data->parser &&
+      metalink_pctrl_get_error(session_data->stm->ctrl) != 0) {
+    xmlStopParser((xmlParserCtxtPtr)session_data->parser);
+  }
+}
 
 static void start_element_handler(void *user_data, const xmlChar *localname,
                                   const xmlChar *prefix, const xmlChar *ns_uri,
@@ -46,12 +76,12 @@ static void start_element_handler(void *user_data, const xmlChar *localname,
                                   int numAttrs, int numDefaulted,
                                   const xmlChar **attrs) {
   metalink_session_data_t *session_data = (metalink_session_data_t *)user_data;
-  metalink_string_buffer_t *str_buf = metalink_string_buffer_new(128);
   char *attrblock;
   char *value_dst_ptr;
   size_t value_alloc_space = 0;
   int i, j;
   const char *mattrs[METALINK_ATTR_TOKEN_MAX];
+  metalink_stats_timer_t timer;
 
   (void)prefix;
   (void)numNamespaces;
@@ -81,9 +111,6 @@ static void start_element_handler(void *user_data, const xmlChar *localname,
     value_dst_ptr += value_len + 1;
   }
 
-  /* TODO evaluate return value of stack_push; non-zero value is error. */
-  metalink_stack_push(session_data->characters_stack, str_buf);
-
   if (ns_uri) {
     session_data->ns_uri =
         metalink_match_ns((const char *)ns_uri, strlen((const char *)ns_uri));
@@ -92,35 +119,67 @@ static void start_element_handler(void *user_data, const xmlChar *localname,
   }
   session_data->name = metalink_lookup_token((const char *)localname,
                                              strlen((const char *)localname));
+  metalink_parse_stats_count_element(session_data->stats, session_data->name);
+  metalink_parse_stats_start(session_data->stats, &timer);
   session_data->stm->state->start_fun(session_data->stm, session_data->name,
                                       session_data->ns_uri, mattrs);
+  metalink_parse_stats_stop(session_data->stats, &timer,
+                            METALINK_STATS_PSTATE);
   free(attrblock);
+
+  /* Character data is only collected for elements whose contents are
+     used, i.e., not for containers or skipped subtrees. */
+  if (metalink_pstm_character_buffering_enabled(session_data->stm)) {
+    if (metalink_session_data_push_characters(session_data) != 0) {
+      metalink_pctrl_set_error(session_data->stm->ctrl,
+                               METALINK_ERR_BAD_ALLOC);
+    }
+  }
+  stop_on_error(session_data);
 }
 
 static void end_element_handler(void *user_data, const xmlChar *localname,
                                 const xmlChar *prefix, const xmlChar *ns_uri) {
   metalink_session_data_t *session_data = (metalink_session_data_t *)user_data;
-  metalink_string_buffer_t *str_buf =
-      metalink_stack_pop(session_data->characters_stack);
+  metalink_string_buffer_t *str_buf = NULL;
+  metalink_stats_timer_t timer;
 
   (void)localname;
   (void)prefix;
   (void)ns_uri;
 
-  session_data->stm->state->end_fun(session_data->stm, session_data->name,
-                                    session_data->ns_uri,
-                                    metalink_string_buffer_str(str_buf));
+  if (metalink_pstm_character_buffering_enabled(session_data->stm)) {
+    str_buf = metalink_session_data_pop_characters(session_data);
+  }
 
-  metalink_string_buffer_delete(str_buf);
+  session_data->stm->characters = str_buf;
+  metalink_parse_stats_start(session_data->stats, &timer);
+  session_data->stm->state->end_fun(
+      session_data->stm, session_data->name, session_data->ns_uri,
+      str_buf ? metalink_string_buffer_str(str_buf) : "");
+  metalink_parse_stats_stop(session_data->stats, &timer,
+                            METALINK_STATS_PSTATE);
+  session_data->stm->characters = NULL;
+
+  metalink_session_data_recycle_characters(session_data, str_buf);
+  stop_on_error(session_data);
 }
 
 static void characters_handler(void *user_data, const xmlChar *chars,
                                int length) {
   metalink_session_data_t *session_data = (metalink_session_data_t *)user_data;
-  metalink_string_buffer_t *str_buf =
-      metalink_stack_top(session_data->characters_stack);
+  metalink_string_buffer_t *str_buf;
+
+  if (!metalink_pstm_character_buffering_enabled(session_data->stm)) {
+    return;
+  }
+
+  str_buf = metalink_stack_top(session_data->characters_stack);
 
   metalink_string_buffer_append(str_buf, (const char *)chars, length);
+  if (session_data->stats) {
+    session_data->stats->text_bytes += (size_t)length;
+  }
 }
 
 static xmlSAXHandler mySAXHandler = {
@@ -158,13 +217,33 @@ static xmlSAXHandler mySAXHandler = {
     0,                      /*   xmlStructuredErrorFunc */
 };
 
+/*
+ * Initializes libxml2 before its first use. libxml2 2.9 requires this
+ * to happen once, before parsers are used on several threads.
+ */
+static void init_libxml2(void) {
+#ifdef HAVE_PTHREAD
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, xmlInitParser);
+#else  /* !HAVE_PTHREAD */
+  static int initialized = 0;
+  if (!initialized) {
+    xmlInitParser();
+    initialized = 1;
+  }
+#endif /* !HAVE_PTHREAD */
+}
+
 struct _metalink_parser_context {
   metalink_session_data_t *session_data;
   xmlParserCtxtPtr parser;
   metalink_t *res;
+  /* nonzero if parser must be reset before it is fed the next chunk */
+  int reset_pending;
 };
 
-metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
+metalink_parser_context_t METALINK_PUBLIC *
+metalink_parser_context_new_ex(const metalink_parse_options_t *opts) {
   metalink_parser_context_t *ctx;
   ctx = malloc(sizeof(metalink_parser_context_t));
   if (ctx == NULL) {
@@ -172,7 +251,11 @@ metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
   }
   memset(ctx, 0, sizeof(metalink_parser_context_t));
 
-  ctx->session_data = metalink_session_data_new();
+  /* The push parser is created with the first chunk, which may come
+     on another thread. */
+  init_libxml2();
+
+  ctx->session_data = metalink_session_data_new_ex(opts);
   if (ctx->session_data == NULL) {
     metalink_parser_context_delete(ctx);
     return NULL;
@@ -180,6 +263,10 @@ metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
   return ctx;
 }
 
+metalink_parser_context_t METALINK_PUBLIC *metalink_parser_context_new(void) {
+  return metalink_parser_context_new_ex(NULL);
+}
+
 void METALINK_PUBLIC
 metalink_parser_context_delete(metalink_parser_context_t *ctx) {
   if (ctx == NULL) {
@@ -190,24 +277,52 @@ metalink_parser_context_delete(metalink_parser_context_t *ctx) {
   free(ctx);
 }
 
+metalink_error_t METALINK_PUBLIC
+metalink_parser_context_reset(metalink_parser_context_t *ctx) {
+  /* The push parser is reset lazily when the first chunk of the next
+     document arrives, so that it can detect the encoding from it just
+     like xmlCreatePushParserCtxt does. */
+  if (ctx->parser) {
+    ctx->reset_pending = 1;
+  }
+  return metalink_session_data_reset(ctx->session_data);
+}
+
 static metalink_error_t
 metalink_parse_update_internal(metalink_parser_context_t *ctx, const char *buf,
                                size_t len, int terminate) {
   metalink_error_t r;
+  metalink_parse_stats_t *stats = ctx->session_data->stats;
+  metalink_stats_timer_t timer;
+  size_t inilen = 4 < len ? 4 : len;
 
+  metalink_parse_stats_start(stats, &timer);
+  if (stats) {
+    stats->input_bytes += len;
+  }
   if (ctx->parser == NULL) {
-    size_t inilen = 4 < len ? 4 : len;
     ctx->parser = xmlCreatePushParserCtxt(&mySAXHandler, ctx->session_data, buf,
                                           (int)inilen, NULL);
+    ctx->session_data->parser = ctx->parser;
     if (ctx->parser == NULL) {
       r = METALINK_ERR_PARSER_ERROR;
     } else {
       r = xmlParseChunk(ctx->parser, buf + inilen, (int)(len - inilen),
                         terminate);
     }
+  } else if (ctx->reset_pending) {
+    ctx->reset_pending = 0;
+    if (xmlCtxtResetPush(ctx->parser, buf, (int)inilen, NULL, NULL) != 0) {
+      r = METALINK_ERR_PARSER_ERROR;
+    } else {
+      ctx->parser->userData = ctx->session_data;
+      r = xmlParseChunk(ctx->parser, buf + inilen, (int)(len - inilen),
+                        terminate);
+    }
   } else {
     r = xmlParseChunk(ctx->parser, buf, (int)len, terminate);
   }
+  metalink_parse_stats_stop(stats, &timer, METALINK_STATS_XML);
   return r;
 }
 
@@ -216,115 +331,299 @@ metalink_parse_update(metalink_parser_context_t *ctx, const char *buf,
                       size_t len) {
   metalink_error_t r;
   r = metalink_parse_update_internal(ctx, buf, len, 0);
-  if (r == 0) {
-    r = metalink_pctrl_get_error(ctx->session_data->stm->ctrl);
+  /* An error of pctrl is what stops the parser, if it was stopped. */
+  if (r != 0 && metalink_pctrl_get_error(ctx->session_data->stm->ctrl) == 0) {
+    /* r may be an xmlParserErrors code; report it like expat does. */
+    return METALINK_ERR_PARSER_ERROR;
   }
-  return r;
+  return metalink_pctrl_get_error(ctx->session_data->stm->ctrl);
 }
 
 metalink_error_t METALINK_PUBLIC
-metalink_parse_final(metalink_parser_context_t *ctx, const char *buf,
-                     size_t len, metalink_t **res) {
-  metalink_error_t r, retval;
+metalink_parse_finish(metalink_parser_context_t *ctx, const char *buf,
+                      size_t len, metalink_t **res) {
+  metalink_error_t r;
 
   r = metalink_parse_update_internal(ctx, buf, len, 1);
-  if (r == 0) {
-    r = metalink_pctrl_get_error(ctx->session_data->stm->ctrl);
-  }
 
-  retval = metalink_handle_parse_result(res, ctx->session_data, r);
+  /* metalink_handle_parse_result reports the error of pctrl by itself
+     if the XML parser succeeded. */
+  return metalink_handle_parse_result(res, ctx->session_data, r);
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_final(metalink_parser_context_t *ctx, const char *buf,
+                     size_t len, metalink_t **res) {
+  metalink_error_t retval;
+
+  retval = metalink_parse_finish(ctx, buf, len, res);
 
   metalink_parser_context_delete(ctx);
 
   return retval;
 }
 
-metalink_error_t METALINK_PUBLIC
-metalink_parse_file(const char *filename, metalink_t **res) {
-  metalink_session_data_t *session_data;
-  metalink_error_t r, retval;
+/*
+ * Does what xmlSAXUserParseMemory does, but makes the parser known to
+ * session_data, so that it can be stopped. Returns 0 if the document
+ * is well formed.
+ */
+static int parse_memory(metalink_session_data_t *session_data,
+                        const char *buf, int len) {
+  xmlParserCtxtPtr ctxt;
+  int r;
 
-  session_data = metalink_session_data_new();
+  ctxt = xmlCreateMemoryParserCtxt(buf, len);
+  if (ctxt == NULL) {
+    return -1;
+  }
+  /* The context owns its handler, so ours is copied into it. */
+  *ctxt->sax = mySAXHandler;
+  ctxt->userData = session_data;
+  session_data->parser = ctxt;
+  xmlParseDocument(ctxt);
+  r = ctxt->wellFormed ? 0 : -1;
+  session_data->parser = NULL;
+  xmlFreeParserCtxt(ctxt);
+  return r;
+}
 
-  r = xmlSAXUserParseFile(&mySAXHandler, session_data, filename);
+/*
+ * Parses len bytes at buf by feeding them to the push parser in
+ * chunks of MMAP_CHUNK_SIZE bytes.
+ */
+static metalink_error_t parse_chunked(const char *buf, size_t len,
+                                      metalink_t **res,
+                                      const metalink_parse_options_t *opts) {
+  metalink_error_t r;
+  metalink_parser_context_t *ctx;
 
-  retval = metalink_handle_parse_result(res, session_data, r);
+  ctx = metalink_parser_context_new_ex(opts);
+  if (ctx == NULL) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  while (len > MMAP_CHUNK_SIZE) {
+    r = metalink_parse_update(ctx, buf, MMAP_CHUNK_SIZE);
+    if (r != 0) {
+      metalink_parser_context_delete(ctx);
+      return r;
+    }
+    buf += MMAP_CHUNK_SIZE;
+    len -= MMAP_CHUNK_SIZE;
+  }
+  return metalink_parse_final(ctx, buf, len, res);
+}
 
-  metalink_session_data_delete(session_data);
+metalink_error_t METALINK_PUBLIC
+metalink_parse_file_ex(const char *filename, metalink_t **res,
+                       const metalink_parse_options_t *opts) {
+  metalink_error_t r;
+  metalink_mmap_t map;
+  metalink_stats_timer_t timer;
+  unsigned long long open_ns;
+  int fd, mapped;
+
+  opts = metalink_parse_options_get(opts);
+  if (metalink_parse_cache_file(&r, filename, res, opts) == 0) {
+    return r;
+  }
 
-  return retval;
+  metalink_parse_stats_clear(opts->stats);
+  metalink_parse_stats_start(opts->stats, &timer);
+  while ((fd = open(filename, O_RDONLY | O_BINARY)) == -1 && errno == EINTR)
+    ;
+  if (fd == -1) {
+    return METALINK_ERR_CANNOT_OPEN_FILE;
+  }
+  /* Regular files are mapped and parsed straight from the mapping,
+     like a memory buffer, so that they are split across threads as
+     well. Fall back to read(2) for pipes, special files or if mmap
+     fails. */
+  mapped = opts->use_mmap && metalink_mmap_file(&map, fd) == 0;
+  /* The parse below clears the statistics, so the time to open and
+     map the file is added afterwards. */
+  open_ns = metalink_parse_stats_elapsed(opts->stats, &timer);
+  if (mapped) {
+    metalink_parse_options_advise_mmap(opts, &map);
+    r = metalink_parse_memory_ex(map.addr, map.length, res, opts);
+    metalink_munmap_file(&map);
+    metalink_parse_options_release_fd(opts, fd);
+  } else {
+    r = metalink_parse_fd_ex(fd, res, opts);
+  }
+  close(fd);
+  if (opts->stats) {
+    opts->stats->io_ns += open_ns;
+  }
+  return r;
 }
 
 metalink_error_t METALINK_PUBLIC
-metalink_parse_fp(FILE *docfp, metalink_t **res) {
+metalink_parse_file(const char *filename, metalink_t **res) {
+  return metalink_parse_file_ex(filename, res, NULL);
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_fp_ex(FILE *docfp, metalink_t **res,
+                     const metalink_parse_options_t *opts) {
   metalink_session_data_t *session_data;
   metalink_error_t r = 0, retval;
   size_t num_read;
-  char buff[BUFSIZ];
+  size_t total;
+  char *buff;
+  metalink_stats_timer_t timer;
 
   xmlParserCtxtPtr ctxt;
 
-  session_data = metalink_session_data_new();
+  opts = metalink_parse_options_get(opts);
+  init_libxml2();
 
+  buff = malloc(opts->read_size < 4 ? 4 : opts->read_size);
+  if (buff == NULL) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+
+  session_data = metalink_session_data_new_ex(opts);
+  if (session_data == NULL) {
+    free(buff);
+    return METALINK_ERR_BAD_ALLOC;
+  }
+
+  metalink_parse_options_advise_fd(opts, fileno(docfp));
+
+  metalink_parse_stats_start(opts->stats, &timer);
   num_read = fread(buff, 1, 4, docfp);
+  metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_IO);
+  total = num_read;
+  metalink_parse_stats_start(opts->stats, &timer);
   ctxt = xmlCreatePushParserCtxt(&mySAXHandler, session_data, buff,
                                  (int)num_read, NULL);
+  session_data->parser = ctxt;
+  metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_XML);
   if (ctxt == NULL)
     r = METALINK_ERR_PARSER_ERROR;
 
   while (!feof(docfp) && !r) {
-    num_read = fread(buff, 1, BUFSIZ, docfp);
+    metalink_parse_stats_start(opts->stats, &timer);
+    num_read = fread(buff, 1, opts->read_size, docfp);
+    metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_IO);
+    total += num_read;
     if (num_read == 0) {
       if (ferror(docfp)) {
         r = METALINK_ERR_PARSER_ERROR;
       }
-    } else if (xmlParseChunk(ctxt, buff, (int)num_read, 0))
+    } else if (metalink_parse_options_exceeds_max_size(opts, total)) {
+      r = METALINK_ERR_DOCUMENT_TOO_LARGE;
+    } else {
+      metalink_parse_stats_start(opts->stats, &timer);
+      if (xmlParseChunk(ctxt, buff, (int)num_read, 0)) {
+        r = METALINK_ERR_PARSER_ERROR;
+      }
+      metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_XML);
+    }
+  }
+  if (ctxt) {
+    metalink_parse_stats_start(opts->stats, &timer);
+    if (!r && xmlParseChunk(ctxt, buff, 0, 1)) {
       r = METALINK_ERR_PARSER_ERROR;
+    }
+    metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_XML);
+    xmlFreeParserCtxt(ctxt);
   }
-  xmlParseChunk(ctxt, buff, 0, 1);
-  xmlFreeParserCtxt(ctxt);
+  if (opts->stats) {
+    opts->stats->input_bytes = total;
+  }
+  free(buff);
 
-  retval = metalink_handle_parse_result(res, session_data, r);
+  metalink_parse_options_release_fd(opts, fileno(docfp));
+
+  if (r == METALINK_ERR_DOCUMENT_TOO_LARGE) {
+    retval = r;
+  } else {
+    retval = metalink_handle_parse_result(res, session_data, r);
+  }
 
   metalink_session_data_delete(session_data);
 
   return retval;
 }
 
-metalink_error_t METALINK_PUBLIC metalink_parse_fd(int fd, metalink_t **res) {
-  metalink_error_t r = 0;
+metalink_error_t METALINK_PUBLIC
+metalink_parse_fp(FILE *docfp, metalink_t **res) {
+  return metalink_parse_fp_ex(docfp, res, NULL);
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_fd_ex(int fd, metalink_t **res,
+                     const metalink_parse_options_t *opts) {
+  metalink_error_t r;
   metalink_parser_context_t *context;
+  char *buf;
+
+  opts = metalink_parse_options_get(opts);
+  init_libxml2();
 
-  context = metalink_parser_context_new();
+  buf = malloc(opts->read_size);
+  if (buf == NULL) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+
+  context = metalink_parser_context_new_ex(opts);
   if (context == NULL) {
+    free(buf);
     return METALINK_ERR_BAD_ALLOC;
   }
 
-  while (1) {
-    ssize_t len;
-    char buf[BUFSIZ];
-    while ((len = read(fd, buf, BUFSIZ)) == -1 && errno == EINTR)
-      ;
-    if (len == 0) {
-      r = metalink_parse_final(context, NULL, 0, res);
-      break;
-    }
-    r = metalink_parse_update(context, buf, len);
-    if (r != 0) {
-      break;
-    }
+  r = metalink_feed_fd(context, fd, buf, opts, opts->stats);
+  if (r == 0) {
+    r = metalink_parse_final(context, NULL, 0, res);
+  } else {
+    metalink_parser_context_delete(context);
   }
+
+  free(buf);
   return r;
 }
 
+metalink_error_t METALINK_PUBLIC metalink_parse_fd(int fd, metalink_t **res) {
+  return metalink_parse_fd_ex(fd, res, NULL);
+}
+
 metalink_error_t METALINK_PUBLIC
-metalink_parse_memory(const char *buf, size_t len, metalink_t **res) {
+metalink_parse_memory_ex(const char *buf, size_t len, metalink_t **res,
+                         const metalink_parse_options_t *opts) {
   metalink_session_data_t *session_data;
   metalink_error_t r, retval;
+  metalink_stats_timer_t timer;
 
-  session_data = metalink_session_data_new();
+  opts = metalink_parse_options_get(opts);
+  init_libxml2();
 
-  r = xmlSAXUserParseMemory(&mySAXHandler, session_data, buf, (int)len);
+  if (metalink_parse_options_exceeds_max_size(opts, len)) {
+    return METALINK_ERR_DOCUMENT_TOO_LARGE;
+  }
+  if (metalink_parse_cache_memory(&r, buf, len, res, opts) == 0) {
+    return r;
+  }
+  if (metalink_parse_parallel(&r, buf, len, res, opts) == 0) {
+    return r;
+  }
+  /* xmlSAXUserParseMemory takes the length as int. */
+  if (len > INT_MAX) {
+    return parse_chunked(buf, len, res, opts);
+  }
+
+  session_data = metalink_session_data_new_ex(opts);
+  if (session_data == NULL) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+
+  metalink_parse_stats_start(opts->stats, &timer);
+  r = parse_memory(session_data, buf, (int)len);
+  metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_XML);
+  if (opts->stats) {
+    opts->stats->input_bytes = len;
+  }
 
   retval = metalink_handle_parse_result(res, session_data, r);
 
@@ -332,3 +631,8 @@ metalink_parse_memory(const char *buf, size_t len, metalink_t **res) {
 
   return retval;
 }
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_memory(const char *buf, size_t len, metalink_t **res) {
+  return metalink_parse_memory_ex(buf, len, res, NULL);
+}
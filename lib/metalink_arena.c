@@ -0,0 +1,189 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_arena.h"
+
+#include <string.h>
+#include <stddef.h>
+
+/* the size of the first block; each following block doubles up to
+   MAX_BLOCK_SIZE */
+#define MIN_BLOCK_SIZE 4096
+#define MAX_BLOCK_SIZE (1024 * 1024)
+
+typedef union {
+  void *p;
+  long long int ll;
+  double d;
+  long double ld;
+} metalink_arena_align_t;
+
+#define ALIGNMENT sizeof(metalink_arena_align_t)
+#define ALIGN_UP(n) (((n) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+typedef struct _metalink_arena_block {
+  struct _metalink_arena_block *next;
+  size_t size;
+  size_t used;
+  /* keeps data aligned */
+  metalink_arena_align_t data[1];
+} metalink_arena_block_t;
+
+struct _metalink_arena {
+  /* the block allocation takes place from; newest first */
+  metalink_arena_block_t *head;
+  /* the size of the next regular block */
+  size_t next_block_size;
+  /* unmapped with the arena if addr is not NULL */
+  metalink_mmap_t map;
+};
+
+metalink_arena_t *metalink_arena_new(void) {
+  metalink_arena_t *arena;
+  arena = malloc(sizeof(metalink_arena_t));
+  if (arena) {
+    arena->head = NULL;
+    arena->next_block_size = MIN_BLOCK_SIZE;
+    arena->map.addr = NULL;
+    arena->map.length = 0;
+  }
+  return arena;
+}
+
+void metalink_arena_delete(metalink_arena_t *arena) {
+  metalink_arena_block_t *block;
+  metalink_arena_block_t *next;
+  if (!arena) {
+    return;
+  }
+  for (block = arena->head; block; block = next) {
+    next = block->next;
+    free(block);
+  }
+  if (arena->map.addr) {
+    metalink_munmap_file(&arena->map);
+  }
+  free(arena);
+}
+
+void metalink_arena_adopt(metalink_arena_t *arena, metalink_arena_t *src) {
+  metalink_arena_block_t *last;
+  if (!src) {
+    return;
+  }
+  if (src->head) {
+    /* Link the blocks of src behind the current block of arena so that
+       allocation goes on where it left off. */
+    for (last = src->head; last->next; last = last->next)
+      ;
+    if (arena->head) {
+      last->next = arena->head->next;
+      arena->head->next = src->head;
+    } else {
+      arena->head = src->head;
+    }
+  }
+  if (src->map.addr) {
+    arena->map = src->map;
+  }
+  free(src);
+}
+
+void metalink_arena_keep_mapping(metalink_arena_t *arena,
+                                 const metalink_mmap_t *map) {
+  arena->map = *map;
+}
+
+static metalink_arena_block_t *new_block(size_t size) {
+  metalink_arena_block_t *block;
+  block = malloc(offsetof(metalink_arena_block_t, data) + size);
+  if (block) {
+    block->size = size;
+    block->used = 0;
+  }
+  return block;
+}
+
+static void *arena_alloc(metalink_arena_t *arena, size_t size) {
+  metalink_arena_block_t *block;
+  void *p;
+
+  if (size > (size_t)-1 - ALIGNMENT) {
+    return NULL;
+  }
+  size = ALIGN_UP(size == 0 ? 1 : size);
+  block = arena->head;
+  if (!block || block->size - block->used < size) {
+    if (size > arena->next_block_size / 4) {
+      /* A large object gets a block of its own, which is linked
+         behind the current block so that the remaining space of the
+         current block is still used. */
+      block = new_block(size);
+      if (!block) {
+        return NULL;
+      }
+      if (arena->head) {
+        block->next = arena->head->next;
+        arena->head->next = block;
+      } else {
+        block->next = NULL;
+        arena->head = block;
+      }
+    } else {
+      block = new_block(arena->next_block_size);
+      if (!block) {
+        return NULL;
+      }
+      block->next = arena->head;
+      arena->head = block;
+      if (arena->next_block_size < MAX_BLOCK_SIZE) {
+        arena->next_block_size *= 2;
+      }
+    }
+  }
+  p = (char *)block->data + block->used;
+  block->used += size;
+  return p;
+}
+
+void *metalink_arena_calloc(metalink_arena_t *arena, size_t size) {
+  void *p;
+  p = arena_alloc(arena, size);
+  if (p) {
+    memset(p, 0, size);
+  }
+  return p;
+}
+
+char *metalink_arena_strdup(metalink_arena_t *arena, const char *src) {
+  size_t length;
+  char *dest;
+  length = strlen(src) + 1;
+  dest = arena_alloc(arena, length);
+  if (dest) {
+    memcpy(dest, src, length);
+  }
+  return dest;
+}
@@ -0,0 +1,76 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_ARENA_H_
+#define _D_METALINK_ARENA_H_
+
+#include "metalink_config.h"
+
+#include <stdlib.h>
+
+#include <metalink/metalink.h>
+
+#include "metalink_mmap.h"
+
+/*
+ * A bump allocator. Memory is carved out of large blocks and is only
+ * released all at once by metalink_arena_delete.
+ */
+typedef struct _metalink_arena metalink_arena_t;
+
+/* constructor */
+metalink_arena_t *metalink_arena_new(void);
+
+/* destructor: frees all memory allocated from arena. */
+void metalink_arena_delete(metalink_arena_t *arena);
+
+/*
+ * Moves all memory allocated from src into arena, so that it is freed
+ * with arena, and deletes src.
+ */
+void metalink_arena_adopt(metalink_arena_t *arena, metalink_arena_t *src);
+
+/*
+ * Makes arena own the file mapping map, which is unmapped by
+ * metalink_arena_delete, so that objects allocated from arena may
+ * point into it. An arena owns at most one mapping, so at most one of
+ * the arenas passed to metalink_arena_adopt may own one.
+ */
+void metalink_arena_keep_mapping(metalink_arena_t *arena,
+                                 const metalink_mmap_t *map);
+
+/*
+ * Allocates size bytes of zero-filled memory from arena. The memory is
+ * suitably aligned for any type. Returns NULL if out of memory.
+ */
+void *metalink_arena_calloc(metalink_arena_t *arena, size_t size);
+
+/*
+ * Copies a null terminated string src into arena. Returns NULL if out
+ * of memory.
+ */
+char *metalink_arena_strdup(metalink_arena_t *arena, const char *src);
+
+#endif /* _D_METALINK_ARENA_H_ */
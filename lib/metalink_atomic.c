@@ -0,0 +1,88 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_atomic.h"
+
+#if !defined(HAVE_ATOMIC_BUILTINS) && defined(HAVE_PTHREAD)
+#include <pthread.h>
+
+static pthread_mutex_t atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define ATOMIC_LOCK() pthread_mutex_lock(&atomic_lock)
+#define ATOMIC_UNLOCK() pthread_mutex_unlock(&atomic_lock)
+#else /* HAVE_ATOMIC_BUILTINS || !HAVE_PTHREAD */
+#define ATOMIC_LOCK()
+#define ATOMIC_UNLOCK()
+#endif /* HAVE_ATOMIC_BUILTINS || !HAVE_PTHREAD */
+
+uint64_t metalink_atomic_load(uint64_t *p) {
+#ifdef HAVE_ATOMIC_BUILTINS
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else  /* !HAVE_ATOMIC_BUILTINS */
+  uint64_t value;
+  ATOMIC_LOCK();
+  value = *p;
+  ATOMIC_UNLOCK();
+  return value;
+#endif /* !HAVE_ATOMIC_BUILTINS */
+}
+
+void metalink_atomic_store(uint64_t *p, uint64_t value) {
+#ifdef HAVE_ATOMIC_BUILTINS
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#else  /* !HAVE_ATOMIC_BUILTINS */
+  ATOMIC_LOCK();
+  *p = value;
+  ATOMIC_UNLOCK();
+#endif /* !HAVE_ATOMIC_BUILTINS */
+}
+
+int metalink_atomic_cas(uint64_t *p, uint64_t expected, uint64_t desired) {
+#ifdef HAVE_ATOMIC_BUILTINS
+  return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#else  /* !HAVE_ATOMIC_BUILTINS */
+  int swapped = 0;
+  ATOMIC_LOCK();
+  if (*p == expected) {
+    *p = desired;
+    swapped = 1;
+  }
+  ATOMIC_UNLOCK();
+  return swapped;
+#endif /* !HAVE_ATOMIC_BUILTINS */
+}
+
+uint64_t metalink_atomic_add(uint64_t *p, uint64_t value) {
+#ifdef HAVE_ATOMIC_BUILTINS
+  return __atomic_add_fetch(p, value, __ATOMIC_ACQ_REL);
+#else  /* !HAVE_ATOMIC_BUILTINS */
+  uint64_t result;
+  ATOMIC_LOCK();
+  result = *p += value;
+  ATOMIC_UNLOCK();
+  return result;
+#endif /* !HAVE_ATOMIC_BUILTINS */
+}
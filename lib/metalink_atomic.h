@@ -0,0 +1,54 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_ATOMIC_H_
+#define _D_METALINK_ATOMIC_H_
+
+#include "metalink_config.h"
+
+#include <stdint.h>
+
+/*
+ * Atomic operations on 64-bit words shared between threads. They use
+ * the compiler's __atomic builtins where configure found them, and a
+ * single process-wide mutex otherwise.
+ */
+
+/* Returns the value of *p. */
+uint64_t metalink_atomic_load(uint64_t *p);
+
+/* Sets *p to value. */
+void metalink_atomic_store(uint64_t *p, uint64_t value);
+
+/*
+ * Replaces *p with desired if it equals expected. Returns nonzero if
+ * it did.
+ */
+int metalink_atomic_cas(uint64_t *p, uint64_t expected, uint64_t desired);
+
+/* Adds value to *p and returns the new value. */
+uint64_t metalink_atomic_add(uint64_t *p, uint64_t value);
+
+#endif /* _D_METALINK_ATOMIC_H_ */
@@ -0,0 +1,255 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include <metalink/metalink_parser.h>
+
+#include "metalink_config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include "metalink_mmap.h"
+#include "metalink_parse_cache.h"
+#include "metalink_parse_options.h"
+#include "metalink_parse_stats.h"
+#include "metalink_parser_common.h"
+#include "metalink_work_queue.h"
+
+struct _batch_job;
+
+typedef struct _batch_worker {
+  /* reset after each document */
+  metalink_parser_context_t *ctx;
+  /* the statistics of the current document, which ctx fills in */
+  metalink_parse_stats_t doc_stats;
+  /* the statistics of all documents of this worker */
+  metalink_parse_stats_t stats;
+  /* holds what is read from files which are not mapped */
+  char *buf;
+  struct _batch_job *job;
+} batch_worker_t;
+
+typedef struct _batch_job {
+  const char *const *paths;
+  metalink_batch_result_t *results;
+  const metalink_parse_options_t *opts;
+  /* the index of the first document in the queues */
+  size_t first;
+  /* the documents queued for each worker */
+  metalink_work_queue_t *queues;
+  batch_worker_t *workers;
+  size_t count;
+} batch_job_t;
+
+/* Parses the file path like metalink_parse_file_ex does. */
+static metalink_error_t parse_path(batch_worker_t *worker, const char *path,
+                                   metalink_t **res) {
+  const metalink_parse_options_t *opts = worker->job->opts;
+  metalink_parse_stats_t *stats = opts->stats ? &worker->doc_stats : NULL;
+  metalink_parse_options_t cache_opts;
+  metalink_stats_timer_t timer;
+  metalink_mmap_t map;
+  metalink_error_t r;
+  int fd, mapped;
+
+  if (!worker->ctx) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  if (opts->cache_dir) {
+    /* A miss is parsed on this worker alone, into its own
+       statistics. */
+    cache_opts = *opts;
+    cache_opts.stats = stats;
+    cache_opts.threads = 1;
+    if (metalink_parse_cache_file(&r, path, res, &cache_opts) == 0) {
+      return r;
+    }
+  }
+  metalink_parse_stats_start(stats, &timer);
+  while ((fd = open(path, O_RDONLY | O_BINARY)) == -1 && errno == EINTR)
+    ;
+  if (fd == -1) {
+    return METALINK_ERR_CANNOT_OPEN_FILE;
+  }
+  mapped = opts->use_mmap && metalink_mmap_file(&map, fd) == 0;
+  metalink_parse_stats_stop(stats, &timer, METALINK_STATS_IO);
+  if (!mapped) {
+    r = metalink_feed_fd(worker->ctx, fd, worker->buf, opts, stats);
+  } else if (metalink_parse_options_exceeds_max_size(opts, map.length)) {
+    r = METALINK_ERR_DOCUMENT_TOO_LARGE;
+  } else {
+    metalink_parse_options_advise_mmap(opts, &map);
+    r = metalink_feed_buffer(worker->ctx, map.addr, map.length);
+  }
+  if (r == 0) {
+    r = metalink_parse_finish(worker->ctx, NULL, 0, res);
+  }
+  if (mapped) {
+    metalink_munmap_file(&map);
+    metalink_parse_options_release_fd(opts, fd);
+  }
+  close(fd);
+  return r;
+}
+
+static void *batch_worker(void *arg) {
+  batch_worker_t *worker = arg;
+  batch_job_t *job = worker->job;
+  metalink_work_queue_t *queue = &job->queues[worker - job->workers];
+  metalink_parse_options_t worker_opts;
+  metalink_batch_result_t *result;
+  size_t index;
+
+  while (metalink_work_queue_pop(queue, &index) ||
+         metalink_work_queue_steal(job->queues, job->count, queue, &index)) {
+    result = &job->results[job->first + index];
+    result->metalink = NULL;
+    result->error =
+        parse_path(worker, job->paths[job->first + index], &result->metalink);
+    if (job->opts->stats) {
+      metalink_parse_stats_add(&worker->stats, &worker->doc_stats);
+    }
+    if (worker->ctx && metalink_parser_context_reset(worker->ctx) != 0) {
+      /* start over with a new parser context */
+      metalink_parser_context_delete(worker->ctx);
+      worker_opts = *job->opts;
+      worker_opts.stats = job->opts->stats ? &worker->doc_stats : NULL;
+      worker->ctx = metalink_parser_context_new_ex(&worker_opts);
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Parses the documents [first, first + count) of job, count being at
+ * most METALINK_WORK_QUEUE_MAX, on its workers.
+ */
+static void run_batch(batch_job_t *job, size_t first, size_t count,
+                      size_t nworkers) {
+  size_t i, head = 0, per_worker, extra;
+#ifdef HAVE_PTHREAD
+  pthread_t *threads;
+  size_t started = 1;
+#endif /* HAVE_PTHREAD */
+
+  job->first = first;
+  /* each worker starts with a contiguous run of documents */
+  per_worker = count / nworkers;
+  extra = count % nworkers;
+  for (i = 0; i < nworkers; ++i) {
+    metalink_work_queue_init(&job->queues[i], head,
+                             head + per_worker + (i < extra));
+    head += per_worker + (i < extra);
+  }
+#ifdef HAVE_PTHREAD
+  threads = malloc(sizeof(pthread_t) * nworkers);
+  if (threads) {
+    for (; started < nworkers; ++started) {
+      /* if a thread cannot be created, the others steal its share */
+      if (pthread_create(&threads[started], NULL, batch_worker,
+                         &job->workers[started]) != 0) {
+        break;
+      }
+    }
+  }
+  batch_worker(&job->workers[0]);
+  for (i = 1; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+#else  /* !HAVE_PTHREAD */
+  batch_worker(&job->workers[0]);
+#endif /* !HAVE_PTHREAD */
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_batch(const char *const *paths, size_t n,
+                     const metalink_parse_options_t *opts,
+                     metalink_batch_result_t *results) {
+  metalink_parse_options_t worker_opts;
+  batch_job_t job;
+  batch_worker_t *worker;
+  size_t nworkers, first, count, i;
+  metalink_error_t r = METALINK_ERR_BAD_ALLOC;
+
+  opts = metalink_parse_options_get(opts);
+  metalink_parse_stats_clear(opts->stats);
+  if (n == 0) {
+    return 0;
+  }
+  nworkers = metalink_parse_options_get_threads(opts);
+  if (nworkers > n) {
+    nworkers = n;
+  }
+
+  memset(&job, 0, sizeof(job));
+  job.paths = paths;
+  job.results = results;
+  job.opts = opts;
+  job.count = nworkers;
+  job.queues = calloc(nworkers, sizeof(metalink_work_queue_t));
+  job.workers = calloc(nworkers, sizeof(batch_worker_t));
+  if (!job.queues || !job.workers) {
+    goto BATCH_END;
+  }
+  /* Each worker keeps one parser context for all of its documents and
+     resets it in between. */
+  worker_opts = *opts;
+  for (i = 0; i < nworkers; ++i) {
+    worker = &job.workers[i];
+    worker->job = &job;
+    worker_opts.stats = opts->stats ? &worker->doc_stats : NULL;
+    worker->ctx = metalink_parser_context_new_ex(&worker_opts);
+    worker->buf = malloc(opts->read_size);
+    if (!worker->ctx || !worker->buf) {
+      goto BATCH_END;
+    }
+  }
+
+  for (first = 0; first < n; first += count) {
+    count = n - first;
+    if (count > METALINK_WORK_QUEUE_MAX) {
+      count = METALINK_WORK_QUEUE_MAX;
+    }
+    run_batch(&job, first, count, nworkers);
+  }
+  for (i = 0; i < nworkers; ++i) {
+    metalink_parse_stats_add(opts->stats, &job.workers[i].stats);
+  }
+  r = 0;
+
+BATCH_END:
+  for (i = 0; job.workers && i < nworkers; ++i) {
+    metalink_parser_context_delete(job.workers[i].ctx);
+    free(job.workers[i].buf);
+  }
+  free(job.workers);
+  free(job.queues);
+  return r;
+}
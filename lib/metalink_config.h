@@ -30,12 +30,6 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
-#ifndef _XOPEN_SOURCE
-#define _XOPEN_SOURCE /* avoid warning when using strptime */
-#endif
-#ifndef _BSD_SOURCE
-#define _BSD_SOURCE /* avoid warning when using timegm */
-#endif
 #ifndef _NETBSD_SOURCE
 #define _NETBSD_SOURCE /* avoid warning when using strtoll on netbsd */
 #endif
@@ -0,0 +1,156 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_date.h"
+
+/* Parses exactly n decimal digits at *p, advancing *p past them. */
+static int parse_digits(const char **p, int n, int *value) {
+  const char *s = *p;
+  int v = 0;
+  int i;
+
+  for (i = 0; i < n; ++i) {
+    if (s[i] < '0' || s[i] > '9') {
+      return -1;
+    }
+    v = v * 10 + (s[i] - '0');
+  }
+  *p = s + n;
+  *value = v;
+  return 0;
+}
+
+/* Skips the separator c at *p, advancing *p past it. */
+static int parse_separator(const char **p, char c) {
+  if (**p != c) {
+    return -1;
+  }
+  ++*p;
+  return 0;
+}
+
+static int is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int days_in_month(int year, int month) {
+  static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+  if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) {
+    return 29;
+  }
+  return days[month - 1];
+}
+
+/*
+ * Returns the number of days from 1970-01-01 to the given date of the
+ * proleptic Gregorian calendar. The year is shifted to start in March
+ * so that the leap day comes last, and split into 400 year eras of
+ * 146097 days each.
+ */
+static long days_from_civil(int year, int month, int day) {
+  int era, year_of_era, day_of_year, day_of_era;
+
+  year -= month <= 2;
+  /* January and February of year 0000 belong to year -1 now, so round
+     the era down rather than towards zero. */
+  era = (year >= 0 ? year : year - 399) / 400;
+  year_of_era = year - era * 400;
+  day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+               day_of_year;
+  return (long)era * 146097 + day_of_era - 719468;
+}
+
+int metalink_parse_date(time_t *t, const char *date) {
+  const char *p = date;
+  int year, month, day, hour, minute, second;
+  int offset_hour = 0, offset_minute = 0, sign = 0;
+  long long seconds;
+
+  while (is_space(*p)) {
+    ++p;
+  }
+
+  if (parse_digits(&p, 4, &year) != 0 || parse_separator(&p, '-') != 0 ||
+      parse_digits(&p, 2, &month) != 0 || parse_separator(&p, '-') != 0 ||
+      parse_digits(&p, 2, &day) != 0) {
+    return -1;
+  }
+  if (*p != 'T' && *p != 't') {
+    return -1;
+  }
+  ++p;
+  if (parse_digits(&p, 2, &hour) != 0 || parse_separator(&p, ':') != 0 ||
+      parse_digits(&p, 2, &minute) != 0 || parse_separator(&p, ':') != 0 ||
+      parse_digits(&p, 2, &second) != 0) {
+    return -1;
+  }
+  if (*p == '.') {
+    ++p;
+    if (*p < '0' || *p > '9') {
+      return -1;
+    }
+    while (*p >= '0' && *p <= '9') {
+      ++p;
+    }
+  }
+  if (*p == 'Z' || *p == 'z') {
+    ++p;
+  } else if (*p == '+' || *p == '-') {
+    /* local time is ahead of UTC by a positive offset */
+    sign = *p == '+' ? -1 : 1;
+    ++p;
+    if (parse_digits(&p, 2, &offset_hour) != 0 ||
+        parse_separator(&p, ':') != 0 ||
+        parse_digits(&p, 2, &offset_minute) != 0 || offset_hour > 23 ||
+        offset_minute > 59) {
+      return -1;
+    }
+  }
+  while (is_space(*p)) {
+    ++p;
+  }
+  if (*p != '\0') {
+    return -1;
+  }
+
+  /* a leap second is accepted and counted as the next second, as
+     timegm does */
+  if (month < 1 || month > 12 || day < 1 ||
+      day > days_in_month(year, month) || hour > 23 || minute > 59 ||
+      second > 60) {
+    return -1;
+  }
+
+  seconds = (long long)days_from_civil(year, month, day) * 86400 +
+            hour * 3600 + minute * 60 + second +
+            sign * (offset_hour * 3600 + offset_minute * 60);
+  if ((long long)(time_t)seconds != seconds) {
+    return -1;
+  }
+  *t = (time_t)seconds;
+  return 0;
+}
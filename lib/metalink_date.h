@@ -0,0 +1,43 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_DATE_H_
+#define _D_METALINK_DATE_H_
+
+#include "metalink_config.h"
+
+#include <time.h>
+
+/*
+ * Parses the RFC 3339 date-time in the NULL terminated string date,
+ * e.g. "2010-05-01T12:15:02Z" or "2010-05-01T12:16:02.25+01:00", and
+ * stores the seconds since the Epoch in *t. Fractions of a second are
+ * truncated. A date-time without an offset is taken as UTC. The
+ * result does not depend on the locale or the time zone of the host.
+ * Returns 0, or -1 if date is malformed or *t cannot hold the result.
+ */
+int metalink_parse_date(time_t *t, const char *date);
+
+#endif /* _D_METALINK_DATE_H_ */
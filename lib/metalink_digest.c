@@ -0,0 +1,666 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_digest.h"
+
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include "metalink_digest_x86.h"
+
+#define ROTL32(X, N) (((X) << (N)) | ((X) >> (32 - (N))))
+#define ROTR32(X, N) (((X) >> (N)) | ((X) << (32 - (N))))
+#define ROTR64(X, N) (((X) >> (N)) | ((X) << (64 - (N))))
+
+static uint32_t load_le32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static uint32_t load_be32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t load_be64(const unsigned char *p) {
+  return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static void store_be32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)(v >> 24);
+  p[1] = (unsigned char)(v >> 16);
+  p[2] = (unsigned char)(v >> 8);
+  p[3] = (unsigned char)v;
+}
+
+static void store_be64(unsigned char *p, uint64_t v) {
+  store_be32(p, (uint32_t)(v >> 32));
+  store_be32(p + 4, (uint32_t)v);
+}
+
+/* MD5, RFC 1321 */
+
+static const uint32_t md5_k[64] = {
+    0xd76aa478U, 0xe8c7b756U, 0x242070dbU, 0xc1bdceeeU,
+    0xf57c0fafU, 0x4787c62aU, 0xa8304613U, 0xfd469501U,
+    0x698098d8U, 0x8b44f7afU, 0xffff5bb1U, 0x895cd7beU,
+    0x6b901122U, 0xfd987193U, 0xa679438eU, 0x49b40821U,
+    0xf61e2562U, 0xc040b340U, 0x265e5a51U, 0xe9b6c7aaU,
+    0xd62f105dU, 0x02441453U, 0xd8a1e681U, 0xe7d3fbc8U,
+    0x21e1cde6U, 0xc33707d6U, 0xf4d50d87U, 0x455a14edU,
+    0xa9e3e905U, 0xfcefa3f8U, 0x676f02d9U, 0x8d2a4c8aU,
+    0xfffa3942U, 0x8771f681U, 0x6d9d6122U, 0xfde5380cU,
+    0xa4beea44U, 0x4bdecfa9U, 0xf6bb4b60U, 0xbebfbc70U,
+    0x289b7ec6U, 0xeaa127faU, 0xd4ef3085U, 0x04881d05U,
+    0xd9d4d039U, 0xe6db99e5U, 0x1fa27cf8U, 0xc4ac5665U,
+    0xf4292244U, 0x432aff97U, 0xab9423a7U, 0xfc93a039U,
+    0x655b59c3U, 0x8f0ccc92U, 0xffeff47dU, 0x85845dd1U,
+    0x6fa87e4fU, 0xfe2ce6e0U, 0xa3014314U, 0x4e0811a1U,
+    0xf7537e82U, 0xbd3af235U, 0x2ad7d2bbU, 0xeb86d391U
+};
+
+static const unsigned char md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+static void md5_compress(uint32_t *h, const unsigned char *block) {
+  uint32_t w[16];
+  uint32_t a, b, c, d, f, t;
+  int i, g;
+
+  for (i = 0; i < 16; ++i) {
+    w[i] = load_le32(block + 4 * i);
+  }
+  a = h[0];
+  b = h[1];
+  c = h[2];
+  d = h[3];
+  for (i = 0; i < 64; ++i) {
+    if (i < 16) {
+      f = (b & c) | (~b & d);
+      g = i;
+    } else if (i < 32) {
+      f = (d & b) | (~d & c);
+      g = (5 * i + 1) & 15;
+    } else if (i < 48) {
+      f = b ^ c ^ d;
+      g = (3 * i + 5) & 15;
+    } else {
+      f = c ^ (b | ~d);
+      g = (7 * i) & 15;
+    }
+    t = d;
+    d = c;
+    c = b;
+    f = a + f + md5_k[i] + w[g];
+    b = b + ROTL32(f, md5_r[i]);
+    a = t;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+}
+
+/* SHA-1, FIPS 180-4 */
+
+static void sha1_compress(uint32_t *h, const unsigned char *block) {
+  uint32_t w[80];
+  uint32_t a, b, c, d, e, f, k, t;
+  int i;
+
+  for (i = 0; i < 16; ++i) {
+    w[i] = load_be32(block + 4 * i);
+  }
+  for (; i < 80; ++i) {
+    t = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+    w[i] = ROTL32(t, 1);
+  }
+  a = h[0];
+  b = h[1];
+  c = h[2];
+  d = h[3];
+  e = h[4];
+  for (i = 0; i < 80; ++i) {
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999U;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1U;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdcU;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6U;
+    }
+    t = ROTL32(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = ROTL32(b, 30);
+    b = a;
+    a = t;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+/* SHA-256, FIPS 180-4 */
+
+const uint32_t metalink_digest_sha256_k[64] = {
+    0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U,
+    0x3956c25bU, 0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U,
+    0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U,
+    0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U,
+    0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU,
+    0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+    0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U,
+    0xc6e00bf3U, 0xd5a79147U, 0x06ca6351U, 0x14292967U,
+    0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U,
+    0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+    0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U,
+    0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+    0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U,
+    0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU, 0x682e6ff3U,
+    0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U,
+    0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U
+};
+
+static void sha256_compress(uint32_t *h, const unsigned char *block) {
+  uint32_t w[64];
+  uint32_t v[8];
+  uint32_t s0, s1, t1, t2;
+  int i;
+
+  for (i = 0; i < 16; ++i) {
+    w[i] = load_be32(block + 4 * i);
+  }
+  for (; i < 64; ++i) {
+    s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  memcpy(v, h, sizeof(v));
+  for (i = 0; i < 64; ++i) {
+    s1 = ROTR32(v[4], 6) ^ ROTR32(v[4], 11) ^ ROTR32(v[4], 25);
+    t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + metalink_digest_sha256_k[i] + w[i];
+    s0 = ROTR32(v[0], 2) ^ ROTR32(v[0], 13) ^ ROTR32(v[0], 22);
+    t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+    v[7] = v[6];
+    v[6] = v[5];
+    v[5] = v[4];
+    v[4] = v[3] + t1;
+    v[3] = v[2];
+    v[2] = v[1];
+    v[1] = v[0];
+    v[0] = t1 + t2;
+  }
+  for (i = 0; i < 8; ++i) {
+    h[i] += v[i];
+  }
+}
+
+/* SHA-384 and SHA-512, FIPS 180-4 */
+
+static const uint64_t sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL,
+    0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+    0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL,
+    0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL,
+    0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL,
+    0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL,
+    0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL,
+    0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL,
+    0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+    0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL,
+    0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL,
+    0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+    0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL,
+    0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static void sha512_compress(uint64_t *h, const unsigned char *block) {
+  uint64_t w[80];
+  uint64_t v[8];
+  uint64_t s0, s1, t1, t2;
+  int i;
+
+  for (i = 0; i < 16; ++i) {
+    w[i] = load_be64(block + 8 * i);
+  }
+  for (; i < 80; ++i) {
+    s0 = ROTR64(w[i - 15], 1) ^ ROTR64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+    s1 = ROTR64(w[i - 2], 19) ^ ROTR64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  memcpy(v, h, sizeof(v));
+  for (i = 0; i < 80; ++i) {
+    s1 = ROTR64(v[4], 14) ^ ROTR64(v[4], 18) ^ ROTR64(v[4], 41);
+    t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha512_k[i] + w[i];
+    s0 = ROTR64(v[0], 28) ^ ROTR64(v[0], 34) ^ ROTR64(v[0], 39);
+    t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+    v[7] = v[6];
+    v[6] = v[5];
+    v[5] = v[4];
+    v[4] = v[3] + t1;
+    v[3] = v[2];
+    v[2] = v[1];
+    v[1] = v[0];
+    v[0] = t1 + t2;
+  }
+  for (i = 0; i < 8; ++i) {
+    h[i] += v[i];
+  }
+}
+
+static const uint32_t md5_init[4] = {0x67452301U, 0xefcdab89U, 0x98badcfeU,
+                                     0x10325476U};
+
+static const uint32_t sha1_init[5] = {0x67452301U, 0xefcdab89U, 0x98badcfeU,
+                                      0x10325476U, 0xc3d2e1f0U};
+
+static const uint32_t sha256_init[8] = {
+    0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU,
+    0x510e527fU, 0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U
+};
+
+static const uint64_t sha384_init[8] = {
+    0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL,
+    0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+    0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL,
+    0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+};
+
+static const uint64_t sha512_init[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const struct {
+  const char *name;
+  metalink_digest_algo_t algo;
+} digest_names[] = {{"md5", METALINK_DIGEST_MD5},
+                    {"sha1", METALINK_DIGEST_SHA1},
+                    {"sha256", METALINK_DIGEST_SHA256},
+                    {"sha384", METALINK_DIGEST_SHA384},
+                    {"sha512", METALINK_DIGEST_SHA512}};
+
+int metalink_digest_algo_from_name(metalink_digest_algo_t *algo,
+                                   const char *name) {
+  char buf[8];
+  size_t i, j;
+
+  if (!name) {
+    return -1;
+  }
+  for (i = 0, j = 0; name[i]; ++i) {
+    if (name[i] == '-') {
+      continue;
+    }
+    if (j == sizeof(buf) - 1) {
+      return -1;
+    }
+    buf[j++] = ('A' <= name[i] && name[i] <= 'Z') ? name[i] - 'A' + 'a'
+                                                   : name[i];
+  }
+  buf[j] = '\0';
+  for (i = 0; i < sizeof(digest_names) / sizeof(digest_names[0]); ++i) {
+    if (strcmp(buf, digest_names[i].name) == 0) {
+      *algo = digest_names[i].algo;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+size_t metalink_digest_length(metalink_digest_algo_t algo) {
+  switch (algo) {
+  case METALINK_DIGEST_MD5:
+    return 16;
+  case METALINK_DIGEST_SHA1:
+    return 20;
+  case METALINK_DIGEST_SHA256:
+    return 32;
+  case METALINK_DIGEST_SHA384:
+    return 48;
+  case METALINK_DIGEST_SHA512:
+  default:
+    return 64;
+  }
+}
+
+static size_t block_length(metalink_digest_algo_t algo) {
+  return algo == METALINK_DIGEST_SHA384 || algo == METALINK_DIGEST_SHA512
+             ? 128
+             : 64;
+}
+
+static void sha1_blocks_scalar(uint32_t *h, const unsigned char *p,
+                               size_t nblocks) {
+  for (; nblocks > 0; --nblocks, p += 64) {
+    sha1_compress(h, p);
+  }
+}
+
+static void sha256_blocks_scalar(uint32_t *h, const unsigned char *p,
+                                 size_t nblocks) {
+  for (; nblocks > 0; --nblocks, p += 64) {
+    sha256_compress(h, p);
+  }
+}
+
+typedef void (*blocks_fn)(uint32_t *h, const unsigned char *p,
+                          size_t nblocks);
+
+/* The SHA-1 and SHA-256 implementations in use. */
+static struct {
+  const char *sha1_name;
+  const char *sha256_name;
+  blocks_fn sha1_blocks;
+  blocks_fn sha256_blocks;
+  /* the number of SHA-256 messages hashed at once by update_multi */
+  size_t sha256_lanes;
+} backend = {"scalar", "scalar", sha1_blocks_scalar, sha256_blocks_scalar,
+             1};
+
+static int set_backend(const char *name) {
+  if (!name || strcmp(name, "auto") == 0) {
+#ifdef METALINK_DIGEST_X86
+    /* A single SHA-NI stream is about as fast as 8 AVX2 lanes, and it
+       needs no batching. */
+    if (set_backend("sha-ni") == 0 || set_backend("avx2") == 0) {
+      return 0;
+    }
+#endif /* METALINK_DIGEST_X86 */
+    return set_backend("scalar");
+  }
+  if (strcmp(name, "scalar") == 0) {
+    backend.sha1_name = "scalar";
+    backend.sha256_name = "scalar";
+    backend.sha1_blocks = sha1_blocks_scalar;
+    backend.sha256_blocks = sha256_blocks_scalar;
+    backend.sha256_lanes = 1;
+    return 0;
+  }
+#ifdef METALINK_DIGEST_X86
+  if (strcmp(name, "sha-ni") == 0 && metalink_digest_x86_has_sha()) {
+    backend.sha1_name = "sha-ni";
+    backend.sha256_name = "sha-ni";
+    backend.sha1_blocks = metalink_digest_sha1_blocks_sha;
+    backend.sha256_blocks = metalink_digest_sha256_blocks_sha;
+    backend.sha256_lanes = 1;
+    return 0;
+  }
+  if (strcmp(name, "avx2") == 0 && metalink_digest_x86_has_avx2()) {
+    backend.sha1_name = "scalar";
+    backend.sha256_name = "avx2";
+    backend.sha1_blocks = sha1_blocks_scalar;
+    backend.sha256_blocks = sha256_blocks_scalar;
+    backend.sha256_lanes = 8;
+    return 0;
+  }
+#endif /* METALINK_DIGEST_X86 */
+  return -1;
+}
+
+static void select_backend(void) { set_backend("auto"); }
+
+/* Picks the fastest backend for this CPU the first time it is needed. */
+static void init_backend(void) {
+#ifdef HAVE_PTHREAD
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, select_backend);
+#else  /* !HAVE_PTHREAD */
+  static int selected = 0;
+  if (!selected) {
+    select_backend();
+    selected = 1;
+  }
+#endif /* !HAVE_PTHREAD */
+}
+
+int metalink_digest_set_backend(const char *name) {
+  /* the automatic choice must not override this one later */
+  init_backend();
+  return set_backend(name);
+}
+
+const char *metalink_digest_get_backend(metalink_digest_algo_t algo) {
+  init_backend();
+  switch (algo) {
+  case METALINK_DIGEST_SHA1:
+    return backend.sha1_name;
+  case METALINK_DIGEST_SHA256:
+    return backend.sha256_name;
+  default:
+    return "scalar";
+  }
+}
+
+size_t metalink_digest_lanes(metalink_digest_algo_t algo) {
+  init_backend();
+  return algo == METALINK_DIGEST_SHA256 ? backend.sha256_lanes : 1;
+}
+
+static void compress(metalink_digest_t *digest, const unsigned char *p,
+                     size_t nblocks) {
+  size_t blen = block_length(digest->algo);
+
+  switch (digest->algo) {
+  case METALINK_DIGEST_SHA1:
+    backend.sha1_blocks(digest->state.h32, p, nblocks);
+    return;
+  case METALINK_DIGEST_SHA256:
+    backend.sha256_blocks(digest->state.h32, p, nblocks);
+    return;
+  default:
+    break;
+  }
+  for (; nblocks > 0; --nblocks, p += blen) {
+    if (digest->algo == METALINK_DIGEST_MD5) {
+      md5_compress(digest->state.h32, p);
+    } else {
+      sha512_compress(digest->state.h64, p);
+    }
+  }
+}
+
+void metalink_digest_init(metalink_digest_t *digest,
+                          metalink_digest_algo_t algo) {
+  init_backend();
+  digest->algo = algo;
+  digest->length = 0;
+  switch (algo) {
+  case METALINK_DIGEST_MD5:
+    memcpy(digest->state.h32, md5_init, sizeof(md5_init));
+    break;
+  case METALINK_DIGEST_SHA1:
+    memcpy(digest->state.h32, sha1_init, sizeof(sha1_init));
+    break;
+  case METALINK_DIGEST_SHA256:
+    memcpy(digest->state.h32, sha256_init, sizeof(sha256_init));
+    break;
+  case METALINK_DIGEST_SHA384:
+    memcpy(digest->state.h64, sha384_init, sizeof(sha384_init));
+    break;
+  case METALINK_DIGEST_SHA512:
+    memcpy(digest->state.h64, sha512_init, sizeof(sha512_init));
+    break;
+  }
+}
+
+void metalink_digest_update(metalink_digest_t *digest, const void *data,
+                            size_t len) {
+  const unsigned char *p = data;
+  size_t blen = block_length(digest->algo);
+  size_t fill = (size_t)(digest->length % blen);
+  size_t n;
+
+  digest->length += len;
+  if (fill) {
+    n = blen - fill;
+    if (len < n) {
+      memcpy(digest->block + fill, p, len);
+      return;
+    }
+    memcpy(digest->block + fill, p, n);
+    compress(digest, digest->block, 1);
+    p += n;
+    len -= n;
+  }
+  if (len >= blen) {
+    compress(digest, p, len / blen);
+    p += len / blen * blen;
+    len %= blen;
+  }
+  if (len) {
+    memcpy(digest->block, p, len);
+  }
+}
+
+void metalink_digest_final(metalink_digest_t *digest, unsigned char *out) {
+  size_t blen = block_length(digest->algo);
+  size_t fill = (size_t)(digest->length % blen);
+  uint64_t bits = digest->length << 3;
+  size_t i;
+
+  digest->block[fill++] = 0x80;
+  /* the message length takes the last 8 bytes of the block, or 16
+     bytes for SHA-384 and SHA-512 */
+  if (fill > blen - blen / 8) {
+    memset(digest->block + fill, 0, blen - fill);
+    compress(digest, digest->block, 1);
+    fill = 0;
+  }
+  memset(digest->block + fill, 0, blen - fill);
+  if (digest->algo == METALINK_DIGEST_MD5) {
+    store_le32(digest->block + blen - 8, (uint32_t)bits);
+    store_le32(digest->block + blen - 4, (uint32_t)(bits >> 32));
+  } else {
+    if (blen == 128) {
+      store_be64(digest->block + blen - 16, digest->length >> 61);
+    }
+    store_be64(digest->block + blen - 8, bits);
+  }
+  compress(digest, digest->block, 1);
+
+  switch (digest->algo) {
+  case METALINK_DIGEST_MD5:
+    for (i = 0; i < 4; ++i) {
+      store_le32(out + 4 * i, digest->state.h32[i]);
+    }
+    break;
+  case METALINK_DIGEST_SHA1:
+  case METALINK_DIGEST_SHA256:
+    for (i = 0; i < metalink_digest_length(digest->algo) / 4; ++i) {
+      store_be32(out + 4 * i, digest->state.h32[i]);
+    }
+    break;
+  case METALINK_DIGEST_SHA384:
+  case METALINK_DIGEST_SHA512:
+    for (i = 0; i < metalink_digest_length(digest->algo) / 8; ++i) {
+      store_be64(out + 8 * i, digest->state.h64[i]);
+    }
+    break;
+  }
+}
+
+void metalink_digest_update_multi(metalink_digest_t *const *digests,
+                                  const unsigned char *const *data, size_t n,
+                                  size_t len) {
+  size_t i;
+#ifdef METALINK_DIGEST_X86
+  uint32_t *h[8];
+  size_t nblocks = len / 64;
+
+  init_backend();
+  if (n == 8 && backend.sha256_lanes == 8 && nblocks > 0) {
+    for (i = 0; i < 8; ++i) {
+      /* only whole blocks of messages at the same position */
+      if (digests[i]->algo != METALINK_DIGEST_SHA256 ||
+          digests[i]->length % 64 != 0 ||
+          digests[i]->length != digests[0]->length) {
+        break;
+      }
+      h[i] = digests[i]->state.h32;
+    }
+    if (i == 8) {
+      metalink_digest_sha256_blocks_avx2(h, data, nblocks);
+      for (i = 0; i < 8; ++i) {
+        digests[i]->length += nblocks * 64;
+        metalink_digest_update(digests[i], data[i] + nblocks * 64,
+                               len - nblocks * 64);
+      }
+      return;
+    }
+  }
+#endif /* METALINK_DIGEST_X86 */
+  for (i = 0; i < n; ++i) {
+    metalink_digest_update(digests[i], data[i], len);
+  }
+}
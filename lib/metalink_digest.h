@@ -0,0 +1,119 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_DIGEST_H_
+#define _D_METALINK_DIGEST_H_
+
+#include "metalink_config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Message digest algorithms used by metalink checksums and piece
+ * hashes.
+ */
+typedef enum {
+  METALINK_DIGEST_MD5,
+  METALINK_DIGEST_SHA1,
+  METALINK_DIGEST_SHA256,
+  METALINK_DIGEST_SHA384,
+  METALINK_DIGEST_SHA512
+} metalink_digest_algo_t;
+
+/* The longest digest, in bytes, produced by any algorithm above. */
+#define METALINK_DIGEST_MAX_LENGTH 64
+
+typedef struct _metalink_digest {
+  metalink_digest_algo_t algo;
+  union {
+    uint32_t h32[8];
+    uint64_t h64[8];
+  } state;
+  /* number of bytes hashed so far */
+  uint64_t length;
+  /* partial input block */
+  unsigned char block[128];
+} metalink_digest_t;
+
+/*
+ * Looks up the algorithm called name, which is matched case
+ * insensitively with or without a hyphen, e.g., "sha-1", "sha1" and
+ * "SHA-1" are all METALINK_DIGEST_SHA1. Returns 0 and stores the
+ * algorithm in *algo on success, or -1 if name is not known.
+ */
+int metalink_digest_algo_from_name(metalink_digest_algo_t *algo,
+                                   const char *name);
+
+/* Returns the length of the digest produced by algo, in bytes. */
+size_t metalink_digest_length(metalink_digest_algo_t algo);
+
+/* Starts a new computation of algo in digest. */
+void metalink_digest_init(metalink_digest_t *digest,
+                          metalink_digest_algo_t algo);
+
+/* Hashes len bytes at data. */
+void metalink_digest_update(metalink_digest_t *digest, const void *data,
+                            size_t len);
+
+/*
+ * Hashes len bytes at data[i] into digests[i] for each i < n. If the
+ * backend hashes several messages at once (see metalink_digest_lanes),
+ * n equals the number of lanes and all digests compute the same
+ * algorithm and have hashed the same number of bytes, the messages are
+ * hashed in parallel. Otherwise they are hashed one after another.
+ */
+void metalink_digest_update_multi(metalink_digest_t *const *digests,
+                                  const unsigned char *const *data, size_t n,
+                                  size_t len);
+
+/*
+ * Finishes the computation and stores metalink_digest_length() bytes
+ * at out. digest must be initialized again before it is reused.
+ */
+void metalink_digest_final(metalink_digest_t *digest, unsigned char *out);
+
+/*
+ * Selects the implementation of SHA-1 and SHA-256 by name: "scalar"
+ * (portable C), "sha-ni" (x86 SHA extensions), "avx2" (8 SHA-256
+ * messages at once in AVX2 registers; single messages use portable C)
+ * or "auto", which is the default and picks the fastest one the CPU
+ * supports. MD5 and SHA-512 are always portable C. Returns -1 if the
+ * CPU or compiler does not support the backend. This must not be called
+ * while digests are being computed.
+ */
+int metalink_digest_set_backend(const char *name);
+
+/* Returns the name of the backend computing algo. */
+const char *metalink_digest_get_backend(metalink_digest_algo_t algo);
+
+/*
+ * Returns the number of messages of algo which
+ * metalink_digest_update_multi hashes at once, or 1 if the backend
+ * hashes one message at a time.
+ */
+size_t metalink_digest_lanes(metalink_digest_algo_t algo);
+
+#endif /* _D_METALINK_DIGEST_H_ */
@@ -0,0 +1,292 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_digest_x86.h"
+
+#ifdef METALINK_DIGEST_X86
+
+#include <string.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SHA_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+int metalink_digest_x86_has_sha(void) {
+  unsigned int a, b, c, d;
+
+  if (__get_cpuid_max(0, NULL) < 7 || !__get_cpuid(1, &a, &b, &c, &d)) {
+    return 0;
+  }
+  /* SSSE3 and SSE4.1 shuffle the message words */
+  if (!(c & bit_SSSE3) || !(c & bit_SSE4_1)) {
+    return 0;
+  }
+  __cpuid_count(7, 0, a, b, c, d);
+  return (b & (1u << 29)) != 0;
+}
+
+int metalink_digest_x86_has_avx2(void) {
+  unsigned int a, b, c, d, xcr0_lo, xcr0_hi;
+
+  if (__get_cpuid_max(0, NULL) < 7 || !__get_cpuid(1, &a, &b, &c, &d) ||
+      !(c & bit_OSXSAVE)) {
+    return 0;
+  }
+  /* the operating system must save the YMM registers */
+  __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  (void)xcr0_hi;
+  if ((xcr0_lo & 6) != 6) {
+    return 0;
+  }
+  __cpuid_count(7, 0, a, b, c, d);
+  return (b & (1u << 5)) != 0;
+}
+
+/* Computes the message words of group G from those of the 4 before. */
+#define SHA1_SCHEDULE(G)                                                       \
+  w[(G)&3] = _mm_sha1msg2_epu32(                                               \
+      _mm_xor_si128(_mm_sha1msg1_epu32(w[(G)&3], w[((G) + 1) & 3]),            \
+                    w[((G) + 2) & 3]),                                         \
+      w[((G) + 3) & 3])
+
+/* Rounds 4 * G to 4 * G + 3 of SHA-1, using round function F. */
+#define SHA1_ROUNDS(G, F)                                                      \
+  do {                                                                         \
+    if ((G) >= 4) {                                                            \
+      SHA1_SCHEDULE(G);                                                        \
+    }                                                                          \
+    e_next = _mm_sha1nexte_epu32(prev, w[(G)&3]);                              \
+    prev = abcd;                                                               \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_next, F);                               \
+  } while (0)
+
+/* SHA-1 with the SHA extensions; 4 rounds per instruction. */
+SHA_TARGET void metalink_digest_sha1_blocks_sha(uint32_t *h,
+                                                const unsigned char *p,
+                                                size_t nblocks) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+  __m128i abcd, abcd_save, e_save, e_next, prev;
+  __m128i w[4];
+  int g;
+
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0x1b);
+  e_save = _mm_set_epi32((int)h[4], 0, 0, 0);
+
+  for (; nblocks > 0; --nblocks, p += 64) {
+    abcd_save = abcd;
+    for (g = 0; g < 4; ++g) {
+      w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + g * 16)),
+                              mask);
+    }
+    prev = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, _mm_add_epi32(e_save, w[0]), 0);
+    SHA1_ROUNDS(1, 0);
+    SHA1_ROUNDS(2, 0);
+    SHA1_ROUNDS(3, 0);
+    SHA1_ROUNDS(4, 0);
+    SHA1_ROUNDS(5, 1);
+    SHA1_ROUNDS(6, 1);
+    SHA1_ROUNDS(7, 1);
+    SHA1_ROUNDS(8, 1);
+    SHA1_ROUNDS(9, 1);
+    SHA1_ROUNDS(10, 2);
+    SHA1_ROUNDS(11, 2);
+    SHA1_ROUNDS(12, 2);
+    SHA1_ROUNDS(13, 2);
+    SHA1_ROUNDS(14, 2);
+    SHA1_ROUNDS(15, 3);
+    SHA1_ROUNDS(16, 3);
+    SHA1_ROUNDS(17, 3);
+    SHA1_ROUNDS(18, 3);
+    SHA1_ROUNDS(19, 3);
+    e_save = _mm_sha1nexte_epu32(prev, e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128((__m128i *)h, _mm_shuffle_epi32(abcd, 0x1b));
+  h[4] = (uint32_t)_mm_extract_epi32(e_save, 3);
+}
+
+/* Rounds 4 * G to 4 * G + 3 of SHA-256. */
+#define SHA256_ROUNDS(G)                                                       \
+  do {                                                                         \
+    if ((G) >= 4) {                                                            \
+      w[(G)&3] = _mm_sha256msg2_epu32(                                         \
+          _mm_add_epi32(_mm_sha256msg1_epu32(w[(G)&3], w[((G) + 1) & 3]),      \
+                        _mm_alignr_epi8(w[((G) + 3) & 3], w[((G) + 2) & 3],    \
+                                        4)),                                   \
+          w[((G) + 3) & 3]);                                                   \
+    }                                                                          \
+    msg = _mm_add_epi32(                                                       \
+        w[(G)&3], _mm_loadu_si128(                                             \
+                      (const __m128i *)(metalink_digest_sha256_k + (G)*4)));   \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);                       \
+    state0 =                                                                   \
+        _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));   \
+  } while (0)
+
+/* SHA-256 with the SHA extensions; 2 rounds per instruction. */
+SHA_TARGET void metalink_digest_sha256_blocks_sha(uint32_t *h,
+                                                  const unsigned char *p,
+                                                  size_t nblocks) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+  __m128i state0, state1, abef_save, cdgh_save, tmp, msg;
+  __m128i w[4];
+  int g;
+
+  /* the instructions keep the state as ABEF and CDGH */
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0xb1);
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(h + 4)), 0x1b);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+  for (; nblocks > 0; --nblocks, p += 64) {
+    abef_save = state0;
+    cdgh_save = state1;
+    for (g = 0; g < 4; ++g) {
+      w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + g * 16)),
+                              mask);
+    }
+    SHA256_ROUNDS(0);
+    SHA256_ROUNDS(1);
+    SHA256_ROUNDS(2);
+    SHA256_ROUNDS(3);
+    SHA256_ROUNDS(4);
+    SHA256_ROUNDS(5);
+    SHA256_ROUNDS(6);
+    SHA256_ROUNDS(7);
+    SHA256_ROUNDS(8);
+    SHA256_ROUNDS(9);
+    SHA256_ROUNDS(10);
+    SHA256_ROUNDS(11);
+    SHA256_ROUNDS(12);
+    SHA256_ROUNDS(13);
+    SHA256_ROUNDS(14);
+    SHA256_ROUNDS(15);
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);
+  state1 = _mm_shuffle_epi32(state1, 0xb1);
+  _mm_storeu_si128((__m128i *)h, _mm_blend_epi16(tmp, state1, 0xf0));
+  _mm_storeu_si128((__m128i *)(h + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#define ROTR8X(X, N)                                                           \
+  _mm256_or_si256(_mm256_srli_epi32((X), (N)), _mm256_slli_epi32((X), 32 - (N)))
+
+/* Loads big endian word i of each of the 8 blocks. */
+AVX2_TARGET static __m256i load_words(const unsigned char *const *p,
+                                      size_t offset) {
+  const __m256i mask = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  uint32_t v[8];
+  int i;
+
+  for (i = 0; i < 8; ++i) {
+    memcpy(&v[i], p[i] + offset, 4);
+  }
+  return _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)v), mask);
+}
+
+/*
+ * SHA-256 of 8 messages in the 8 lanes of AVX2 registers. This wins on
+ * CPUs without the SHA extensions.
+ */
+AVX2_TARGET void metalink_digest_sha256_blocks_avx2(
+    uint32_t *const *h, const unsigned char *const *p, size_t nblocks) {
+  __m256i w[64];
+  __m256i v[8], save[8];
+  __m256i s0, s1, t1, t2;
+  uint32_t lanes[8];
+  size_t offset;
+  int i, j;
+
+  for (i = 0; i < 8; ++i) {
+    for (j = 0; j < 8; ++j) {
+      lanes[j] = h[j][i];
+    }
+    v[i] = _mm256_loadu_si256((const __m256i *)lanes);
+  }
+
+  for (offset = 0; nblocks > 0; --nblocks, offset += 64) {
+    for (i = 0; i < 16; ++i) {
+      w[i] = load_words(p, offset + (size_t)i * 4);
+    }
+    for (; i < 64; ++i) {
+      s0 = _mm256_xor_si256(
+          _mm256_xor_si256(ROTR8X(w[i - 15], 7), ROTR8X(w[i - 15], 18)),
+          _mm256_srli_epi32(w[i - 15], 3));
+      s1 = _mm256_xor_si256(
+          _mm256_xor_si256(ROTR8X(w[i - 2], 17), ROTR8X(w[i - 2], 19)),
+          _mm256_srli_epi32(w[i - 2], 10));
+      w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], s0),
+                              _mm256_add_epi32(w[i - 7], s1));
+    }
+    memcpy(save, v, sizeof(v));
+    for (i = 0; i < 64; ++i) {
+      s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8X(v[4], 6), ROTR8X(v[4], 11)),
+                            ROTR8X(v[4], 25));
+      t1 = _mm256_add_epi32(
+          _mm256_add_epi32(_mm256_add_epi32(v[7], s1),
+                           _mm256_xor_si256(_mm256_and_si256(v[4], v[5]),
+                                            _mm256_andnot_si256(v[4], v[6]))),
+          _mm256_add_epi32(
+              _mm256_set1_epi32((int)metalink_digest_sha256_k[i]), w[i]));
+      s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8X(v[0], 2), ROTR8X(v[0], 13)),
+                            ROTR8X(v[0], 22));
+      t2 = _mm256_add_epi32(
+          s0, _mm256_xor_si256(
+                  _mm256_xor_si256(_mm256_and_si256(v[0], v[1]),
+                                   _mm256_and_si256(v[0], v[2])),
+                  _mm256_and_si256(v[1], v[2])));
+      v[7] = v[6];
+      v[6] = v[5];
+      v[5] = v[4];
+      v[4] = _mm256_add_epi32(v[3], t1);
+      v[3] = v[2];
+      v[2] = v[1];
+      v[1] = v[0];
+      v[0] = _mm256_add_epi32(t1, t2);
+    }
+    for (i = 0; i < 8; ++i) {
+      v[i] = _mm256_add_epi32(v[i], save[i]);
+    }
+  }
+
+  for (i = 0; i < 8; ++i) {
+    _mm256_storeu_si256((__m256i *)lanes, v[i]);
+    for (j = 0; j < 8; ++j) {
+      h[j][i] = lanes[j];
+    }
+  }
+}
+
+#endif /* METALINK_DIGEST_X86 */
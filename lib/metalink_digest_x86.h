@@ -0,0 +1,72 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_DIGEST_X86_H_
+#define _D_METALINK_DIGEST_X86_H_
+
+#include "metalink_config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Digest code using the x86 SHA extensions and AVX2. It is compiled
+ * for every x86 CPU and only called after cpuid has confirmed that the
+ * instructions are available.
+ */
+#if defined(HAVE_X86_INTRINSICS) && (defined(__x86_64__) || defined(__i386__))
+#define METALINK_DIGEST_X86 1
+#endif /* HAVE_X86_INTRINSICS && (__x86_64__ || __i386__) */
+
+#ifdef METALINK_DIGEST_X86
+
+/* Round constants of SHA-256, defined in metalink_digest.c. */
+extern const uint32_t metalink_digest_sha256_k[64];
+
+/* Returns nonzero if the CPU supports the SHA extensions. */
+int metalink_digest_x86_has_sha(void);
+
+/* Returns nonzero if the CPU and the operating system support AVX2. */
+int metalink_digest_x86_has_avx2(void);
+
+/* Hashes nblocks 64 byte blocks at p into the SHA-1 state h. */
+void metalink_digest_sha1_blocks_sha(uint32_t *h, const unsigned char *p,
+                                     size_t nblocks);
+
+/* Hashes nblocks 64 byte blocks at p into the SHA-256 state h. */
+void metalink_digest_sha256_blocks_sha(uint32_t *h, const unsigned char *p,
+                                       size_t nblocks);
+
+/*
+ * Hashes nblocks 64 byte blocks at p[i] into the SHA-256 state h[i] for
+ * each of 8 independent messages at once.
+ */
+void metalink_digest_sha256_blocks_avx2(uint32_t *const *h,
+                                        const unsigned char *const *p,
+                                        size_t nblocks);
+
+#endif /* METALINK_DIGEST_X86 */
+
+#endif /* _D_METALINK_DIGEST_X86_H_ */
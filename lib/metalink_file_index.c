@@ -0,0 +1,308 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_file_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* The kinds of keys, mixed into their hashes. */
+#define KEY_NAME 1
+#define KEY_IDENTITY 2
+#define KEY_CHECKSUM 3
+
+typedef struct _file_index_entry {
+  /* hash of the key, 0 if the entry is free */
+  uint64_t hash;
+  metalink_file_t *file;
+} file_index_entry_t;
+
+struct _metalink_file_index {
+  file_index_entry_t *entries;
+  size_t mask;
+};
+
+/* FNV-1a over str, continued from h. */
+static uint64_t hash_string(uint64_t h, const char *str) {
+  for (; *str; ++str) {
+    h ^= (unsigned char)*str;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/*
+ * Same as hash_string, but ignores case and hyphens, so that "SHA-256"
+ * and "sha256" or upper and lower case hex digits hash the same.
+ */
+static uint64_t hash_loose(uint64_t h, const char *str) {
+  int c;
+  for (; *str; ++str) {
+    c = (unsigned char)*str;
+    if (c == '-') {
+      continue;
+    }
+    if ('A' <= c && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    h ^= (uint64_t)c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* Returns 0 if lhs and rhs are equal as compared by hash_loose. */
+static int loose_comp(const char *lhs, const char *rhs) {
+  int l, r;
+  for (;;) {
+    while (*lhs == '-') {
+      ++lhs;
+    }
+    while (*rhs == '-') {
+      ++rhs;
+    }
+    l = (unsigned char)*lhs;
+    r = (unsigned char)*rhs;
+    if ('A' <= l && l <= 'Z') {
+      l += 'a' - 'A';
+    }
+    if ('A' <= r && r <= 'Z') {
+      r += 'a' - 'A';
+    }
+    if (l != r || l == '\0') {
+      return l - r;
+    }
+    ++lhs;
+    ++rhs;
+  }
+}
+
+static const char *or_empty(const char *str) { return str ? str : ""; }
+
+static uint64_t finish_hash(uint64_t h) { return h ? h : 1; }
+
+static uint64_t name_hash(const char *name) {
+  return finish_hash(hash_string(14695981039346656037ULL ^ KEY_NAME, name));
+}
+
+static uint64_t identity_hash(const char *identity, const char *version) {
+  uint64_t h;
+  h = hash_string(14695981039346656037ULL ^ KEY_IDENTITY, identity);
+  /* separates "ab" + "c" from "a" + "bc" */
+  h ^= 0xff;
+  h *= 1099511628211ULL;
+  return finish_hash(hash_string(h, or_empty(version)));
+}
+
+static uint64_t checksum_hash(const char *type, const char *hash) {
+  uint64_t h;
+  h = hash_loose(14695981039346656037ULL ^ KEY_CHECKSUM, type);
+  h ^= 0xff;
+  h *= 1099511628211ULL;
+  return finish_hash(hash_loose(h, hash));
+}
+
+static void insert(metalink_file_index_t *index, uint64_t hash,
+                   metalink_file_t *file) {
+  size_t i;
+  for (i = (size_t)hash & index->mask; index->entries[i].hash;
+       i = (i + 1) & index->mask)
+    ;
+  index->entries[i].hash = hash;
+  index->entries[i].file = file;
+}
+
+metalink_file_index_t *metalink_file_index_new(metalink_file_t **files) {
+  metalink_file_index_t *index;
+  metalink_checksum_t **checksums;
+  size_t keys = 0, size = 1, i;
+
+  for (i = 0; files[i]; ++i) {
+    keys += 2;
+    for (checksums = files[i]->checksums; checksums && *checksums;
+         ++checksums) {
+      ++keys;
+    }
+  }
+  /* keep the table at most half full */
+  while (size < keys * 2) {
+    size *= 2;
+  }
+  index = malloc(sizeof(metalink_file_index_t));
+  if (!index) {
+    return NULL;
+  }
+  index->entries = calloc(size, sizeof(file_index_entry_t));
+  if (!index->entries) {
+    free(index);
+    return NULL;
+  }
+  index->mask = size - 1;
+
+  /* files come in document order, so a lookup meets the first of
+     several files with the same key first */
+  for (i = 0; files[i]; ++i) {
+    if (files[i]->name) {
+      insert(index, name_hash(files[i]->name), files[i]);
+    }
+    if (files[i]->identity) {
+      insert(index, identity_hash(files[i]->identity, files[i]->version),
+             files[i]);
+    }
+    for (checksums = files[i]->checksums; checksums && *checksums;
+         ++checksums) {
+      if ((*checksums)->type && (*checksums)->hash) {
+        insert(index, checksum_hash((*checksums)->type, (*checksums)->hash),
+               files[i]);
+      }
+    }
+  }
+  return index;
+}
+
+void metalink_file_index_delete(metalink_file_index_t *index) {
+  if (!index) {
+    return;
+  }
+  free(index->entries);
+  free(index);
+}
+
+static int match_name(const metalink_file_t *file, const char *name) {
+  return file->name && strcmp(file->name, name) == 0;
+}
+
+static int match_identity(const metalink_file_t *file, const char *identity,
+                          const char *version) {
+  return file->identity && strcmp(file->identity, identity) == 0 &&
+         strcmp(or_empty(file->version), or_empty(version)) == 0;
+}
+
+static int match_checksum(const metalink_file_t *file, const char *type,
+                          const char *hash) {
+  metalink_checksum_t **checksums;
+  for (checksums = file->checksums; checksums && *checksums; ++checksums) {
+    if ((*checksums)->type && (*checksums)->hash &&
+        loose_comp((*checksums)->type, type) == 0 &&
+        loose_comp((*checksums)->hash, hash) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+metalink_error_t METALINK_PUBLIC metalink_index_files(metalink_t *metalink) {
+  metalink_file_index_t *index = NULL;
+  if (metalink->files) {
+    index = metalink_file_index_new(metalink->files);
+    if (!index) {
+      return METALINK_ERR_BAD_ALLOC;
+    }
+  }
+  metalink_file_index_delete(metalink->file_index);
+  metalink->file_index = index;
+  return 0;
+}
+
+metalink_file_t METALINK_PUBLIC *metalink_find_file(const metalink_t *metalink,
+                                                    const char *name) {
+  const metalink_file_index_t *index = metalink->file_index;
+  metalink_file_t **files;
+  uint64_t hash;
+  size_t i;
+
+  if (index) {
+    hash = name_hash(name);
+    for (i = (size_t)hash & index->mask; index->entries[i].hash;
+         i = (i + 1) & index->mask) {
+      if (index->entries[i].hash == hash &&
+          match_name(index->entries[i].file, name)) {
+        return index->entries[i].file;
+      }
+    }
+    return NULL;
+  }
+  for (files = metalink->files; files && *files; ++files) {
+    if (match_name(*files, name)) {
+      return *files;
+    }
+  }
+  return NULL;
+}
+
+metalink_file_t METALINK_PUBLIC *
+metalink_find_file_by_identity(const metalink_t *metalink,
+                               const char *identity, const char *version) {
+  const metalink_file_index_t *index = metalink->file_index;
+  metalink_file_t **files;
+  uint64_t hash;
+  size_t i;
+
+  if (index) {
+    hash = identity_hash(identity, version);
+    for (i = (size_t)hash & index->mask; index->entries[i].hash;
+         i = (i + 1) & index->mask) {
+      if (index->entries[i].hash == hash &&
+          match_identity(index->entries[i].file, identity, version)) {
+        return index->entries[i].file;
+      }
+    }
+    return NULL;
+  }
+  for (files = metalink->files; files && *files; ++files) {
+    if (match_identity(*files, identity, version)) {
+      return *files;
+    }
+  }
+  return NULL;
+}
+
+metalink_file_t METALINK_PUBLIC *
+metalink_find_file_by_checksum(const metalink_t *metalink, const char *type,
+                               const char *hash) {
+  const metalink_file_index_t *index = metalink->file_index;
+  metalink_file_t **files;
+  uint64_t h;
+  size_t i;
+
+  if (index) {
+    h = checksum_hash(type, hash);
+    for (i = (size_t)h & index->mask; index->entries[i].hash;
+         i = (i + 1) & index->mask) {
+      if (index->entries[i].hash == h &&
+          match_checksum(index->entries[i].file, type, hash)) {
+        return index->entries[i].file;
+      }
+    }
+    return NULL;
+  }
+  for (files = metalink->files; files && *files; ++files) {
+    if (match_checksum(*files, type, hash)) {
+      return *files;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,49 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_FILE_INDEX_H_
+#define _D_METALINK_FILE_INDEX_H_
+
+#include "metalink_config.h"
+
+#include <metalink/metalink.h>
+
+/*
+ * A hash index of the files of a metalink_t by name, by identity and
+ * version, and by checksum. It refers to the file entries, so it is
+ * freed together with them by metalink_delete.
+ */
+typedef struct _metalink_file_index metalink_file_index_t;
+
+/*
+ * Indexes the NULL terminated list of files. Returns NULL if memory
+ * runs out.
+ */
+metalink_file_index_t *metalink_file_index_new(metalink_file_t **files);
+
+/* Frees index. Passing NULL is legal. */
+void metalink_file_index_delete(metalink_file_index_t *index);
+
+#endif /* _D_METALINK_FILE_INDEX_H_ */
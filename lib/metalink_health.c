@@ -0,0 +1,437 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#endif /* HAVE_GETTIMEOFDAY */
+
+#include <metalink/metalink.h>
+
+#include "metalink_atomic.h"
+
+#define HEALTH_DEFAULT_CAPACITY 1024
+
+/* The longest host name, as limited by DNS. */
+#define HEALTH_HOST_LENGTH 255
+
+/* Hosts more than this many times slower than the fastest are not
+   used. */
+#define HEALTH_SLOW_FACTOR 4
+
+/* The first and the longest back off after a failure. */
+#define HEALTH_BACKOFF_MS 1000
+#define HEALTH_MAX_BACKOFF_MS 60000
+
+/* The transfer for which the expected time is compared. */
+#define HEALTH_SCORE_BYTES (1024 * 1024)
+
+typedef struct _health_entry {
+  /* hash of the host, 0 if the entry is free */
+  uint64_t key;
+  /* nonzero once host is filled in */
+  uint64_t named;
+  /* moving averages, 0 if there is no sample yet */
+  uint64_t latency_us;
+  uint64_t throughput;
+  /* failures in a row, and when the host may be tried again */
+  uint64_t failures;
+  uint64_t retry_at_ms;
+  char host[HEALTH_HOST_LENGTH + 1];
+} health_entry_t;
+
+struct _metalink_health {
+  health_entry_t *entries;
+  size_t mask;
+};
+
+typedef struct _health_rank {
+  /* nonzero if the resource is not moved to the end */
+  int usable;
+  /* expected microseconds to fetch HEALTH_SCORE_BYTES; 0 if unknown,
+     and UINT64_MAX while backed off */
+  uint64_t score;
+  size_t pos;
+  size_t resource;
+} health_rank_t;
+
+static uint64_t now_ms(void) {
+#ifdef HAVE_GETTIMEOFDAY
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+#else  /* !HAVE_GETTIMEOFDAY */
+  return (uint64_t)time(NULL) * 1000;
+#endif /* !HAVE_GETTIMEOFDAY */
+}
+
+/*
+ * Copies the host of url in lower case to host, which has room for
+ * HEALTH_HOST_LENGTH characters and the terminating NULL. Returns 0,
+ * or -1 if url has no host.
+ */
+static int url_host(char *host, const char *url) {
+  const char *first, *last, *p;
+  size_t len, i;
+
+  first = strstr(url, "://");
+  if (!first) {
+    return -1;
+  }
+  first += 3;
+  for (last = first; *last && *last != '/' && *last != '?' && *last != '#';
+       ++last)
+    ;
+  /* drop user info */
+  for (p = first; p != last; ++p) {
+    if (*p == '@') {
+      first = p + 1;
+    }
+  }
+  if (first != last && *first == '[') {
+    for (p = first; p != last && *p != ']'; ++p)
+      ;
+    if (p == last) {
+      return -1;
+    }
+    last = p + 1;
+  } else {
+    for (p = first; p != last && *p != ':'; ++p)
+      ;
+    last = p;
+  }
+  len = (size_t)(last - first);
+  if (len == 0 || len > HEALTH_HOST_LENGTH) {
+    return -1;
+  }
+  for (i = 0; i < len; ++i) {
+    host[i] = first[i];
+    if ('A' <= host[i] && host[i] <= 'Z') {
+      host[i] += 'a' - 'A';
+    }
+  }
+  host[len] = '\0';
+  return 0;
+}
+
+/* FNV-1a, never 0 so that 0 can mark free entries. */
+static uint64_t host_hash(const char *host) {
+  uint64_t h = 14695981039346656037ULL;
+  for (; *host; ++host) {
+    h ^= (unsigned char)*host;
+    h *= 1099511628211ULL;
+  }
+  return h ? h : 1;
+}
+
+/*
+ * Returns the entry of host, which is added if create is nonzero.
+ * Returns NULL if host is not in the table and cannot be added.
+ */
+static health_entry_t *find_entry(const metalink_health_t *health,
+                                  const char *host, int create) {
+  health_entry_t *entry;
+  uint64_t hash, key;
+  size_t i, probes;
+
+  hash = host_hash(host);
+  i = (size_t)hash & health->mask;
+  for (probes = 0; probes <= health->mask;) {
+    entry = &health->entries[i];
+    key = metalink_atomic_load(&entry->key);
+    if (key == hash) {
+      return entry;
+    }
+    if (key == 0) {
+      if (!create) {
+        return NULL;
+      }
+      if (!metalink_atomic_cas(&entry->key, 0, hash)) {
+        /* someone else took it; look at the same entry again */
+        continue;
+      }
+      strcpy(entry->host, host);
+      metalink_atomic_store(&entry->named, 1);
+      return entry;
+    }
+    i = (i + 1) & health->mask;
+    ++probes;
+  }
+  return NULL;
+}
+
+/* Moves the average at p a quarter of the way towards sample. */
+static void update_average(uint64_t *p, uint64_t sample) {
+  uint64_t old, avg;
+  if (sample == 0) {
+    sample = 1;
+  }
+  do {
+    old = metalink_atomic_load(p);
+    avg = old == 0 ? sample : old - old / 4 + sample / 4;
+    if (avg == 0) {
+      avg = 1;
+    }
+  } while (!metalink_atomic_cas(p, old, avg));
+}
+
+static uint64_t backoff_ms(uint64_t failures) {
+  if (failures > 6) {
+    return HEALTH_MAX_BACKOFF_MS;
+  }
+  if ((HEALTH_BACKOFF_MS << (failures - 1)) > HEALTH_MAX_BACKOFF_MS) {
+    return HEALTH_MAX_BACKOFF_MS;
+  }
+  return HEALTH_BACKOFF_MS << (failures - 1);
+}
+
+metalink_error_t METALINK_PUBLIC metalink_health_new(metalink_health_t **res,
+                                                     size_t capacity) {
+  metalink_health_t *health;
+  size_t size = 1;
+
+  if (capacity == 0) {
+    capacity = HEALTH_DEFAULT_CAPACITY;
+  }
+  /* keep the table at most half full */
+  while (size < capacity * 2) {
+    size *= 2;
+  }
+  health = malloc(sizeof(metalink_health_t));
+  if (!health) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  health->entries = calloc(size, sizeof(health_entry_t));
+  if (!health->entries) {
+    free(health);
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  health->mask = size - 1;
+  *res = health;
+  return 0;
+}
+
+void METALINK_PUBLIC metalink_health_delete(metalink_health_t *health) {
+  if (!health) {
+    return;
+  }
+  free(health->entries);
+  free(health);
+}
+
+void METALINK_PUBLIC metalink_health_report(metalink_health_t *health,
+                                            const char *url, int latency_ms,
+                                            long long bytes, int elapsed_ms) {
+  char host[HEALTH_HOST_LENGTH + 1];
+  health_entry_t *entry;
+
+  if (url_host(host, url) != 0) {
+    return;
+  }
+  entry = find_entry(health, host, 1);
+  if (!entry) {
+    return;
+  }
+  if (latency_ms >= 0) {
+    update_average(&entry->latency_us, (uint64_t)latency_ms * 1000);
+  }
+  if (bytes > 0 && elapsed_ms > 0) {
+    update_average(&entry->throughput,
+                   (uint64_t)bytes * 1000 / (uint64_t)elapsed_ms);
+  }
+  metalink_atomic_store(&entry->failures, 0);
+  metalink_atomic_store(&entry->retry_at_ms, 0);
+}
+
+void METALINK_PUBLIC metalink_health_report_failure(metalink_health_t *health,
+                                                    const char *url) {
+  char host[HEALTH_HOST_LENGTH + 1];
+  health_entry_t *entry;
+  uint64_t failures;
+
+  if (url_host(host, url) != 0) {
+    return;
+  }
+  entry = find_entry(health, host, 1);
+  if (!entry) {
+    return;
+  }
+  failures = metalink_atomic_add(&entry->failures, 1);
+  metalink_atomic_store(&entry->retry_at_ms, now_ms() + backoff_ms(failures));
+}
+
+static int health_rank_comp(const void *lhs, const void *rhs) {
+  const health_rank_t *l = lhs;
+  const health_rank_t *r = rhs;
+  if (l->usable != r->usable) {
+    return r->usable - l->usable;
+  }
+  if (l->score != r->score) {
+    return l->score < r->score ? -1 : 1;
+  }
+  return l->pos < r->pos ? -1 : l->pos > r->pos;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_health_rank(const metalink_health_t *health,
+                     const metalink_file_t *file, size_t *resources,
+                     size_t count, size_t *usable) {
+  char host[HEALTH_HOST_LENGTH + 1];
+  health_rank_t *ranks;
+  health_entry_t *entry;
+  const char *url;
+  uint64_t now, throughput, total = 0, best = 0;
+  size_t i, known = 0, n = 0;
+
+  ranks = malloc(sizeof(health_rank_t) * (count ? count : 1));
+  if (!ranks) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  now = now_ms();
+  for (i = 0; i < count; ++i) {
+    ranks[i].usable = 1;
+    ranks[i].score = 0;
+    ranks[i].pos = i;
+    ranks[i].resource = resources[i];
+    url = file->resources[resources[i]]->url;
+    if (!url || url_host(host, url) != 0) {
+      continue;
+    }
+    entry = find_entry(health, host, 0);
+    if (!entry) {
+      continue;
+    }
+    if (metalink_atomic_load(&entry->retry_at_ms) > now) {
+      ranks[i].usable = 0;
+      ranks[i].score = UINT64_MAX;
+      continue;
+    }
+    throughput = metalink_atomic_load(&entry->throughput);
+    if (throughput == 0) {
+      continue;
+    }
+    ranks[i].score = metalink_atomic_load(&entry->latency_us) +
+                     (uint64_t)HEALTH_SCORE_BYTES * 1000000 / throughput;
+    if (ranks[i].score == 0) {
+      ranks[i].score = 1;
+    }
+    if (best == 0 || ranks[i].score < best) {
+      best = ranks[i].score;
+    }
+    total += ranks[i].score;
+    ++known;
+  }
+  for (i = 0; i < count; ++i) {
+    if (!ranks[i].usable) {
+      continue;
+    }
+    if (ranks[i].score == 0) {
+      /* unknown hosts are given a chance, however slow the average */
+      ranks[i].score = known ? total / known : 0;
+    } else if (ranks[i].score > best * HEALTH_SLOW_FACTOR) {
+      ranks[i].usable = 0;
+    }
+    n += ranks[i].usable;
+  }
+  qsort(ranks, count, sizeof(health_rank_t), health_rank_comp);
+  for (i = 0; i < count; ++i) {
+    resources[i] = ranks[i].resource;
+  }
+  free(ranks);
+  *usable = n;
+  return 0;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_health_save(const metalink_health_t *health, const char *path) {
+  health_entry_t *entry;
+  FILE *fp;
+  size_t i;
+  int r;
+
+  fp = fopen(path, "w");
+  if (!fp) {
+    return METALINK_ERR_CANNOT_OPEN_FILE;
+  }
+  r = fputs("# libmetalink mirror health: host latency_us throughput "
+            "failures\n",
+            fp);
+  for (i = 0; i <= health->mask && r >= 0; ++i) {
+    entry = &health->entries[i];
+    if (!metalink_atomic_load(&entry->named)) {
+      continue;
+    }
+    r = fprintf(fp, "%s %llu %llu %llu\n", entry->host,
+                (unsigned long long)metalink_atomic_load(&entry->latency_us),
+                (unsigned long long)metalink_atomic_load(&entry->throughput),
+                (unsigned long long)metalink_atomic_load(&entry->failures));
+  }
+  if (fclose(fp) != 0 || r < 0) {
+    return METALINK_ERR_CANNOT_WRITE_FILE;
+  }
+  return 0;
+}
+
+metalink_error_t METALINK_PUBLIC metalink_health_load(metalink_health_t *health,
+                                                      const char *path) {
+  char line[HEALTH_HOST_LENGTH + 128];
+  char host[HEALTH_HOST_LENGTH + 1];
+  unsigned long long latency_us, throughput, failures;
+  health_entry_t *entry;
+  uint64_t now;
+  FILE *fp;
+  int error;
+
+  fp = fopen(path, "r");
+  if (!fp) {
+    return METALINK_ERR_CANNOT_OPEN_FILE;
+  }
+  now = now_ms();
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' ||
+        sscanf(line, "%255s %llu %llu %llu", host, &latency_us, &throughput,
+               &failures) != 4) {
+      continue;
+    }
+    entry = find_entry(health, host, 1);
+    if (!entry) {
+      continue;
+    }
+    metalink_atomic_store(&entry->latency_us, latency_us);
+    metalink_atomic_store(&entry->throughput, throughput);
+    metalink_atomic_store(&entry->failures, failures);
+    metalink_atomic_store(&entry->retry_at_ms,
+                          failures ? now + backoff_ms(failures) : 0);
+  }
+  error = ferror(fp);
+  fclose(fp);
+  return error ? METALINK_ERR_CANNOT_READ_FILE : 0;
+}
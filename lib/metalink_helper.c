@@ -112,12 +112,18 @@ const char *metalink_strerror(int error_code) {
     return "out of memory";
   case METALINK_ERR_CANNOT_OPEN_FILE:
     return "could not open file";
+  case METALINK_ERR_CANNOT_READ_FILE:
+    return "could not read file";
+  case METALINK_ERR_CANNOT_WRITE_FILE:
+    return "could not write file";
   case METALINK_ERR_MISSING_REQUIRED_ATTR:
     return "required attribute not found";
   case METALINK_ERR_NAMESPACE_ERROR:
     return "unexpected namespace";
   case METALINK_ERR_PARSER_ERROR:
     return "xml parser failure";
+  case METALINK_ERR_DOCUMENT_TOO_LARGE:
+    return "document exceeds size limit";
   /* METALINK_ERR_NO_*_TRANSACTION error code should not be returned
      to the application code. If they are, it is a bug of
      libmetalink. In the future release, they will be removed and
@@ -132,11 +138,54 @@ const char *metalink_strerror(int error_code) {
     return "no chunk checksum transaction";
   case METALINK_ERR_NO_PIECE_HASH_TRANSACTION:
     return "no piece hash transaction";
+  case METALINK_ERR_CALLBACK_FAILURE:
+    return "aborted by callback";
+  case METALINK_ERR_NO_PIECE_HASHES:
+    return "no usable piece hashes";
+  case METALINK_ERR_UNSUPPORTED_HASH:
+    return "unsupported hash type";
+  case METALINK_ERR_NO_CHECKSUMS:
+    return "no usable checksums";
+  case METALINK_ERR_UNKNOWN_FILE_SIZE:
+    return "file size is unknown";
+  case METALINK_ERR_NO_RESOURCES:
+    return "no usable resources";
+  case METALINK_ERR_BAD_SNAPSHOT:
+    return "not a valid snapshot";
   default:
     return "unknown error code";
   }
 }
 
+static int hex_value(char c) {
+  if ('0' <= c && c <= '9') {
+    return c - '0';
+  }
+  if ('a' <= c && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if ('A' <= c && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+int metalink_hex_decode(unsigned char *dest, const char *src, size_t len) {
+  size_t i;
+  if (len % 2) {
+    return -1;
+  }
+  for (i = 0; i < len; i += 2) {
+    int hi = hex_value(src[i]);
+    int lo = hex_value(src[i + 1]);
+    if (hi == -1 || lo == -1) {
+      return -1;
+    }
+    *dest++ = (unsigned char)(hi << 4 | lo);
+  }
+  return 0;
+}
+
 int metalink_match_ns(const char *uri, size_t len) {
   switch (len) {
   case sizeof(METALINK_V3_NS_URI) - 1:
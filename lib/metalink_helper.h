@@ -43,4 +43,12 @@ int metalink_check_safe_path(const char *path);
  */
 int metalink_match_ns(const char *uri, size_t len);
 
+/*
+ * Decodes the hex string src of length len into len / 2 bytes at dest.
+ * Both lower and upper case digits are accepted. Returns 0 on success,
+ * or -1 if len is odd or src contains a character which is not a hex
+ * digit.
+ */
+int metalink_hex_decode(unsigned char *dest, const char *src, size_t len);
+
 #endif /* _D_METALINK_HELPER_H_ */
@@ -25,99 +25,109 @@
 /* copyright --> */
 #include "metalink_list.h"
 
+#include <string.h>
+
+/* the capacity of the first allocation */
+#define METALINK_LIST_MIN_CAPACITY 4
+
 metalink_list_t *metalink_list_new(void) {
   metalink_list_t *l = malloc(sizeof(metalink_list_t));
   if (l) {
-    l->head = NULL;
-    l->tail = NULL;
+    l->data = NULL;
+    l->length = 0;
+    l->capacity = 0;
   }
   return l;
 }
 
 void metalink_list_delete(metalink_list_t *list) {
-  metalink_list_clear(list);
+  free(list->data);
   free(list);
 }
 
 void metalink_list_clear(metalink_list_t *list) {
-  metalink_list_entry_t *e = list->head;
-  metalink_list_entry_t *next;
-  while (e) {
-    next = e->next;
-    free(e);
-    e = next;
-  }
-  list->head = NULL;
-  list->tail = NULL;
+  /* Keep the storage for the next use. */
+  list->length = 0;
 }
 
 void metalink_list_clear_data(metalink_list_t *list) {
-  metalink_list_entry_t *e = list->head;
-  metalink_list_entry_t *next;
-  while (e) {
-    next = e->next;
-    free(e->data);
-    free(e);
-    e = next;
+  size_t i;
+  for (i = 0; i < list->length; ++i) {
+    free(list->data[i]);
   }
-  list->head = NULL;
-  list->tail = NULL;
+  list->length = 0;
 }
 
 void *metalink_list_get_data(metalink_list_t *list, size_t index) {
-  metalink_list_entry_t *e = list->head;
-  while (index-- && e) {
-    e = e->next;
-  }
-  if (e) {
-    return e->data;
+  if (index < list->length) {
+    return list->data[index];
   } else {
     return 0;
   }
 }
 
-size_t metalink_list_length(metalink_list_t *list) {
-  size_t length = 0;
-  metalink_list_entry_t *e = list->head;
-  while (e) {
-    e = e->next;
-    ++length;
-  }
-  return length;
-}
+size_t metalink_list_length(metalink_list_t *list) { return list->length; }
 
-int metalink_list_append(metalink_list_t *list, void *data) {
-  metalink_list_entry_t *new_entry = malloc(sizeof(metalink_list_entry_t));
+/* Makes room for at least capacity elements. Returns 0 on success. */
+static int reserve(metalink_list_t *list, size_t capacity) {
+  size_t new_capacity;
+  void **new_data;
 
-  if (!new_entry) {
+  if (capacity <= list->capacity) {
+    return 0;
+  }
+  new_capacity = list->capacity ? list->capacity : METALINK_LIST_MIN_CAPACITY;
+  while (new_capacity < capacity) {
+    new_capacity *= 2;
+  }
+  if (new_capacity > ((size_t)-1) / sizeof(void *)) {
     return 1;
   }
-  new_entry->data = data;
-  new_entry->next = NULL;
-
-  if (!list->head) {
-    list->head = new_entry;
+  new_data = realloc(list->data, new_capacity * sizeof(void *));
+  if (!new_data) {
+    return 1;
   }
-  if (list->tail) {
-    list->tail->next = new_entry;
+  list->data = new_data;
+  list->capacity = new_capacity;
+  return 0;
+}
+
+int metalink_list_append(metalink_list_t *list, void *data) {
+  if (reserve(list, list->length + 1) != 0) {
+    return 1;
   }
-  list->tail = new_entry;
+  list->data[list->length++] = data;
   return 0;
 }
 
 void metalink_list_to_array(metalink_list_t *list, void **array) {
-  void **p = array;
-  metalink_list_entry_t *e = list->head;
-  while (e) {
-    *p++ = e->data;
-    e = e->next;
+  if (list->length) {
+    memcpy(array, list->data, list->length * sizeof(void *));
+  }
+}
+
+void **metalink_list_release_array(metalink_list_t *list) {
+  void **array;
+
+  if (list->length == 0 || reserve(list, list->length + 1) != 0) {
+    return NULL;
+  }
+  list->data[list->length] = NULL;
+  /* Give back the unused tail of the storage. Shrinking is not
+     supposed to fail, but the original block is fine if it does. */
+  array = realloc(list->data, (list->length + 1) * sizeof(void *));
+  if (!array) {
+    array = list->data;
   }
+  list->data = NULL;
+  list->length = 0;
+  list->capacity = 0;
+  return array;
 }
 
 void metalink_list_for_each(metalink_list_t *list, void (*fun)(void *data)) {
-  metalink_list_entry_t *e = list->head;
-  while (e) {
-    fun(e->data);
-    e = e->next;
+  size_t i;
+  for (i = 0; i < list->length; ++i) {
+    fun(list->data[i]);
   }
 }
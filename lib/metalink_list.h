@@ -32,14 +32,14 @@
 
 #include <metalink/metalink.h>
 
-typedef struct _metalink_list_entry {
-  void *data;
-  struct _metalink_list_entry *next;
-} metalink_list_entry_t;
-
+/*
+ * A growable array of pointers. Appending is amortized O(1), and so
+ * are the length and the random access.
+ */
 typedef struct _metalink_list {
-  metalink_list_entry_t *head;
-  metalink_list_entry_t *tail;
+  void **data;
+  size_t length;
+  size_t capacity;
 } metalink_list_t;
 
 metalink_list_t *metalink_list_new(void);
@@ -56,6 +56,14 @@ void metalink_list_clear_data(metalink_list_t *list);
 
 void metalink_list_to_array(metalink_list_t *list, void **array);
 
+/*
+ * Hands the storage of list over to the caller as a NULL terminated
+ * array and leaves list empty. The array must be freed with free().
+ * Returns NULL if list is empty or out of memory; in the latter case,
+ * list is left untouched.
+ */
+void **metalink_list_release_array(metalink_list_t *list);
+
 int metalink_list_append(metalink_list_t *list, void *data);
 
 void metalink_list_insert(metalink_list_t *list, size_t index);
@@ -0,0 +1,467 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <metalink/metalink.h>
+
+/* The number of protocols a query merges; more fall back to filtering. */
+#define MIRROR_MAX_CURSORS 16
+
+struct _metalink_mirror_index {
+  size_t count;
+  /* for each rank, the index into file->resources, the protocol id and
+     the country id */
+  uint32_t *resources;
+  uint32_t *protocols;
+  uint32_t *countries;
+  /* ranks grouped by protocol, by country, and by country and then
+     protocol; in rank order within each group */
+  uint32_t *by_protocol;
+  uint32_t *by_country;
+  uint32_t *by_country_protocol;
+  /* the groups of protocol p start at protocol_start[p], those of
+     country c at country_start[c] */
+  size_t *protocol_start;
+  size_t *country_start;
+  /* distinct names sorted case insensitively; the id is the position */
+  char **protocol_names;
+  size_t protocol_count;
+  char **country_names;
+  size_t country_count;
+};
+
+/* A run of ranks in ascending order; ranks is NULL for pos itself. */
+typedef struct _rank_cursor {
+  const uint32_t *ranks;
+  size_t pos;
+  size_t end;
+} rank_cursor_t;
+
+typedef struct _rank_key {
+  int priority;
+  size_t index;
+} rank_key_t;
+
+typedef struct _name_key {
+  const char *name;
+  uint32_t rank;
+} name_key_t;
+
+static int name_comp(const char *lhs, const char *rhs) {
+  int l, r;
+  for (;; ++lhs, ++rhs) {
+    l = (unsigned char)*lhs;
+    r = (unsigned char)*rhs;
+    if ('A' <= l && l <= 'Z') {
+      l += 'a' - 'A';
+    }
+    if ('A' <= r && r <= 'Z') {
+      r += 'a' - 'A';
+    }
+    if (l != r || l == '\0') {
+      return l - r;
+    }
+  }
+}
+
+static int rank_key_comp(const void *lhs, const void *rhs) {
+  const rank_key_t *l = lhs;
+  const rank_key_t *r = rhs;
+  if (l->priority != r->priority) {
+    return l->priority < r->priority ? -1 : 1;
+  }
+  return l->index < r->index ? -1 : l->index > r->index;
+}
+
+static int name_key_comp(const void *lhs, const void *rhs) {
+  return name_comp(((const name_key_t *)lhs)->name,
+                   ((const name_key_t *)rhs)->name);
+}
+
+static int name_search_comp(const void *key, const void *elem) {
+  return name_comp(key, *(char *const *)elem);
+}
+
+/*
+ * Assigns ids to the distinct names, one per rank, in keys and stores
+ * them in ids. The distinct names are copied to *names_out in id
+ * order. keys is sorted in place.
+ */
+static metalink_error_t intern_names(uint32_t *ids, char ***names_out,
+                                     size_t *count_out, name_key_t *keys,
+                                     size_t count) {
+  char **names;
+  size_t i, n = 0;
+
+  qsort(keys, count, sizeof(name_key_t), name_key_comp);
+  names = malloc(sizeof(char *) * (count ? count : 1));
+  if (!names) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  *names_out = names;
+  *count_out = 0;
+  for (i = 0; i < count; ++i) {
+    if (n == 0 || name_comp(names[n - 1], keys[i].name) != 0) {
+      names[n] = strdup(keys[i].name);
+      if (!names[n]) {
+        return METALINK_ERR_BAD_ALLOC;
+      }
+      *count_out = ++n;
+    }
+    ids[keys[i].rank] = (uint32_t)(n - 1);
+  }
+  return 0;
+}
+
+/*
+ * Stably sorts the count ranks in src, or 0, 1, ..., count - 1 if src
+ * is NULL, by key[rank] into dest. The ranks with key k start at
+ * start[k]; start[nkeys] is count.
+ */
+static void sort_by_key(uint32_t *dest, size_t *start, const uint32_t *src,
+                        const uint32_t *key, size_t nkeys, size_t count) {
+  size_t i, rank;
+
+  memset(start, 0, sizeof(size_t) * (nkeys + 1));
+  for (i = 0; i < count; ++i) {
+    ++start[key[i] + 1];
+  }
+  for (i = 0; i < nkeys; ++i) {
+    start[i + 1] += start[i];
+  }
+  for (i = 0; i < count; ++i) {
+    rank = src ? src[i] : i;
+    dest[start[key[rank]]++] = (uint32_t)rank;
+  }
+  /* start[k] is now where group k + 1 begins */
+  memmove(start + 1, start, sizeof(size_t) * nkeys);
+  start[0] = 0;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_mirror_index_new(metalink_mirror_index_t **res,
+                          const metalink_file_t *file) {
+  metalink_mirror_index_t *index;
+  metalink_resource_t **resources = file->resources;
+  rank_key_t *rank_keys = NULL;
+  name_key_t *name_keys = NULL;
+  size_t count = 0, i, *start = NULL;
+  metalink_error_t r = METALINK_ERR_BAD_ALLOC;
+
+  if (resources) {
+    for (; resources[count]; ++count)
+      ;
+  }
+  index = calloc(1, sizeof(metalink_mirror_index_t));
+  if (!index) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  index->count = count;
+  /* allocate at least one element so that NULL always means failure */
+  i = count ? count : 1;
+  index->resources = malloc(sizeof(uint32_t) * i);
+  index->protocols = malloc(sizeof(uint32_t) * i);
+  index->countries = malloc(sizeof(uint32_t) * i);
+  index->by_protocol = malloc(sizeof(uint32_t) * i);
+  index->by_country = malloc(sizeof(uint32_t) * i);
+  index->by_country_protocol = malloc(sizeof(uint32_t) * i);
+  rank_keys = malloc(sizeof(rank_key_t) * i);
+  name_keys = malloc(sizeof(name_key_t) * i);
+  if (!index->resources || !index->protocols || !index->countries ||
+      !index->by_protocol || !index->by_country ||
+      !index->by_country_protocol || !rank_keys || !name_keys) {
+    goto MIRROR_INDEX_NEW_ERROR;
+  }
+
+  for (i = 0; i < count; ++i) {
+    rank_keys[i].priority = resources[i]->priority;
+    rank_keys[i].index = i;
+  }
+  qsort(rank_keys, count, sizeof(rank_key_t), rank_key_comp);
+  for (i = 0; i < count; ++i) {
+    index->resources[i] = (uint32_t)rank_keys[i].index;
+  }
+
+  for (i = 0; i < count; ++i) {
+    name_keys[i].name = resources[index->resources[i]]->type;
+    if (!name_keys[i].name) {
+      name_keys[i].name = "";
+    }
+    name_keys[i].rank = (uint32_t)i;
+  }
+  r = intern_names(index->protocols, &index->protocol_names,
+                   &index->protocol_count, name_keys, count);
+  if (r != 0) {
+    goto MIRROR_INDEX_NEW_ERROR;
+  }
+  for (i = 0; i < count; ++i) {
+    name_keys[i].name = resources[index->resources[i]]->location;
+    if (!name_keys[i].name) {
+      name_keys[i].name = "";
+    }
+    name_keys[i].rank = (uint32_t)i;
+  }
+  r = intern_names(index->countries, &index->country_names,
+                   &index->country_count, name_keys, count);
+  if (r != 0) {
+    goto MIRROR_INDEX_NEW_ERROR;
+  }
+
+  r = METALINK_ERR_BAD_ALLOC;
+  index->protocol_start = malloc(sizeof(size_t) * (index->protocol_count + 1));
+  index->country_start = malloc(sizeof(size_t) * (index->country_count + 1));
+  start = malloc(sizeof(size_t) * (index->country_count + 1));
+  if (!index->protocol_start || !index->country_start || !start) {
+    goto MIRROR_INDEX_NEW_ERROR;
+  }
+  sort_by_key(index->by_protocol, index->protocol_start, NULL,
+              index->protocols, index->protocol_count, count);
+  sort_by_key(index->by_country, index->country_start, NULL,
+              index->countries, index->country_count, count);
+  /* stable, so the protocol order of by_protocol is kept per country */
+  sort_by_key(index->by_country_protocol, start, index->by_protocol,
+              index->countries, index->country_count, count);
+
+  free(start);
+  free(name_keys);
+  free(rank_keys);
+  *res = index;
+  return 0;
+
+MIRROR_INDEX_NEW_ERROR:
+  free(start);
+  free(name_keys);
+  free(rank_keys);
+  metalink_mirror_index_delete(index);
+  return r;
+}
+
+static void free_names(char **names, size_t count) {
+  size_t i;
+  if (!names) {
+    return;
+  }
+  for (i = 0; i < count; ++i) {
+    free(names[i]);
+  }
+  free(names);
+}
+
+void METALINK_PUBLIC metalink_mirror_index_delete(metalink_mirror_index_t *index) {
+  if (!index) {
+    return;
+  }
+  free(index->resources);
+  free(index->protocols);
+  free(index->countries);
+  free(index->by_protocol);
+  free(index->by_country);
+  free(index->by_country_protocol);
+  free(index->protocol_start);
+  free(index->country_start);
+  free_names(index->protocol_names, index->protocol_count);
+  free_names(index->country_names, index->country_count);
+  free(index);
+}
+
+size_t METALINK_PUBLIC
+metalink_mirror_index_get_count(const metalink_mirror_index_t *index) {
+  return index->count;
+}
+
+/* Returns the id of name in names, or -1 if it is not there. */
+static long find_name(char *const *names, size_t count, const char *name) {
+  char *const *found;
+  found = bsearch(name, names, count, sizeof(char *), name_search_comp);
+  return found ? (long)(found - names) : -1;
+}
+
+/* Returns nonzero if the type of the resource of rank is in protocols. */
+static int protocol_wanted(const metalink_mirror_index_t *index,
+                           const char *const *protocols, uint32_t rank) {
+  const char *name = index->protocol_names[index->protocols[rank]];
+  for (; *protocols; ++protocols) {
+    if (name_comp(*protocols, name) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Narrows the cursor over by_country_protocol[first, last), which is
+ * sorted by protocol, to the ranks of protocol.
+ */
+static void protocol_range(rank_cursor_t *cursor,
+                           const metalink_mirror_index_t *index, size_t first,
+                           size_t last, uint32_t protocol) {
+  const uint32_t *ranks = index->by_country_protocol;
+  size_t lo = first, hi = last, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (index->protocols[ranks[mid]] < protocol) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  cursor->pos = lo;
+  hi = last;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (index->protocols[ranks[mid]] <= protocol) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  cursor->ranks = ranks;
+  cursor->end = lo;
+}
+
+/*
+ * Merges the cursors in rank order and appends the accepted resources
+ * to out[n, max). Ranks located in skip_country are passed over, as are
+ * the ones whose type is not in filter if it is not NULL.
+ */
+static size_t merge_cursors(const metalink_mirror_index_t *index,
+                            rank_cursor_t *cursors, size_t ncursors,
+                            long skip_country, const char *const *filter,
+                            const unsigned char *excluded, size_t *out,
+                            size_t n, size_t max) {
+  rank_cursor_t *best;
+  uint32_t rank = 0, r, resource;
+  size_t i;
+
+  while (n < max) {
+    best = NULL;
+    for (i = 0; i < ncursors; ++i) {
+      if (cursors[i].pos == cursors[i].end) {
+        continue;
+      }
+      r = cursors[i].ranks ? cursors[i].ranks[cursors[i].pos]
+                           : (uint32_t)cursors[i].pos;
+      if (!best || r < rank) {
+        best = &cursors[i];
+        rank = r;
+      }
+    }
+    if (!best) {
+      break;
+    }
+    ++best->pos;
+    if ((long)index->countries[rank] == skip_country ||
+        (filter && !protocol_wanted(index, filter, rank))) {
+      continue;
+    }
+    resource = index->resources[rank];
+    if (excluded && (excluded[resource / 8] & (0x80 >> (resource % 8)))) {
+      continue;
+    }
+    out[n++] = resource;
+  }
+  return n;
+}
+
+size_t METALINK_PUBLIC
+metalink_mirror_index_select(const metalink_mirror_index_t *index,
+                             const char *country,
+                             const char *const *protocols,
+                             const unsigned char *excluded, size_t *out,
+                             size_t max) {
+  rank_cursor_t cursors[MIRROR_MAX_CURSORS];
+  uint32_t ids[MIRROR_MAX_CURSORS];
+  const char *const *filter = NULL;
+  size_t nids = 0, i, j, n = 0;
+  long c = -1, id;
+
+  if (protocols) {
+    for (i = 0; protocols[i]; ++i) {
+      id = find_name(index->protocol_names, index->protocol_count,
+                     protocols[i]);
+      if (id < 0) {
+        continue;
+      }
+      for (j = 0; j < nids && ids[j] != (uint32_t)id; ++j)
+        ;
+      if (j < nids) {
+        continue;
+      }
+      if (nids == MIRROR_MAX_CURSORS) {
+        filter = protocols;
+        break;
+      }
+      ids[nids++] = (uint32_t)id;
+    }
+    if (nids == 0) {
+      return 0;
+    }
+    if (nids == index->protocol_count) {
+      /* every protocol is wanted, which is the same as no filter */
+      protocols = NULL;
+    }
+  }
+  if (filter) {
+    protocols = NULL;
+  }
+  if (country && country[0]) {
+    c = find_name(index->country_names, index->country_count, country);
+  }
+
+  if (c >= 0) {
+    if (protocols) {
+      for (i = 0; i < nids; ++i) {
+        protocol_range(&cursors[i], index, index->country_start[c],
+                       index->country_start[c + 1], ids[i]);
+      }
+    } else {
+      cursors[0].ranks = index->by_country;
+      cursors[0].pos = index->country_start[c];
+      cursors[0].end = index->country_start[c + 1];
+    }
+    n = merge_cursors(index, cursors, protocols ? nids : 1, -1, filter,
+                      excluded, out, n, max);
+  }
+
+  if (protocols) {
+    for (i = 0; i < nids; ++i) {
+      cursors[i].ranks = index->by_protocol;
+      cursors[i].pos = index->protocol_start[ids[i]];
+      cursors[i].end = index->protocol_start[ids[i] + 1];
+    }
+  } else {
+    cursors[0].ranks = NULL;
+    cursors[0].pos = 0;
+    cursors[0].end = index->count;
+  }
+  return merge_cursors(index, cursors, protocols ? nids : 1, c, filter,
+                       excluded, out, n, max);
+}
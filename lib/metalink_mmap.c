@@ -0,0 +1,71 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_mmap.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+int metalink_mmap_file(metalink_mmap_t *map, int fd) {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  struct stat st;
+  void *addr;
+
+  if (fstat(fd, &st) == -1) {
+    return -1;
+  }
+  /* pipes, sockets and character devices are not mappable (or their
+     size is not known in advance), so let the caller read them. */
+  if (!S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (unsigned long long)st.st_size > (size_t)-1) {
+    return -1;
+  }
+  addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    return -1;
+  }
+#ifdef HAVE_MADVISE
+  madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif /* HAVE_MADVISE */
+  map->addr = addr;
+  map->length = (size_t)st.st_size;
+  return 0;
+#else  /* !HAVE_MMAP || !HAVE_SYS_MMAN_H */
+  (void)map;
+  (void)fd;
+  return -1;
+#endif /* !HAVE_MMAP || !HAVE_SYS_MMAN_H */
+}
+
+void metalink_munmap_file(metalink_mmap_t *map) {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  munmap(map->addr, map->length);
+#endif /* HAVE_MMAP && HAVE_SYS_MMAN_H */
+  map->addr = NULL;
+  map->length = 0;
+}
@@ -0,0 +1,61 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_MMAP_H_
+#define _D_METALINK_MMAP_H_
+
+#include "metalink_config.h"
+
+#include <stdlib.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+
+#include <metalink/metalink.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif /* !O_BINARY */
+
+typedef struct _metalink_mmap {
+  /* start address of mapped region */
+  void *addr;
+  /* length of mapped region in bytes */
+  size_t length;
+} metalink_mmap_t;
+
+/*
+ * Maps the whole file opened as fd into memory read-only and tells
+ * the kernel that it is going to be read sequentially.
+ * @return 0 on success. Non-zero if fd does not refer to a non-empty
+ * regular file or mmap is not available on this platform; in this
+ * case, the caller should read the data from fd instead.
+ */
+int metalink_mmap_file(metalink_mmap_t *map, int fd);
+
+/* Unmaps the region mapped by metalink_mmap_file. */
+void metalink_munmap_file(metalink_mmap_t *map);
+
+#endif /* _D_METALINK_MMAP_H_ */
@@ -0,0 +1,230 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_parse_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "metalink_digest.h"
+#include "metalink_file_index.h"
+#include "metalink_parse_options.h"
+#include "metalink_parse_stats.h"
+#include "metalink_snapshot_common.h"
+
+/* the number of digest bytes in the name of a cache entry */
+#define NAME_BYTES 8
+
+typedef struct {
+  /* the path of the snapshot in the cache directory */
+  char *path;
+  /* what the snapshot must have been made of */
+  unsigned char key[METALINK_SNAPSHOT_KEY_LENGTH];
+} cache_entry_t;
+
+static int cache_enabled(const metalink_parse_options_t *opts) {
+  return opts->cache_dir && !opts->file_callback;
+}
+
+/*
+ * Sets the path of entry to the file in the cache directory of opts
+ * named after the first NAME_BYTES bytes of digest. Returns 0 on
+ * success.
+ */
+static int set_entry_path(cache_entry_t *entry,
+                          const metalink_parse_options_t *opts,
+                          const unsigned char *digest) {
+  static const char hex[] = "0123456789abcdef";
+  size_t length;
+  size_t i;
+
+  length = strlen(opts->cache_dir);
+  entry->path = malloc(length + 1 + NAME_BYTES * 2 + sizeof(".snap"));
+  if (!entry->path) {
+    return -1;
+  }
+  memcpy(entry->path, opts->cache_dir, length);
+  entry->path[length++] = '/';
+  for (i = 0; i < NAME_BYTES; ++i) {
+    entry->path[length++] = hex[digest[i] >> 4];
+    entry->path[length++] = hex[digest[i] & 0xf];
+  }
+  memcpy(entry->path + length, ".snap", sizeof(".snap"));
+  return 0;
+}
+
+/*
+ * Computes the key of the file at filename with status st. Everything
+ * which changes when the file is replaced or written to goes into it.
+ */
+static void file_key(unsigned char *key, const char *filename,
+                     const struct stat *st, int skip_fields) {
+  metalink_digest_t digest;
+  uint64_t values[6];
+
+  values[0] = (uint64_t)st->st_dev;
+  values[1] = (uint64_t)st->st_ino;
+  values[2] = (uint64_t)st->st_size;
+  values[3] = (uint64_t)st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+  values[4] = (uint64_t)st->st_mtim.tv_nsec;
+#else  /* !HAVE_STRUCT_STAT_ST_MTIM */
+  values[4] = 0;
+#endif /* !HAVE_STRUCT_STAT_ST_MTIM */
+  values[5] = (uint64_t)skip_fields;
+  metalink_digest_init(&digest, METALINK_DIGEST_SHA256);
+  metalink_digest_update(&digest, "file", sizeof("file"));
+  metalink_digest_update(&digest, filename, strlen(filename) + 1);
+  metalink_digest_update(&digest, values, sizeof(values));
+  metalink_digest_final(&digest, key);
+}
+
+/*
+ * Loads the snapshot of entry into *res. Returns 0 on a hit. The time
+ * it takes is counted as I/O in the statistics of opts.
+ */
+static int load_entry(const cache_entry_t *entry,
+                      const metalink_parse_options_t *opts, metalink_t **res) {
+  metalink_stats_timer_t timer;
+  metalink_t *metalink;
+
+  metalink_parse_stats_clear(opts->stats);
+  metalink_parse_stats_start(opts->stats, &timer);
+  if (metalink_load_snapshot_keyed(entry->path, entry->key, &metalink) != 0) {
+    return -1;
+  }
+  if (opts->index_files && !metalink->file_index) {
+    if (metalink_index_files(metalink) != 0) {
+      metalink_delete(metalink);
+      return -1;
+    }
+  } else if (!opts->index_files && metalink->file_index) {
+    metalink_file_index_delete(metalink->file_index);
+    metalink->file_index = NULL;
+  }
+  metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_IO);
+  *res = metalink;
+  return 0;
+}
+
+/*
+ * Returns a copy of opts for parsing a document on a cache miss. The
+ * result is made the way a snapshot of it loads.
+ */
+static metalink_parse_options_t
+miss_options(const metalink_parse_options_t *opts) {
+  metalink_parse_options_t parse_opts = *opts;
+  parse_opts.cache_dir = NULL;
+  parse_opts.use_arena = 1;
+  parse_opts.compact_pieces = 1;
+  return parse_opts;
+}
+
+int metalink_parse_cache_file(metalink_error_t *r, const char *filename,
+                              metalink_t **res,
+                              const metalink_parse_options_t *opts) {
+  metalink_parse_options_t parse_opts;
+  cache_entry_t entry;
+  struct stat st;
+  unsigned char name_digest[METALINK_SNAPSHOT_KEY_LENGTH];
+  unsigned char key[METALINK_SNAPSHOT_KEY_LENGTH];
+  metalink_digest_t digest;
+
+  if (!cache_enabled(opts) || stat(filename, &st) != 0 ||
+      !S_ISREG(st.st_mode)) {
+    return -1;
+  }
+  if ((unsigned long long)st.st_size > (size_t)-1 ||
+      metalink_parse_options_exceeds_max_size(opts, (size_t)st.st_size)) {
+    *r = METALINK_ERR_DOCUMENT_TOO_LARGE;
+    return 0;
+  }
+  /* Each path has one entry, which is replaced when the file
+     changes. */
+  metalink_digest_init(&digest, METALINK_DIGEST_SHA256);
+  metalink_digest_update(&digest, filename, strlen(filename) + 1);
+  metalink_digest_update(&digest, &opts->skip_fields,
+                         sizeof(opts->skip_fields));
+  metalink_digest_final(&digest, name_digest);
+  if (set_entry_path(&entry, opts, name_digest) != 0) {
+    return -1;
+  }
+  file_key(entry.key, filename, &st, opts->skip_fields);
+
+  if (load_entry(&entry, opts, res) == 0) {
+    *r = 0;
+  } else {
+    parse_opts = miss_options(opts);
+    *r = metalink_parse_file_ex(filename, res, &parse_opts);
+    /* Only save the result if the file did not change while it was
+       parsed, as the key might not describe what was read otherwise. */
+    if (*r == 0 && stat(filename, &st) == 0) {
+      file_key(key, filename, &st, opts->skip_fields);
+      if (memcmp(key, entry.key, sizeof(key)) == 0) {
+        metalink_save_snapshot_keyed(*res, entry.path, entry.key);
+      }
+    }
+  }
+  free(entry.path);
+  return 0;
+}
+
+int metalink_parse_cache_memory(metalink_error_t *r, const char *buf,
+                                size_t len, metalink_t **res,
+                                const metalink_parse_options_t *opts) {
+  metalink_parse_options_t parse_opts;
+  cache_entry_t entry;
+  metalink_digest_t digest;
+
+  if (!cache_enabled(opts)) {
+    return -1;
+  }
+  /* Documents are found by their contents, so the key names the
+     entry. */
+  metalink_digest_init(&digest, METALINK_DIGEST_SHA256);
+  metalink_digest_update(&digest, "memory", sizeof("memory"));
+  metalink_digest_update(&digest, &opts->skip_fields,
+                         sizeof(opts->skip_fields));
+  metalink_digest_update(&digest, buf, len);
+  metalink_digest_final(&digest, entry.key);
+  if (set_entry_path(&entry, opts, entry.key) != 0) {
+    return -1;
+  }
+
+  if (load_entry(&entry, opts, res) == 0) {
+    *r = 0;
+  } else {
+    parse_opts = miss_options(opts);
+    *r = metalink_parse_memory_ex(buf, len, res, &parse_opts);
+    if (*r == 0) {
+      metalink_save_snapshot_keyed(*res, entry.path, entry.key);
+    }
+  }
+  free(entry.path);
+  return 0;
+}
@@ -0,0 +1,53 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_PARSE_CACHE_H_
+#define _D_METALINK_PARSE_CACHE_H_
+
+#include "metalink_config.h"
+
+#include <metalink/metalink.h>
+
+/*
+ * Parses the file at filename through the cache directory of opts:
+ * loads the snapshot of the file if it is still valid, and otherwise
+ * parses the file and saves the result for the next time.
+ *
+ * Returns 0 if the cache was used. Then *r is the result of the parse
+ * and, if it is 0, *res is the resulting metalink_t. Returns -1 and
+ * leaves *r and *res untouched if the file is to be parsed without
+ * the cache: if opts has no cache directory, a file callback is set,
+ * or filename is not a regular file.
+ */
+int metalink_parse_cache_file(metalink_error_t *r, const char *filename,
+                              metalink_t **res,
+                              const metalink_parse_options_t *opts);
+
+/* Same as metalink_parse_cache_file, for the document buf of len bytes. */
+int metalink_parse_cache_memory(metalink_error_t *r, const char *buf,
+                                size_t len, metalink_t **res,
+                                const metalink_parse_options_t *opts);
+
+#endif /* _D_METALINK_PARSE_CACHE_H_ */
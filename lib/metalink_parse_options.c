@@ -0,0 +1,257 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_parse_options.h"
+
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+static const metalink_parse_options_t default_options = {
+    METALINK_DEFAULT_READ_SIZE, /* read_size */
+    METALINK_FADVISE_SEQUENTIAL, /* fadvise */
+    METALINK_READAHEAD_DEFAULT, /* readahead */
+    0,                          /* max_size */
+    1,                          /* use_mmap */
+    0,                          /* skip_fields */
+    NULL,                       /* file_callback */
+    NULL,                       /* file_callback_user_data */
+    0,                          /* use_arena */
+    0,                          /* compact_pieces */
+    0,                          /* index_files */
+    NULL,                       /* stats */
+    1,                          /* threads */
+    NULL                        /* cache_dir */
+};
+
+void metalink_parse_options_init(metalink_parse_options_t *opts) {
+  *opts = default_options;
+}
+
+const metalink_parse_options_t *
+metalink_parse_options_get(const metalink_parse_options_t *opts) {
+  return opts ? opts : &default_options;
+}
+
+metalink_parse_options_t METALINK_PUBLIC *metalink_parse_options_new(void) {
+  metalink_parse_options_t *opts;
+  opts = malloc(sizeof(metalink_parse_options_t));
+  if (opts) {
+    metalink_parse_options_init(opts);
+  }
+  return opts;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_delete(metalink_parse_options_t *opts) {
+  if (opts) {
+    free(opts->cache_dir);
+  }
+  free(opts);
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_read_size(metalink_parse_options_t *opts,
+                                     size_t read_size) {
+  if (read_size == 0) {
+    read_size = METALINK_DEFAULT_READ_SIZE;
+  } else if (read_size > INT_MAX) {
+    /* Both expat and libxml2 take the length of data as int. */
+    read_size = INT_MAX;
+  }
+  opts->read_size = read_size;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_fadvise(metalink_parse_options_t *opts,
+                                   int fadvise) {
+  opts->fadvise = fadvise;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_readahead(metalink_parse_options_t *opts,
+                                     metalink_readahead_t readahead) {
+  opts->readahead = readahead;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_max_size(metalink_parse_options_t *opts,
+                                    size_t max_size) {
+  opts->max_size = max_size;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_mmap(metalink_parse_options_t *opts, int use_mmap) {
+  opts->use_mmap = use_mmap;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_skip_fields(metalink_parse_options_t *opts,
+                                       int fields) {
+  opts->skip_fields = fields;
+}
+
+void METALINK_PUBLIC metalink_parse_options_set_file_callback(
+    metalink_parse_options_t *opts, metalink_file_callback callback,
+    void *user_data) {
+  opts->file_callback = callback;
+  opts->file_callback_user_data = user_data;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_arena(metalink_parse_options_t *opts,
+                                 int use_arena) {
+  opts->use_arena = use_arena;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_compact_pieces(metalink_parse_options_t *opts,
+                                          int compact_pieces) {
+  opts->compact_pieces = compact_pieces;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_file_index(metalink_parse_options_t *opts,
+                                      int index_files) {
+  opts->index_files = index_files;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_stats(metalink_parse_options_t *opts,
+                                 metalink_parse_stats_t *stats) {
+  opts->stats = stats;
+}
+
+void METALINK_PUBLIC
+metalink_parse_options_set_threads(metalink_parse_options_t *opts,
+                                   int nthreads) {
+  opts->threads = nthreads;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_parse_options_set_cache_dir(metalink_parse_options_t *opts,
+                                     const char *dir) {
+  char *copy = NULL;
+  if (dir) {
+    copy = strdup(dir);
+    if (!copy) {
+      return METALINK_ERR_BAD_ALLOC;
+    }
+  }
+  free(opts->cache_dir);
+  opts->cache_dir = copy;
+  return 0;
+}
+
+size_t
+metalink_parse_options_get_threads(const metalink_parse_options_t *opts) {
+#ifdef HAVE_PTHREAD
+  long ncpu;
+  if (opts->threads > 0) {
+    return (size_t)opts->threads;
+  }
+#if defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#else  /* !HAVE_SYSCONF || !_SC_NPROCESSORS_ONLN */
+  ncpu = 1;
+#endif /* !HAVE_SYSCONF || !_SC_NPROCESSORS_ONLN */
+  return ncpu > 0 ? (size_t)ncpu : 1;
+#else  /* !HAVE_PTHREAD */
+  (void)opts;
+  return 1;
+#endif /* !HAVE_PTHREAD */
+}
+
+int metalink_parse_options_exceeds_max_size(
+    const metalink_parse_options_t *opts, size_t size) {
+  return opts->max_size != 0 && size > opts->max_size;
+}
+
+void metalink_parse_options_advise_fd(const metalink_parse_options_t *opts,
+                                      int fd) {
+#ifdef HAVE_POSIX_FADVISE
+  /* The advice is only a hint; failures (e.g., ESPIPE for pipes) are
+     harmless and ignored. */
+  if (opts->fadvise & METALINK_FADVISE_SEQUENTIAL) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  if (opts->fadvise & METALINK_FADVISE_NOREUSE) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+  }
+  switch (opts->readahead) {
+  case METALINK_READAHEAD_NONE:
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    break;
+  case METALINK_READAHEAD_WHOLE_FILE:
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    break;
+  default:
+    break;
+  }
+#else  /* !HAVE_POSIX_FADVISE */
+  (void)opts;
+  (void)fd;
+#endif /* !HAVE_POSIX_FADVISE */
+}
+
+void metalink_parse_options_release_fd(const metalink_parse_options_t *opts,
+                                       int fd) {
+#ifdef HAVE_POSIX_FADVISE
+  if (opts->fadvise & METALINK_FADVISE_DONTNEED) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+#else  /* !HAVE_POSIX_FADVISE */
+  (void)opts;
+  (void)fd;
+#endif /* !HAVE_POSIX_FADVISE */
+}
+
+void metalink_parse_options_advise_mmap(const metalink_parse_options_t *opts,
+                                        metalink_mmap_t *map) {
+#if defined(HAVE_MADVISE) && defined(HAVE_SYS_MMAN_H)
+  /* There is no madvise for NOREUSE, but MADV_SEQUENTIAL lets the
+     kernel free the pages soon after they are read, too. */
+  if (opts->fadvise &
+      (METALINK_FADVISE_SEQUENTIAL | METALINK_FADVISE_NOREUSE)) {
+    madvise(map->addr, map->length, MADV_SEQUENTIAL);
+  }
+  switch (opts->readahead) {
+  case METALINK_READAHEAD_NONE:
+    madvise(map->addr, map->length, MADV_RANDOM);
+    break;
+  case METALINK_READAHEAD_WHOLE_FILE:
+    madvise(map->addr, map->length, MADV_WILLNEED);
+    break;
+  default:
+    break;
+  }
+#else  /* !HAVE_MADVISE || !HAVE_SYS_MMAN_H */
+  (void)opts;
+  (void)map;
+#endif /* !HAVE_MADVISE || !HAVE_SYS_MMAN_H */
+}
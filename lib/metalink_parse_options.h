@@ -0,0 +1,117 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_PARSE_OPTIONS_H_
+#define _D_METALINK_PARSE_OPTIONS_H_
+
+#include "metalink_config.h"
+
+#include <metalink/metalink.h>
+
+#include "metalink_mmap.h"
+
+/* default value of read_size */
+#define METALINK_DEFAULT_READ_SIZE (64 * 1024)
+
+struct _metalink_parse_options {
+  /* the number of bytes read from a file at once */
+  size_t read_size;
+  /* bitwise OR of metalink_fadvise_t */
+  int fadvise;
+  metalink_readahead_t readahead;
+  /* maximum document size in bytes. 0 means no limit. */
+  size_t max_size;
+  /* nonzero if regular files are mapped into memory */
+  int use_mmap;
+  /* bitwise OR of metalink_field_t to leave out of the result */
+  int skip_fields;
+  /* called with each file entry instead of collecting it in
+     metalink_t */
+  metalink_file_callback file_callback;
+  void *file_callback_user_data;
+  /* nonzero if the resulting metalink_t is allocated from an arena */
+  int use_arena;
+  /* nonzero if piece hashes are only kept in the binary digest table */
+  int compact_pieces;
+  /* nonzero if a hash index of the files is built */
+  int index_files;
+  /* filled in by each parse if not NULL */
+  metalink_parse_stats_t *stats;
+  /* the number of threads parsing a document in memory; less than or
+     equal to 0 means one per online processor */
+  int threads;
+  /* the directory of the parse cache, or NULL. Owned by the
+     metalink_parse_options_t made by metalink_parse_options_new;
+     copies must not outlive it. */
+  char *cache_dir;
+};
+
+/* Initializes opts with the default values. */
+void metalink_parse_options_init(metalink_parse_options_t *opts);
+
+/*
+ * Returns opts if it is not NULL, otherwise returns the default
+ * options.
+ */
+const metalink_parse_options_t *
+metalink_parse_options_get(const metalink_parse_options_t *opts);
+
+/*
+ * Returns nonzero if a document of size bytes exceeds the size limit
+ * in opts.
+ */
+int metalink_parse_options_exceeds_max_size(
+    const metalink_parse_options_t *opts, size_t size);
+
+/*
+ * Gives the fadvise hints and the readahead policy in opts to the
+ * kernel before fd is read.
+ */
+void metalink_parse_options_advise_fd(const metalink_parse_options_t *opts,
+                                      int fd);
+
+/*
+ * Tells the kernel that the data of fd is no longer needed if opts
+ * says so. Call this after fd has been read.
+ */
+void metalink_parse_options_release_fd(const metalink_parse_options_t *opts,
+                                       int fd);
+
+/*
+ * Returns the number of threads opts asks for, which is the number of
+ * online processors if the threads option is less than or equal to 0,
+ * and 1 without thread support.
+ */
+size_t metalink_parse_options_get_threads(const metalink_parse_options_t *opts);
+
+/*
+ * Applies the fadvise hints and the readahead policy in opts to the
+ * mapped region map. METALINK_FADVISE_DONTNEED is left to
+ * metalink_parse_options_release_fd, called once map is unmapped.
+ */
+void metalink_parse_options_advise_mmap(const metalink_parse_options_t *opts,
+                                        metalink_mmap_t *map);
+
+#endif /* _D_METALINK_PARSE_OPTIONS_H_ */
@@ -0,0 +1,394 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_parse_parallel.h"
+
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include "metalink_arena.h"
+#include "metalink_parse_options.h"
+#include "metalink_parser_common.h"
+#include "metalink_parse_stats.h"
+
+/* Parts smaller than this are not worth a thread of their own. */
+#define MIN_SHARD_SIZE (64 * 1024)
+
+struct _shard_job;
+
+typedef struct _shard {
+  /* the file elements parsed by this shard */
+  const char *begin;
+  size_t length;
+  metalink_parser_context_t *ctx;
+  metalink_t *res;
+  metalink_error_t error;
+  metalink_parse_stats_t stats;
+  const struct _shard_job *job;
+} shard_t;
+
+typedef struct _shard_job {
+  /* the document before the first and after the last file element,
+     which every shard is parsed with */
+  const char *head;
+  size_t head_length;
+  const char *tail;
+  size_t tail_length;
+  shard_t *shards;
+  size_t count;
+} shard_job_t;
+
+static int is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int name_equals(const char *name, size_t length, const char *s) {
+  return strlen(s) == length && memcmp(name, s, length) == 0;
+}
+
+/*
+ * Finds the top-level file elements of the document buf of len bytes,
+ * i.e., the children of metalink in Metalink version 4 and of
+ * metalink/files in version 3, and splits them into at most
+ * max_shards runs of about the same size. Shard i begins at bounds[i]
+ * and ends at bounds[i + 1]; bounds must have room for max_shards + 1
+ * offsets. Returns the number of shards.
+ *
+ * This is not an XML parser: it only tracks the nesting of tags.
+ * Returns 0 if that may be mistaken, i.e., if the document has
+ * comments, CDATA sections, a document type declaration, prefixed
+ * names near the root, or other elements between the file elements,
+ * or if the document is not in an ASCII compatible encoding. Errors in
+ * the document are left to the XML parser.
+ */
+static size_t split_document(size_t *bounds, const char *buf, size_t len,
+                             size_t max_shards) {
+  const char *p = buf, *end = buf + len, *name, *q;
+  size_t name_length, depth = 0, count = 0, offset;
+  /* the depth of the parent of the file elements, 0 until the first
+     one is seen */
+  size_t container = 0;
+  /* nonzero while metalink/files is open */
+  int files_open = 0;
+  /* nonzero while a file element is open */
+  int file_open = 0;
+  /* nonzero once an element other than file follows a file element,
+     or once the parent of the file elements is closed */
+  int files_end = 0;
+  int is_file, empty;
+  char quote;
+
+  /* UTF-16 documents start with a byte order mark or a zero byte. */
+  if (len < 2 || buf[0] == '\0' || buf[1] == '\0' ||
+      (unsigned char)buf[0] >= 0xfe) {
+    return 0;
+  }
+  while ((p = memchr(p, '<', (size_t)(end - p))) != NULL) {
+    if (end - p < 2 || p[1] == '!') {
+      return 0;
+    }
+    if (p[1] == '?') {
+      /* processing instruction */
+      for (q = p + 2; q + 1 < end && (q[0] != '?' || q[1] != '>'); ++q)
+        ;
+      if (q + 1 >= end) {
+        return 0;
+      }
+      p = q + 2;
+      continue;
+    }
+    if (p[1] == '/') {
+      q = memchr(p, '>', (size_t)(end - p));
+      if (!q || depth == 0) {
+        return 0;
+      }
+      if (container && depth == container + 1 && file_open) {
+        file_open = 0;
+        bounds[count + 1] = (size_t)(q + 1 - buf);
+      } else if (container && depth == container) {
+        files_end = 1;
+      }
+      if (depth == 2) {
+        files_open = 0;
+      }
+      --depth;
+      p = q + 1;
+      continue;
+    }
+    name = p + 1;
+    for (q = name; q < end && !is_space(*q) && *q != '/' && *q != '>'; ++q)
+      ;
+    name_length = (size_t)(q - name);
+    /* skip the attributes, whose values may contain '>' */
+    for (quote = 0; q < end; ++q) {
+      if (quote) {
+        if (*q == quote) {
+          quote = 0;
+        }
+      } else if (*q == '"' || *q == '\'') {
+        quote = *q;
+      } else if (*q == '>') {
+        break;
+      }
+    }
+    if (q == end) {
+      return 0;
+    }
+    empty = q[-1] == '/';
+    /* A prefix could bind any namespace. */
+    if (depth < 3 && memchr(name, ':', name_length)) {
+      return 0;
+    }
+    if (depth == 0 && !name_equals(name, name_length, "metalink")) {
+      return 0;
+    }
+    if (depth == 1 && !empty && name_equals(name, name_length, "files")) {
+      files_open = 1;
+    }
+    is_file = name_equals(name, name_length, "file") &&
+              (depth == 1 || (depth == 2 && files_open));
+    offset = (size_t)(p - buf);
+    if (is_file) {
+      if (!container) {
+        container = depth;
+        bounds[0] = offset;
+      } else if (depth != container || files_end) {
+        return 0;
+      } else if (count + 1 < max_shards &&
+                 offset - bounds[0] >=
+                     (count + 1) * ((len - bounds[0]) / max_shards)) {
+        bounds[++count] = offset;
+      }
+      file_open = !empty;
+      if (empty) {
+        bounds[count + 1] = (size_t)(q + 1 - buf);
+      }
+    } else if (container && depth == container) {
+      files_end = 1;
+    }
+    if (!empty) {
+      ++depth;
+    }
+    p = q + 1;
+  }
+  if (!container || depth != 0) {
+    return 0;
+  }
+  return count + 1;
+}
+
+static void parse_shard(shard_t *shard) {
+  const shard_job_t *job = shard->job;
+  metalink_error_t r;
+
+  r = metalink_feed_buffer(shard->ctx, job->head, job->head_length);
+  if (r == 0) {
+    r = metalink_feed_buffer(shard->ctx, shard->begin, shard->length);
+  }
+  if (r == 0) {
+    r = metalink_parse_finish(shard->ctx, job->tail, job->tail_length,
+                              &shard->res);
+  }
+  shard->error = r;
+}
+
+#ifdef HAVE_PTHREAD
+static void *shard_worker(void *arg) {
+  parse_shard(arg);
+  return NULL;
+}
+#endif /* HAVE_PTHREAD */
+
+/* Parses the shards of job, the first one on the calling thread. */
+static void run_shards(shard_job_t *job) {
+  size_t i, started = 1;
+#ifdef HAVE_PTHREAD
+  pthread_t *threads;
+
+  threads = malloc(sizeof(pthread_t) * job->count);
+  if (threads) {
+    for (; started < job->count; ++started) {
+      if (pthread_create(&threads[started], NULL, shard_worker,
+                         &job->shards[started]) != 0) {
+        break;
+      }
+    }
+  }
+#endif /* HAVE_PTHREAD */
+  parse_shard(&job->shards[0]);
+  /* if a thread cannot be created, its shard is parsed here */
+  for (i = started; i < job->count; ++i) {
+    parse_shard(&job->shards[i]);
+  }
+#ifdef HAVE_PTHREAD
+  for (i = 1; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+#endif /* HAVE_PTHREAD */
+}
+
+/*
+ * Moves the files of all shards into the metalink_t of the first one,
+ * in document order, and deletes the others.
+ */
+static metalink_error_t join_shards(shard_job_t *job,
+                                    const metalink_parse_options_t *opts) {
+  metalink_t *metalink = job->shards[0].res, *part;
+  metalink_file_t **files = NULL, **filepp, **src;
+  size_t count = 0, size, i;
+
+  for (i = 0; i < job->count; ++i) {
+    for (src = job->shards[i].res->files; src && *src; ++src) {
+      ++count;
+    }
+  }
+  if (count) {
+    size = (count + 1) * sizeof(metalink_file_t *);
+    if (metalink->arena) {
+      files = metalink_arena_calloc(metalink->arena, size);
+    } else {
+      files = malloc(size);
+    }
+    if (!files) {
+      return METALINK_ERR_BAD_ALLOC;
+    }
+    metalink_parse_stats_count_allocation(opts->stats, METALINK_OBJECT_ARRAY,
+                                          size);
+  }
+  filepp = files;
+  for (i = 0; i < job->count; ++i) {
+    part = job->shards[i].res;
+    for (src = part->files; src && *src; ++src) {
+      *filepp++ = *src;
+    }
+    if (!part->arena) {
+      free(part->files);
+    }
+    part->files = NULL;
+    if (i > 0) {
+      if (metalink->arena) {
+        /* part itself lives in its arena. */
+        metalink_arena_adopt(metalink->arena, part->arena);
+      } else {
+        metalink_delete(part);
+      }
+      job->shards[i].res = NULL;
+    }
+  }
+  if (files) {
+    *filepp = NULL;
+  }
+  metalink->files = files;
+  if (opts->index_files) {
+    return metalink_index_files(metalink);
+  }
+  return 0;
+}
+
+int metalink_parse_parallel(metalink_error_t *r, const char *buf, size_t len,
+                            metalink_t **res,
+                            const metalink_parse_options_t *opts) {
+  metalink_parse_options_t shard_opts;
+  metalink_stats_timer_t timer;
+  shard_job_t job;
+  size_t *bounds = NULL;
+  size_t max_shards, i;
+  int rv = -1;
+
+  max_shards = metalink_parse_options_get_threads(opts);
+  if (max_shards > len / MIN_SHARD_SIZE) {
+    max_shards = len / MIN_SHARD_SIZE;
+  }
+  if (max_shards < 2 || opts->file_callback) {
+    return -1;
+  }
+
+  memset(&job, 0, sizeof(job));
+  metalink_parse_stats_clear(opts->stats);
+  metalink_parse_stats_start(opts->stats, &timer);
+  bounds = malloc(sizeof(size_t) * (max_shards + 1));
+  if (bounds) {
+    job.count = split_document(bounds, buf, len, max_shards);
+  }
+  metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_XML);
+  if (job.count < 2) {
+    goto PARALLEL_END;
+  }
+  job.shards = calloc(job.count, sizeof(shard_t));
+  if (!job.shards) {
+    goto PARALLEL_END;
+  }
+  job.head = buf;
+  job.head_length = bounds[0];
+  job.tail = buf + bounds[job.count];
+  job.tail_length = len - bounds[job.count];
+
+  /* The parser contexts are created here rather than on the threads,
+     so that the XML parser is initialized on the calling thread. */
+  shard_opts = *opts;
+  shard_opts.threads = 1;
+  shard_opts.index_files = 0;
+  for (i = 0; i < job.count; ++i) {
+    job.shards[i].job = &job;
+    job.shards[i].begin = buf + bounds[i];
+    job.shards[i].length = bounds[i + 1] - bounds[i];
+    shard_opts.stats = opts->stats ? &job.shards[i].stats : NULL;
+    job.shards[i].ctx = metalink_parser_context_new_ex(&shard_opts);
+    if (!job.shards[i].ctx) {
+      goto PARALLEL_END;
+    }
+  }
+
+  run_shards(&job);
+
+  for (i = 0; i < job.count; ++i) {
+    if (job.shards[i].error != 0) {
+      /* The document is parsed again serially for the error to be the
+         same. */
+      goto PARALLEL_END;
+    }
+    metalink_parse_stats_add(opts->stats, &job.shards[i].stats);
+  }
+  metalink_parse_stats_start(opts->stats, &timer);
+  *r = join_shards(&job, opts);
+  metalink_parse_stats_stop(opts->stats, &timer, METALINK_STATS_PSTATE);
+  if (*r == 0) {
+    *res = job.shards[0].res;
+    job.shards[0].res = NULL;
+  }
+  rv = 0;
+
+PARALLEL_END:
+  for (i = 0; job.shards && i < job.count; ++i) {
+    metalink_parser_context_delete(job.shards[i].ctx);
+    metalink_delete(job.shards[i].res);
+  }
+  free(job.shards);
+  free(bounds);
+  return rv;
+}
@@ -0,0 +1,52 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_PARSE_PARALLEL_H_
+#define _D_METALINK_PARSE_PARALLEL_H_
+
+#include "metalink_config.h"
+
+#include <metalink/metalink.h>
+
+/*
+ * Parses the document buf of len bytes on the threads configured in
+ * opts. The document is split before its top-level file elements, and
+ * each part is parsed with the elements around the files, i.e., as a
+ * complete document of its own, by a parser context of its own. The
+ * files are then joined in document order.
+ *
+ * Returns 0 if the document was parsed this way. Then *r is the
+ * result of the parse and, if it is 0, *res is the resulting
+ * metalink_t. Returns -1 and leaves *r and *res untouched if the
+ * document is to be parsed serially: if opts asks for one thread, a
+ * file callback is set, the document is too small or cannot be split
+ * safely, or a part of it fails to parse, so that the error is the
+ * same as with a serial parse.
+ */
+int metalink_parse_parallel(metalink_error_t *r, const char *buf, size_t len,
+                            metalink_t **res,
+                            const metalink_parse_options_t *opts);
+
+#endif /* _D_METALINK_PARSE_PARALLEL_H_ */
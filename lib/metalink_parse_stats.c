@@ -0,0 +1,171 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_parse_stats.h"
+
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#endif /* HAVE_GETTIMEOFDAY */
+
+#include "metalink_pstate.h"
+
+/* indexed by metalink_token, followed by unknown elements */
+static const char *element_names[] = {
+    "copyright", "description", "file",         "files",    "generator",
+    "hash",      "identity",    "language",     "logo",     "metalink",
+    "metaurl",   "origin",      "os",           "pieces",   "published",
+    "publisher", "resources",   "signature",    "size",     "tags",
+    "updated",   "url",         "verification", "version",  "(other)"};
+
+/* indexed by metalink_object_type_t */
+static const char *object_type_names[] = {
+    "metalink",       "file",       "resource",  "metaurl", "checksum",
+    "chunk checksum", "piece hash", "signature", "string",  "array"};
+
+const char METALINK_PUBLIC *metalink_parse_stats_element_name(size_t index) {
+  if (index >= sizeof(element_names) / sizeof(element_names[0])) {
+    return NULL;
+  }
+  return element_names[index];
+}
+
+const char METALINK_PUBLIC *
+metalink_object_type_name(metalink_object_type_t type) {
+  if ((size_t)type >=
+      sizeof(object_type_names) / sizeof(object_type_names[0])) {
+    return NULL;
+  }
+  return object_type_names[type];
+}
+
+unsigned long long metalink_parse_stats_clock(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  }
+#endif /* HAVE_CLOCK_GETTIME && CLOCK_MONOTONIC */
+#ifdef HAVE_GETTIMEOFDAY
+  {
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) == 0) {
+      return (unsigned long long)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+    }
+  }
+#endif /* HAVE_GETTIMEOFDAY */
+  return 0;
+}
+
+void metalink_parse_stats_clear(metalink_parse_stats_t *stats) {
+  if (stats) {
+    memset(stats, 0, sizeof(*stats));
+  }
+}
+
+void metalink_parse_stats_start(const metalink_parse_stats_t *stats,
+                                metalink_stats_timer_t *timer) {
+  if (stats) {
+    timer->start = metalink_parse_stats_clock();
+    timer->pstate_ns = stats->pstate_ns;
+  }
+}
+
+unsigned long long
+metalink_parse_stats_elapsed(const metalink_parse_stats_t *stats,
+                             const metalink_stats_timer_t *timer) {
+  if (!stats) {
+    return 0;
+  }
+  return metalink_parse_stats_clock() - timer->start;
+}
+
+void metalink_parse_stats_stop(metalink_parse_stats_t *stats,
+                               const metalink_stats_timer_t *timer,
+                               metalink_stats_phase_t phase) {
+  unsigned long long elapsed, handlers;
+
+  if (!stats) {
+    return;
+  }
+  elapsed = metalink_parse_stats_elapsed(stats, timer);
+  switch (phase) {
+  case METALINK_STATS_IO:
+    stats->io_ns += elapsed;
+    break;
+  case METALINK_STATS_XML:
+    handlers = stats->pstate_ns - timer->pstate_ns;
+    /* gettimeofday may go backwards */
+    stats->xml_ns += handlers < elapsed ? elapsed - handlers : 0;
+    break;
+  case METALINK_STATS_PSTATE:
+    stats->pstate_ns += elapsed;
+    break;
+  }
+}
+
+void metalink_parse_stats_count_element(metalink_parse_stats_t *stats,
+                                        int name) {
+  if (stats) {
+    if (name < 0 || name >= METALINK_PARSE_STATS_ELEMENTS - 1) {
+      name = METALINK_PARSE_STATS_ELEMENTS - 1;
+    }
+    ++stats->elements[name];
+  }
+}
+
+void metalink_parse_stats_count_allocation(metalink_parse_stats_t *stats,
+                                           metalink_object_type_t type,
+                                           size_t size) {
+  if (stats) {
+    ++stats->allocations[type];
+    stats->allocated_bytes[type] += size;
+  }
+}
+
+void metalink_parse_stats_add(metalink_parse_stats_t *stats,
+                              const metalink_parse_stats_t *src) {
+  size_t i;
+
+  if (!stats) {
+    return;
+  }
+  stats->input_bytes += src->input_bytes;
+  for (i = 0; i < METALINK_PARSE_STATS_ELEMENTS; ++i) {
+    stats->elements[i] += src->elements[i];
+  }
+  stats->skipped_elements += src->skipped_elements;
+  stats->text_bytes += src->text_bytes;
+  for (i = 0; i < METALINK_OBJECT_MAX; ++i) {
+    stats->allocations[i] += src->allocations[i];
+    stats->allocated_bytes[i] += src->allocated_bytes[i];
+  }
+  stats->io_ns += src->io_ns;
+  stats->xml_ns += src->xml_ns;
+  stats->pstate_ns += src->pstate_ns;
+}
@@ -0,0 +1,97 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_PARSE_STATS_H_
+#define _D_METALINK_PARSE_STATS_H_
+
+#include "metalink_config.h"
+
+#include <metalink/metalink.h>
+
+/*
+ * Helpers filling in metalink_parse_stats_t. They all accept NULL
+ * stats and do nothing then, so that callers need not check whether
+ * statistics are collected.
+ */
+
+/* The parts of the work whose wall time is measured. */
+typedef enum {
+  METALINK_STATS_IO,
+  METALINK_STATS_XML,
+  METALINK_STATS_PSTATE
+} metalink_stats_phase_t;
+
+typedef struct _metalink_stats_timer {
+  /* the clock when the timer was started */
+  unsigned long long start;
+  /* pstate_ns at that time, to exclude the element handlers called
+     back by the XML parser from xml_ns */
+  unsigned long long pstate_ns;
+} metalink_stats_timer_t;
+
+/*
+ * Returns a monotonic clock in nanoseconds, or 0 if no clock is
+ * available.
+ */
+unsigned long long metalink_parse_stats_clock(void);
+
+/* Clears stats for the next document. */
+void metalink_parse_stats_clear(metalink_parse_stats_t *stats);
+
+/* Starts timer for stats. */
+void metalink_parse_stats_start(const metalink_parse_stats_t *stats,
+                                metalink_stats_timer_t *timer);
+
+/*
+ * Returns the nanoseconds elapsed since timer was started, or 0 if
+ * stats is NULL.
+ */
+unsigned long long
+metalink_parse_stats_elapsed(const metalink_parse_stats_t *stats,
+                             const metalink_stats_timer_t *timer);
+
+/*
+ * Adds the time since timer was started to phase. For
+ * METALINK_STATS_XML, the time spent in the element handlers meanwhile
+ * is left out, as it is already counted as METALINK_STATS_PSTATE.
+ */
+void metalink_parse_stats_stop(metalink_parse_stats_t *stats,
+                               const metalink_stats_timer_t *timer,
+                               metalink_stats_phase_t phase);
+
+/* Counts an element, where name is a metalink_token or -1. */
+void metalink_parse_stats_count_element(metalink_parse_stats_t *stats,
+                                        int name);
+
+/* Counts an object of size bytes allocated for the result. */
+void metalink_parse_stats_count_allocation(metalink_parse_stats_t *stats,
+                                           metalink_object_type_t type,
+                                           size_t size);
+
+/* Adds the counts and times of src to stats. */
+void metalink_parse_stats_add(metalink_parse_stats_t *stats,
+                              const metalink_parse_stats_t *src);
+
+#endif /* _D_METALINK_PARSE_STATS_H_ */
@@ -24,7 +24,13 @@
  */
 /* copyright --> */
 #include "metalink_parser_common.h"
+
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+
 #include "metalink_pctrl.h"
+#include "metalink_parse_stats.h"
 
 metalink_error_t
 metalink_handle_parse_result(metalink_t **res,
@@ -35,11 +41,68 @@ metalink_handle_parse_result(metalink_t **res,
     *res = metalink_pctrl_detach_metalink(session_data->stm->ctrl);
   }
 
-  if (parser_retval != 0) {
+  /* The XML parser is stopped once pctrl fails, so its error, if any,
+     is what stopped it. */
+  retval = metalink_pctrl_get_error(session_data->stm->ctrl);
+  if (retval == 0 && parser_retval != 0) {
     /* TODO more detailed error handling for parser is desired. */
     retval = METALINK_ERR_PARSER_ERROR;
-  } else {
-    retval = metalink_pctrl_get_error(session_data->stm->ctrl);
   }
   return retval;
 }
+
+metalink_error_t metalink_read_chunk(int fd, char *buf, size_t *num_read,
+                                     size_t *total,
+                                     const metalink_parse_options_t *opts,
+                                     metalink_parse_stats_t *stats) {
+  metalink_stats_timer_t timer;
+  ssize_t len;
+
+  metalink_parse_stats_start(stats, &timer);
+  while ((len = read(fd, buf, opts->read_size)) == -1 && errno == EINTR)
+    ;
+  metalink_parse_stats_stop(stats, &timer, METALINK_STATS_IO);
+  *num_read = 0;
+  if (len == -1) {
+    return METALINK_ERR_PARSER_ERROR;
+  }
+  *num_read = (size_t)len;
+  *total += (size_t)len;
+  if (metalink_parse_options_exceeds_max_size(opts, *total)) {
+    return METALINK_ERR_DOCUMENT_TOO_LARGE;
+  }
+  return 0;
+}
+
+metalink_error_t metalink_feed_fd(metalink_parser_context_t *ctx, int fd,
+                                  char *buf,
+                                  const metalink_parse_options_t *opts,
+                                  metalink_parse_stats_t *stats) {
+  metalink_error_t r;
+  size_t num_read;
+  size_t total = 0;
+
+  metalink_parse_options_advise_fd(opts, fd);
+  while ((r = metalink_read_chunk(fd, buf, &num_read, &total, opts,
+                                  stats)) == 0 &&
+         num_read > 0) {
+    r = metalink_parse_update(ctx, buf, num_read);
+    if (r != 0) {
+      break;
+    }
+  }
+  metalink_parse_options_release_fd(opts, fd);
+  return r;
+}
+
+metalink_error_t metalink_feed_buffer(metalink_parser_context_t *ctx,
+                                      const char *buf, size_t len) {
+  metalink_error_t r;
+  for (; len > INT_MAX; buf += INT_MAX, len -= INT_MAX) {
+    r = metalink_parse_update(ctx, buf, INT_MAX);
+    if (r != 0) {
+      return r;
+    }
+  }
+  return metalink_parse_update(ctx, buf, len);
+}
@@ -31,6 +31,7 @@
 #include <metalink/metalink.h>
 
 #include "metalink_session_data.h"
+#include "metalink_parse_options.h"
 
 /*
  * See session_data and parser_retval which is a return value of parser object
@@ -50,4 +51,38 @@ metalink_handle_parse_result(metalink_t **res,
                              metalink_session_data_t *session_data,
                              metalink_error_t parser_retval);
 
+/*
+ * Reads at most opts->read_size bytes of fd into buf and stores their
+ * number in *num_read, which is 0 at the end of file. *total is the
+ * number of bytes of the document read so far and is updated. The
+ * time spent is counted in stats, which may be NULL.
+ * @return 0 for success, METALINK_ERR_PARSER_ERROR if read fails, or
+ *  METALINK_ERR_DOCUMENT_TOO_LARGE if *total exceeds opts->max_size.
+ */
+metalink_error_t metalink_read_chunk(int fd, char *buf, size_t *num_read,
+                                     size_t *total,
+                                     const metalink_parse_options_t *opts,
+                                     metalink_parse_stats_t *stats);
+
+/*
+ * Reads fd up to the end of file through buf, which must hold
+ * opts->read_size bytes, and feeds it to ctx with
+ * metalink_parse_update. The caller finishes the parse. The fadvise
+ * hints in opts are given for fd, and the time spent reading is
+ * counted in stats, which may be NULL.
+ * @return 0 for success, otherwise the error of metalink_read_chunk
+ *  or metalink_parse_update.
+ */
+metalink_error_t metalink_feed_fd(metalink_parser_context_t *ctx, int fd,
+                                  char *buf,
+                                  const metalink_parse_options_t *opts,
+                                  metalink_parse_stats_t *stats);
+
+/*
+ * Feeds len bytes of buf to ctx with metalink_parse_update, in pieces
+ * the XML parsers can take.
+ */
+metalink_error_t metalink_feed_buffer(metalink_parser_context_t *ctx,
+                                      const char *buf, size_t len);
+
 #endif /* _D_METALINK_PARSER_COMMON_H_ */
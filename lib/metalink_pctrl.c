@@ -27,6 +27,193 @@
 
 #include <string.h>
 
+#include "metalink_helper.h"
+#include "metalink_parse_stats.h"
+
+/* the longest digest supported in the piece digest table (sha-512) */
+#define MAX_PIECE_DIGEST_LENGTH 64
+
+/*
+ * Allocates size bytes of zero-filled memory for an object of the given
+ * type which becomes part of ctrl->metalink. In arena mode, the memory
+ * comes from ctrl->arena and must not be freed individually.
+ */
+static void *pctrl_calloc(metalink_pctrl_t *ctrl, metalink_object_type_t type,
+                          size_t size) {
+  void *p;
+
+  if (ctrl->arena) {
+    p = metalink_arena_calloc(ctrl->arena, size);
+  } else {
+    p = calloc(1, size);
+  }
+  if (p) {
+    metalink_parse_stats_count_allocation(ctrl->options.stats, type, size);
+  }
+  return p;
+}
+
+/*
+ * Copies src to *dest, replacing the old value. src may be NULL. In
+ * arena mode, the old value is simply abandoned.
+ */
+static metalink_error_t copy_string(metalink_pctrl_t *ctrl, char **dest,
+                                    const char *src) {
+  if (!ctrl->arena) {
+    free(*dest);
+  }
+  if (!src) {
+    *dest = NULL;
+    return 0;
+  }
+  if (ctrl->arena) {
+    *dest = metalink_arena_strdup(ctrl->arena, src);
+  } else {
+    *dest = strdup(src);
+  }
+  if (!*dest) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  metalink_parse_stats_count_allocation(
+      ctrl->options.stats, METALINK_OBJECT_STRING, strlen(src) + 1);
+  return 0;
+}
+
+/*
+ * Stores src, which is allocated for ctrl, in *dest, replacing the old
+ * value. src is consumed. Returns METALINK_ERR_BAD_ALLOC if src is NULL,
+ * so that the result of a failed allocation can be passed as is.
+ */
+static metalink_error_t take_string(metalink_pctrl_t *ctrl, char **dest,
+                                    char *src) {
+  if (!src) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  if (!ctrl->arena) {
+    free(*dest);
+  }
+  *dest = src;
+  return 0;
+}
+
+char *metalink_pctrl_strdup(metalink_pctrl_t *ctrl, const char *str) {
+  metalink_parse_stats_count_allocation(
+      ctrl->options.stats, METALINK_OBJECT_STRING, strlen(str) + 1);
+  if (ctrl->arena) {
+    return metalink_arena_strdup(ctrl->arena, str);
+  }
+  return strdup(str);
+}
+
+int metalink_pctrl_use_arena(const metalink_pctrl_t *ctrl) {
+  return ctrl->arena != NULL;
+}
+
+int metalink_pctrl_compact_pieces(const metalink_pctrl_t *ctrl) {
+  return ctrl->options.compact_pieces;
+}
+
+/*
+ * Creates an empty ctrl->metalink. If arena mode is requested, a new
+ * arena is created and is owned by the metalink_t allocated from it.
+ */
+static metalink_error_t pctrl_new_metalink(metalink_pctrl_t *ctrl) {
+  metalink_arena_t *arena;
+
+  ctrl->arena = NULL;
+  metalink_parse_stats_count_allocation(
+      ctrl->options.stats, METALINK_OBJECT_METALINK, sizeof(metalink_t));
+  /* The file callback takes ownership of each file entry, which
+     cannot be given away from an arena. */
+  if (!ctrl->options.use_arena || ctrl->options.file_callback) {
+    ctrl->metalink = metalink_new();
+    return ctrl->metalink ? 0 : METALINK_ERR_BAD_ALLOC;
+  }
+  arena = metalink_arena_new();
+  if (!arena) {
+    ctrl->metalink = NULL;
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  ctrl->metalink = metalink_arena_calloc(arena, sizeof(metalink_t));
+  if (!ctrl->metalink) {
+    metalink_arena_delete(arena);
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  ctrl->metalink->arena = arena;
+  ctrl->arena = arena;
+  return 0;
+}
+
+/*
+ * Clears list. The objects in it are freed by delete_fun unless they
+ * are allocated from the arena.
+ */
+static void clear_object_list(metalink_pctrl_t *ctrl, metalink_list_t *list,
+                              void (*delete_fun)(void *)) {
+  if (!list) {
+    return;
+  }
+  if (!ctrl->arena) {
+    metalink_list_for_each(list, delete_fun);
+  }
+  metalink_list_clear(list);
+}
+
+/* Clears list of strings. See clear_object_list. */
+static void clear_string_list(metalink_pctrl_t *ctrl, metalink_list_t *list) {
+  if (!list) {
+    return;
+  }
+  if (ctrl->arena) {
+    metalink_list_clear(list);
+  } else {
+    metalink_list_clear_data(list);
+  }
+}
+
+/*
+ * Frees all objects which are built but not yet attached to
+ * ctrl->metalink, and empties the lists.
+ */
+static void release_objects(metalink_pctrl_t *ctrl) {
+  clear_object_list(ctrl, ctrl->files,
+                    (void (*)(void *)) & metalink_file_delete);
+  /* Strings in these lists belong to the lists until the file
+     transaction is committed. */
+  clear_string_list(ctrl, ctrl->languages);
+  clear_string_list(ctrl, ctrl->oses);
+  clear_object_list(ctrl, ctrl->resources,
+                    (void (*)(void *)) & metalink_resource_delete);
+  clear_object_list(ctrl, ctrl->metaurls,
+                    (void (*)(void *)) & metalink_metaurl_delete);
+  clear_object_list(ctrl, ctrl->checksums,
+                    (void (*)(void *)) & metalink_checksum_delete);
+  clear_object_list(ctrl, ctrl->piece_hashes,
+                    (void (*)(void *)) & metalink_piece_hash_delete);
+
+  if (!ctrl->arena) {
+    metalink_file_delete(ctrl->temp_file);
+    metalink_resource_delete(ctrl->temp_resource);
+    metalink_metaurl_delete(ctrl->temp_metaurl);
+    metalink_checksum_delete(ctrl->temp_checksum);
+    metalink_chunk_checksum_delete(ctrl->temp_chunk_checksum);
+    metalink_piece_hash_delete(ctrl->temp_piece_hash);
+    metalink_signature_delete(ctrl->temp_signature);
+  }
+  ctrl->temp_file = NULL;
+  ctrl->temp_resource = NULL;
+  ctrl->temp_metaurl = NULL;
+  ctrl->temp_checksum = NULL;
+  ctrl->temp_chunk_checksum = NULL;
+  ctrl->temp_piece_hash = NULL;
+  ctrl->temp_signature = NULL;
+
+  if (ctrl->piece_digests) {
+    metalink_string_buffer_clear(ctrl->piece_digests);
+  }
+  ctrl->piece_index_count = 0;
+}
+
 metalink_pctrl_t *new_metalink_pctrl(void) {
   metalink_pctrl_t *ctrl;
   ctrl = malloc(sizeof(metalink_pctrl_t));
@@ -34,8 +221,8 @@ metalink_pctrl_t *new_metalink_pctrl(void) {
     return NULL;
   }
   memset(ctrl, 0, sizeof(metalink_pctrl_t));
-  ctrl->metalink = metalink_new();
-  if (!ctrl->metalink) {
+  metalink_parse_options_init(&ctrl->options);
+  if (pctrl_new_metalink(ctrl) != 0) {
     goto NEW_METALINK_PCTRL_ERROR;
   }
   ctrl->files = metalink_list_new();
@@ -66,56 +253,75 @@ metalink_pctrl_t *new_metalink_pctrl(void) {
   if (!ctrl->piece_hashes) {
     goto NEW_METALINK_PCTRL_ERROR;
   }
+  ctrl->piece_digests = metalink_string_buffer_new(0);
+  if (!ctrl->piece_digests) {
+    goto NEW_METALINK_PCTRL_ERROR;
+  }
   return ctrl;
 NEW_METALINK_PCTRL_ERROR:
   delete_metalink_pctrl(ctrl);
   return NULL;
 }
 
+static void delete_list(metalink_list_t *list) {
+  if (list) {
+    metalink_list_delete(list);
+  }
+}
+
 void delete_metalink_pctrl(metalink_pctrl_t *ctrl) {
   if (!ctrl) {
     return;
   }
+  release_objects(ctrl);
+
+  delete_list(ctrl->files);
+  delete_list(ctrl->languages);
+  delete_list(ctrl->oses);
+  delete_list(ctrl->resources);
+  delete_list(ctrl->metaurls);
+  delete_list(ctrl->checksums);
+  delete_list(ctrl->piece_hashes);
+  metalink_string_buffer_delete(ctrl->piece_digests);
+  free(ctrl->piece_indices);
+
+  /* In arena mode, this also releases everything allocated above. */
   metalink_delete(ctrl->metalink);
 
-  metalink_list_for_each(ctrl->files,
-                         (void (*)(void *)) & metalink_file_delete);
-  metalink_list_delete(ctrl->files);
-  metalink_file_delete(ctrl->temp_file);
-
-  /* metalink_list_delete takes care of freeing the pointers in those lists */
-  metalink_list_delete(ctrl->languages);
-  metalink_list_delete(ctrl->oses);
-
-  metalink_list_for_each(ctrl->resources,
-                         (void (*)(void *)) & metalink_resource_delete);
-  metalink_list_delete(ctrl->resources);
-  metalink_resource_delete(ctrl->temp_resource);
-
-  metalink_list_for_each(ctrl->metaurls,
-                         (void (*)(void *)) & metalink_metaurl_delete);
-  metalink_list_delete(ctrl->metaurls);
-  metalink_metaurl_delete(ctrl->temp_metaurl);
-
-  metalink_list_for_each(ctrl->checksums,
-                         (void (*)(void *)) & metalink_checksum_delete);
-  metalink_list_delete(ctrl->checksums);
-  metalink_checksum_delete(ctrl->temp_checksum);
-
-  metalink_chunk_checksum_delete(ctrl->temp_chunk_checksum);
-
-  metalink_list_for_each(ctrl->piece_hashes,
-                         (void (*)(void *)) & metalink_piece_hash_delete);
-  metalink_list_delete(ctrl->piece_hashes);
-  metalink_piece_hash_delete(ctrl->temp_piece_hash);
+  free(ctrl);
+}
 
-  metalink_signature_delete(ctrl->temp_signature);
+metalink_error_t metalink_pctrl_reset(metalink_pctrl_t *ctrl) {
+  release_objects(ctrl);
+  metalink_delete(ctrl->metalink);
+  ctrl->error = 0;
+  metalink_parse_stats_clear(ctrl->options.stats);
+  return pctrl_new_metalink(ctrl);
+}
 
-  free(ctrl);
+metalink_error_t
+metalink_pctrl_set_options(metalink_pctrl_t *ctrl,
+                           const metalink_parse_options_t *opts) {
+  ctrl->options = *metalink_parse_options_get(opts);
+  /* Parser contexts do not use the cache, and opts may go first. */
+  ctrl->options.cache_dir = NULL;
+  if (!ctrl->options.use_arena && !ctrl->arena && !ctrl->options.stats) {
+    return 0;
+  }
+  /* Nothing has been parsed yet, so the empty metalink_t can be
+     replaced with one matching the allocation mode, and counted in the
+     statistics. */
+  return metalink_pctrl_reset(ctrl);
 }
 
 metalink_t *metalink_pctrl_detach_metalink(metalink_pctrl_t *ctrl) {
   metalink_t *metalink;
+  /* The objects left unfinished by an aborted parse must be released
+     before the arena is handed over with metalink. */
+  if (ctrl->arena) {
+    release_objects(ctrl);
+    ctrl->arena = NULL;
+  }
   metalink = ctrl->metalink;
   ctrl->metalink = NULL;
   return metalink;
@@ -129,60 +335,66 @@ metalink_error_t metalink_pctrl_get_error(metalink_pctrl_t *ctrl) {
   return ctrl->error;
 }
 
-metalink_error_t
-metalink_pctrl_metalink_accumulate_files(metalink_pctrl_t *ctrl) {
-  size_t files_length;
-  files_length = metalink_list_length(ctrl->files);
-  if (files_length) {
-    ctrl->metalink->files = calloc(files_length + 1, sizeof(metalink_file_t *));
-    if (!ctrl->metalink->files) {
-      return METALINK_ERR_BAD_ALLOC;
+/*
+ * Moves the elements of src to a NULL terminated array *array_ptr and
+ * clears src. *array_ptr is left untouched if src is empty.
+ */
+static metalink_error_t commit_list_to_array(metalink_pctrl_t *ctrl,
+                                             void ***array_ptr,
+                                             metalink_list_t *src,
+                                             size_t ele_size) {
+  size_t size;
+  size = metalink_list_length(src);
+  if (!size) {
+    return 0;
+  }
+  if (!ctrl->arena) {
+    /* The storage of src becomes the array. */
+    *array_ptr = metalink_list_release_array(src);
+  } else {
+    *array_ptr = metalink_arena_calloc(ctrl->arena, (size + 1) * ele_size);
+    if (*array_ptr) {
+      metalink_list_to_array(src, *array_ptr);
+      (*array_ptr)[size] = NULL;
+      metalink_list_clear(src);
     }
-    metalink_list_to_array(ctrl->files, (void **)ctrl->metalink->files);
-    ctrl->metalink->files[files_length] = NULL;
-
-    metalink_list_clear(ctrl->files);
   }
+  if (!*array_ptr) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  metalink_parse_stats_count_allocation(
+      ctrl->options.stats, METALINK_OBJECT_ARRAY, (size + 1) * ele_size);
   return 0;
 }
 
-static metalink_error_t
-commit_list_to_array(void ***array_ptr, metalink_list_t *src, size_t ele_size) {
-  size_t size;
-  size = metalink_list_length(src);
-  if (size) {
-    *array_ptr = calloc(size + 1, ele_size);
-    if (!*array_ptr) {
-      return METALINK_ERR_BAD_ALLOC;
-    }
-    metalink_list_to_array(src, *array_ptr);
-    (*array_ptr)[size] = NULL;
-    metalink_list_clear(src);
+metalink_error_t
+metalink_pctrl_metalink_accumulate_files(metalink_pctrl_t *ctrl) {
+  metalink_error_t r;
+  r = commit_list_to_array(ctrl, (void *)&ctrl->metalink->files,
+                           ctrl->files, sizeof(metalink_file_t *));
+  if (r != 0 || !ctrl->options.index_files) {
+    return r;
   }
-  return 0;
+  return metalink_index_files(ctrl->metalink);
 }
 
 /* transaction functions */
 metalink_file_t *metalink_pctrl_new_file_transaction(metalink_pctrl_t *ctrl) {
-  if (ctrl->temp_file) {
+  if (!ctrl->arena) {
     metalink_file_delete(ctrl->temp_file);
   }
-  ctrl->temp_file = metalink_file_new();
+  ctrl->temp_file =
+      pctrl_calloc(ctrl, METALINK_OBJECT_FILE, sizeof(metalink_file_t));
 
   metalink_list_clear(ctrl->languages);
   metalink_list_clear(ctrl->oses);
 
-  metalink_list_for_each(ctrl->resources,
-                         (void (*)(void *)) & metalink_resource_delete);
-  metalink_list_clear(ctrl->resources);
-
-  metalink_list_for_each(ctrl->metaurls,
-                         (void (*)(void *)) & metalink_metaurl_delete);
-  metalink_list_clear(ctrl->metaurls);
-
-  metalink_list_for_each(ctrl->checksums,
-                         (void (*)(void *)) & metalink_checksum_delete);
-  metalink_list_clear(ctrl->checksums);
+  clear_object_list(ctrl, ctrl->resources,
+                    (void (*)(void *)) & metalink_resource_delete);
+  clear_object_list(ctrl, ctrl->metaurls,
+                    (void (*)(void *)) & metalink_metaurl_delete);
+  clear_object_list(ctrl, ctrl->checksums,
+                    (void (*)(void *)) & metalink_checksum_delete);
 
   return ctrl->temp_file;
 }
@@ -205,8 +417,8 @@ metalink_pctrl_commit_file_transaction(metalink_pctrl_t *ctrl) {
   }
 
   /* copy ctrl->languages to ctrl->temp_file->languages */
-  r = commit_list_to_array((void *)&ctrl->temp_file->languages, ctrl->languages,
-                           sizeof(char *));
+  r = commit_list_to_array(ctrl, (void *)&ctrl->temp_file->languages,
+                           ctrl->languages, sizeof(char *));
   if (r != 0) {
     return r;
   }
@@ -215,8 +427,8 @@ metalink_pctrl_commit_file_transaction(metalink_pctrl_t *ctrl) {
   }
 
   /* copy ctrl->oses to ctrl->temp_file->oses */
-  r = commit_list_to_array((void *)&ctrl->temp_file->oses, ctrl->oses,
-                           sizeof(char *));
+  r = commit_list_to_array(ctrl, (void *)&ctrl->temp_file->oses,
+                           ctrl->oses, sizeof(char *));
   if (r != 0) {
     return r;
   }
@@ -225,8 +437,8 @@ metalink_pctrl_commit_file_transaction(metalink_pctrl_t *ctrl) {
   }
 
   /* copy ctrl->resources to ctrl->temp_file->resources */
-  r = commit_list_to_array((void *)&ctrl->temp_file->resources, ctrl->resources,
-                           sizeof(metalink_resource_t *));
+  r = commit_list_to_array(ctrl, (void *)&ctrl->temp_file->resources,
+                           ctrl->resources, sizeof(metalink_resource_t *));
   if (r != 0) {
     return r;
   }
@@ -240,8 +452,8 @@ metalink_pctrl_commit_file_transaction(metalink_pctrl_t *ctrl) {
   }
 
   /* copy ctrl->metaurls to ctrl->temp_file->metaurls */
-  r = commit_list_to_array((void *)&ctrl->temp_file->metaurls, ctrl->metaurls,
-                           sizeof(metalink_metaurl_t *));
+  r = commit_list_to_array(ctrl, (void *)&ctrl->temp_file->metaurls,
+                           ctrl->metaurls, sizeof(metalink_metaurl_t *));
   if (r != 0) {
     return r;
   }
@@ -255,12 +467,26 @@ metalink_pctrl_commit_file_transaction(metalink_pctrl_t *ctrl) {
   }
 
   /* copy ctrl->checksums to ctrl->temp_file->checksums */
-  r = commit_list_to_array((void *)&ctrl->temp_file->checksums, ctrl->checksums,
-                           sizeof(metalink_checksum_t *));
+  r = commit_list_to_array(ctrl, (void *)&ctrl->temp_file->checksums,
+                           ctrl->checksums, sizeof(metalink_checksum_t *));
   if (r != 0) {
     return r;
   }
 
+  if (ctrl->options.file_callback) {
+    metalink_file_t *file;
+
+    /* Hand the file over to the application right away, so that it
+       is never collected in ctrl->files. */
+    file = ctrl->temp_file;
+    ctrl->temp_file = NULL;
+    if (ctrl->options.file_callback(
+            file, ctrl->options.file_callback_user_data) != 0) {
+      return METALINK_ERR_CALLBACK_FAILURE;
+    }
+    return 0;
+  }
+
   if (metalink_list_append(ctrl->files, ctrl->temp_file) != 0) {
     return METALINK_ERR_BAD_ALLOC;
   }
@@ -271,10 +497,11 @@ metalink_pctrl_commit_file_transaction(metalink_pctrl_t *ctrl) {
 
 metalink_resource_t *
 metalink_pctrl_new_resource_transaction(metalink_pctrl_t *ctrl) {
-  if (ctrl->temp_resource) {
+  if (!ctrl->arena) {
     metalink_resource_delete(ctrl->temp_resource);
   }
-  ctrl->temp_resource = metalink_resource_new();
+  ctrl->temp_resource =
+      pctrl_calloc(ctrl, METALINK_OBJECT_RESOURCE, sizeof(metalink_resource_t));
   return ctrl->temp_resource;
 }
 
@@ -294,10 +521,11 @@ metalink_pctrl_commit_resource_transaction(metalink_pctrl_t *ctrl) {
 
 metalink_metaurl_t *
 metalink_pctrl_new_metaurl_transaction(metalink_pctrl_t *ctrl) {
-  if (ctrl->temp_metaurl) {
+  if (!ctrl->arena) {
     metalink_metaurl_delete(ctrl->temp_metaurl);
   }
-  ctrl->temp_metaurl = metalink_metaurl_new();
+  ctrl->temp_metaurl =
+      pctrl_calloc(ctrl, METALINK_OBJECT_METAURL, sizeof(metalink_metaurl_t));
   return ctrl->temp_metaurl;
 }
 
@@ -317,10 +545,11 @@ metalink_pctrl_commit_metaurl_transaction(metalink_pctrl_t *ctrl) {
 
 metalink_checksum_t *
 metalink_pctrl_new_checksum_transaction(metalink_pctrl_t *ctrl) {
-  if (ctrl->temp_checksum) {
+  if (!ctrl->arena) {
     metalink_checksum_delete(ctrl->temp_checksum);
   }
-  ctrl->temp_checksum = metalink_checksum_new();
+  ctrl->temp_checksum =
+      pctrl_calloc(ctrl, METALINK_OBJECT_CHECKSUM, sizeof(metalink_checksum_t));
   return ctrl->temp_checksum;
 }
 
@@ -339,33 +568,155 @@ metalink_pctrl_commit_checksum_transaction(metalink_pctrl_t *ctrl) {
 
 metalink_chunk_checksum_t *
 metalink_pctrl_new_chunk_checksum_transaction(metalink_pctrl_t *ctrl) {
-  if (ctrl->temp_chunk_checksum) {
+  if (!ctrl->arena) {
     metalink_chunk_checksum_delete(ctrl->temp_chunk_checksum);
   }
-
-  ctrl->temp_chunk_checksum = metalink_chunk_checksum_new();
-  metalink_list_for_each(ctrl->piece_hashes,
-                         (void (*)(void *)) & metalink_piece_hash_delete);
-  metalink_list_clear(ctrl->piece_hashes);
+  ctrl->temp_chunk_checksum = pctrl_calloc(
+      ctrl, METALINK_OBJECT_CHUNK_CHECKSUM, sizeof(metalink_chunk_checksum_t));
+  clear_object_list(ctrl, ctrl->piece_hashes,
+                    (void (*)(void *)) & metalink_piece_hash_delete);
+  metalink_string_buffer_clear(ctrl->piece_digests);
+  ctrl->piece_index_count = 0;
+  ctrl->piece_digest_length = 0;
+  ctrl->piece_digests_valid = 1;
+  ctrl->piece_hash_count = 0;
 
   return ctrl->temp_chunk_checksum;
 }
 
+/*
+ * Stores the count digests in ctrl->piece_digests in a new table, in
+ * the order given by ctrl->piece_indices, and stores it in *table. If
+ * the digests are already in order, *table is NULL. Returns 0 on
+ * success, 1 if the pieces are not numbered 0 to count - 1 exactly
+ * once, or -1 if out of memory.
+ */
+static int order_piece_digests(metalink_pctrl_t *ctrl, size_t count,
+                               unsigned char **table) {
+  const char *digests;
+  unsigned char *seen;
+  size_t length = ctrl->piece_digest_length;
+  size_t i;
+  int piece;
+  int r = 0;
+
+  *table = NULL;
+  if (ctrl->piece_index_count == 0) {
+    return 0;
+  }
+  digests = metalink_string_buffer_str(ctrl->piece_digests);
+  *table = malloc(count * length);
+  seen = calloc(count, 1);
+  if (!*table || !seen) {
+    r = -1;
+    goto ORDER_PIECE_DIGESTS_END;
+  }
+  for (i = 0; i < count; ++i) {
+    piece = ctrl->piece_indices[i];
+    if (piece < 0 || (size_t)piece >= count || seen[piece]) {
+      r = 1;
+      goto ORDER_PIECE_DIGESTS_END;
+    }
+    seen[piece] = 1;
+    memcpy(*table + (size_t)piece * length, digests + i * length, length);
+  }
+ORDER_PIECE_DIGESTS_END:
+  if (r != 0) {
+    free(*table);
+    *table = NULL;
+  }
+  free(seen);
+  return r;
+}
+
+/*
+ * Moves the digests collected in ctrl->piece_digests to the digest
+ * table of ctrl->temp_chunk_checksum. piece_count is the number of
+ * piece hashes which were committed as objects. The table is only set
+ * if every piece hash was decoded and the pieces are numbered 0 to
+ * count - 1 exactly once, in any order.
+ */
+static metalink_error_t commit_piece_digests(metalink_pctrl_t *ctrl,
+                                             size_t piece_count) {
+  metalink_chunk_checksum_t *chunk_checksum;
+  unsigned char *table = NULL;
+  size_t size;
+  size_t count;
+  int r;
+
+  chunk_checksum = ctrl->temp_chunk_checksum;
+  size = metalink_string_buffer_strlen(ctrl->piece_digests);
+  count = ctrl->piece_digest_length ? size / ctrl->piece_digest_length : 0;
+  r = 1;
+  if (ctrl->piece_digests_valid && count > 0 &&
+      (ctrl->options.compact_pieces || count == piece_count)) {
+    r = order_piece_digests(ctrl, count, &table);
+  }
+  ctrl->piece_index_count = 0;
+  if (r != 0) {
+    metalink_string_buffer_clear(ctrl->piece_digests);
+    return r < 0 ? METALINK_ERR_BAD_ALLOC : 0;
+  }
+  if (ctrl->arena) {
+    chunk_checksum->digests = metalink_arena_calloc(ctrl->arena, size);
+    if (chunk_checksum->digests) {
+      memcpy(chunk_checksum->digests,
+             table ? (const char *)table
+                   : metalink_string_buffer_str(ctrl->piece_digests),
+             size);
+    }
+    free(table);
+    metalink_string_buffer_clear(ctrl->piece_digests);
+  } else if (table) {
+    /* The reordered copy becomes the table. */
+    chunk_checksum->digests = table;
+    metalink_string_buffer_clear(ctrl->piece_digests);
+  } else {
+    /* The buffer becomes the table. */
+    chunk_checksum->digests =
+        (unsigned char *)metalink_string_buffer_detach(ctrl->piece_digests);
+  }
+  if (!chunk_checksum->digests) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  metalink_parse_stats_count_allocation(ctrl->options.stats,
+                                        METALINK_OBJECT_ARRAY, size);
+  chunk_checksum->digest_length = ctrl->piece_digest_length;
+  chunk_checksum->piece_count = count;
+  return 0;
+}
+
 metalink_error_t
 metalink_pctrl_commit_chunk_checksum_transaction(metalink_pctrl_t *ctrl) {
   metalink_error_t r;
+  size_t piece_count;
   if (!ctrl->temp_chunk_checksum) {
     return METALINK_ERR_NO_CHUNK_CHECKSUM_TRANSACTION;
   }
   if (!ctrl->temp_file) {
     return METALINK_ERR_NO_FILE_TRANSACTION;
   }
-  r = commit_list_to_array((void *)&ctrl->temp_chunk_checksum->piece_hashes,
+  piece_count = metalink_list_length(ctrl->piece_hashes);
+  r = commit_list_to_array(ctrl,
+                           (void *)&ctrl->temp_chunk_checksum->piece_hashes,
                            ctrl->piece_hashes, sizeof(metalink_piece_hash_t *));
   if (r != 0) {
     return r;
   }
   metalink_list_clear(ctrl->piece_hashes);
+  r = commit_piece_digests(ctrl, piece_count);
+  if (r != 0) {
+    return r;
+  }
+  if (ctrl->options.compact_pieces && !ctrl->temp_chunk_checksum->digests) {
+    /* The hex strings were not kept, so nothing describes the pieces
+       any more. Drop the chunk checksum as if it were skipped. */
+    if (!ctrl->arena) {
+      metalink_chunk_checksum_delete(ctrl->temp_chunk_checksum);
+    }
+    ctrl->temp_chunk_checksum = NULL;
+    return 0;
+  }
   ctrl->temp_file->chunk_checksum = ctrl->temp_chunk_checksum;
   ctrl->temp_chunk_checksum = NULL;
   return 0;
@@ -373,10 +724,22 @@ metalink_pctrl_commit_chunk_checksum_transaction(metalink_pctrl_t *ctrl) {
 
 metalink_piece_hash_t *
 metalink_pctrl_new_piece_hash_transaction(metalink_pctrl_t *ctrl) {
-  if (ctrl->temp_piece_hash) {
+  if (ctrl->options.compact_pieces && ctrl->temp_piece_hash) {
+    /* Only the digest of a piece hash is kept, so the object is
+       reused for all of them. */
+    ctrl->temp_piece_hash->piece = ctrl->piece_hash_count++;
+    return ctrl->temp_piece_hash;
+  }
+  if (!ctrl->arena) {
     metalink_piece_hash_delete(ctrl->temp_piece_hash);
   }
-  ctrl->temp_piece_hash = metalink_piece_hash_new();
+  ctrl->temp_piece_hash = pctrl_calloc(ctrl, METALINK_OBJECT_PIECE_HASH,
+                                       sizeof(metalink_piece_hash_t));
+  if (ctrl->temp_piece_hash) {
+    /* Pieces are numbered in document order unless the piece
+       attribute says otherwise. */
+    ctrl->temp_piece_hash->piece = ctrl->piece_hash_count++;
+  }
   return ctrl->temp_piece_hash;
 }
 
@@ -385,6 +748,10 @@ metalink_pctrl_commit_piece_hash_transaction(metalink_pctrl_t *ctrl) {
   if (!ctrl->temp_piece_hash) {
     return METALINK_ERR_NO_PIECE_HASH_TRANSACTION;
   }
+  if (ctrl->options.compact_pieces) {
+    /* Keep temp_piece_hash for the next transaction. */
+    return 0;
+  }
   if (metalink_list_append(ctrl->piece_hashes, (void *)ctrl->temp_piece_hash) !=
       0) {
     return METALINK_ERR_BAD_ALLOC;
@@ -395,10 +762,11 @@ metalink_pctrl_commit_piece_hash_transaction(metalink_pctrl_t *ctrl) {
 
 metalink_signature_t *
 metalink_pctrl_new_signature_transaction(metalink_pctrl_t *ctrl) {
-  if (ctrl->temp_signature) {
+  if (!ctrl->arena) {
     metalink_signature_delete(ctrl->temp_signature);
   }
-  ctrl->temp_signature = metalink_signature_new();
+  ctrl->temp_signature = pctrl_calloc(ctrl, METALINK_OBJECT_SIGNATURE,
+                                      sizeof(metalink_signature_t));
   return ctrl->temp_signature;
 }
 
@@ -407,7 +775,7 @@ metalink_pctrl_commit_signature_transaction(metalink_pctrl_t *ctrl) {
   if (!ctrl->temp_signature) {
     return METALINK_ERR_NO_SIGNATURE_TRANSACTION;
   }
-  if (ctrl->temp_file->signature) {
+  if (!ctrl->arena) {
     metalink_signature_delete(ctrl->temp_file->signature);
   }
   ctrl->temp_file->signature = ctrl->temp_signature;
@@ -425,8 +793,14 @@ metalink_error_t metalink_pctrl_add_language(metalink_pctrl_t *ctrl,
                                              const char *language) {
   char *l;
 
-  l = strdup(language);
-  if (!l || metalink_list_append(ctrl->languages, l) != 0) {
+  l = NULL;
+  if (copy_string(ctrl, &l, language) != 0) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  if (metalink_list_append(ctrl->languages, l) != 0) {
+    if (!ctrl->arena) {
+      free(l);
+    }
     return METALINK_ERR_BAD_ALLOC;
   }
   return 0;
@@ -435,8 +809,14 @@ metalink_error_t metalink_pctrl_add_language(metalink_pctrl_t *ctrl,
 metalink_error_t metalink_pctrl_add_os(metalink_pctrl_t *ctrl, const char *os) {
   char *o;
 
-  o = strdup(os);
-  if (!o || metalink_list_append(ctrl->oses, o) != 0) {
+  o = NULL;
+  if (copy_string(ctrl, &o, os) != 0) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  if (metalink_list_append(ctrl->oses, o) != 0) {
+    if (!ctrl->arena) {
+      free(o);
+    }
     return METALINK_ERR_BAD_ALLOC;
   }
   return 0;
@@ -444,84 +824,60 @@ metalink_error_t metalink_pctrl_add_os(metalink_pctrl_t *ctrl, const char *os) {
 
 metalink_error_t metalink_pctrl_set_identity(metalink_pctrl_t *ctrl,
                                              const char *identity) {
-  return metalink_set_identity(ctrl->metalink, identity);
+  return copy_string(ctrl, &ctrl->metalink->identity, identity);
 }
 
 metalink_error_t metalink_pctrl_set_tags(metalink_pctrl_t *ctrl,
                                          const char *tags) {
-  return metalink_set_tags(ctrl->metalink, tags);
+  return copy_string(ctrl, &ctrl->metalink->tags, tags);
 }
 
 /* file manipulation functions*/
 metalink_error_t metalink_pctrl_file_set_language(metalink_pctrl_t *ctrl,
                                                   const char *language) {
-  char *l;
-
-  if (ctrl->languages) {
-    metalink_list_delete(ctrl->languages);
-  }
-
-  l = strdup(language);
-  ctrl->languages = metalink_list_new();
-  if (!ctrl->languages || !l || metalink_list_append(ctrl->languages, l) != 0) {
-    if (l) free(l);
-    return METALINK_ERR_BAD_ALLOC;
-  }
-
-  return 0;
+  clear_string_list(ctrl, ctrl->languages);
+  return metalink_pctrl_add_language(ctrl, language);
 }
 
 metalink_error_t metalink_pctrl_file_set_os(metalink_pctrl_t *ctrl,
                                             const char *os) {
-  char *o;
-
-  if (ctrl->oses) {
-    metalink_list_delete(ctrl->oses);
-  }
-
-  o = strdup(os);
-  ctrl->oses = metalink_list_new();
-  if (!ctrl->oses || !o || metalink_list_append(ctrl->oses, o) != 0) {
-    if (o) free(o);
-    return METALINK_ERR_BAD_ALLOC;
-  }
-
-  return 0;
+  clear_string_list(ctrl, ctrl->oses);
+  return metalink_pctrl_add_os(ctrl, os);
 }
 
 metalink_error_t metalink_pctrl_file_set_name(metalink_pctrl_t *ctrl,
                                               const char *name) {
-  return metalink_file_set_name(ctrl->temp_file, name);
+  return copy_string(ctrl, &ctrl->temp_file->name, name);
 }
 
 metalink_error_t metalink_pctrl_file_set_description(metalink_pctrl_t *ctrl,
                                                      const char *description) {
-  return metalink_file_set_description(ctrl->temp_file, description);
+  return copy_string(ctrl, &ctrl->temp_file->description, description);
 }
 
 metalink_error_t metalink_pctrl_file_set_copyright(metalink_pctrl_t *ctrl,
                                                    const char *copyright) {
-  return metalink_file_set_copyright(ctrl->temp_file, copyright);
+  return copy_string(ctrl, &ctrl->temp_file->copyright, copyright);
 }
 
 metalink_error_t metalink_pctrl_file_set_identity(metalink_pctrl_t *ctrl,
                                                   const char *identity) {
-  return metalink_file_set_identity(ctrl->temp_file, identity);
+  return copy_string(ctrl, &ctrl->temp_file->identity, identity);
 }
 
 metalink_error_t metalink_pctrl_file_set_logo(metalink_pctrl_t *ctrl,
                                               const char *logo) {
-  return metalink_file_set_logo(ctrl->temp_file, logo);
+  return copy_string(ctrl, &ctrl->temp_file->logo, logo);
 }
 
 metalink_error_t metalink_pctrl_file_set_publisher_name(metalink_pctrl_t *ctrl,
                                                         const char *name) {
-  return metalink_file_set_publisher_name(ctrl->temp_file, name);
+  return copy_string(ctrl, &ctrl->temp_file->publisher_name, name);
 }
 
 metalink_error_t metalink_pctrl_file_set_publisher_url(metalink_pctrl_t *ctrl,
                                                        const char *url) {
-  return metalink_file_set_publisher_url(ctrl->temp_file, url);
+  return copy_string(ctrl, &ctrl->temp_file->publisher_url, url);
 }
 
 void metalink_pctrl_file_set_size(metalink_pctrl_t *ctrl, long long int size) {
@@ -530,7 +886,7 @@ void metalink_pctrl_file_set_size(metalink_pctrl_t *ctrl, long long int size) {
 
 metalink_error_t metalink_pctrl_file_set_version(metalink_pctrl_t *ctrl,
                                                  const char *version) {
-  return metalink_file_set_version(ctrl->temp_file, version);
+  return copy_string(ctrl, &ctrl->temp_file->version, version);
 }
 
 void metalink_pctrl_file_set_maxconnections(metalink_pctrl_t *ctrl,
@@ -541,12 +897,17 @@ void metalink_pctrl_file_set_maxconnections(metalink_pctrl_t *ctrl,
 /* resource manipulation functions */
 metalink_error_t metalink_pctrl_resource_set_type(metalink_pctrl_t *ctrl,
                                                   const char *type) {
-  return metalink_resource_set_type(ctrl->temp_resource, type);
+  return copy_string(ctrl, &ctrl->temp_resource->type, type);
 }
 
 metalink_error_t metalink_pctrl_resource_set_location(metalink_pctrl_t *ctrl,
                                                       const char *location) {
-  return metalink_resource_set_location(ctrl->temp_resource, location);
+  return copy_string(ctrl, &ctrl->temp_resource->location, location);
+}
+
+metalink_error_t metalink_pctrl_resource_take_url(metalink_pctrl_t *ctrl,
+                                                  char *url) {
+  return take_string(ctrl, &ctrl->temp_resource->url, url);
 }
 
 void metalink_pctrl_resource_set_preference(metalink_pctrl_t *ctrl,
@@ -566,18 +927,23 @@ void metalink_pctrl_resource_set_maxconnections(metalink_pctrl_t *ctrl,
 
 metalink_error_t metalink_pctrl_resource_set_url(metalink_pctrl_t *ctrl,
                                                  const char *url) {
-  return metalink_resource_set_url(ctrl->temp_resource, url);
+  return copy_string(ctrl, &ctrl->temp_resource->url, url);
 }
 
 /* metaurl manipulation functions */
 metalink_error_t metalink_pctrl_metaurl_set_mediatype(metalink_pctrl_t *ctrl,
                                                       const char *mediatype) {
-  return metalink_metaurl_set_mediatype(ctrl->temp_metaurl, mediatype);
+  return copy_string(ctrl, &ctrl->temp_metaurl->mediatype, mediatype);
 }
 
 metalink_error_t metalink_pctrl_metaurl_set_name(metalink_pctrl_t *ctrl,
                                                  const char *name) {
-  return metalink_metaurl_set_name(ctrl->temp_metaurl, name);
+  return copy_string(ctrl, &ctrl->temp_metaurl->name, name);
+}
+
+metalink_error_t metalink_pctrl_metaurl_take_url(metalink_pctrl_t *ctrl,
+                                                 char *url) {
+  return take_string(ctrl, &ctrl->temp_metaurl->url, url);
 }
 
 void metalink_pctrl_metaurl_set_priority(metalink_pctrl_t *ctrl, int priority) {
@@ -586,18 +952,23 @@ void metalink_pctrl_metaurl_set_priority(metalink_pctrl_t *ctrl, int priority) {
 
 metalink_error_t metalink_pctrl_metaurl_set_url(metalink_pctrl_t *ctrl,
                                                 const char *url) {
-  return metalink_metaurl_set_url(ctrl->temp_metaurl, url);
+  return copy_string(ctrl, &ctrl->temp_metaurl->url, url);
 }
 
 /* checksum manipulation functions */
 metalink_error_t metalink_pctrl_checksum_set_type(metalink_pctrl_t *ctrl,
                                                   const char *type) {
-  return metalink_checksum_set_type(ctrl->temp_checksum, type);
+  return copy_string(ctrl, &ctrl->temp_checksum->type, type);
 }
 
 metalink_error_t metalink_pctrl_checksum_set_hash(metalink_pctrl_t *ctrl,
                                                   const char *hash) {
-  return metalink_checksum_set_hash(ctrl->temp_checksum, hash);
+  return copy_string(ctrl, &ctrl->temp_checksum->hash, hash);
+}
+
+metalink_error_t metalink_pctrl_checksum_take_hash(metalink_pctrl_t *ctrl,
+                                                   char *hash) {
+  return take_string(ctrl, &ctrl->temp_checksum->hash, hash);
 }
 
 /* piece hash manipulation functions */
@@ -607,13 +978,105 @@ void metalink_pctrl_piece_hash_set_piece(metalink_pctrl_t *ctrl, int piece) {
 
 metalink_error_t metalink_pctrl_piece_hash_set_hash(metalink_pctrl_t *ctrl,
                                                     const char *hash) {
-  return metalink_piece_hash_set_hash(ctrl->temp_piece_hash, hash);
+  return copy_string(ctrl, &ctrl->temp_piece_hash->hash, hash);
+}
+
+metalink_error_t metalink_pctrl_piece_hash_take_hash(metalink_pctrl_t *ctrl,
+                                                     char *hash) {
+  return take_string(ctrl, &ctrl->temp_piece_hash->hash, hash);
+}
+
+/*
+ * Appends piece to ctrl->piece_indices, growing it as needed. Returns
+ * 0 on success, or 1 if out of memory.
+ */
+static int append_piece_index(metalink_pctrl_t *ctrl, int piece) {
+  size_t new_capacity;
+  int *new_indices;
+
+  if (ctrl->piece_index_count == ctrl->piece_index_capacity) {
+    new_capacity =
+        ctrl->piece_index_capacity ? ctrl->piece_index_capacity * 2 : 16;
+    if (new_capacity > ((size_t)-1) / sizeof(int)) {
+      return 1;
+    }
+    new_indices = realloc(ctrl->piece_indices, new_capacity * sizeof(int));
+    if (!new_indices) {
+      return 1;
+    }
+    ctrl->piece_indices = new_indices;
+    ctrl->piece_index_capacity = new_capacity;
+  }
+  ctrl->piece_indices[ctrl->piece_index_count++] = piece;
+  return 0;
+}
+
+/*
+ * Records that the count-th digest collected belongs to the piece-th
+ * piece. Nothing is recorded as long as the two are equal. Returns 0
+ * on success, or 1 if out of memory.
+ */
+static int record_piece_index(metalink_pctrl_t *ctrl, size_t count,
+                              int piece) {
+  int i;
+
+  if (ctrl->piece_index_count == 0) {
+    if (piece >= 0 && (size_t)piece == count) {
+      return 0;
+    }
+    for (i = 0; (size_t)i < count; ++i) {
+      if (append_piece_index(ctrl, i) != 0) {
+        return 1;
+      }
+    }
+  }
+  return append_piece_index(ctrl, piece);
+}
+
+static int is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+metalink_error_t metalink_pctrl_piece_hash_add_digest(metalink_pctrl_t *ctrl,
+                                                      const char *hash) {
+  unsigned char digest[MAX_PIECE_DIGEST_LENGTH];
+  const char *end;
+  size_t length;
+
+  if (!ctrl->piece_digests_valid) {
+    return 0;
+  }
+  while (is_space(*hash)) {
+    ++hash;
+  }
+  end = hash + strlen(hash);
+  while (end > hash && is_space(end[-1])) {
+    --end;
+  }
+  length = (size_t)(end - hash);
+  if (length == 0 || length > sizeof(digest) * 2 ||
+      metalink_hex_decode(digest, hash, length) != 0 ||
+      (ctrl->piece_digest_length &&
+       ctrl->piece_digest_length != length / 2)) {
+    ctrl->piece_digests_valid = 0;
+    return 0;
+  }
+  ctrl->piece_digest_length = length / 2;
+  if (record_piece_index(ctrl,
+                         metalink_string_buffer_strlen(ctrl->piece_digests) /
+                             ctrl->piece_digest_length,
+                         ctrl->temp_piece_hash->piece) != 0 ||
+      metalink_string_buffer_append(ctrl->piece_digests, (const char *)digest,
+                                    length / 2) != 0) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  return 0;
 }
 
 /* chunk checksum manipulation functions */
 metalink_error_t metalink_pctrl_chunk_checksum_set_type(metalink_pctrl_t *ctrl,
                                                         const char *type) {
-  return metalink_chunk_checksum_set_type(ctrl->temp_chunk_checksum, type);
+  return copy_string(ctrl, &ctrl->temp_chunk_checksum->type, type);
 }
 
 void metalink_pctrl_chunk_checksum_set_length(metalink_pctrl_t *ctrl,
@@ -628,20 +1091,30 @@ void metalink_pctrl_chunk_checksum_set_piece_hashes(
 }
 
 /* signature manipulation functions */
+metalink_error_t metalink_pctrl_signature_set_mediatype(metalink_pctrl_t *ctrl,
+                                                        const char *mediatype) {
+  return copy_string(ctrl, &ctrl->temp_signature->mediatype, mediatype);
+}
+
 metalink_error_t metalink_pctrl_signature_set_signature(metalink_pctrl_t *ctrl,
                                                         const char *signature) {
-  return metalink_signature_set_signature(ctrl->temp_signature, signature);
+  return copy_string(ctrl, &ctrl->temp_signature->signature, signature);
+}
+
+metalink_error_t metalink_pctrl_signature_take_signature(metalink_pctrl_t *ctrl,
+                                                         char *signature) {
+  return take_string(ctrl, &ctrl->temp_signature->signature, signature);
 }
 
 /* information functions */
 metalink_error_t metalink_pctrl_set_generator(metalink_pctrl_t *ctrl,
                                               const char *generator) {
-  return metalink_set_generator(ctrl->metalink, generator);
+  return copy_string(ctrl, &ctrl->metalink->generator, generator);
 }
 
 metalink_error_t metalink_pctrl_set_origin(metalink_pctrl_t *ctrl,
                                            const char *origin) {
-  return metalink_set_origin(ctrl->metalink, origin);
+  return copy_string(ctrl, &ctrl->metalink->origin, origin);
 }
 
 void metalink_pctrl_set_origin_dynamic(metalink_pctrl_t *ctrl,
@@ -31,6 +31,9 @@
 #include <metalink/metalink.h>
 
 #include "metalink_list.h"
+#include "metalink_parse_options.h"
+#include "metalink_arena.h"
+#include "metalink_string_buffer.h"
 
 typedef struct metalink_pctrl_t {
   metalink_error_t error;
@@ -63,13 +66,59 @@ typedef struct metalink_pctrl_t {
 
   metalink_piece_hash_t *temp_piece_hash;
 
+  /* binary piece digests of the current chunk checksum transaction */
+  metalink_string_buffer_t *piece_digests;
+
+  /* the length of each digest in piece_digests */
+  size_t piece_digest_length;
+
+  /* nonzero while every piece hash decoded to piece_digest_length
+     bytes */
+  int piece_digests_valid;
+
+  /* the piece index of each digest in piece_digests; empty while the
+     pieces come in order */
+  int *piece_indices;
+
+  /* the number of elements used in piece_indices */
+  size_t piece_index_count;
+
+  /* the number of elements allocated for piece_indices */
+  size_t piece_index_capacity;
+
+  /* the number of piece hash transactions begun in the current chunk
+     checksum transaction */
+  int piece_hash_count;
+
   metalink_signature_t *temp_signature;
+
+  /* a copy of the options given by the application */
+  metalink_parse_options_t options;
+
+  /* If not NULL, metalink and all objects built for it are allocated
+     from this arena, which is owned by metalink. */
+  metalink_arena_t *arena;
 } metalink_pctrl_t;
 
 metalink_pctrl_t *new_metalink_pctrl(void);
 
 void delete_metalink_pctrl(metalink_pctrl_t *ctrl);
 
+/**
+ * Frees all objects built so far and makes ctrl ready for the next
+ * document. The lists are cleared in place and reused.
+ */
+metalink_error_t metalink_pctrl_reset(metalink_pctrl_t *ctrl);
+
+/**
+ * Copies opts to ctrl. If opts is NULL, the default options are used.
+ * ctrl->metalink is recreated to match the allocation mode requested by
+ * opts, so this must be called before any input is parsed.
+ */
+metalink_error_t
+metalink_pctrl_set_options(metalink_pctrl_t *ctrl,
+                           const metalink_parse_options_t *opts);
+
 /**
  * detach metalink member: return ctrl->metalink and set NULL to
  * ctrl->metalink.
@@ -81,6 +130,26 @@ void metalink_pctrl_set_error(metalink_pctrl_t *ctrl, metalink_error_t error);
 
 metalink_error_t metalink_pctrl_get_error(metalink_pctrl_t *ctrl);
 
+/*
+ * Returns a copy of str allocated the same way as the objects of
+ * ctrl->metalink, i.e., from the arena in arena mode and by malloc
+ * otherwise. Returns NULL if out of memory.
+ */
+char *metalink_pctrl_strdup(metalink_pctrl_t *ctrl, const char *str);
+
+/* Returns nonzero if ctrl->metalink is allocated from an arena. */
+int metalink_pctrl_use_arena(const metalink_pctrl_t *ctrl);
+
+/* Returns nonzero if piece hashes are kept in the digest table only. */
+int metalink_pctrl_compact_pieces(const metalink_pctrl_t *ctrl);
+
+/*
+ * The *_take_* setters below store the given string as is instead of
+ * copying it. The string must be allocated as by metalink_pctrl_strdup,
+ * and is owned by ctrl afterwards even if the function fails. Passing
+ * NULL yields METALINK_ERR_BAD_ALLOC.
+ */
+
 /* metalink manipulation functions */
 metalink_error_t
 metalink_pctrl_metalink_accumulate_files(metalink_pctrl_t *ctrl);
@@ -191,6 +260,9 @@ void metalink_pctrl_resource_set_maxconnections(metalink_pctrl_t *ctrl,
 metalink_error_t metalink_pctrl_resource_set_url(metalink_pctrl_t *ctrl,
                                                  const char *url);
 
+metalink_error_t metalink_pctrl_resource_take_url(metalink_pctrl_t *ctrl,
+                                                  char *url);
+
 /* metaurl manipulation functions */
 metalink_error_t metalink_pctrl_metaurl_set_mediatype(metalink_pctrl_t *ctrl,
                                                       const char *mediatype);
@@ -203,6 +275,9 @@ void metalink_pctrl_metaurl_set_priority(metalink_pctrl_t *ctrl, int priority);
 metalink_error_t metalink_pctrl_metaurl_set_url(metalink_pctrl_t *ctrl,
                                                 const char *url);
 
+metalink_error_t metalink_pctrl_metaurl_take_url(metalink_pctrl_t *ctrl,
+                                                 char *url);
+
 /* checksum manipulation functions */
 metalink_error_t metalink_pctrl_checksum_set_type(metalink_pctrl_t *ctrl,
                                                   const char *type);
@@ -210,12 +285,28 @@ metalink_error_t metalink_pctrl_checksum_set_type(metalink_pctrl_t *ctrl,
 metalink_error_t metalink_pctrl_checksum_set_hash(metalink_pctrl_t *ctrl,
                                                   const char *hash);
 
+metalink_error_t metalink_pctrl_checksum_take_hash(metalink_pctrl_t *ctrl,
+                                                   char *hash);
+
 /* piece hash manipulation functions */
 void metalink_pctrl_piece_hash_set_piece(metalink_pctrl_t *ctrl, int piece);
 
 metalink_error_t metalink_pctrl_piece_hash_set_hash(metalink_pctrl_t *ctrl,
                                                     const char *hash);
 
+metalink_error_t metalink_pctrl_piece_hash_take_hash(metalink_pctrl_t *ctrl,
+                                                     char *hash);
+
+/*
+ * Decodes the hex string hash and adds it to the digest table of the
+ * current chunk checksum transaction as the digest of the piece of the
+ * current piece hash transaction. If hash cannot be decoded, the table
+ * is abandoned for this transaction, which is not an error. So is it
+ * if the pieces turn out not to be numbered 0 to n - 1 exactly once.
+ */
+metalink_error_t metalink_pctrl_piece_hash_add_digest(metalink_pctrl_t *ctrl,
+                                                      const char *hash);
+
 /* chunk checksum manipulation functions */
 metalink_error_t metalink_pctrl_chunk_checksum_set_type(metalink_pctrl_t *ctrl,
                                                         const char *type);
@@ -224,9 +315,15 @@ void metalink_pctrl_chunk_checksum_set_length(metalink_pctrl_t *ctrl,
                                               int length);
 
 /* signature manipulation functions */
+metalink_error_t metalink_pctrl_signature_set_mediatype(metalink_pctrl_t *ctrl,
+                                                        const char *mediatype);
+
 metalink_error_t metalink_pctrl_signature_set_signature(metalink_pctrl_t *ctrl,
                                                         const char *signature);
 
+metalink_error_t metalink_pctrl_signature_take_signature(metalink_pctrl_t *ctrl,
+                                                         char *signature);
+
 /* Unlike other mutator functions, this function doesn't create copy of
    piece_hashes. So don't free piece_hashes manually after this call.*/
 void metalink_pctrl_chunk_checksum_set_piece_hashes(
@@ -0,0 +1,300 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include <metalink/metalink.h>
+
+#include "metalink_work_queue.h"
+
+/* The piece length of files without a chunk checksum. */
+#define PLAN_PIECE_LENGTH (1024 * 1024)
+
+/* Each connection starts with this many segments, so that there is
+   something left to steal when a mirror stalls. */
+#define PLAN_SEGMENTS_PER_CONNECTION 4
+
+/* A connection without a limit of its own, when the total is limited. */
+#define PLAN_UNLIMITED INT_MAX
+
+struct _metalink_plan {
+  long long size;
+  long long piece_length;
+  size_t piece_count;
+  size_t segment_pieces;
+  size_t segment_count;
+  /* the queued segments of each connection */
+  metalink_work_queue_t *queues;
+  /* the resource of each connection */
+  size_t *resources;
+  size_t connection_count;
+};
+
+typedef struct _plan_rank {
+  int priority;
+  size_t index;
+} plan_rank_t;
+
+static int plan_rank_comp(const void *lhs, const void *rhs) {
+  const plan_rank_t *l = lhs;
+  const plan_rank_t *r = rhs;
+  if (l->priority != r->priority) {
+    return l->priority < r->priority ? -1 : 1;
+  }
+  return l->index < r->index ? -1 : l->index > r->index;
+}
+
+/*
+ * Hands out connections to the ranked resources in rounds, one per
+ * resource per round, until the total limit is reached or every
+ * resource is at its own limit.
+ */
+static metalink_error_t plan_connections(metalink_plan_t *plan,
+                                         const metalink_file_t *file,
+                                         const size_t *ranked, size_t count,
+                                         int max_connections) {
+  int *limits;
+  int *given;
+  long long total = 0, limit;
+  size_t i, n = 0;
+  int progress;
+
+  if (file->maxconnections > 0) {
+    total = file->maxconnections;
+  }
+  if (max_connections > 0 && (total == 0 || max_connections < total)) {
+    total = max_connections;
+  }
+  limits = malloc(sizeof(int) * count);
+  given = calloc(count, sizeof(int));
+  if (!limits || !given) {
+    free(limits);
+    free(given);
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  limit = 0;
+  for (i = 0; i < count; ++i) {
+    limits[i] = file->resources[ranked[i]]->maxconnections;
+    if (limits[i] <= 0) {
+      limits[i] = total ? PLAN_UNLIMITED : 1;
+    }
+    limit += limits[i];
+  }
+  if (total == 0 || limit < total) {
+    total = limit;
+  }
+  /* more connections than pieces would stay idle */
+  if ((unsigned long long)total > plan->piece_count) {
+    total = (long long)plan->piece_count;
+  }
+
+  plan->queues = calloc((size_t)total, sizeof(metalink_work_queue_t));
+  plan->resources = calloc((size_t)total, sizeof(size_t));
+  if (!plan->queues || !plan->resources) {
+    free(limits);
+    free(given);
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  do {
+    progress = 0;
+    for (i = 0; i < count && n < (size_t)total; ++i) {
+      if (given[i] < limits[i]) {
+        ++given[i];
+        plan->resources[n++] = ranked[i];
+        progress = 1;
+      }
+    }
+  } while (progress && n < (size_t)total);
+  plan->connection_count = n;
+
+  free(limits);
+  free(given);
+  return 0;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_plan_new(metalink_plan_t **res, const metalink_file_t *file,
+                  const size_t *resources, size_t nresources,
+                  int max_connections) {
+  metalink_plan_t *plan;
+  size_t *ranked = NULL;
+  plan_rank_t *ranks = NULL;
+  size_t count = 0, n = 0, i, per_connection;
+  metalink_error_t r;
+
+  if (file->size <= 0) {
+    return METALINK_ERR_UNKNOWN_FILE_SIZE;
+  }
+  if (file->resources) {
+    for (; file->resources[count]; ++count)
+      ;
+  }
+
+  plan = calloc(1, sizeof(metalink_plan_t));
+  if (!plan) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  plan->size = file->size;
+  if (file->chunk_checksum && file->chunk_checksum->length > 0) {
+    plan->piece_length = file->chunk_checksum->length;
+  } else {
+    plan->piece_length = PLAN_PIECE_LENGTH;
+  }
+  plan->piece_count =
+      (size_t)((plan->size + plan->piece_length - 1) / plan->piece_length);
+
+  r = METALINK_ERR_BAD_ALLOC;
+  ranked = malloc(sizeof(size_t) * (count ? count : 1));
+  if (!ranked) {
+    goto PLAN_NEW_ERROR;
+  }
+  if (resources) {
+    for (i = 0; i < nresources; ++i) {
+      if (resources[i] < count) {
+        ranked[n++] = resources[i];
+      }
+    }
+  } else {
+    ranks = malloc(sizeof(plan_rank_t) * (count ? count : 1));
+    if (!ranks) {
+      goto PLAN_NEW_ERROR;
+    }
+    for (i = 0; i < count; ++i) {
+      ranks[i].priority = file->resources[i]->priority;
+      ranks[i].index = i;
+    }
+    qsort(ranks, count, sizeof(plan_rank_t), plan_rank_comp);
+    for (i = 0; i < count; ++i) {
+      ranked[n++] = ranks[i].index;
+    }
+  }
+  if (n == 0) {
+    r = METALINK_ERR_NO_RESOURCES;
+    goto PLAN_NEW_ERROR;
+  }
+
+  r = plan_connections(plan, file, ranked, n, max_connections);
+  if (r != 0) {
+    goto PLAN_NEW_ERROR;
+  }
+
+  /* segment numbers must fit in a work queue */
+  plan->segment_pieces =
+      plan->piece_count /
+      (plan->connection_count * PLAN_SEGMENTS_PER_CONNECTION);
+  if (plan->segment_pieces == 0) {
+    plan->segment_pieces = 1;
+  }
+  if (plan->piece_count / plan->segment_pieces >= METALINK_WORK_QUEUE_MAX) {
+    plan->segment_pieces =
+        plan->piece_count / (METALINK_WORK_QUEUE_MAX - 1) + 1;
+  }
+  plan->segment_count =
+      (plan->piece_count + plan->segment_pieces - 1) / plan->segment_pieces;
+
+  /* each connection starts with a contiguous run of segments, the
+     better resources at the beginning of the file */
+  per_connection = plan->segment_count / plan->connection_count;
+  n = plan->segment_count % plan->connection_count;
+  count = 0;
+  for (i = 0; i < plan->connection_count; ++i) {
+    size_t len = per_connection + (i < n);
+    metalink_work_queue_init(&plan->queues[i], count, count + len);
+    count += len;
+  }
+
+  free(ranks);
+  free(ranked);
+  *res = plan;
+  return 0;
+
+PLAN_NEW_ERROR:
+  free(ranks);
+  free(ranked);
+  metalink_plan_delete(plan);
+  return r;
+}
+
+void METALINK_PUBLIC metalink_plan_delete(metalink_plan_t *plan) {
+  if (!plan) {
+    return;
+  }
+  free(plan->queues);
+  free(plan->resources);
+  free(plan);
+}
+
+size_t METALINK_PUBLIC
+metalink_plan_get_connection_count(const metalink_plan_t *plan) {
+  return plan->connection_count;
+}
+
+size_t METALINK_PUBLIC
+metalink_plan_get_connection_resource(const metalink_plan_t *plan,
+                                      size_t connection) {
+  return plan->resources[connection];
+}
+
+size_t METALINK_PUBLIC
+metalink_plan_get_segment_count(const metalink_plan_t *plan) {
+  return plan->segment_count;
+}
+
+int METALINK_PUBLIC metalink_plan_next(metalink_plan_t *plan,
+                                       size_t connection,
+                                       metalink_segment_t *segment) {
+  metalink_work_queue_t *queue;
+  size_t index;
+  long long end;
+
+  if (connection >= plan->connection_count) {
+    return 0;
+  }
+  queue = &plan->queues[connection];
+  if (!metalink_work_queue_pop(queue, &index) &&
+      !metalink_work_queue_steal(plan->queues, plan->connection_count, queue,
+                                 &index)) {
+    return 0;
+  }
+  segment->resource = plan->resources[connection];
+  segment->index = index;
+  segment->first_piece = index * plan->segment_pieces;
+  segment->piece_count = plan->segment_pieces;
+  if (segment->piece_count > plan->piece_count - segment->first_piece) {
+    segment->piece_count = plan->piece_count - segment->first_piece;
+  }
+  segment->offset = (long long)segment->first_piece * plan->piece_length;
+  end = segment->offset + (long long)segment->piece_count * plan->piece_length;
+  if (end > plan->size) {
+    end = plan->size;
+  }
+  segment->length = end - segment->offset;
+  return 1;
+}
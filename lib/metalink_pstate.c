@@ -125,6 +125,9 @@ void skip_state_start_fun(metalink_pstm_t *stm, int name, int ns_uri,
   (void)attrs;
 
   ++stm->state->skip_depth;
+  if (stm->ctrl->options.stats) {
+    ++stm->ctrl->options.stats->skipped_elements;
+  }
 }
 
 void skip_state_end_fun(metalink_pstm_t *stm, int name, int ns_uri,
@@ -295,7 +298,8 @@ void url_state_end_fun(metalink_pstm_t *stm, int name, int ns_uri,
 
   (void)name;
 
-  r = metalink_pctrl_resource_set_url(stm->ctrl, characters);
+  r = metalink_pctrl_resource_take_url(
+      stm->ctrl, metalink_pstm_take_characters(stm, characters));
   if (r != 0) {
     /* TODO clear intermidiate resource transaction. */
     error_handler(stm, r);
@@ -335,7 +339,8 @@ void hash_state_end_fun(metalink_pstm_t *stm, int name, int ns_uri,
 
   (void)name;
 
-  r = metalink_pctrl_checksum_set_hash(stm->ctrl, characters);
+  r = metalink_pctrl_checksum_take_hash(
+      stm->ctrl, metalink_pstm_take_characters(stm, characters));
   if (r != 0) {
     error_handler(stm, r);
     return;
@@ -374,7 +379,15 @@ void piece_hash_state_end_fun(metalink_pstm_t *stm, int name, int ns_uri,
 
   (void)name;
 
-  metalink_pctrl_piece_hash_set_hash(stm->ctrl, characters);
+  r = metalink_pctrl_piece_hash_add_digest(stm->ctrl, characters);
+  if (r == 0 && !metalink_pctrl_compact_pieces(stm->ctrl)) {
+    r = metalink_pctrl_piece_hash_take_hash(
+        stm->ctrl, metalink_pstm_take_characters(stm, characters));
+  }
+  if (r != 0) {
+    error_handler(stm, r);
+    return;
+  }
   r = metalink_pctrl_commit_piece_hash_transaction(stm->ctrl);
   if (r != 0) {
     error_handler(stm, r);
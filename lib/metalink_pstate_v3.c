@@ -239,7 +239,7 @@ void resources_state_start_fun_v3(metalink_pstm_t *stm, int name, int ns_uri,
                                   const char **attrs) {
   metalink_error_t r;
 
-  if (ns_uri != METALINK_NS_V3) {
+  if (ns_uri != METALINK_NS_V3 || metalink_pstm_field_skipped(stm, name)) {
     metalink_pstm_enter_skip_state(stm);
     return;
   }
@@ -321,7 +321,7 @@ void verification_state_start_fun_v3(metalink_pstm_t *stm, int name, int ns_uri,
                                      const char **attrs) {
   metalink_error_t r;
 
-  if (ns_uri != METALINK_NS_V3) {
+  if (ns_uri != METALINK_NS_V3 || metalink_pstm_field_skipped(stm, name)) {
     metalink_pstm_enter_skip_state(stm);
     return;
   }
@@ -342,7 +342,7 @@ void verification_state_start_fun_v3(metalink_pstm_t *stm, int name, int ns_uri,
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
     }
-    r = metalink_checksum_set_type(checksum, type);
+    r = metalink_pctrl_checksum_set_type(stm->ctrl, type);
     if (r != 0) {
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
@@ -385,12 +385,12 @@ void verification_state_start_fun_v3(metalink_pstm_t *stm, int name, int ns_uri,
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
     }
-    r = metalink_chunk_checksum_set_type(chunk_checksum, type);
+    r = metalink_pctrl_chunk_checksum_set_type(stm->ctrl, type);
     if (r != 0) {
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
     }
-    metalink_chunk_checksum_set_length(chunk_checksum, (int)length);
+    metalink_pctrl_chunk_checksum_set_length(stm->ctrl, (int)length);
 
     metalink_pstm_enter_pieces_state(stm);
     break;
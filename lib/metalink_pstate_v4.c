@@ -25,10 +25,6 @@
 /* copyright --> */
 #include "metalink_pstate_v4.h"
 
-#include <time.h>
-#ifdef HAVE_TIME64_H
-#include <time64.h>
-#endif
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -36,70 +32,16 @@
 
 #include "metalink_pstm.h"
 #include "metalink_helper.h"
-#ifndef HAVE_STRPTIME
-#include "strptime.h"
-#endif /* !HAVE_STRPTIME */
-#ifndef HAVE_TIMEGM
-#include "timegm.h"
-#endif /* !HAVE_TIMEGM */
-
-static time_t my_timegm(struct tm *tm) {
-#ifdef HAVE__MKGMTIME
-  /* WINE does not implement _mkgmtime() yet */
-  return _mkgmtime(tm);
-#elif defined(HAVE_MKGMTIME)
-  return mkgmtime(tm);
-#elif defined(HAVE_TIMEGM64)
-  return (time_t)timegm64(tm);
-#else
-  return timegm(tm);
-#endif
-}
+#include "metalink_date.h"
 
 /* parse a RFC3339 formatted date, ie. 2010-05-01T12:15:02Z or
-   2010-05-01T12:16:02+01:00 */
+   2010-05-01T12:16:02+01:00, returning 0 if it is malformed */
 static time_t parse_date(const char *date) {
-  time_t t = 0;
-  int sign = 0;
-  struct tm tm, offset;
-  char *rest;
-
-  if (strlen(date) < 20) {
-    return t;
-  }
-
-  memset(&tm, 0, sizeof(tm));
-
-  rest = strptime(date, "%Y-%m-%dT%H:%M:%S", &tm);
-
-  if (rest == NULL) {
-    return t;
-  }
-
-  t = my_timegm(&tm);
+  time_t t;
 
-  while (*rest != 'Z' && *rest != '+' && *rest != '-' && *rest != '\0') {
-    rest++;
+  if (metalink_parse_date(&t, date) != 0) {
+    return 0;
   }
-
-  if (*rest == '\0') {
-    /* not a valid RFC3339 date, but we can still return what has already been
-     * parsed */
-    return t;
-  }
-  if (*rest == '+') {
-    sign = -1;
-  } else if (*rest == '-') {
-    sign = +1;
-  }
-
-  if (sign != 0) {
-    memset(&offset, 0, sizeof(offset));
-    if (strptime(rest + 1, "%H:%M", &offset) == NULL)
-      return t;
-    t += sign * (offset.tm_hour * 3600 + offset.tm_min * 60);
-  }
-
   return t;
 }
 
@@ -220,7 +162,7 @@ void file_state_start_fun_v4(metalink_pstm_t *stm, int name, int ns_uri,
                              const char **attrs) {
   metalink_error_t r;
 
-  if (ns_uri != METALINK_NS_V4) {
+  if (ns_uri != METALINK_NS_V4 || metalink_pstm_field_skipped(stm, name)) {
     metalink_pstm_enter_skip_state(stm);
     return;
   }
@@ -322,7 +264,7 @@ void file_state_start_fun_v4(metalink_pstm_t *stm, int name, int ns_uri,
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
     }
-    r = metalink_checksum_set_type(checksum, type);
+    r = metalink_pctrl_checksum_set_type(stm->ctrl, type);
     if (r != 0) {
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
@@ -361,12 +303,12 @@ void file_state_start_fun_v4(metalink_pstm_t *stm, int name, int ns_uri,
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
     }
-    r = metalink_chunk_checksum_set_type(chunk_checksum, type);
+    r = metalink_pctrl_chunk_checksum_set_type(stm->ctrl, type);
     if (r != 0) {
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
     }
-    metalink_chunk_checksum_set_length(chunk_checksum, (int)length);
+    metalink_pctrl_chunk_checksum_set_length(stm->ctrl, (int)length);
 
     metalink_pstm_enter_pieces_state_v4(stm);
     break;
@@ -385,7 +327,7 @@ void file_state_start_fun_v4(metalink_pstm_t *stm, int name, int ns_uri,
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
     }
-    r = metalink_signature_set_mediatype(signature, mediatype);
+    r = metalink_pctrl_signature_set_mediatype(stm->ctrl, mediatype);
     if (r != 0) {
       error_handler(stm, METALINK_ERR_BAD_ALLOC);
       return;
@@ -583,7 +525,8 @@ void signature_state_end_fun_v4(metalink_pstm_t *stm, int name, int ns_uri,
   (void)name;
   (void)ns_uri;
 
-  r = metalink_pctrl_signature_set_signature(stm->ctrl, characters);
+  r = metalink_pctrl_signature_take_signature(
+      stm->ctrl, metalink_pstm_take_characters(stm, characters));
   if (r != 0) {
     error_handler(stm, r);
     return;
@@ -657,7 +600,8 @@ void metaurl_state_end_fun_v4(metalink_pstm_t *stm, int name, int ns_uri,
   (void)name;
   (void)ns_uri;
 
-  r = metalink_pctrl_metaurl_set_url(stm->ctrl, characters);
+  r = metalink_pctrl_metaurl_take_url(
+      stm->ctrl, metalink_pstm_take_characters(stm, characters));
   if (r != 0) {
     error_handler(stm, r);
     return;
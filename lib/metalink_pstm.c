@@ -27,6 +27,8 @@
 
 #include <string.h>
 
+#include "metalink_parse_stats.h"
+
 metalink_pstm_t *new_metalink_pstm(void) {
   metalink_pstm_t *stm;
 
@@ -35,6 +37,7 @@ metalink_pstm_t *new_metalink_pstm(void) {
     return NULL;
   }
   stm->state = NULL;
+  stm->characters = NULL;
   stm->ctrl = new_metalink_pctrl();
   if (!stm->ctrl) {
     goto NEW_METALINK_PSTM_ERROR;
@@ -62,6 +65,12 @@ void delete_metalink_pstm(metalink_pstm_t *stm) {
   free(stm);
 }
 
+metalink_error_t metalink_pstm_reset(metalink_pstm_t *stm) {
+  memset(stm->state, 0, sizeof(metalink_pstate_t));
+  metalink_pstm_set_fun(stm, &initial_state_start_fun, &initial_state_end_fun);
+  return metalink_pctrl_reset(stm->ctrl);
+}
+
 int metalink_pstm_character_buffering_enabled(const metalink_pstm_t *stm) {
   return stm->state->character_buffering;
 }
@@ -74,6 +83,44 @@ void metalink_pstm_disable_character_buffering(metalink_pstm_t *stm) {
   stm->state->character_buffering = 0;
 }
 
+char *metalink_pstm_take_characters(metalink_pstm_t *stm,
+                                    const char *characters) {
+  /* Strings in an arena cannot be taken over from the heap. */
+  if (stm->characters && !metalink_pctrl_use_arena(stm->ctrl) &&
+      metalink_string_buffer_str(stm->characters) == characters) {
+    metalink_parse_stats_count_allocation(stm->ctrl->options.stats,
+                                          METALINK_OBJECT_STRING,
+                                          strlen(characters) + 1);
+    return metalink_string_buffer_detach(stm->characters);
+  }
+  return metalink_pctrl_strdup(stm->ctrl, characters);
+}
+
+int metalink_pstm_field_skipped(const metalink_pstm_t *stm, int name) {
+  int field;
+
+  switch (name) {
+  case METALINK_TOKEN_URL:
+    field = METALINK_FIELD_RESOURCES;
+    break;
+  case METALINK_TOKEN_METAURL:
+    field = METALINK_FIELD_METAURLS;
+    break;
+  case METALINK_TOKEN_HASH:
+    field = METALINK_FIELD_CHECKSUMS;
+    break;
+  case METALINK_TOKEN_PIECES:
+    field = METALINK_FIELD_PIECES;
+    break;
+  case METALINK_TOKEN_SIGNATURE:
+    field = METALINK_FIELD_SIGNATURE;
+    break;
+  default:
+    return 0;
+  }
+  return (stm->ctrl->options.skip_fields & field) != 0;
+}
+
 void metalink_pstm_set_fun(metalink_pstm_t *stm, metalink_start_fun start_fun,
                            metalink_end_fun end_fun) {
   stm->state->start_fun = start_fun;
@@ -182,11 +229,16 @@ void metalink_pstm_enter_fin_state(metalink_pstm_t *stm) {
 void metalink_pstm_enter_skip_state(metalink_pstm_t *stm) {
   stm->state->before_skip_state_start_fun = stm->state->start_fun;
   stm->state->before_skip_state_end_fun = stm->state->end_fun;
+  stm->state->before_skip_character_buffering =
+      stm->state->character_buffering;
 
   metalink_pstm_set_fun(stm, &skip_state_start_fun, &skip_state_end_fun);
 
   metalink_pstm_disable_character_buffering(stm);
   stm->state->skip_depth = 1;
+  if (stm->ctrl->options.stats) {
+    ++stm->ctrl->options.stats->skipped_elements;
+  }
 }
 
 void metalink_pstm_exit_skip_state(metalink_pstm_t *stm) {
@@ -34,11 +34,15 @@
 #include "metalink_pstate_v3.h"
 #include "metalink_pstate_v4.h"
 #include "metalink_pctrl.h"
+#include "metalink_string_buffer.h"
 
 /* parser state machine */
 struct _metalink_pstm {
   metalink_pctrl_t *ctrl;
   metalink_pstate_t *state;
+  /* the buffer holding the characters passed to the running end_fun,
+     or NULL */
+  metalink_string_buffer_t *characters;
 } /* metalink_pstm_t */;
 
 /* constructor */
@@ -47,6 +51,9 @@ metalink_pstm_t *new_metalink_pstm(void);
 /* destructor */
 void delete_metalink_pstm(metalink_pstm_t *stm);
 
+/* Returns stm to the initial state for the next document. */
+metalink_error_t metalink_pstm_reset(metalink_pstm_t *stm);
+
 /* Setting callback functions for start element and end element */
 void metalink_pstm_set_fun(metalink_pstm_t *stm, metalink_start_fun start_fun,
                            metalink_end_fun end_fun);
@@ -67,6 +74,22 @@ void metalink_pstm_enable_character_buffering(metalink_pstm_t *stm);
  */
 void metalink_pstm_disable_character_buffering(metalink_pstm_t *stm);
 
+/**
+ * Returns characters, the text passed to the running end_fun, as a
+ * string allocated as by metalink_pctrl_strdup, so that it can be
+ * passed to the *_take_* setters of metalink_pctrl. If possible, the
+ * storage of stm->characters is taken over instead of copying the
+ * text. Returns NULL if out of memory.
+ */
+char *metalink_pstm_take_characters(metalink_pstm_t *stm,
+                                    const char *characters);
+
+/**
+ * Returns nonzero if the element name inside a file entry is excluded
+ * by the skip_fields option and must be skipped.
+ */
+int metalink_pstm_field_skipped(const metalink_pstm_t *stm, int name);
+
 /* functions for state transition */
 void metalink_pstm_enter_null_state(metalink_pstm_t *stm);
 
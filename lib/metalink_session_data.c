@@ -24,7 +24,23 @@
  */
 /* copyright --> */
 #include "metalink_session_data.h"
-#include "metalink_string_buffer.h"
+
+/* the initial capacity of a string buffer */
+#define STRING_BUFFER_INITIAL_CAPACITY 128
+
+/* Buffers which have grown larger than this are not kept in the pool,
+   so that a single huge element does not pin its memory. */
+#define STRING_BUFFER_POOL_MAX_CAPACITY (64 * 1024)
+
+/* Deletes all string buffers in stack. stack may be NULL. */
+static void delete_string_buffers(metalink_stack_t *stack) {
+  if (!stack) {
+    return;
+  }
+  while (!metalink_stack_empty(stack)) {
+    metalink_string_buffer_delete(metalink_stack_pop(stack));
+  }
+}
 
 metalink_session_data_t *metalink_session_data_new(void) {
   metalink_session_data_t *sd;
@@ -35,6 +51,9 @@ metalink_session_data_t *metalink_session_data_new(void) {
   sd->name = -1;
   sd->ns_uri = METALINK_NS_NONE;
   sd->characters_stack = NULL;
+  sd->string_buffer_pool = NULL;
+  sd->stats = NULL;
+  sd->parser = NULL;
   sd->stm = new_metalink_pstm();
   if (!sd->stm) {
     goto NEW_SESSION_DATA_ERROR;
@@ -43,20 +62,90 @@ metalink_session_data_t *metalink_session_data_new(void) {
   if (!sd->characters_stack) {
     goto NEW_SESSION_DATA_ERROR;
   }
+  sd->string_buffer_pool = metalink_stack_new();
+  if (!sd->string_buffer_pool) {
+    goto NEW_SESSION_DATA_ERROR;
+  }
   return sd;
 NEW_SESSION_DATA_ERROR:
   metalink_session_data_delete(sd);
   return NULL;
 }
 
+metalink_error_t metalink_session_data_reset(metalink_session_data_t *sd) {
+  sd->name = -1;
+  sd->ns_uri = METALINK_NS_NONE;
+  while (!metalink_stack_empty(sd->characters_stack)) {
+    metalink_session_data_recycle_characters(
+        sd, metalink_stack_pop(sd->characters_stack));
+  }
+  return metalink_pstm_reset(sd->stm);
+}
+
+metalink_session_data_t *
+metalink_session_data_new_ex(const metalink_parse_options_t *opts) {
+  metalink_session_data_t *sd;
+  sd = metalink_session_data_new();
+  if (!sd) {
+    return NULL;
+  }
+  if (metalink_pctrl_set_options(sd->stm->ctrl, opts) != 0) {
+    metalink_session_data_delete(sd);
+    return NULL;
+  }
+  sd->stats = sd->stm->ctrl->options.stats;
+  return sd;
+}
+
 void metalink_session_data_delete(metalink_session_data_t *sd) {
   if (!sd) {
     return;
   }
   delete_metalink_pstm(sd->stm);
-  while (!metalink_stack_empty(sd->characters_stack)) {
-    metalink_string_buffer_delete(metalink_stack_pop(sd->characters_stack));
+  delete_string_buffers(sd->characters_stack);
+  delete_string_buffers(sd->string_buffer_pool);
+  if (sd->characters_stack) {
+    metalink_stack_delete(sd->characters_stack);
+  }
+  if (sd->string_buffer_pool) {
+    metalink_stack_delete(sd->string_buffer_pool);
   }
-  metalink_stack_delete(sd->characters_stack);
   free(sd);
 }
+
+int metalink_session_data_push_characters(metalink_session_data_t *sd) {
+  metalink_string_buffer_t *str_buf;
+
+  if (metalink_stack_empty(sd->string_buffer_pool)) {
+    str_buf = metalink_string_buffer_new(STRING_BUFFER_INITIAL_CAPACITY);
+    if (!str_buf) {
+      return 1;
+    }
+  } else {
+    str_buf = metalink_stack_pop(sd->string_buffer_pool);
+  }
+  if (metalink_stack_push(sd->characters_stack, str_buf) != 0) {
+    metalink_session_data_recycle_characters(sd, str_buf);
+    return 1;
+  }
+  return 0;
+}
+
+metalink_string_buffer_t *
+metalink_session_data_pop_characters(metalink_session_data_t *sd) {
+  return metalink_stack_pop(sd->characters_stack);
+}
+
+void metalink_session_data_recycle_characters(
+    metalink_session_data_t *sd, metalink_string_buffer_t *str_buf) {
+  if (!str_buf) {
+    return;
+  }
+  if (metalink_string_buffer_capacity(str_buf) >
+          STRING_BUFFER_POOL_MAX_CAPACITY ||
+      metalink_stack_push(sd->string_buffer_pool, str_buf) != 0) {
+    metalink_string_buffer_delete(str_buf);
+    return;
+  }
+  metalink_string_buffer_clear(str_buf);
+}
@@ -32,20 +32,63 @@
 
 #include "metalink_pstm.h"
 #include "metalink_stack.h"
+#include "metalink_string_buffer.h"
 
 typedef struct _metalink_session_data {
   metalink_pstm_t *stm;
 
   metalink_stack_t *characters_stack;
 
+  /* string buffers of finished elements, kept for reuse */
+  metalink_stack_t *string_buffer_pool;
+
   int name;
   int ns_uri;
+
+  /* the statistics requested by the parse options, or NULL */
+  metalink_parse_stats_t *stats;
+
+  /* the XML parser of the backend feeding this session, which is
+     stopped as soon as the document fails */
+  void *parser;
 } metalink_session_data_t;
 
 /* constructor */
 metalink_session_data_t *metalink_session_data_new(void);
 
+/*
+ * Same as metalink_session_data_new, but the document is parsed with
+ * opts. If opts is NULL, the default options are used.
+ */
+metalink_session_data_t *
+metalink_session_data_new_ex(const metalink_parse_options_t *opts);
+
 /* destructor */
 void metalink_session_data_delete(metalink_session_data_t *sd);
 
+/*
+ * Discards the progress of the current document and makes sd ready
+ * for the next one without reallocating it.
+ */
+metalink_error_t metalink_session_data_reset(metalink_session_data_t *sd);
+
+/*
+ * Pushes an empty string buffer onto sd->characters_stack to collect
+ * the character data of the element just started. A buffer from the
+ * pool is used if available. Returns 0 on success.
+ */
+int metalink_session_data_push_characters(metalink_session_data_t *sd);
+
+/*
+ * Pops the string buffer of the element just ended from
+ * sd->characters_stack. Give it back with
+ * metalink_session_data_recycle_characters when done with it.
+ */
+metalink_string_buffer_t *
+metalink_session_data_pop_characters(metalink_session_data_t *sd);
+
+/* Returns str_buf to the pool of sd. str_buf may be NULL. */
+void metalink_session_data_recycle_characters(
+    metalink_session_data_t *sd, metalink_string_buffer_t *str_buf);
+
 #endif /* _D_METALINK_SESSION_DATA_H_ */
@@ -0,0 +1,1008 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_snapshot_common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "metalink_arena.h"
+#include "metalink_mmap.h"
+#include "metalink_string_buffer.h"
+
+/*
+ * A snapshot is a header, followed by the records, followed by the
+ * strings. Records refer to other records and to digest tables by
+ * their offset from the start of the snapshot, and to strings by their
+ * offset from the start of the strings. Offset 0 stands for NULL in
+ * both cases: the records start after the header, and the strings
+ * start with a null character nothing refers to. Every record starts
+ * at a multiple of SNAPSHOT_ALIGNMENT and is in the byte order of the
+ * machine which wrote it.
+ */
+
+#define SNAPSHOT_MAGIC "MLNKSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_ALIGNMENT 8
+#define SNAPSHOT_MAX_LENGTH 0xffffffffu
+
+/* header flags */
+#define SNAPSHOT_FILE_INDEX 1u
+
+/* the kinds of objects whose number is recorded in the header */
+enum {
+  POOL_FILE,
+  POOL_RESOURCE,
+  POOL_METAURL,
+  POOL_CHECKSUM,
+  POOL_CHUNK_CHECKSUM,
+  POOL_PIECE_HASH,
+  POOL_SIGNATURE,
+  /* the elements of all null terminated arrays, including the NULLs */
+  POOL_POINTER,
+  POOL_COUNT
+};
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  /* the length of the whole snapshot */
+  uint64_t length;
+  /* the snap_metalink_t */
+  uint32_t metalink;
+  uint32_t flags;
+  /* the strings, which end the snapshot */
+  uint32_t strings;
+  uint32_t strings_length;
+  /* the number of objects of each pool, so that the loader can
+     allocate them all at once */
+  uint32_t counts[POOL_COUNT];
+  /* what the snapshot was made of, e.g., a cached document */
+  unsigned char key[METALINK_SNAPSHOT_KEY_LENGTH];
+} snap_header_t;
+
+/* count records in a row, or a NULL array if offset is 0 */
+typedef struct {
+  uint32_t offset;
+  uint32_t count;
+} snap_array_t;
+
+typedef struct {
+  int64_t published;
+  int64_t updated;
+  int32_t version;
+  int32_t origin_dynamic;
+  uint32_t generator;
+  uint32_t origin;
+  uint32_t identity;
+  uint32_t tags;
+  /* snap_file_t */
+  snap_array_t files;
+} snap_metalink_t;
+
+typedef struct {
+  int64_t size;
+  uint32_t name;
+  uint32_t description;
+  uint32_t version;
+  uint32_t copyright;
+  uint32_t identity;
+  uint32_t logo;
+  uint32_t publisher_name;
+  uint32_t publisher_url;
+  uint32_t language;
+  uint32_t os;
+  /* strings, each a uint32_t */
+  snap_array_t languages;
+  snap_array_t oses;
+  /* snap_resource_t, snap_metaurl_t and snap_checksum_t */
+  snap_array_t resources;
+  snap_array_t metaurls;
+  snap_array_t checksums;
+  /* a snap_signature_t and a snap_chunk_checksum_t */
+  uint32_t signature;
+  uint32_t chunk_checksum;
+  int32_t maxconnections;
+  uint32_t reserved;
+} snap_file_t;
+
+typedef struct {
+  uint32_t url;
+  uint32_t type;
+  uint32_t location;
+  int32_t preference;
+  int32_t priority;
+  int32_t maxconnections;
+} snap_resource_t;
+
+typedef struct {
+  uint32_t url;
+  uint32_t mediatype;
+  uint32_t name;
+  int32_t priority;
+} snap_metaurl_t;
+
+typedef struct {
+  uint32_t type;
+  uint32_t hash;
+} snap_checksum_t;
+
+typedef struct {
+  uint32_t type;
+  int32_t length;
+  /* snap_piece_hash_t */
+  snap_array_t piece_hashes;
+  /* piece_count * digest_length bytes */
+  uint32_t digests;
+  uint32_t digest_length;
+  uint32_t piece_count;
+  uint32_t reserved;
+} snap_chunk_checksum_t;
+
+typedef struct {
+  int32_t piece;
+  uint32_t hash;
+} snap_piece_hash_t;
+
+typedef struct {
+  uint32_t mediatype;
+  uint32_t signature;
+} snap_signature_t;
+
+/* the size of the objects of each pool in memory */
+static const size_t object_sizes[POOL_COUNT] = {
+    sizeof(metalink_file_t),           sizeof(metalink_resource_t),
+    sizeof(metalink_metaurl_t),        sizeof(metalink_checksum_t),
+    sizeof(metalink_chunk_checksum_t), sizeof(metalink_piece_hash_t),
+    sizeof(metalink_signature_t),      sizeof(void *)};
+
+/*
+ * The least number of snapshot bytes each object of a pool takes: its
+ * record, or for array elements, 4 bytes plus a share of the record
+ * holding the array. Counts in a header which exceed what fits into
+ * the snapshot are rejected, so that a damaged snapshot cannot make
+ * the loader allocate much more than its own size.
+ */
+static const size_t min_record_sizes[POOL_COUNT] = {
+    sizeof(snap_file_t),           sizeof(snap_resource_t),
+    sizeof(snap_metaurl_t),        sizeof(snap_checksum_t),
+    sizeof(snap_chunk_checksum_t), sizeof(snap_piece_hash_t),
+    sizeof(snap_signature_t),      2};
+
+typedef struct {
+  metalink_string_buffer_t *records;
+  metalink_string_buffer_t *strings;
+  /* hash table of the offsets of the strings written so far, so that
+     each string is written once; 0 marks a free slot */
+  uint32_t *slots;
+  size_t mask;
+  size_t string_count;
+  uint32_t counts[POOL_COUNT];
+  metalink_error_t error;
+} snap_writer_t;
+
+static void writer_fail(snap_writer_t *w, metalink_error_t error) {
+  if (!w->error) {
+    w->error = error;
+  }
+}
+
+/*
+ * Appends size bytes of data to the records of w at the next aligned
+ * offset and returns the offset. Returns 0 on error.
+ */
+static uint32_t put_bytes(snap_writer_t *w, const void *data, size_t size) {
+  static const char zeros[SNAPSHOT_ALIGNMENT];
+  size_t length;
+
+  length = metalink_string_buffer_strlen(w->records);
+  if (w->error || size > SNAPSHOT_MAX_LENGTH - sizeof(snap_header_t) -
+                             SNAPSHOT_ALIGNMENT - length) {
+    writer_fail(w, METALINK_ERR_DOCUMENT_TOO_LARGE);
+    return 0;
+  }
+  if (length % SNAPSHOT_ALIGNMENT != 0) {
+    if (metalink_string_buffer_append(
+            w->records, zeros,
+            SNAPSHOT_ALIGNMENT - length % SNAPSHOT_ALIGNMENT) != 0) {
+      writer_fail(w, METALINK_ERR_BAD_ALLOC);
+      return 0;
+    }
+    length = metalink_string_buffer_strlen(w->records);
+  }
+  if (size > 0 &&
+      metalink_string_buffer_append(w->records, data, size) != 0) {
+    writer_fail(w, METALINK_ERR_BAD_ALLOC);
+    return 0;
+  }
+  return (uint32_t)(sizeof(snap_header_t) + length);
+}
+
+static size_t hash_string(const char *str) {
+  size_t h = 2166136261u;
+  for (; *str; ++str) {
+    h = (h ^ (unsigned char)*str) * 16777619u;
+  }
+  return h;
+}
+
+/* Doubles the string table of w. Returns 0 on success. */
+static int grow_slots(snap_writer_t *w) {
+  const char *strings = metalink_string_buffer_str(w->strings);
+  uint32_t *slots;
+  size_t mask;
+  size_t i, j;
+
+  mask = w->mask * 2 + 1;
+  slots = calloc(mask + 1, sizeof(uint32_t));
+  if (!slots) {
+    return 1;
+  }
+  for (i = 0; i <= w->mask; ++i) {
+    if (w->slots[i]) {
+      for (j = hash_string(strings + w->slots[i]) & mask; slots[j];
+           j = (j + 1) & mask)
+        ;
+      slots[j] = w->slots[i];
+    }
+  }
+  free(w->slots);
+  w->slots = slots;
+  w->mask = mask;
+  return 0;
+}
+
+/*
+ * Adds str to the strings of w unless it is there already, and returns
+ * its offset. Returns 0 if str is NULL or on error.
+ */
+static uint32_t put_string(snap_writer_t *w, const char *str) {
+  size_t length;
+  size_t offset;
+  size_t i;
+
+  if (!str || w->error) {
+    return 0;
+  }
+  for (i = hash_string(str) & w->mask; w->slots[i]; i = (i + 1) & w->mask) {
+    if (strcmp(metalink_string_buffer_str(w->strings) + w->slots[i], str) ==
+        0) {
+      return w->slots[i];
+    }
+  }
+  length = strlen(str) + 1;
+  offset = metalink_string_buffer_strlen(w->strings);
+  if (length > SNAPSHOT_MAX_LENGTH - offset) {
+    writer_fail(w, METALINK_ERR_DOCUMENT_TOO_LARGE);
+    return 0;
+  }
+  if (metalink_string_buffer_append(w->strings, str, length) != 0) {
+    writer_fail(w, METALINK_ERR_BAD_ALLOC);
+    return 0;
+  }
+  w->slots[i] = (uint32_t)offset;
+  if (++w->string_count > w->mask / 2 && grow_slots(w) != 0) {
+    writer_fail(w, METALINK_ERR_BAD_ALLOC);
+  }
+  return (uint32_t)offset;
+}
+
+static size_t count_elements(void *const *array) {
+  size_t count = 0;
+  while (array[count]) {
+    ++count;
+  }
+  return count;
+}
+
+/*
+ * Writes the records of the null terminated array of objects one after
+ * the other and sets array to refer to them. fill makes the record of
+ * one object.
+ */
+static void put_array(snap_writer_t *w, snap_array_t *array,
+                      void *const *objects, size_t record_size, int pool,
+                      void (*fill)(snap_writer_t *, void *, const void *)) {
+  char *records;
+  size_t count;
+  size_t i;
+
+  array->offset = 0;
+  array->count = 0;
+  if (!objects || w->error) {
+    return;
+  }
+  count = count_elements(objects);
+  if (count > SNAPSHOT_MAX_LENGTH / record_size) {
+    writer_fail(w, METALINK_ERR_DOCUMENT_TOO_LARGE);
+    return;
+  }
+  records = calloc(count ? count : 1, record_size);
+  if (!records) {
+    writer_fail(w, METALINK_ERR_BAD_ALLOC);
+    return;
+  }
+  for (i = 0; i < count; ++i) {
+    fill(w, records + i * record_size, objects[i]);
+  }
+  array->offset = put_bytes(w, records, count * record_size);
+  array->count = (uint32_t)count;
+  free(records);
+  if (pool != POOL_POINTER) {
+    w->counts[pool] += (uint32_t)count;
+  }
+  w->counts[POOL_POINTER] += (uint32_t)count + 1;
+}
+
+static void fill_string(snap_writer_t *w, void *record, const void *object) {
+  *(uint32_t *)record = put_string(w, object);
+}
+
+static void fill_resource(snap_writer_t *w, void *record,
+                          const void *object) {
+  snap_resource_t *rec = record;
+  const metalink_resource_t *resource = object;
+  rec->url = put_string(w, resource->url);
+  rec->type = put_string(w, resource->type);
+  rec->location = put_string(w, resource->location);
+  rec->preference = resource->preference;
+  rec->priority = resource->priority;
+  rec->maxconnections = resource->maxconnections;
+}
+
+static void fill_metaurl(snap_writer_t *w, void *record, const void *object) {
+  snap_metaurl_t *rec = record;
+  const metalink_metaurl_t *metaurl = object;
+  rec->url = put_string(w, metaurl->url);
+  rec->mediatype = put_string(w, metaurl->mediatype);
+  rec->name = put_string(w, metaurl->name);
+  rec->priority = metaurl->priority;
+}
+
+static void fill_checksum(snap_writer_t *w, void *record,
+                          const void *object) {
+  snap_checksum_t *rec = record;
+  const metalink_checksum_t *checksum = object;
+  rec->type = put_string(w, checksum->type);
+  rec->hash = put_string(w, checksum->hash);
+}
+
+static void fill_piece_hash(snap_writer_t *w, void *record,
+                            const void *object) {
+  snap_piece_hash_t *rec = record;
+  const metalink_piece_hash_t *piece_hash = object;
+  rec->piece = piece_hash->piece;
+  rec->hash = put_string(w, piece_hash->hash);
+}
+
+static uint32_t put_signature(snap_writer_t *w,
+                              const metalink_signature_t *signature) {
+  snap_signature_t rec;
+  if (!signature) {
+    return 0;
+  }
+  rec.mediatype = put_string(w, signature->mediatype);
+  rec.signature = put_string(w, signature->signature);
+  ++w->counts[POOL_SIGNATURE];
+  return put_bytes(w, &rec, sizeof(rec));
+}
+
+static uint32_t
+put_chunk_checksum(snap_writer_t *w,
+                   const metalink_chunk_checksum_t *chunk_checksum) {
+  static metalink_piece_hash_t *const no_piece_hashes[] = {NULL};
+  snap_chunk_checksum_t rec;
+  size_t piece_count;
+  size_t digest_length;
+
+  if (!chunk_checksum) {
+    return 0;
+  }
+  memset(&rec, 0, sizeof(rec));
+  rec.type = put_string(w, chunk_checksum->type);
+  rec.length = chunk_checksum->length;
+  piece_count = metalink_chunk_checksum_get_piece_count(chunk_checksum);
+  digest_length = chunk_checksum->digest_length;
+  if (piece_count > 0) {
+    if (digest_length > SNAPSHOT_MAX_LENGTH ||
+        piece_count > SNAPSHOT_MAX_LENGTH / digest_length) {
+      writer_fail(w, METALINK_ERR_DOCUMENT_TOO_LARGE);
+      return 0;
+    }
+    rec.digests =
+        put_bytes(w, chunk_checksum->digests, piece_count * digest_length);
+    rec.digest_length = (uint32_t)digest_length;
+    rec.piece_count = (uint32_t)piece_count;
+    /* The table is all that is kept, as with compact_pieces. */
+    put_array(w, &rec.piece_hashes,
+              chunk_checksum->piece_hashes ? (void *const *)no_piece_hashes
+                                           : NULL,
+              sizeof(snap_piece_hash_t), POOL_PIECE_HASH, fill_piece_hash);
+  } else {
+    put_array(w, &rec.piece_hashes,
+              (void *const *)chunk_checksum->piece_hashes,
+              sizeof(snap_piece_hash_t), POOL_PIECE_HASH, fill_piece_hash);
+  }
+  ++w->counts[POOL_CHUNK_CHECKSUM];
+  return put_bytes(w, &rec, sizeof(rec));
+}
+
+static void fill_file(snap_writer_t *w, void *record, const void *object) {
+  snap_file_t *rec = record;
+  const metalink_file_t *file = object;
+  rec->size = file->size;
+  rec->name = put_string(w, file->name);
+  rec->description = put_string(w, file->description);
+  rec->version = put_string(w, file->version);
+  rec->copyright = put_string(w, file->copyright);
+  rec->identity = put_string(w, file->identity);
+  rec->logo = put_string(w, file->logo);
+  rec->publisher_name = put_string(w, file->publisher_name);
+  rec->publisher_url = put_string(w, file->publisher_url);
+  rec->language = put_string(w, file->language);
+  rec->os = put_string(w, file->os);
+  put_array(w, &rec->languages, (void *const *)file->languages,
+            sizeof(uint32_t), POOL_POINTER, fill_string);
+  put_array(w, &rec->oses, (void *const *)file->oses, sizeof(uint32_t),
+            POOL_POINTER, fill_string);
+  put_array(w, &rec->resources, (void *const *)file->resources,
+            sizeof(snap_resource_t), POOL_RESOURCE, fill_resource);
+  put_array(w, &rec->metaurls, (void *const *)file->metaurls,
+            sizeof(snap_metaurl_t), POOL_METAURL, fill_metaurl);
+  put_array(w, &rec->checksums, (void *const *)file->checksums,
+            sizeof(snap_checksum_t), POOL_CHECKSUM, fill_checksum);
+  rec->signature = put_signature(w, file->signature);
+  rec->chunk_checksum = put_chunk_checksum(w, file->chunk_checksum);
+  rec->maxconnections = file->maxconnections;
+}
+
+/*
+ * Creates a temporary file next to path, which is opened for writing
+ * in *fp. Its name is stored in *temp_path, which the caller must
+ * free. Each call gets a file of its own, even if several threads save
+ * to the same path at once.
+ */
+static metalink_error_t open_temp_file(FILE **fp, char **temp_path,
+                                       const char *path) {
+#ifdef HAVE_MKSTEMP
+  int fd;
+  mode_t mask;
+#endif /* HAVE_MKSTEMP */
+
+  *temp_path = malloc(strlen(path) + 32);
+  if (!*temp_path) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+#ifdef HAVE_MKSTEMP
+  sprintf(*temp_path, "%s.XXXXXX", path);
+  fd = mkstemp(*temp_path);
+  if (fd != -1) {
+    /* mkstemp creates the file with mode 0600, which the rename would
+       carry over to path. Give it the mode fopen would have, so that a
+       snapshot in a shared directory stays readable by others. umask
+       can only be read by setting it, hence the restore. */
+    mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+  }
+  *fp = fd == -1 ? NULL : fdopen(fd, "wb");
+  if (fd != -1 && !*fp) {
+    close(fd);
+    remove(*temp_path);
+  }
+#else  /* !HAVE_MKSTEMP */
+  sprintf(*temp_path, "%s.%ld.tmp", path, (long)getpid());
+  *fp = fopen(*temp_path, "wb");
+#endif /* !HAVE_MKSTEMP */
+  if (!*fp) {
+    free(*temp_path);
+    return METALINK_ERR_CANNOT_OPEN_FILE;
+  }
+  return 0;
+}
+
+/* Writes the snapshot made by w to path through a temporary file. */
+static metalink_error_t write_snapshot(const snap_writer_t *w,
+                                       const snap_header_t *header,
+                                       const char *path) {
+  metalink_error_t r;
+  char *temp_path;
+  FILE *fp;
+
+  r = open_temp_file(&fp, &temp_path, path);
+  if (r != 0) {
+    return r;
+  }
+  if (fwrite(header, sizeof(*header), 1, fp) != 1 ||
+      fwrite(metalink_string_buffer_str(w->records), 1,
+             metalink_string_buffer_strlen(w->records),
+             fp) != metalink_string_buffer_strlen(w->records) ||
+      fwrite(metalink_string_buffer_str(w->strings), 1,
+             metalink_string_buffer_strlen(w->strings),
+             fp) != metalink_string_buffer_strlen(w->strings)) {
+    r = METALINK_ERR_CANNOT_WRITE_FILE;
+  }
+  if (fclose(fp) != 0) {
+    r = METALINK_ERR_CANNOT_WRITE_FILE;
+  }
+  if (r == 0 && rename(temp_path, path) != 0) {
+    r = METALINK_ERR_CANNOT_WRITE_FILE;
+  }
+  if (r != 0) {
+    remove(temp_path);
+  }
+  free(temp_path);
+  return r;
+}
+
+metalink_error_t metalink_save_snapshot_keyed(const metalink_t *metalink,
+                                              const char *path,
+                                              const unsigned char *key) {
+  snap_writer_t w;
+  snap_header_t header;
+  snap_metalink_t rec;
+  metalink_error_t r;
+
+  memset(&w, 0, sizeof(w));
+  w.records = metalink_string_buffer_new(4096);
+  w.strings = metalink_string_buffer_new(4096);
+  w.mask = 255;
+  w.slots = calloc(w.mask + 1, sizeof(uint32_t));
+  if (!w.records || !w.strings || !w.slots ||
+      metalink_string_buffer_append(w.strings, "", 1) != 0) {
+    r = METALINK_ERR_BAD_ALLOC;
+    goto SAVE_SNAPSHOT_END;
+  }
+
+  memset(&rec, 0, sizeof(rec));
+  rec.published = metalink->published;
+  rec.updated = metalink->updated;
+  rec.version = metalink->version;
+  rec.origin_dynamic = metalink->origin_dynamic;
+  rec.generator = put_string(&w, metalink->generator);
+  rec.origin = put_string(&w, metalink->origin);
+  rec.identity = put_string(&w, metalink->identity);
+  rec.tags = put_string(&w, metalink->tags);
+  put_array(&w, &rec.files, (void *const *)metalink->files,
+            sizeof(snap_file_t), POOL_FILE, fill_file);
+
+  memset(&header, 0, sizeof(header));
+  header.metalink = put_bytes(&w, &rec, sizeof(rec));
+  header.strings = (uint32_t)(sizeof(header) +
+                              metalink_string_buffer_strlen(w.records));
+  if (!w.error && metalink_string_buffer_strlen(w.strings) >
+                      SNAPSHOT_MAX_LENGTH - header.strings) {
+    writer_fail(&w, METALINK_ERR_DOCUMENT_TOO_LARGE);
+  }
+  if (w.error) {
+    r = w.error;
+    goto SAVE_SNAPSHOT_END;
+  }
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.byte_order = SNAPSHOT_BYTE_ORDER;
+  header.strings_length =
+      (uint32_t)metalink_string_buffer_strlen(w.strings);
+  header.length = (uint64_t)header.strings + header.strings_length;
+  header.flags = metalink->file_index ? SNAPSHOT_FILE_INDEX : 0;
+  memcpy(header.counts, w.counts, sizeof(header.counts));
+  if (key) {
+    memcpy(header.key, key, sizeof(header.key));
+  }
+  r = write_snapshot(&w, &header, path);
+
+SAVE_SNAPSHOT_END:
+  metalink_string_buffer_delete(w.records);
+  metalink_string_buffer_delete(w.strings);
+  free(w.slots);
+  return r;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_save_snapshot(const metalink_t *metalink, const char *path) {
+  return metalink_save_snapshot_keyed(metalink, path, NULL);
+}
+
+typedef struct {
+  const char *image;
+  /* the records end where the strings start */
+  uint32_t records_end;
+  const char *strings;
+  uint32_t strings_length;
+  /* the objects of each pool which are not handed out yet */
+  char *pools[POOL_COUNT];
+  uint32_t left[POOL_COUNT];
+  /* set if anything in the snapshot is out of place */
+  int bad;
+} snap_loader_t;
+
+/*
+ * Returns the count records of size bytes at offset, or NULL if offset
+ * is 0. Marks the snapshot bad if they are not all within the records.
+ */
+static const void *get_records(snap_loader_t *l, uint32_t offset,
+                               uint32_t count, size_t size) {
+  if (offset == 0) {
+    return NULL;
+  }
+  if (offset < sizeof(snap_header_t) || offset % SNAPSHOT_ALIGNMENT != 0 ||
+      offset > l->records_end ||
+      (uint64_t)count * size > (uint64_t)(l->records_end - offset)) {
+    l->bad = 1;
+    return NULL;
+  }
+  return l->image + offset;
+}
+
+/*
+ * Returns the string at offset, or NULL if offset is 0. As the strings
+ * end with a null character, any offset within them is safe to use.
+ */
+static char *get_string(snap_loader_t *l, uint32_t offset) {
+  if (offset >= l->strings_length) {
+    l->bad = 1;
+    return NULL;
+  }
+  return offset ? (char *)l->strings + offset : NULL;
+}
+
+/* Hands out count objects of pool, or returns NULL if there are fewer. */
+static void *take(snap_loader_t *l, int pool, uint64_t count) {
+  char *objects;
+  if (count > l->left[pool]) {
+    l->bad = 1;
+    return NULL;
+  }
+  objects = l->pools[pool];
+  l->pools[pool] += (size_t)count * object_sizes[pool];
+  l->left[pool] -= (uint32_t)count;
+  return objects;
+}
+
+/*
+ * Makes the null terminated array of objects described by the records
+ * which array refers to. fill sets up one object from its record.
+ */
+static void *load_array(snap_loader_t *l, const snap_array_t *array,
+                        size_t record_size, int pool,
+                        void (*fill)(snap_loader_t *, void *, const void *)) {
+  const char *records;
+  char *objects = NULL;
+  void **elements;
+  uint32_t i;
+
+  records = get_records(l, array->offset, array->count, record_size);
+  if (!records) {
+    if (array->count != 0) {
+      l->bad = 1;
+    }
+    return NULL;
+  }
+  elements = take(l, POOL_POINTER, (uint64_t)array->count + 1);
+  if (pool != POOL_POINTER) {
+    objects = take(l, pool, array->count);
+  }
+  if (l->bad) {
+    return NULL;
+  }
+  for (i = 0; i < array->count; ++i) {
+    if (objects) {
+      elements[i] = objects + (size_t)i * object_sizes[pool];
+    }
+    fill(l, &elements[i], records + (size_t)i * record_size);
+  }
+  return elements;
+}
+
+/* for string lists, element points to the array element itself */
+static void load_string(snap_loader_t *l, void *element, const void *record) {
+  *(char **)element = get_string(l, *(const uint32_t *)record);
+}
+
+static void load_resource(snap_loader_t *l, void *element,
+                          const void *record) {
+  metalink_resource_t *resource = *(void **)element;
+  const snap_resource_t *rec = record;
+  resource->url = get_string(l, rec->url);
+  resource->type = get_string(l, rec->type);
+  resource->location = get_string(l, rec->location);
+  resource->preference = rec->preference;
+  resource->priority = rec->priority;
+  resource->maxconnections = rec->maxconnections;
+}
+
+static void load_metaurl(snap_loader_t *l, void *element,
+                         const void *record) {
+  metalink_metaurl_t *metaurl = *(void **)element;
+  const snap_metaurl_t *rec = record;
+  metaurl->url = get_string(l, rec->url);
+  metaurl->mediatype = get_string(l, rec->mediatype);
+  metaurl->name = get_string(l, rec->name);
+  metaurl->priority = rec->priority;
+}
+
+static void load_checksum(snap_loader_t *l, void *element,
+                          const void *record) {
+  metalink_checksum_t *checksum = *(void **)element;
+  const snap_checksum_t *rec = record;
+  checksum->type = get_string(l, rec->type);
+  checksum->hash = get_string(l, rec->hash);
+}
+
+static void load_piece_hash(snap_loader_t *l, void *element,
+                            const void *record) {
+  metalink_piece_hash_t *piece_hash = *(void **)element;
+  const snap_piece_hash_t *rec = record;
+  piece_hash->piece = rec->piece;
+  piece_hash->hash = get_string(l, rec->hash);
+}
+
+static metalink_signature_t *load_signature(snap_loader_t *l,
+                                            uint32_t offset) {
+  const snap_signature_t *rec;
+  metalink_signature_t *signature;
+
+  rec = get_records(l, offset, 1, sizeof(*rec));
+  if (!rec || !(signature = take(l, POOL_SIGNATURE, 1))) {
+    return NULL;
+  }
+  signature->mediatype = get_string(l, rec->mediatype);
+  signature->signature = get_string(l, rec->signature);
+  return signature;
+}
+
+static metalink_chunk_checksum_t *load_chunk_checksum(snap_loader_t *l,
+                                                      uint32_t offset) {
+  const snap_chunk_checksum_t *rec;
+  metalink_chunk_checksum_t *chunk_checksum;
+  uint64_t size;
+
+  rec = get_records(l, offset, 1, sizeof(*rec));
+  if (!rec || !(chunk_checksum = take(l, POOL_CHUNK_CHECKSUM, 1))) {
+    return NULL;
+  }
+  chunk_checksum->type = get_string(l, rec->type);
+  chunk_checksum->length = rec->length;
+  chunk_checksum->piece_hashes =
+      load_array(l, &rec->piece_hashes, sizeof(snap_piece_hash_t),
+                 POOL_PIECE_HASH, load_piece_hash);
+  if (rec->digests) {
+    /* Digests are bytes, so they need not be aligned. */
+    size = (uint64_t)rec->piece_count * rec->digest_length;
+    if (rec->digests < sizeof(snap_header_t) ||
+        rec->digests > l->records_end ||
+        size > (uint64_t)(l->records_end - rec->digests) ||
+        rec->piece_count == 0 || rec->digest_length == 0) {
+      l->bad = 1;
+      return NULL;
+    }
+    chunk_checksum->digests = (unsigned char *)l->image + rec->digests;
+    chunk_checksum->digest_length = rec->digest_length;
+    chunk_checksum->piece_count = rec->piece_count;
+  }
+  return chunk_checksum;
+}
+
+static void load_file(snap_loader_t *l, void *element, const void *record) {
+  metalink_file_t *file = *(void **)element;
+  const snap_file_t *rec = record;
+  file->name = get_string(l, rec->name);
+  file->description = get_string(l, rec->description);
+  file->size = rec->size;
+  file->version = get_string(l, rec->version);
+  file->copyright = get_string(l, rec->copyright);
+  file->identity = get_string(l, rec->identity);
+  file->logo = get_string(l, rec->logo);
+  file->publisher_name = get_string(l, rec->publisher_name);
+  file->publisher_url = get_string(l, rec->publisher_url);
+  file->languages = load_array(l, &rec->languages, sizeof(uint32_t),
+                               POOL_POINTER, load_string);
+  file->language = get_string(l, rec->language);
+  file->oses =
+      load_array(l, &rec->oses, sizeof(uint32_t), POOL_POINTER, load_string);
+  file->os = get_string(l, rec->os);
+  file->signature = load_signature(l, rec->signature);
+  file->maxconnections = rec->maxconnections;
+  file->resources = load_array(l, &rec->resources, sizeof(snap_resource_t),
+                               POOL_RESOURCE, load_resource);
+  file->metaurls = load_array(l, &rec->metaurls, sizeof(snap_metaurl_t),
+                              POOL_METAURL, load_metaurl);
+  file->checksums = load_array(l, &rec->checksums, sizeof(snap_checksum_t),
+                               POOL_CHECKSUM, load_checksum);
+  file->chunk_checksum = load_chunk_checksum(l, rec->chunk_checksum);
+}
+
+/*
+ * Checks the snapshot of length bytes at image and makes a metalink_t
+ * from it in arena.
+ */
+static metalink_error_t load_image(metalink_arena_t *arena,
+                                   const char *image, size_t length,
+                                   const unsigned char *key,
+                                   metalink_t **res) {
+  const snap_header_t *header = (const snap_header_t *)image;
+  const snap_metalink_t *rec;
+  snap_loader_t l;
+  metalink_t *metalink;
+  int i;
+
+  if (length < sizeof(*header) ||
+      memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SNAPSHOT_VERSION ||
+      header->byte_order != SNAPSHOT_BYTE_ORDER || header->length != length ||
+      header->strings < sizeof(*header) || header->strings_length == 0 ||
+      (uint64_t)header->strings + header->strings_length != length ||
+      image[header->strings] != '\0' || image[length - 1] != '\0' ||
+      (key && memcmp(header->key, key, sizeof(header->key)) != 0)) {
+    return METALINK_ERR_BAD_SNAPSHOT;
+  }
+  memset(&l, 0, sizeof(l));
+  l.image = image;
+  l.records_end = header->strings;
+  l.strings = image + header->strings;
+  l.strings_length = header->strings_length;
+  for (i = 0; i < POOL_COUNT; ++i) {
+    if (header->counts[i] > length / min_record_sizes[i]) {
+      return METALINK_ERR_BAD_SNAPSHOT;
+    }
+    l.left[i] = header->counts[i];
+    if (l.left[i] > 0) {
+      l.pools[i] =
+          metalink_arena_calloc(arena, (size_t)l.left[i] * object_sizes[i]);
+      if (!l.pools[i]) {
+        return METALINK_ERR_BAD_ALLOC;
+      }
+    }
+  }
+
+  rec = get_records(&l, header->metalink, 1, sizeof(*rec));
+  metalink = metalink_arena_calloc(arena, sizeof(metalink_t));
+  if (!rec || !metalink) {
+    return rec ? METALINK_ERR_BAD_ALLOC : METALINK_ERR_BAD_SNAPSHOT;
+  }
+  switch (rec->version) {
+  case METALINK_VERSION_UNKNOWN:
+  case METALINK_VERSION_3:
+  case METALINK_VERSION_4:
+    metalink->version = (metalink_version_t)rec->version;
+    break;
+  default:
+    return METALINK_ERR_BAD_SNAPSHOT;
+  }
+  metalink->generator = get_string(&l, rec->generator);
+  metalink->origin = get_string(&l, rec->origin);
+  metalink->origin_dynamic = rec->origin_dynamic;
+  metalink->published = (time_t)rec->published;
+  metalink->updated = (time_t)rec->updated;
+  metalink->identity = get_string(&l, rec->identity);
+  metalink->tags = get_string(&l, rec->tags);
+  metalink->files = load_array(&l, &rec->files, sizeof(snap_file_t),
+                               POOL_FILE, load_file);
+  if (l.bad) {
+    return METALINK_ERR_BAD_SNAPSHOT;
+  }
+  metalink->arena = arena;
+  if ((header->flags & SNAPSHOT_FILE_INDEX) &&
+      metalink_index_files(metalink) != 0) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  *res = metalink;
+  return 0;
+}
+
+/*
+ * Reads the file fd into arena if it cannot be mapped. Returns 0 on
+ * success.
+ */
+static metalink_error_t read_image(metalink_arena_t *arena, int fd,
+                                   const char **image, size_t *length) {
+  metalink_string_buffer_t *buf;
+  metalink_error_t r = 0;
+  char block[4096];
+  char *copy;
+  ssize_t num_read;
+
+  buf = metalink_string_buffer_new(0);
+  if (!buf) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  for (;;) {
+    while ((num_read = read(fd, block, sizeof(block))) == -1 &&
+           errno == EINTR)
+      ;
+    if (num_read == -1) {
+      r = METALINK_ERR_CANNOT_READ_FILE;
+      break;
+    } else if (num_read == 0) {
+      break;
+    }
+    if (metalink_string_buffer_append(buf, block, (size_t)num_read) != 0) {
+      r = METALINK_ERR_BAD_ALLOC;
+      break;
+    }
+  }
+  if (r == 0) {
+    /* The arena keeps the copy aligned for the records. */
+    *length = metalink_string_buffer_strlen(buf);
+    copy = metalink_arena_calloc(arena, *length);
+    if (copy) {
+      memcpy(copy, metalink_string_buffer_str(buf), *length);
+      *image = copy;
+    } else {
+      r = METALINK_ERR_BAD_ALLOC;
+    }
+  }
+  metalink_string_buffer_delete(buf);
+  return r;
+}
+
+metalink_error_t metalink_load_snapshot_keyed(const char *path,
+                                              const unsigned char *key,
+                                              metalink_t **res) {
+  metalink_arena_t *arena;
+  metalink_mmap_t map;
+  metalink_error_t r;
+  const char *image;
+  size_t length;
+  int fd;
+
+  while ((fd = open(path, O_RDONLY | O_BINARY)) == -1 && errno == EINTR)
+    ;
+  if (fd == -1) {
+    return METALINK_ERR_CANNOT_OPEN_FILE;
+  }
+  arena = metalink_arena_new();
+  if (!arena) {
+    close(fd);
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  if (metalink_mmap_file(&map, fd) == 0) {
+    metalink_arena_keep_mapping(arena, &map);
+    image = map.addr;
+    length = map.length;
+    r = 0;
+  } else {
+    r = read_image(arena, fd, &image, &length);
+  }
+  close(fd);
+  if (r == 0) {
+    r = load_image(arena, image, length, key, res);
+  }
+  if (r != 0) {
+    metalink_arena_delete(arena);
+  }
+  return r;
+}
+
+metalink_error_t METALINK_PUBLIC metalink_load_snapshot(const char *path,
+                                                        metalink_t **res) {
+  return metalink_load_snapshot_keyed(path, NULL, res);
+}
@@ -0,0 +1,53 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_SNAPSHOT_COMMON_H_
+#define _D_METALINK_SNAPSHOT_COMMON_H_
+
+#include "metalink_config.h"
+
+#include <metalink/metalink.h>
+
+/* the length of the key which identifies what a snapshot was made of */
+#define METALINK_SNAPSHOT_KEY_LENGTH 32
+
+/*
+ * Like metalink_save_snapshot, but records key in the snapshot. key
+ * is METALINK_SNAPSHOT_KEY_LENGTH bytes long, or NULL for all zeros.
+ */
+metalink_error_t metalink_save_snapshot_keyed(const metalink_t *metalink,
+                                              const char *path,
+                                              const unsigned char *key);
+
+/*
+ * Like metalink_load_snapshot, but fails with METALINK_ERR_BAD_SNAPSHOT
+ * unless the snapshot was saved with key. If key is NULL, any key is
+ * accepted.
+ */
+metalink_error_t metalink_load_snapshot_keyed(const char *path,
+                                              const unsigned char *key,
+                                              metalink_t **res);
+
+#endif /* _D_METALINK_SNAPSHOT_COMMON_H_ */
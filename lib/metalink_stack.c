@@ -25,9 +25,14 @@
 /* copyright --> */
 #include "metalink_stack.h"
 
-#include <stdlib.h>
+/* the capacity of the first allocation */
+#define METALINK_STACK_MIN_CAPACITY 16
 
-static void init_stack(metalink_stack_t *s) { s->entry = NULL; }
+static void init_stack(metalink_stack_t *s) {
+  s->data = NULL;
+  s->length = 0;
+  s->capacity = 0;
+}
 
 metalink_stack_t *metalink_stack_new(void) {
   metalink_stack_t *s = malloc(sizeof(metalink_stack_t));
@@ -38,50 +43,43 @@ metalink_stack_t *metalink_stack_new(void) {
 }
 
 void metalink_stack_delete(metalink_stack_t *stack) {
-  metalink_stack_entry_t *e;
-  metalink_stack_entry_t *next;
-
-  e = stack->entry;
-  while (e) {
-    next = e->next;
-    free(e);
-    e = next;
-  }
+  free(stack->data);
   free(stack);
 }
 
 int metalink_stack_empty(const metalink_stack_t *stack) {
-  return stack->entry == NULL;
+  return stack->length == 0;
 }
 
 int metalink_stack_push(metalink_stack_t *stack, void *data) {
-  metalink_stack_entry_t *new_entry;
+  if (stack->length == stack->capacity) {
+    size_t new_capacity;
+    void **new_data;
 
-  new_entry = malloc(sizeof(metalink_stack_entry_t));
-  if (!new_entry) {
-    return 1;
+    new_capacity =
+        stack->capacity ? stack->capacity * 2 : METALINK_STACK_MIN_CAPACITY;
+    if (new_capacity > ((size_t)-1) / sizeof(void *)) {
+      return 1;
+    }
+    new_data = realloc(stack->data, new_capacity * sizeof(void *));
+    if (!new_data) {
+      return 1;
+    }
+    stack->data = new_data;
+    stack->capacity = new_capacity;
   }
-  new_entry->data = data;
-  new_entry->next = stack->entry;
-  stack->entry = new_entry;
+  stack->data[stack->length++] = data;
   return 0;
 }
 
 void *metalink_stack_pop(metalink_stack_t *stack) {
-  metalink_stack_entry_t *pop_entry;
-  void *data;
-
-  pop_entry = stack->entry;
-  stack->entry = pop_entry->next;
-  data = pop_entry->data;
-  free(pop_entry);
-  return data;
+  return stack->data[--stack->length];
 }
 
 void *metalink_stack_top(metalink_stack_t *stack) {
   if (metalink_stack_empty(stack)) {
     return NULL;
   } else {
-    return stack->entry->data;
+    return stack->data[stack->length - 1];
   }
 }
@@ -28,15 +28,15 @@
 
 #include "metalink_config.h"
 
-#include <metalink/metalink.h>
+#include <stdlib.h>
 
-typedef struct _metalink_stack_entry {
-  void *data;
-  struct _metalink_stack_entry *next;
-} metalink_stack_entry_t;
+#include <metalink/metalink.h>
 
+/* A stack of pointers on top of a growable array. */
 typedef struct _metalink_stack {
-  metalink_stack_entry_t *entry;
+  void **data;
+  size_t length;
+  size_t capacity;
 } metalink_stack_t;
 
 metalink_stack_t *metalink_stack_new(void);
@@ -51,34 +51,76 @@ void metalink_string_buffer_delete(metalink_string_buffer_t *str_buf) {
   }
 }
 
-static void metalink_string_buffer_resize(metalink_string_buffer_t *str_buf,
-                                          size_t new_capacity) {
+/*
+ * Grows the capacity of str_buf to at least min_capacity. The capacity
+ * is at least doubled, so that a series of small appends takes
+ * amortized linear time. Returns 0 on success.
+ */
+static int metalink_string_buffer_reserve(metalink_string_buffer_t *str_buf,
+                                          size_t min_capacity) {
+  size_t new_capacity;
   char *new_buffer;
 
+  if (min_capacity <= str_buf->capacity && str_buf->buffer) {
+    return 0;
+  }
+  new_capacity = str_buf->capacity * 2;
+  if (new_capacity < min_capacity) {
+    new_capacity = min_capacity;
+  }
+  if (new_capacity < METALINK_STRING_BUFFER_MIN_CAPACITY) {
+    new_capacity = METALINK_STRING_BUFFER_MIN_CAPACITY;
+  }
   new_buffer = realloc(str_buf->buffer, new_capacity + 1);
-
+  if (!new_buffer) {
+    return 1;
+  }
   str_buf->buffer = new_buffer;
   str_buf->capacity = new_capacity;
-  if (str_buf->length > new_capacity) {
-    str_buf->length = new_capacity;
-    str_buf->buffer[str_buf->length] = '\0';
-  }
+  return 0;
 }
 
-void metalink_string_buffer_append(metalink_string_buffer_t *str_buf,
-                                   const char *str, size_t length) {
-  if (str_buf->length + length > str_buf->capacity) {
-    metalink_string_buffer_resize(str_buf, str_buf->length + length);
+int metalink_string_buffer_append(metalink_string_buffer_t *str_buf,
+                                  const char *str, size_t length) {
+  if (length > ((size_t)-1) / 2 - str_buf->length ||
+      metalink_string_buffer_reserve(str_buf, str_buf->length + length) != 0) {
+    return 1;
   }
 
   memcpy(str_buf->buffer + str_buf->length, str, length);
   str_buf->length += length;
   str_buf->buffer[str_buf->length] = '\0';
+  return 0;
+}
+
+char *metalink_string_buffer_detach(metalink_string_buffer_t *str_buf) {
+  char *str;
+
+  if (!str_buf->buffer) {
+    str = malloc(1);
+    if (str) {
+      str[0] = '\0';
+    }
+    return str;
+  }
+  str = str_buf->buffer;
+  if (str_buf->capacity > str_buf->length) {
+    /* Give back the unused capacity; this is not supposed to fail, and
+       the original block is fine if it does. */
+    char *shrunk = realloc(str, str_buf->length + 1);
+    if (shrunk) {
+      str = shrunk;
+    }
+  }
+  str_buf->buffer = NULL;
+  str_buf->length = 0;
+  str_buf->capacity = 0;
+  return str;
 }
 
 const char *
 metalink_string_buffer_str(const metalink_string_buffer_t *str_buf) {
-  return str_buf->buffer;
+  return str_buf->buffer ? str_buf->buffer : "";
 }
 
 size_t
@@ -89,3 +131,10 @@ metalink_string_buffer_capacity(const metalink_string_buffer_t *str_buf) {
 size_t metalink_string_buffer_strlen(const metalink_string_buffer_t *str_buf) {
   return str_buf->length;
 }
+
+void metalink_string_buffer_clear(metalink_string_buffer_t *str_buf) {
+  str_buf->length = 0;
+  if (str_buf->buffer) {
+    str_buf->buffer[0] = '\0';
+  }
+}
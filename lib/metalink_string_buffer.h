@@ -32,7 +32,11 @@
 
 #include <metalink/metalink.h>
 
+/* the smallest capacity allocated by metalink_string_buffer_append */
+#define METALINK_STRING_BUFFER_MIN_CAPACITY 16
+
 typedef struct metalink_string_buffer_t {
+  /* NULL after metalink_string_buffer_detach until the next append */
   char *buffer;
   size_t length;
   size_t capacity;
@@ -42,8 +46,19 @@ metalink_string_buffer_t *metalink_string_buffer_new(size_t initial_capacity);
 
 void metalink_string_buffer_delete(metalink_string_buffer_t *str_buf);
 
-void metalink_string_buffer_append(metalink_string_buffer_t *str_buf,
-                                   const char *str, size_t length);
+/*
+ * Appends length bytes of str to str_buf. Returns 0 on success, or 1 if
+ * out of memory, in which case str_buf is left untouched.
+ */
+int metalink_string_buffer_append(metalink_string_buffer_t *str_buf,
+                                  const char *str, size_t length);
+
+/*
+ * Hands the null terminated contents of str_buf over to the caller,
+ * who must free it with free(), and leaves str_buf empty. Returns NULL
+ * if out of memory.
+ */
+char *metalink_string_buffer_detach(metalink_string_buffer_t *str_buf);
 
 const char *metalink_string_buffer_str(const metalink_string_buffer_t *str_buf);
 
@@ -51,4 +66,7 @@ size_t metalink_string_buffer_capacity(const metalink_string_buffer_t *str_buf);
 
 size_t metalink_string_buffer_strlen(const metalink_string_buffer_t *str_buf);
 
+/* Empties str_buf, keeping its capacity. */
+void metalink_string_buffer_clear(metalink_string_buffer_t *str_buf);
+
 #endif /* _D_METALINK_STRING_BUFFER_H_ */
@@ -31,6 +31,9 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include "metalink_arena.h"
+#include "metalink_file_index.h"
+
 static metalink_error_t allocate_copy_string(char **dest, const char *src) {
   free(*dest);
   if (src) {
@@ -397,6 +400,7 @@ metalink_chunk_checksum_delete(metalink_chunk_checksum_t *chunk_checksum) {
     }
     free(chunk_checksum->piece_hashes);
   }
+  free(chunk_checksum->digests);
   free(chunk_checksum);
 }
 
@@ -425,6 +429,29 @@ void METALINK_PUBLIC metalink_chunk_checksum_set_piece_hashes(
     free(chunk_checksum->piece_hashes);
   }
   chunk_checksum->piece_hashes = piece_hashes;
+  /* The digest table no longer matches. */
+  free(chunk_checksum->digests);
+  chunk_checksum->digests = NULL;
+  chunk_checksum->digest_length = 0;
+  chunk_checksum->piece_count = 0;
+}
+
+size_t METALINK_PUBLIC metalink_chunk_checksum_get_piece_count(
+    const metalink_chunk_checksum_t *chunk_checksum) {
+  return chunk_checksum->digests ? chunk_checksum->piece_count : 0;
+}
+
+size_t METALINK_PUBLIC metalink_chunk_checksum_get_digest_length(
+    const metalink_chunk_checksum_t *chunk_checksum) {
+  return chunk_checksum->digest_length;
+}
+
+const unsigned char METALINK_PUBLIC *metalink_chunk_checksum_get_digest(
+    const metalink_chunk_checksum_t *chunk_checksum, size_t index) {
+  if (!chunk_checksum->digests || index >= chunk_checksum->piece_count) {
+    return NULL;
+  }
+  return chunk_checksum->digests + index * chunk_checksum->digest_length;
 }
 
 /* for metalink_signature_t */
@@ -473,6 +500,12 @@ void METALINK_PUBLIC metalink_delete(metalink_t *metalink) {
   if (!metalink) {
     return;
   }
+  metalink_file_index_delete(metalink->file_index);
+  if (metalink->arena) {
+    /* metalink itself lives in the arena, too. */
+    metalink_arena_delete(metalink->arena);
+    return;
+  }
 
   if (metalink->generator) {
     free(metalink->generator);
@@ -0,0 +1,1147 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include <metalink/metalink.h>
+
+#include "metalink_digest.h"
+#include "metalink_helper.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif /* !O_BINARY */
+
+/* Each thread reads a piece in blocks of at most this many bytes. */
+#define VERIFY_BUFFER_LENGTH (1024 * 1024)
+
+/* The binary piece hashes of a chunk checksum. */
+typedef struct _piece_table {
+  metalink_digest_algo_t algo;
+  size_t digest_length;
+  size_t piece_count;
+  long long piece_length;
+  const unsigned char *digests;
+  /* owns digests if they had to be decoded from piece_hashes */
+  unsigned char *decoded;
+} piece_table_t;
+
+static metalink_error_t
+piece_table_init(piece_table_t *table,
+                 const metalink_chunk_checksum_t *chunk_checksum) {
+  metalink_piece_hash_t **piece_hashes;
+  const char *hash;
+  unsigned char *seen;
+  size_t i;
+  int piece;
+  metalink_error_t r;
+
+  if (!chunk_checksum || chunk_checksum->length <= 0) {
+    return METALINK_ERR_NO_PIECE_HASHES;
+  }
+  if (metalink_digest_algo_from_name(&table->algo, chunk_checksum->type) !=
+      0) {
+    return METALINK_ERR_UNSUPPORTED_HASH;
+  }
+  table->digest_length = metalink_digest_length(table->algo);
+  table->piece_length = chunk_checksum->length;
+  table->decoded = NULL;
+
+  table->piece_count = metalink_chunk_checksum_get_piece_count(chunk_checksum);
+  if (table->piece_count > 0) {
+    if (metalink_chunk_checksum_get_digest_length(chunk_checksum) !=
+        table->digest_length) {
+      return METALINK_ERR_NO_PIECE_HASHES;
+    }
+    table->digests = metalink_chunk_checksum_get_digest(chunk_checksum, 0);
+    return 0;
+  }
+
+  /* No digest table, e.g., the chunk checksum was built by hand. */
+  piece_hashes = chunk_checksum->piece_hashes;
+  for (; piece_hashes && piece_hashes[table->piece_count];
+       ++table->piece_count)
+    ;
+  if (table->piece_count == 0) {
+    return METALINK_ERR_NO_PIECE_HASHES;
+  }
+  table->decoded = malloc(table->piece_count * table->digest_length);
+  seen = calloc(table->piece_count, 1);
+  if (!table->decoded || !seen) {
+    r = METALINK_ERR_BAD_ALLOC;
+    goto PIECE_TABLE_INIT_ERROR;
+  }
+  /* The pieces may come in any order, but each exactly once. */
+  for (i = 0; i < table->piece_count; ++i) {
+    piece = piece_hashes[i]->piece;
+    hash = piece_hashes[i]->hash;
+    if (piece < 0 || (size_t)piece >= table->piece_count || seen[piece] ||
+        !hash || strlen(hash) != table->digest_length * 2 ||
+        metalink_hex_decode(table->decoded + piece * table->digest_length,
+                            hash, table->digest_length * 2) != 0) {
+      r = METALINK_ERR_NO_PIECE_HASHES;
+      goto PIECE_TABLE_INIT_ERROR;
+    }
+    seen[piece] = 1;
+  }
+  free(seen);
+  table->digests = table->decoded;
+  return 0;
+
+PIECE_TABLE_INIT_ERROR:
+  free(seen);
+  free(table->decoded);
+  table->decoded = NULL;
+  return r;
+}
+
+static void piece_table_free(piece_table_t *table) { free(table->decoded); }
+
+/*
+ * Returns the number of bytes of the index-th piece which lie within
+ * the first file_length bytes of the file.
+ */
+static long long piece_span(const piece_table_t *table, long long file_length,
+                            size_t index) {
+  long long offset = (long long)index * table->piece_length;
+  if (offset >= file_length) {
+    return 0;
+  }
+  return file_length - offset < table->piece_length ? file_length - offset
+                                                    : table->piece_length;
+}
+
+/*
+ * Returns a dynamically allocated bitmap with bit i set if bad[i] is
+ * nonzero, or NULL if out of memory.
+ */
+static unsigned char *pack_bitmap(const unsigned char *bad, size_t count) {
+  unsigned char *bitmap;
+  size_t i;
+
+  bitmap = calloc((count + 7) / 8, 1);
+  if (!bitmap) {
+    return NULL;
+  }
+  for (i = 0; i < count; ++i) {
+    if (bad[i]) {
+      bitmap[i / 8] |= (unsigned char)(0x80u >> (i % 8));
+    }
+  }
+  return bitmap;
+}
+
+/*
+ * Opens path for reading and stores the expected length of file in
+ * *file_length: file->size if it is known, or the length of the local
+ * file otherwise. Returns the file descriptor, or -1 with *error set.
+ */
+static int open_local_file(const metalink_file_t *file, const char *path,
+                           long long *file_length, metalink_error_t *error) {
+  struct stat st;
+  int fd;
+
+  while ((fd = open(path, O_RDONLY | O_BINARY)) == -1 && errno == EINTR)
+    ;
+  if (fd == -1) {
+    *error = METALINK_ERR_CANNOT_OPEN_FILE;
+    return -1;
+  }
+  if (file->size > 0) {
+    *file_length = file->size;
+  } else if (fstat(fd, &st) == 0) {
+    *file_length = st.st_size;
+  } else {
+    close(fd);
+    *error = METALINK_ERR_CANNOT_READ_FILE;
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * Reads up to len bytes at offset. Returns the number of bytes read,
+ * which is 0 at the end of file, or -1 on error.
+ */
+static ssize_t read_at(int fd, void *buf, size_t len, long long offset) {
+  ssize_t r;
+#ifdef HAVE_PREAD
+  while ((r = pread(fd, buf, len, (off_t)offset)) == -1 && errno == EINTR)
+    ;
+#else  /* !HAVE_PREAD */
+  if (lseek(fd, (off_t)offset, SEEK_SET) == -1) {
+    return -1;
+  }
+  while ((r = read(fd, buf, len)) == -1 && errno == EINTR)
+    ;
+#endif /* !HAVE_PREAD */
+  return r;
+}
+
+typedef struct _verify_job {
+  const piece_table_t *table;
+  int fd;
+  /* expected length of the file */
+  long long file_length;
+  /* one byte per piece, nonzero if the piece is bad */
+  unsigned char *bad;
+  /* the next piece to be handed out to a thread */
+  size_t next_piece;
+  /* the first error encountered by any thread */
+  metalink_error_t error;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif /* HAVE_PTHREAD */
+} verify_job_t;
+
+static void job_lock(verify_job_t *job) {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&job->lock);
+#else  /* !HAVE_PTHREAD */
+  (void)job;
+#endif /* !HAVE_PTHREAD */
+}
+
+static void job_unlock(verify_job_t *job) {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&job->lock);
+#else  /* !HAVE_PTHREAD */
+  (void)job;
+#endif /* !HAVE_PTHREAD */
+}
+
+/*
+ * Hands out up to max consecutive pieces, the first of which is stored
+ * in *index. Returns the number of pieces, which is 0 if all pieces
+ * have been handed out or verification has failed.
+ */
+static size_t job_next_pieces(verify_job_t *job, size_t *index, size_t max) {
+  size_t count = 0;
+  job_lock(job);
+  if (job->error == 0 && job->next_piece < job->table->piece_count) {
+    *index = job->next_piece;
+    count = job->table->piece_count - job->next_piece;
+    if (count > max) {
+      count = max;
+    }
+    job->next_piece += count;
+  }
+  job_unlock(job);
+  return count;
+}
+
+static void job_set_error(verify_job_t *job, metalink_error_t error) {
+  job_lock(job);
+  if (job->error == 0) {
+    job->error = error;
+  }
+  job_unlock(job);
+}
+
+static metalink_error_t verify_piece(verify_job_t *job, size_t index,
+                                     unsigned char *buf, size_t buflen) {
+  const piece_table_t *table = job->table;
+  metalink_digest_t digest;
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  long long offset = (long long)index * table->piece_length;
+  long long remaining = piece_span(table, job->file_length, index);
+  size_t n;
+  ssize_t r;
+
+  metalink_digest_init(&digest, table->algo);
+  while (remaining > 0) {
+    n = remaining < (long long)buflen ? (size_t)remaining : buflen;
+    r = read_at(job->fd, buf, n, offset);
+    if (r == -1) {
+      return METALINK_ERR_CANNOT_READ_FILE;
+    }
+    if (r == 0) {
+      /* the local file is shorter than the piece */
+      job->bad[index] = 1;
+      return 0;
+    }
+    metalink_digest_update(&digest, buf, (size_t)r);
+    offset += r;
+    remaining -= r;
+  }
+  metalink_digest_final(&digest, md);
+  job->bad[index] =
+      memcmp(md, table->digests + index * table->digest_length,
+             table->digest_length) != 0;
+  return 0;
+}
+
+/*
+ * Verifies the lanes full length pieces starting at index at once with
+ * a multi-buffer digest, each lane reading into its own lane_length
+ * bytes of buf. Returns 0 and sets *done to 0 without verifying
+ * anything if the local file turns out to be too short, so that the
+ * pieces can be checked one by one instead.
+ */
+static metalink_error_t verify_batch(verify_job_t *job, size_t index,
+                                     size_t lanes, unsigned char *buf,
+                                     size_t lane_length, int *done) {
+  const piece_table_t *table = job->table;
+  metalink_digest_t digests[8];
+  metalink_digest_t *digest_ptrs[8];
+  const unsigned char *data[8];
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  long long pos, offset;
+  size_t i, n;
+  ssize_t r;
+
+  *done = 0;
+  for (i = 0; i < lanes; ++i) {
+    metalink_digest_init(&digests[i], table->algo);
+    digest_ptrs[i] = &digests[i];
+    data[i] = buf + i * lane_length;
+  }
+  for (pos = 0; pos < table->piece_length; pos += n) {
+    n = table->piece_length - pos < (long long)lane_length
+            ? (size_t)(table->piece_length - pos)
+            : lane_length;
+    for (i = 0; i < lanes; ++i) {
+      offset = (long long)(index + i) * table->piece_length + pos;
+      r = read_at(job->fd, buf + i * lane_length, n, offset);
+      if (r == -1) {
+        return METALINK_ERR_CANNOT_READ_FILE;
+      }
+      if ((size_t)r != n) {
+        return 0;
+      }
+    }
+    metalink_digest_update_multi(digest_ptrs, data, lanes, n);
+  }
+  for (i = 0; i < lanes; ++i) {
+    metalink_digest_final(&digests[i], md);
+    job->bad[index + i] =
+        memcmp(md, table->digests + (index + i) * table->digest_length,
+               table->digest_length) != 0;
+  }
+  *done = 1;
+  return 0;
+}
+
+static void *verify_worker(void *arg) {
+  verify_job_t *job = arg;
+  const piece_table_t *table = job->table;
+  unsigned char *buf;
+  size_t buflen = VERIFY_BUFFER_LENGTH;
+  size_t lanes = metalink_digest_lanes(table->algo);
+  size_t lane_length = 0;
+  size_t index, count, i;
+  int done;
+  metalink_error_t r = 0;
+
+  if ((long long)buflen > table->piece_length) {
+    buflen = (size_t)table->piece_length;
+  }
+  /* each lane reads whole digest blocks */
+  if (lanes > 8 || buflen / lanes < 64) {
+    lanes = 1;
+  } else {
+    lane_length = buflen / lanes / 64 * 64;
+  }
+  buf = malloc(buflen);
+  if (!buf) {
+    job_set_error(job, METALINK_ERR_BAD_ALLOC);
+    return NULL;
+  }
+  while ((count = job_next_pieces(job, &index, lanes)) > 0) {
+    done = 0;
+    if (count == lanes && lanes > 1 &&
+        piece_span(table, job->file_length, index + lanes - 1) ==
+            table->piece_length) {
+      r = verify_batch(job, index, lanes, buf, lane_length, &done);
+    }
+    for (i = 0; r == 0 && !done && i < count; ++i) {
+      r = verify_piece(job, index + i, buf, buflen);
+    }
+    if (r != 0) {
+      job_set_error(job, r);
+      break;
+    }
+  }
+  free(buf);
+  return NULL;
+}
+
+static size_t count_threads(int nthreads, size_t piece_count) {
+  size_t n = 1;
+#if defined(HAVE_PTHREAD) && defined(HAVE_PREAD)
+  long ncpu;
+  if (nthreads > 0) {
+    n = (size_t)nthreads;
+  } else {
+#if defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#else  /* !HAVE_SYSCONF || !_SC_NPROCESSORS_ONLN */
+    ncpu = 1;
+#endif /* !HAVE_SYSCONF || !_SC_NPROCESSORS_ONLN */
+    n = ncpu > 0 ? (size_t)ncpu : 1;
+  }
+#else  /* !HAVE_PTHREAD || !HAVE_PREAD */
+  /* without pread, threads would race on the file offset */
+  (void)nthreads;
+#endif /* !HAVE_PTHREAD || !HAVE_PREAD */
+  return n < piece_count ? n : piece_count;
+}
+
+/*
+ * Hashes all pieces of job on nthreads threads, one of which is the
+ * calling thread.
+ */
+static metalink_error_t run_job(verify_job_t *job, size_t nthreads) {
+#ifdef HAVE_PTHREAD
+  pthread_t *threads;
+  size_t i, started = 0;
+
+  if (pthread_mutex_init(&job->lock, NULL) != 0) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  threads = malloc(sizeof(pthread_t) * nthreads);
+  if (threads) {
+    for (i = 1; i < nthreads; ++i) {
+      /* if a thread cannot be created, the others take its share */
+      if (pthread_create(&threads[started], NULL, verify_worker, job) != 0) {
+        break;
+      }
+      ++started;
+    }
+  }
+  verify_worker(job);
+  for (i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&job->lock);
+#else  /* !HAVE_PTHREAD */
+  (void)nthreads;
+  verify_worker(job);
+#endif /* !HAVE_PTHREAD */
+  return job->error;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_verify_pieces(const metalink_file_t *file, const char *path,
+                       int nthreads, unsigned char **bitmap_out) {
+  piece_table_t table;
+  verify_job_t job;
+  unsigned char *bitmap;
+  metalink_error_t r;
+
+  r = piece_table_init(&table, file->chunk_checksum);
+  if (r != 0) {
+    return r;
+  }
+  memset(&job, 0, sizeof(job));
+  job.table = &table;
+  job.fd = open_local_file(file, path, &job.file_length, &r);
+  if (job.fd == -1) {
+    goto VERIFY_PIECES_ERROR;
+  }
+  job.bad = calloc(table.piece_count, 1);
+  if (!job.bad) {
+    r = METALINK_ERR_BAD_ALLOC;
+    goto VERIFY_PIECES_ERROR;
+  }
+
+  r = run_job(&job, count_threads(nthreads, table.piece_count));
+  if (r != 0) {
+    goto VERIFY_PIECES_ERROR;
+  }
+  bitmap = pack_bitmap(job.bad, table.piece_count);
+  if (!bitmap) {
+    r = METALINK_ERR_BAD_ALLOC;
+    goto VERIFY_PIECES_ERROR;
+  }
+  close(job.fd);
+  free(job.bad);
+  piece_table_free(&table);
+  *bitmap_out = bitmap;
+  return 0;
+
+VERIFY_PIECES_ERROR:
+  if (job.fd != -1) {
+    close(job.fd);
+  }
+  free(job.bad);
+  piece_table_free(&table);
+  return r;
+}
+
+/* The whole file is read once in blocks of this many bytes. */
+#define PIPELINE_BLOCK_LENGTH (1024 * 1024)
+
+/* The number of blocks the reader may get ahead of the slowest hash. */
+#define PIPELINE_DEPTH 4
+
+/* one stream per digest algorithm, plus one for the pieces */
+#define PIPELINE_MAX_STREAMS (METALINK_DIGEST_SHA512 + 2)
+
+/*
+ * A digest computed over the whole file, or over each piece if table is
+ * not NULL.
+ */
+typedef struct _hash_stream {
+  metalink_digest_t digest;
+  /* the digest of the whole file, once it is finished */
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  const piece_table_t *table;
+  long long file_length;
+  /* the number of bytes hashed so far */
+  long long offset;
+  /* the piece being hashed and its bytes hashed so far */
+  size_t piece;
+  long long piece_filled;
+  /* one byte per piece, nonzero if the piece is bad */
+  unsigned char *bad;
+} hash_stream_t;
+
+static void hash_stream_update(hash_stream_t *stream,
+                               const unsigned char *data, size_t len) {
+  const piece_table_t *table = stream->table;
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  long long span;
+  size_t n;
+
+  if (!table) {
+    metalink_digest_update(&stream->digest, data, len);
+    return;
+  }
+  /* bytes beyond the expected end of file do not belong to any piece */
+  if (stream->offset >= stream->file_length) {
+    return;
+  }
+  if ((long long)len > stream->file_length - stream->offset) {
+    len = (size_t)(stream->file_length - stream->offset);
+  }
+  stream->offset += len;
+  while (len > 0 && stream->piece < table->piece_count) {
+    span = piece_span(table, stream->file_length, stream->piece);
+    n = span - stream->piece_filled < (long long)len
+            ? (size_t)(span - stream->piece_filled)
+            : len;
+    metalink_digest_update(&stream->digest, data, n);
+    stream->piece_filled += n;
+    data += n;
+    len -= n;
+    if (stream->piece_filled == span) {
+      metalink_digest_final(&stream->digest, md);
+      stream->bad[stream->piece] =
+          memcmp(md, table->digests + stream->piece * table->digest_length,
+                 table->digest_length) != 0;
+      ++stream->piece;
+      stream->piece_filled = 0;
+      metalink_digest_init(&stream->digest, table->algo);
+    }
+  }
+}
+
+static void hash_stream_finish(hash_stream_t *stream) {
+  if (!stream->table) {
+    metalink_digest_final(&stream->digest, stream->md);
+    return;
+  }
+  /* the local file ended before these pieces were complete */
+  for (; stream->piece < stream->table->piece_count; ++stream->piece) {
+    stream->bad[stream->piece] = 1;
+  }
+}
+
+/*
+ * The calling thread reads the file into a ring of blocks, and each
+ * stream hashes every block on a thread of its own. A stream whose
+ * thread could not be started is hashed by the reader instead.
+ */
+typedef struct _pipeline {
+  int fd;
+  unsigned char *blocks[PIPELINE_DEPTH];
+  size_t lengths[PIPELINE_DEPTH];
+  /* the number of blocks read so far */
+  size_t produced;
+  /* nonzero once the whole file has been read */
+  int eof;
+  hash_stream_t *streams;
+  size_t nstreams;
+  /* the number of blocks hashed by each stream */
+  size_t consumed[PIPELINE_MAX_STREAMS];
+  /* nonzero if the stream has a thread of its own */
+  int threaded[PIPELINE_MAX_STREAMS];
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+  pthread_cond_t produced_cond;
+  pthread_cond_t consumed_cond;
+#endif /* HAVE_PTHREAD */
+} pipeline_t;
+
+#ifdef HAVE_PTHREAD
+typedef struct _pipeline_worker {
+  pipeline_t *pipeline;
+  size_t index;
+} pipeline_worker_t;
+
+static void *pipeline_worker(void *arg) {
+  pipeline_worker_t *worker = arg;
+  pipeline_t *pipeline = worker->pipeline;
+  size_t slot;
+
+  for (;;) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->consumed[worker->index] == pipeline->produced &&
+           !pipeline->eof) {
+      pthread_cond_wait(&pipeline->produced_cond, &pipeline->lock);
+    }
+    if (pipeline->consumed[worker->index] == pipeline->produced) {
+      pthread_mutex_unlock(&pipeline->lock);
+      return NULL;
+    }
+    slot = pipeline->consumed[worker->index] % PIPELINE_DEPTH;
+    pthread_mutex_unlock(&pipeline->lock);
+
+    hash_stream_update(&pipeline->streams[worker->index],
+                       pipeline->blocks[slot], pipeline->lengths[slot]);
+
+    pthread_mutex_lock(&pipeline->lock);
+    ++pipeline->consumed[worker->index];
+    pthread_cond_signal(&pipeline->consumed_cond);
+    pthread_mutex_unlock(&pipeline->lock);
+  }
+}
+
+/* Returns nonzero if every threaded stream is done with the oldest block. */
+static int pipeline_has_free_slot(pipeline_t *pipeline) {
+  size_t i;
+  for (i = 0; i < pipeline->nstreams; ++i) {
+    if (pipeline->threaded[i] &&
+        pipeline->produced - pipeline->consumed[i] >= PIPELINE_DEPTH) {
+      return 0;
+    }
+  }
+  return 1;
+}
+#endif /* HAVE_PTHREAD */
+
+/* Reads up to PIPELINE_BLOCK_LENGTH bytes. Returns 0 at end of file. */
+static ssize_t pipeline_read(pipeline_t *pipeline, unsigned char *buf) {
+  size_t filled = 0;
+  ssize_t r;
+
+  while (filled < PIPELINE_BLOCK_LENGTH) {
+    while ((r = read(pipeline->fd, buf + filled,
+                     PIPELINE_BLOCK_LENGTH - filled)) == -1 &&
+           errno == EINTR)
+      ;
+    if (r == -1) {
+      return -1;
+    }
+    if (r == 0) {
+      break;
+    }
+    filled += (size_t)r;
+  }
+  return (ssize_t)filled;
+}
+
+static metalink_error_t pipeline_run(pipeline_t *pipeline) {
+  metalink_error_t error = 0;
+  size_t i, slot;
+  ssize_t r;
+#ifdef HAVE_PTHREAD
+  pipeline_worker_t workers[PIPELINE_MAX_STREAMS];
+  pthread_t threads[PIPELINE_MAX_STREAMS];
+
+  pthread_mutex_init(&pipeline->lock, NULL);
+  pthread_cond_init(&pipeline->produced_cond, NULL);
+  pthread_cond_init(&pipeline->consumed_cond, NULL);
+  /* a single stream gains nothing from a thread of its own */
+  for (i = 0; pipeline->nstreams > 1 && i < pipeline->nstreams; ++i) {
+    workers[i].pipeline = pipeline;
+    workers[i].index = i;
+    pipeline->threaded[i] =
+        pthread_create(&threads[i], NULL, pipeline_worker, &workers[i]) == 0;
+  }
+#endif /* HAVE_PTHREAD */
+
+  for (;;) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&pipeline->lock);
+    while (!pipeline_has_free_slot(pipeline)) {
+      pthread_cond_wait(&pipeline->consumed_cond, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+#endif /* HAVE_PTHREAD */
+    slot = pipeline->produced % PIPELINE_DEPTH;
+    r = pipeline_read(pipeline, pipeline->blocks[slot]);
+    if (r <= 0) {
+      if (r == -1) {
+        error = METALINK_ERR_CANNOT_READ_FILE;
+      }
+      break;
+    }
+    pipeline->lengths[slot] = (size_t)r;
+    for (i = 0; i < pipeline->nstreams; ++i) {
+      if (!pipeline->threaded[i]) {
+        hash_stream_update(&pipeline->streams[i], pipeline->blocks[slot],
+                           (size_t)r);
+        ++pipeline->consumed[i];
+      }
+    }
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&pipeline->lock);
+    ++pipeline->produced;
+    pthread_cond_broadcast(&pipeline->produced_cond);
+    pthread_mutex_unlock(&pipeline->lock);
+#else  /* !HAVE_PTHREAD */
+    ++pipeline->produced;
+#endif /* !HAVE_PTHREAD */
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->eof = 1;
+  pthread_cond_broadcast(&pipeline->produced_cond);
+  pthread_mutex_unlock(&pipeline->lock);
+  for (i = 0; i < pipeline->nstreams; ++i) {
+    if (pipeline->threaded[i]) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+  pthread_cond_destroy(&pipeline->consumed_cond);
+  pthread_cond_destroy(&pipeline->produced_cond);
+  pthread_mutex_destroy(&pipeline->lock);
+#else  /* !HAVE_PTHREAD */
+  pipeline->eof = 1;
+#endif /* !HAVE_PTHREAD */
+  return error;
+}
+
+/*
+ * Returns the stream computing algo over the whole file, or NULL if
+ * there is none.
+ */
+static hash_stream_t *find_stream(hash_stream_t *streams, size_t nstreams,
+                                  metalink_digest_algo_t algo) {
+  size_t i;
+  for (i = 0; i < nstreams; ++i) {
+    if (!streams[i].table && streams[i].digest.algo == algo) {
+      return &streams[i];
+    }
+  }
+  return NULL;
+}
+
+/* Returns nonzero if the hex string hash is the digest of stream. */
+static int match_checksum(const hash_stream_t *stream, const char *hash) {
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  size_t len = metalink_digest_length(stream->digest.algo);
+
+  return hash && strlen(hash) == len * 2 &&
+         metalink_hex_decode(md, hash, len * 2) == 0 &&
+         memcmp(md, stream->md, len) == 0;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_verify_file(const metalink_file_t *file, const char *path,
+                     int *bad_checksums, unsigned char **bitmap_out) {
+  hash_stream_t streams[PIPELINE_MAX_STREAMS];
+  pipeline_t pipeline;
+  piece_table_t table;
+  metalink_checksum_t **checksum;
+  metalink_digest_algo_t algo;
+  hash_stream_t *stream;
+  unsigned char *bad = NULL;
+  unsigned char *bitmap = NULL;
+  long long file_length;
+  size_t i, nstreams = 0;
+  int nbad = 0;
+  metalink_error_t r;
+
+  memset(&table, 0, sizeof(table));
+  memset(&pipeline, 0, sizeof(pipeline));
+  memset(streams, 0, sizeof(streams));
+  pipeline.fd = -1;
+  if (bitmap_out) {
+    r = piece_table_init(&table, file->chunk_checksum);
+    if (r != 0) {
+      return r;
+    }
+  }
+
+  /* one stream for each distinct supported algorithm */
+  for (checksum = file->checksums; checksum && *checksum; ++checksum) {
+    if (metalink_digest_algo_from_name(&algo, (*checksum)->type) == 0 &&
+        !find_stream(streams, nstreams, algo)) {
+      metalink_digest_init(&streams[nstreams++].digest, algo);
+    }
+  }
+  if (nstreams == 0 && !bitmap_out) {
+    return METALINK_ERR_NO_CHECKSUMS;
+  }
+
+  pipeline.fd = open_local_file(file, path, &file_length, &r);
+  if (pipeline.fd == -1) {
+    goto VERIFY_FILE_ERROR;
+  }
+#ifdef HAVE_POSIX_FADVISE
+  posix_fadvise(pipeline.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* HAVE_POSIX_FADVISE */
+  if (bitmap_out) {
+    bad = calloc(table.piece_count, 1);
+    if (!bad) {
+      r = METALINK_ERR_BAD_ALLOC;
+      goto VERIFY_FILE_ERROR;
+    }
+    stream = &streams[nstreams++];
+    metalink_digest_init(&stream->digest, table.algo);
+    stream->table = &table;
+    stream->file_length = file_length;
+    stream->bad = bad;
+  }
+  for (i = 0; i < PIPELINE_DEPTH; ++i) {
+    pipeline.blocks[i] = malloc(PIPELINE_BLOCK_LENGTH);
+    if (!pipeline.blocks[i]) {
+      r = METALINK_ERR_BAD_ALLOC;
+      goto VERIFY_FILE_ERROR;
+    }
+  }
+  pipeline.streams = streams;
+  pipeline.nstreams = nstreams;
+
+  r = pipeline_run(&pipeline);
+  if (r != 0) {
+    goto VERIFY_FILE_ERROR;
+  }
+  for (i = 0; i < nstreams; ++i) {
+    hash_stream_finish(&streams[i]);
+  }
+  for (checksum = file->checksums; checksum && *checksum; ++checksum) {
+    if (metalink_digest_algo_from_name(&algo, (*checksum)->type) == 0 &&
+        !match_checksum(find_stream(streams, nstreams, algo),
+                        (*checksum)->hash)) {
+      ++nbad;
+    }
+  }
+  if (bitmap_out) {
+    bitmap = pack_bitmap(bad, table.piece_count);
+    if (!bitmap) {
+      r = METALINK_ERR_BAD_ALLOC;
+      goto VERIFY_FILE_ERROR;
+    }
+  }
+
+  for (i = 0; i < PIPELINE_DEPTH; ++i) {
+    free(pipeline.blocks[i]);
+  }
+  close(pipeline.fd);
+  free(bad);
+  piece_table_free(&table);
+  *bad_checksums = nbad;
+  if (bitmap_out) {
+    *bitmap_out = bitmap;
+  }
+  return 0;
+
+VERIFY_FILE_ERROR:
+  for (i = 0; i < PIPELINE_DEPTH; ++i) {
+    free(pipeline.blocks[i]);
+  }
+  if (pipeline.fd != -1) {
+    close(pipeline.fd);
+  }
+  free(bad);
+  piece_table_free(&table);
+  return r;
+}
+
+/* Data which arrived before the bytes preceding it in its piece. */
+typedef struct _pending_extent {
+  struct _pending_extent *next;
+  /* offset within the piece */
+  long long begin;
+  size_t length;
+  /* followed by length bytes of data */
+} pending_extent_t;
+
+/* The hash state of a piece which has received some data. */
+typedef struct _piece_state {
+  metalink_digest_t digest;
+  /* the number of bytes from the start of the piece hashed so far */
+  long long hashed;
+  /* extents beyond hashed, sorted by begin */
+  pending_extent_t *pending;
+} piece_state_t;
+
+struct _metalink_verifier {
+  piece_table_t table;
+  long long file_length;
+  metalink_piece_callback callback;
+  void *user_data;
+  /* metalink_piece_status_t of each piece */
+  unsigned char *status;
+  /* hash state of each incomplete piece, or NULL if it has no data */
+  piece_state_t **states;
+};
+
+static void piece_state_delete(piece_state_t *state) {
+  pending_extent_t *extent, *next;
+  if (!state) {
+    return;
+  }
+  for (extent = state->pending; extent; extent = next) {
+    next = extent->next;
+    free(extent);
+  }
+  free(state);
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_verifier_new(metalink_verifier_t **res, const metalink_file_t *file,
+                      metalink_piece_callback callback, void *user_data) {
+  metalink_verifier_t *verifier;
+  unsigned char *digests;
+  long long covered;
+  metalink_error_t r;
+
+  verifier = malloc(sizeof(metalink_verifier_t));
+  if (!verifier) {
+    return METALINK_ERR_BAD_ALLOC;
+  }
+  memset(verifier, 0, sizeof(metalink_verifier_t));
+  r = piece_table_init(&verifier->table, file->chunk_checksum);
+  if (r != 0) {
+    free(verifier);
+    return r;
+  }
+  /* keep a copy of the digests, so that file may be deleted */
+  if (!verifier->table.decoded) {
+    digests = malloc(verifier->table.piece_count *
+                     verifier->table.digest_length);
+    if (!digests) {
+      r = METALINK_ERR_BAD_ALLOC;
+      goto VERIFIER_NEW_ERROR;
+    }
+    memcpy(digests, verifier->table.digests,
+           verifier->table.piece_count * verifier->table.digest_length);
+    verifier->table.decoded = digests;
+    verifier->table.digests = digests;
+  }
+  /*
+   * Data beyond the last piece cannot be verified, and pieces which
+   * start at or beyond the end of the file can never be completed, so
+   * both are left out.
+   */
+  covered =
+      (long long)verifier->table.piece_count * verifier->table.piece_length;
+  verifier->file_length =
+      file->size > 0 && file->size < covered ? file->size : covered;
+  verifier->table.piece_count =
+      (size_t)((verifier->file_length + verifier->table.piece_length - 1) /
+               verifier->table.piece_length);
+  verifier->callback = callback;
+  verifier->user_data = user_data;
+  verifier->status = calloc(verifier->table.piece_count, 1);
+  verifier->states =
+      calloc(verifier->table.piece_count, sizeof(piece_state_t *));
+  if (!verifier->status || !verifier->states) {
+    r = METALINK_ERR_BAD_ALLOC;
+    goto VERIFIER_NEW_ERROR;
+  }
+  *res = verifier;
+  return 0;
+
+VERIFIER_NEW_ERROR:
+  metalink_verifier_delete(verifier);
+  return r;
+}
+
+void METALINK_PUBLIC metalink_verifier_delete(metalink_verifier_t *verifier) {
+  size_t i;
+  if (!verifier) {
+    return;
+  }
+  if (verifier->states) {
+    for (i = 0; i < verifier->table.piece_count; ++i) {
+      piece_state_delete(verifier->states[i]);
+    }
+    free(verifier->states);
+  }
+  free(verifier->status);
+  piece_table_free(&verifier->table);
+  free(verifier);
+}
+
+static metalink_error_t piece_complete(metalink_verifier_t *verifier,
+                                       size_t index) {
+  const piece_table_t *table = &verifier->table;
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  int good;
+
+  metalink_digest_final(&verifier->states[index]->digest, md);
+  piece_state_delete(verifier->states[index]);
+  verifier->states[index] = NULL;
+  good = memcmp(md, table->digests + index * table->digest_length,
+                table->digest_length) == 0;
+  verifier->status[index] = good ? METALINK_PIECE_GOOD : METALINK_PIECE_BAD;
+  if (verifier->callback &&
+      verifier->callback(index, good, verifier->user_data) != 0) {
+    return METALINK_ERR_CALLBACK_FAILURE;
+  }
+  return 0;
+}
+
+/*
+ * Adds len bytes at begin within the index-th piece. Data which
+ * continues the hashed prefix is hashed right away; anything else is
+ * copied until the gap before it is filled.
+ */
+static metalink_error_t piece_write(metalink_verifier_t *verifier,
+                                    size_t index, long long begin,
+                                    const unsigned char *data, size_t len) {
+  piece_state_t *state = verifier->states[index];
+  pending_extent_t *extent, **p;
+  long long end = begin + (long long)len;
+
+  if (verifier->status[index] != METALINK_PIECE_INCOMPLETE) {
+    return 0;
+  }
+  if (!state) {
+    state = malloc(sizeof(piece_state_t));
+    if (!state) {
+      return METALINK_ERR_BAD_ALLOC;
+    }
+    metalink_digest_init(&state->digest, verifier->table.algo);
+    state->hashed = 0;
+    state->pending = NULL;
+    verifier->states[index] = state;
+  }
+  if (end <= state->hashed) {
+    return 0;
+  }
+  if (begin > state->hashed) {
+    extent = malloc(sizeof(pending_extent_t) + len);
+    if (!extent) {
+      return METALINK_ERR_BAD_ALLOC;
+    }
+    extent->begin = begin;
+    extent->length = len;
+    memcpy(extent + 1, data, len);
+    for (p = &state->pending; *p && (*p)->begin < begin; p = &(*p)->next)
+      ;
+    extent->next = *p;
+    *p = extent;
+    return 0;
+  }
+
+  metalink_digest_update(&state->digest, data + (state->hashed - begin),
+                         (size_t)(end - state->hashed));
+  state->hashed = end;
+  /* the gap before some pending extents may be filled now */
+  while (state->pending && state->pending->begin <= state->hashed) {
+    extent = state->pending;
+    state->pending = extent->next;
+    end = extent->begin + (long long)extent->length;
+    if (end > state->hashed) {
+      metalink_digest_update(&state->digest,
+                             (unsigned char *)(extent + 1) +
+                                 (state->hashed - extent->begin),
+                             (size_t)(end - state->hashed));
+      state->hashed = end;
+    }
+    free(extent);
+  }
+  if (state->hashed ==
+      piece_span(&verifier->table, verifier->file_length, index)) {
+    return piece_complete(verifier, index);
+  }
+  return 0;
+}
+
+metalink_error_t METALINK_PUBLIC
+metalink_verifier_write(metalink_verifier_t *verifier, long long offset,
+                        const void *buf, size_t len) {
+  const unsigned char *data = buf;
+  long long piece_length = verifier->table.piece_length;
+  long long begin, span;
+  size_t index, n;
+  metalink_error_t r;
+
+  if (offset < 0) {
+    return 0;
+  }
+  while (len > 0 && offset < verifier->file_length) {
+    index = (size_t)(offset / piece_length);
+    if (index >= verifier->table.piece_count) {
+      break;
+    }
+    begin = offset - (long long)index * piece_length;
+    span = piece_span(&verifier->table, verifier->file_length, index);
+    n = span - begin < (long long)len ? (size_t)(span - begin) : len;
+    r = piece_write(verifier, index, begin, data, n);
+    if (r != 0) {
+      return r;
+    }
+    offset += n;
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+void METALINK_PUBLIC metalink_verifier_reset_piece(metalink_verifier_t *verifier,
+                                                   size_t index) {
+  if (index >= verifier->table.piece_count) {
+    return;
+  }
+  piece_state_delete(verifier->states[index]);
+  verifier->states[index] = NULL;
+  verifier->status[index] = METALINK_PIECE_INCOMPLETE;
+}
+
+size_t METALINK_PUBLIC
+metalink_verifier_get_piece_count(const metalink_verifier_t *verifier) {
+  return verifier->table.piece_count;
+}
+
+metalink_piece_status_t METALINK_PUBLIC
+metalink_verifier_get_piece_status(const metalink_verifier_t *verifier,
+                                   size_t index) {
+  if (index >= verifier->table.piece_count) {
+    return METALINK_PIECE_INCOMPLETE;
+  }
+  return (metalink_piece_status_t)verifier->status[index];
+}
@@ -0,0 +1,91 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_work_queue.h"
+
+#include "metalink_atomic.h"
+
+#define RANGE(head, tail) (((uint64_t)(head) << 32) | (uint64_t)(tail))
+#define RANGE_HEAD(range) ((size_t)((range) >> 32))
+#define RANGE_TAIL(range) ((size_t)((range)&0xffffffffu))
+
+void metalink_work_queue_init(metalink_work_queue_t *queue, size_t head,
+                              size_t tail) {
+  metalink_atomic_store(&queue->range, RANGE(head, tail));
+}
+
+int metalink_work_queue_pop(metalink_work_queue_t *queue, size_t *index) {
+  uint64_t range;
+  size_t head, tail;
+
+  for (;;) {
+    range = metalink_atomic_load(&queue->range);
+    head = RANGE_HEAD(range);
+    tail = RANGE_TAIL(range);
+    if (head >= tail) {
+      return 0;
+    }
+    if (metalink_atomic_cas(&queue->range, range, RANGE(head + 1, tail))) {
+      *index = head;
+      return 1;
+    }
+  }
+}
+
+int metalink_work_queue_steal(metalink_work_queue_t *queues, size_t count,
+                              metalink_work_queue_t *thief, size_t *index) {
+  metalink_work_queue_t *victim;
+  uint64_t range, victim_range = 0;
+  size_t i, head, tail, longest, stolen;
+
+  for (;;) {
+    victim = NULL;
+    longest = 0;
+    for (i = 0; i < count; ++i) {
+      range = metalink_atomic_load(&queues[i].range);
+      head = RANGE_HEAD(range);
+      tail = RANGE_TAIL(range);
+      if (tail > head && tail - head > longest) {
+        victim = &queues[i];
+        victim_range = range;
+        longest = tail - head;
+      }
+    }
+    if (!victim) {
+      return 0;
+    }
+    stolen = (longest + 1) / 2;
+    head = RANGE_HEAD(victim_range);
+    tail = RANGE_TAIL(victim_range);
+    if (metalink_atomic_cas(&victim->range, victim_range,
+                            RANGE(head, tail - stolen))) {
+      break;
+    }
+  }
+  /* no one else writes to an empty queue */
+  metalink_atomic_store(&thief->range, RANGE(tail - stolen + 1, tail));
+  *index = tail - stolen;
+  return 1;
+}
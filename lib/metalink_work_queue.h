@@ -0,0 +1,67 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#ifndef _D_METALINK_WORK_QUEUE_H_
+#define _D_METALINK_WORK_QUEUE_H_
+
+#include "metalink_config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * A run of work items [head, tail), numbered from 0 to
+ * METALINK_WORK_QUEUE_MAX, which its owner takes from the front and
+ * other threads steal from the back. Both ends are packed into one
+ * word, so that they move with a single compare-and-swap.
+ */
+typedef struct _metalink_work_queue {
+  uint64_t range;
+  /* keeps the queues of different threads in different cache lines */
+  unsigned char padding[64 - sizeof(uint64_t)];
+} metalink_work_queue_t;
+
+/* the largest tail of a queue */
+#define METALINK_WORK_QUEUE_MAX 0xffffffffu
+
+/* Queues the items [head, tail). */
+void metalink_work_queue_init(metalink_work_queue_t *queue, size_t head,
+                              size_t tail);
+
+/*
+ * Takes the first item of queue and stores it in *index. Returns 0 if
+ * queue is empty, otherwise 1.
+ */
+int metalink_work_queue_pop(metalink_work_queue_t *queue, size_t *index);
+
+/*
+ * Moves the back half of the longest of count queues to the empty
+ * queue thief, which is one of them, and takes the first item of it.
+ * Returns 0 if all queues are empty, otherwise 1.
+ */
+int metalink_work_queue_steal(metalink_work_queue_t *queues, size_t count,
+                              metalink_work_queue_t *thief, size_t *index);
+
+#endif /* _D_METALINK_WORK_QUEUE_H_ */
@@ -7,6 +7,12 @@
 #include "metalink_parser_test.h"
 #include "metalink_parser_test_v4.h"
 #include "metalink_helper_test.h"
+#include "metalink_verify_test.h"
+#include "metalink_mirror_test.h"
+#include "metalink_plan_test.h"
+#include "metalink_health_test.h"
+#include "metalink_batch_test.h"
+#include "metalink_snapshot_test.h"
 
 static int init_suite1(void) { return 0; }
 
@@ -43,6 +49,24 @@ int main(void) {
                     test_metalink_pctrl_signature_transaction)) ||
       (!CU_add_test(pSuite, "test of metalink_parse_file",
                     test_metalink_parse_file)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_file_fallback",
+                    test_metalink_parse_file_fallback)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_options",
+                    test_metalink_parse_options)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_file_callback",
+                    test_metalink_parse_file_callback)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_skip_fields",
+                    test_metalink_parse_skip_fields)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_arena",
+                    test_metalink_parse_arena)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_compact_pieces",
+                    test_metalink_parse_compact_pieces)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_file_index",
+                    test_metalink_parse_file_index)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_stats",
+                    test_metalink_parse_stats)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_parallel",
+                    test_metalink_parse_parallel)) ||
       (!CU_add_test(pSuite, "test of metalink_parse_fp",
                     test_metalink_parse_fp)) ||
       (!CU_add_test(pSuite, "test of metalink_parse_fd",
@@ -53,10 +77,47 @@ int main(void) {
                     test_metalink_parse_update)) ||
       (!CU_add_test(pSuite, "test of metalink_parser_update_fail",
                     test_metalink_parse_update_fail)) ||
+      (!CU_add_test(pSuite, "test of metalink_parser_context_reset",
+                    test_metalink_parser_context_reset)) ||
       (!CU_add_test(pSuite, "test of metalink_check_safe_path",
                     test_metalink_check_safe_path)) ||
       (!CU_add_test(pSuite, "test of metalink_get_version",
                     test_metalink_get_version)) ||
+      (!CU_add_test(pSuite, "test of metalink_hex_decode",
+                    test_metalink_hex_decode)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_date",
+                    test_metalink_parse_date)) ||
+      (!CU_add_test(pSuite, "test of metalink_digest", test_metalink_digest)) ||
+      (!CU_add_test(pSuite, "test of metalink_verify_pieces",
+                    test_metalink_verify_pieces)) ||
+      (!CU_add_test(pSuite, "test of metalink_verify_pieces_out_of_order",
+                    test_metalink_verify_pieces_out_of_order)) ||
+      (!CU_add_test(pSuite, "test of metalink_verify_pieces_multi_buffer",
+                    test_metalink_verify_pieces_multi_buffer)) ||
+      (!CU_add_test(pSuite, "test of metalink_verify_file",
+                    test_metalink_verify_file)) ||
+      (!CU_add_test(pSuite, "test of metalink_verifier",
+                    test_metalink_verifier)) ||
+      (!CU_add_test(pSuite, "test of metalink_mirror_index",
+                    test_metalink_mirror_index)) ||
+      (!CU_add_test(pSuite, "test of metalink_mirror_index with many mirrors",
+                    test_metalink_mirror_index_many)) ||
+      (!CU_add_test(pSuite, "test of metalink_plan", test_metalink_plan)) ||
+      (!CU_add_test(pSuite, "test of metalink_plan with threads",
+                    test_metalink_plan_threads)) ||
+      (!CU_add_test(pSuite, "test of metalink_health", test_metalink_health)) ||
+      (!CU_add_test(pSuite, "test of metalink_health with threads",
+                    test_metalink_health_threads)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_batch",
+                    test_metalink_parse_batch)) ||
+      (!CU_add_test(pSuite, "test of metalink_parse_* with threads",
+                    test_metalink_parse_threads)) ||
+      (!CU_add_test(pSuite, "test of metalink_save_snapshot",
+                    test_metalink_snapshot)) ||
+      (!CU_add_test(pSuite, "test of metalink_load_snapshot with damage",
+                    test_metalink_snapshot_damaged)) ||
+      (!CU_add_test(pSuite, "test of the parse cache",
+                    test_metalink_parse_cache)) ||
       (!CU_add_test(pSuite, "test of metalink_parse_file_v4",
                     test_metalink_parse_file_v4))) {
     CU_cleanup_registry();
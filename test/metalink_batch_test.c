@@ -0,0 +1,258 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_batch_test.h"
+
+#include "metalink_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include <CUnit/CUnit.h>
+
+#include <metalink/metalink.h>
+
+#include "metalink_session_data.h"
+
+#define BATCH_TEST_FILE "metalink_batch_test.xml"
+#define BATCH_COUNT 101
+#define THREAD_COUNT 4
+#define THREAD_ITERATIONS 50
+
+static const char *const batch_files[] = {
+    LIBMETALINK_TEST_DIR "test1.xml", LIBMETALINK_TEST_DIR "test2.xml",
+    LIBMETALINK_TEST_DIR "no-such-file.xml", BATCH_TEST_FILE, "/dev/null"};
+
+#define BATCH_FILE_COUNT (sizeof(batch_files) / sizeof(batch_files[0]))
+
+static size_t count_files(const metalink_t *metalink) {
+  size_t count = 0;
+  while (metalink->files && metalink->files[count]) {
+    ++count;
+  }
+  return count;
+}
+
+/*
+ * Parses paths with metalink_parse_batch and opts, and checks the
+ * results against metalink_parse_file_ex.
+ */
+static void check_batch(const char *const *paths, size_t n,
+                        metalink_parse_options_t *opts, int nthreads) {
+  metalink_batch_result_t *results;
+  metalink_parse_stats_t stats, doc_stats, expected_stats;
+  metalink_t *expected;
+  metalink_error_t r;
+  size_t i, j;
+
+  results = malloc(sizeof(metalink_batch_result_t) * n);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(results);
+  metalink_parse_options_set_threads(opts, nthreads);
+  metalink_parse_options_set_stats(opts, &stats);
+  CU_ASSERT_EQUAL_FATAL(0, metalink_parse_batch(paths, n, opts, results));
+
+  memset(&expected_stats, 0, sizeof(expected_stats));
+  metalink_parse_options_set_threads(opts, 1);
+  metalink_parse_options_set_stats(opts, &doc_stats);
+  for (i = 0; i < n; ++i) {
+    expected = NULL;
+    r = metalink_parse_file_ex(paths[i], &expected, opts);
+    CU_ASSERT_EQUAL(r, results[i].error);
+    CU_ASSERT_EQUAL(!expected, !results[i].metalink);
+    if (expected && results[i].metalink) {
+      CU_ASSERT_EQUAL(count_files(expected), count_files(results[i].metalink));
+      CU_ASSERT_STRING_EQUAL(expected->files[0]->name,
+                             results[i].metalink->files[0]->name);
+    }
+    for (j = 0; j < METALINK_PARSE_STATS_ELEMENTS; ++j) {
+      expected_stats.elements[j] += doc_stats.elements[j];
+    }
+    expected_stats.allocations[METALINK_OBJECT_FILE] +=
+        doc_stats.allocations[METALINK_OBJECT_FILE];
+    metalink_delete(expected);
+    metalink_delete(results[i].metalink);
+  }
+  CU_ASSERT(memcmp(expected_stats.elements, stats.elements,
+                   sizeof(stats.elements)) == 0);
+  CU_ASSERT_EQUAL(expected_stats.allocations[METALINK_OBJECT_FILE],
+                  stats.allocations[METALINK_OBJECT_FILE]);
+  metalink_parse_options_set_stats(opts, NULL);
+  free(results);
+}
+
+void test_metalink_parse_batch(void) {
+  const char *paths[BATCH_COUNT];
+  metalink_batch_result_t result;
+  metalink_parse_options_t *opts;
+  metalink_t *expected;
+  FILE *fp;
+  size_t i;
+
+  fp = fopen(BATCH_TEST_FILE, "w");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  fputs("<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+        "<file name=\"a\"></metalink>",
+        fp);
+  fclose(fp);
+  for (i = 0; i < BATCH_COUNT; ++i) {
+    paths[i] = batch_files[i % BATCH_FILE_COUNT];
+  }
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+
+  check_batch(paths, BATCH_COUNT, opts, 1);
+  check_batch(paths, BATCH_COUNT, opts, THREAD_COUNT);
+  check_batch(paths, BATCH_COUNT, opts, 0);
+  /* more threads than documents */
+  check_batch(paths, 3, opts, THREAD_COUNT);
+  metalink_parse_options_set_mmap(opts, 0);
+  metalink_parse_options_set_arena(opts, 1);
+  metalink_parse_options_set_read_size(opts, 100);
+  check_batch(paths, BATCH_COUNT, opts, THREAD_COUNT);
+  metalink_parse_options_set_max_size(opts, 1000);
+  check_batch(paths, BATCH_COUNT, opts, THREAD_COUNT);
+
+  CU_ASSERT_EQUAL(0, metalink_parse_batch(paths, 0, NULL, &result));
+  CU_ASSERT_EQUAL(0, metalink_parse_batch(paths, 1, NULL, &result));
+  CU_ASSERT_EQUAL_FATAL(0, result.error);
+  CU_ASSERT_EQUAL(0, metalink_parse_file(paths[0], &expected));
+  CU_ASSERT_EQUAL(count_files(expected), count_files(result.metalink));
+  metalink_delete(expected);
+  metalink_delete(result.metalink);
+
+  metalink_parse_options_delete(opts);
+  remove(BATCH_TEST_FILE);
+}
+
+typedef struct _parse_worker {
+  /* test2.xml */
+  const char *doc;
+  size_t length;
+  /* the number of files in test1.xml and test2.xml */
+  size_t files1;
+  size_t files2;
+  int failures;
+} parse_worker_t;
+
+/* Parses test1.xml and test2.xml through every entry point. */
+static void *parse_work(void *arg) {
+  parse_worker_t *worker = arg;
+  metalink_session_data_t *session_data;
+  metalink_parser_context_t *ctx;
+  metalink_t *metalink;
+  int i;
+
+  for (i = 0; i < THREAD_ITERATIONS; ++i) {
+    session_data = metalink_session_data_new();
+    if (!session_data) {
+      ++worker->failures;
+    }
+    metalink_session_data_delete(session_data);
+
+    metalink = NULL;
+    if (metalink_parse_file(LIBMETALINK_TEST_DIR "test1.xml", &metalink) !=
+            0 ||
+        count_files(metalink) != worker->files1) {
+      ++worker->failures;
+    }
+    metalink_delete(metalink);
+
+    metalink = NULL;
+    if (metalink_parse_memory(worker->doc, worker->length, &metalink) != 0 ||
+        count_files(metalink) != worker->files2) {
+      ++worker->failures;
+    }
+    metalink_delete(metalink);
+
+    metalink = NULL;
+    ctx = metalink_parser_context_new();
+    if (!ctx ||
+        metalink_parse_update(ctx, worker->doc, worker->length / 2) != 0 ||
+        metalink_parse_final(ctx, worker->doc + worker->length / 2,
+                             worker->length - worker->length / 2,
+                             &metalink) != 0 ||
+        count_files(metalink) != worker->files2) {
+      ++worker->failures;
+    }
+    metalink_delete(metalink);
+  }
+  return NULL;
+}
+
+void test_metalink_parse_threads(void) {
+  parse_worker_t workers[THREAD_COUNT];
+#ifdef HAVE_PTHREAD
+  pthread_t threads[THREAD_COUNT];
+  int started[THREAD_COUNT];
+#endif /* HAVE_PTHREAD */
+  metalink_t *metalink;
+  char doc[65536];
+  size_t length, files1, files2;
+  FILE *fp;
+  int i;
+
+  fp = fopen(LIBMETALINK_TEST_DIR "test2.xml", "rb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  length = fread(doc, 1, sizeof(doc), fp);
+  fclose(fp);
+  CU_ASSERT_FATAL(length > 0 && length < sizeof(doc));
+  CU_ASSERT_EQUAL_FATAL(
+      0, metalink_parse_file(LIBMETALINK_TEST_DIR "test1.xml", &metalink));
+  files1 = count_files(metalink);
+  metalink_delete(metalink);
+  CU_ASSERT_EQUAL_FATAL(0, metalink_parse_memory(doc, length, &metalink));
+  files2 = count_files(metalink);
+  metalink_delete(metalink);
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    workers[i].doc = doc;
+    workers[i].length = length;
+    workers[i].files1 = files1;
+    workers[i].files2 = files2;
+    workers[i].failures = 0;
+  }
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    started[i] = pthread_create(&threads[i], NULL, parse_work, &workers[i]);
+  }
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    if (started[i] == 0) {
+      pthread_join(threads[i], NULL);
+    } else {
+      parse_work(&workers[i]);
+    }
+  }
+#else  /* !HAVE_PTHREAD */
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    parse_work(&workers[i]);
+  }
+#endif /* !HAVE_PTHREAD */
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    CU_ASSERT_EQUAL(0, workers[i].failures);
+  }
+}
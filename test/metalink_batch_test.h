@@ -23,13 +23,10 @@
  * THE SOFTWARE.
  */
 /* copyright --> */
-#ifndef _D_STRPTIME_H
-#define _D_STRPTIME_H
+#ifndef _D_METALINK_BATCH_TEST_H_
+#define _D_METALINK_BATCH_TEST_H_
 
-#include "metalink_config.h"
+void test_metalink_parse_batch(void);
+void test_metalink_parse_threads(void);
 
-#include <time.h>
-
-char *strptime(const char *buf, const char *format, struct tm *timeptr);
-
-#endif /* not _D_STRPTIME_H */
+#endif /* _D_METALINK_BATCH_TEST_H_ */
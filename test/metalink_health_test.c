@@ -0,0 +1,205 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_health_test.h"
+
+#include "metalink_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include <CUnit/CUnit.h>
+
+#include <metalink/metalink.h>
+
+#define HEALTH_TEST_FILE "metalink_health_test.txt"
+
+static const char *const urls[] = {
+    "http://fast.example.org/f",        "ftp://user@SLOW.example.org:21/f",
+    "https://broken.example.org/f",     "http://new.example.org/f",
+    "http://[2001:db8::1]:8080/f",      "https://Fast.Example.org/g?x=1",
+    "http://medium.example.org#frag"};
+
+#define URL_COUNT (sizeof(urls) / sizeof(urls[0]))
+
+static metalink_file_t *make_file(void) {
+  metalink_file_t *file;
+  size_t i;
+
+  file = metalink_file_new();
+  file->resources = calloc(URL_COUNT + 1, sizeof(metalink_resource_t *));
+  for (i = 0; i < URL_COUNT; ++i) {
+    file->resources[i] = metalink_resource_new();
+    metalink_resource_set_url(file->resources[i], urls[i]);
+  }
+  return file;
+}
+
+static void check_rank(const metalink_health_t *health,
+                       const metalink_file_t *file, const size_t *expected,
+                       size_t expected_usable) {
+  size_t resources[URL_COUNT];
+  size_t i, usable;
+
+  for (i = 0; i < URL_COUNT; ++i) {
+    resources[i] = i;
+  }
+  CU_ASSERT_EQUAL_FATAL(
+      0, metalink_health_rank(health, file, resources, URL_COUNT, &usable));
+  CU_ASSERT(expected_usable == usable);
+  for (i = 0; i < URL_COUNT; ++i) {
+    CU_ASSERT(expected[i] == resources[i]);
+  }
+}
+
+void test_metalink_health(void) {
+  /* without reports, the order is kept */
+  static const size_t unchanged[] = {0, 1, 2, 3, 4, 5, 6};
+  /* fast (0 and 5 share a host), then medium and the unknown ones,
+     which count as average, then the one which is too slow and the
+     broken one */
+  static const size_t ranked[] = {0, 5, 6, 3, 4, 1, 2};
+  /* slow recovered, fast failed */
+  static const size_t changed[] = {1, 3, 4, 6, 0, 2, 5};
+  metalink_file_t *file;
+  metalink_health_t *health, *loaded;
+  int i;
+
+  file = make_file();
+  CU_ASSERT_EQUAL_FATAL(0, metalink_health_new(&health, 0));
+  check_rank(health, file, unchanged, URL_COUNT);
+
+  /* 10 MB/s, 4 MB/s and 100 KB/s */
+  metalink_health_report(health, urls[0], 20, 10000000, 1000);
+  metalink_health_report(health, urls[6], 50, 4000000, 1000);
+  metalink_health_report(health, urls[1], 100, 100000, 1000);
+  /* backed off for 4 seconds */
+  metalink_health_report(health, urls[2], 10, 50000000, 1000);
+  metalink_health_report_failure(health, urls[2]);
+  metalink_health_report_failure(health, urls[2]);
+  metalink_health_report_failure(health, urls[2]);
+  /* no host, or not one to be stored; ignored */
+  metalink_health_report(health, "example.org/f", 1, 1, 1);
+  metalink_health_report(health, "http:///f", 1, 1, 1);
+  metalink_health_report(health, "http://[::1/f", 1, 1, 1);
+  check_rank(health, file, ranked, 5);
+
+  CU_ASSERT_EQUAL_FATAL(0, metalink_health_save(health, HEALTH_TEST_FILE));
+  CU_ASSERT_EQUAL_FATAL(0, metalink_health_new(&loaded, 4));
+  CU_ASSERT_EQUAL(0, metalink_health_load(loaded, HEALTH_TEST_FILE));
+  check_rank(loaded, file, ranked, 5);
+  metalink_health_delete(loaded);
+  remove(HEALTH_TEST_FILE);
+  CU_ASSERT(METALINK_ERR_CANNOT_OPEN_FILE ==
+            metalink_health_load(health, HEALTH_TEST_FILE));
+
+  /* the averages follow a mirror within a few reports */
+  for (i = 0; i < 16; ++i) {
+    metalink_health_report(health, urls[1], 10, 5000000, 1000);
+  }
+  metalink_health_report_failure(health, urls[5]);
+  check_rank(health, file, changed, 4);
+
+  metalink_health_delete(health);
+  metalink_file_delete(file);
+}
+
+#define THREAD_COUNT 4
+#define THREAD_REPORTS 2000
+
+typedef struct _health_worker {
+  metalink_health_t *health;
+  int id;
+} health_worker_t;
+
+static void *health_work(void *arg) {
+  health_worker_t *worker = arg;
+  char url[64];
+  int i;
+
+  for (i = 0; i < THREAD_REPORTS; ++i) {
+    snprintf(url, sizeof(url), "http://host%d.example.org/f", i % 50);
+    if ((i + worker->id) % 10 == 0) {
+      metalink_health_report_failure(worker->health, url);
+    } else {
+      metalink_health_report(worker->health, url, 10, 1000000, 100);
+    }
+  }
+  return NULL;
+}
+
+void test_metalink_health_threads(void) {
+  health_worker_t workers[THREAD_COUNT];
+#ifdef HAVE_PTHREAD
+  pthread_t threads[THREAD_COUNT];
+  int started[THREAD_COUNT];
+#endif /* HAVE_PTHREAD */
+  metalink_health_t *health;
+  FILE *fp;
+  char line[512];
+  int i, lines = 0;
+
+  CU_ASSERT_EQUAL_FATAL(0, metalink_health_new(&health, 64));
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    workers[i].health = health;
+    workers[i].id = i;
+  }
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    started[i] = pthread_create(&threads[i], NULL, health_work, &workers[i]);
+  }
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    if (started[i] == 0) {
+      pthread_join(threads[i], NULL);
+    } else {
+      health_work(&workers[i]);
+    }
+  }
+#else  /* !HAVE_PTHREAD */
+  for (i = 0; i < THREAD_COUNT; ++i) {
+    health_work(&workers[i]);
+  }
+#endif /* !HAVE_PTHREAD */
+
+  /* every host is in the table exactly once */
+  CU_ASSERT_EQUAL_FATAL(0, metalink_health_save(health, HEALTH_TEST_FILE));
+  fp = fopen(HEALTH_TEST_FILE, "r");
+  CU_ASSERT_FATAL(fp != NULL);
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] != '#') {
+      CU_ASSERT(strncmp(line, "host", 4) == 0);
+      CU_ASSERT(strstr(line, " 10000 10000000 ") != NULL);
+      ++lines;
+    }
+  }
+  fclose(fp);
+  remove(HEALTH_TEST_FILE);
+  CU_ASSERT(50 == lines);
+  metalink_health_delete(health);
+}
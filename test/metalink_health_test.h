@@ -23,25 +23,10 @@
  * THE SOFTWARE.
  */
 /* copyright --> */
-#ifndef _D_TIMEGM_H_
-#define _D_TIMEGM_H_
+#ifndef _D_METALINK_HEALTH_TEST_H_
+#define _D_METALINK_HEALTH_TEST_H_
 
-#include "metalink_config.h"
+void test_metalink_health(void);
+void test_metalink_health_threads(void);
 
-#ifdef __cplusplus
-extern "C" {
-#endif /* __cplusplus */
-
-#include <time.h>
-
-#ifndef HAVE_TIMEGM
-
-time_t timegm(struct tm *tm);
-
-#endif /* HAVE_TIMEGM */
-
-#ifdef __cplusplus
-}
-#endif /* __cplusplus */
-
-#endif /* _D_TIMEGM_H_ */
+#endif /* _D_METALINK_HEALTH_TEST_H_ */
@@ -30,6 +30,7 @@
 #include <metalink/metalink.h>
 
 #include "metalink_helper.h"
+#include "metalink_date.h"
 
 void test_metalink_check_safe_path(void) {
   char ctrlchars[] = {0x1f, 0x7f, 0x00};
@@ -84,3 +85,62 @@ void test_metalink_get_version(void) {
   CU_ASSERT_EQUAL(LIBMETALINK_VERSION_MINOR, minor);
   CU_ASSERT_EQUAL(LIBMETALINK_VERSION_PATCH, patch);
 }
+
+void test_metalink_hex_decode(void) {
+  unsigned char buf[4];
+  CU_ASSERT_EQUAL(0, metalink_hex_decode(buf, "00fFa9", 6));
+  CU_ASSERT_EQUAL(0x00, buf[0]);
+  CU_ASSERT_EQUAL(0xff, buf[1]);
+  CU_ASSERT_EQUAL(0xa9, buf[2]);
+  CU_ASSERT_EQUAL(0, metalink_hex_decode(buf, "", 0));
+  CU_ASSERT_EQUAL(-1, metalink_hex_decode(buf, "abc", 3));
+  CU_ASSERT_EQUAL(-1, metalink_hex_decode(buf, "0g", 2));
+  CU_ASSERT_EQUAL(-1, metalink_hex_decode(buf, " 0", 2));
+}
+
+void test_metalink_parse_date(void) {
+  time_t t;
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "2009-05-15T12:23:23Z"));
+  CU_ASSERT(1242390203 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "2009-05-15T12:23:23+10:00"));
+  CU_ASSERT(1242354203 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "2009-05-15T12:23:23-01:30"));
+  CU_ASSERT(1242395603 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "2009-05-15t12:23:23.999z"));
+  CU_ASSERT(1242390203 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, " 2009-05-15T12:23:23 \n"));
+  CU_ASSERT(1242390203 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "1970-01-01T00:00:00Z"));
+  CU_ASSERT(0 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "1969-12-31T23:59:59Z"));
+  CU_ASSERT(-1 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "2000-02-29T00:00:00Z"));
+  CU_ASSERT(951782400 == t);
+  CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "2016-12-31T23:59:60Z"));
+  CU_ASSERT(1483228800 == t);
+  if (sizeof(time_t) >= 8) {
+    CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "0000-03-01T00:00:00Z"));
+    CU_ASSERT(-62162035200LL == (long long)t);
+    CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "0000-02-29T00:00:00Z"));
+    CU_ASSERT(-62162121600LL == (long long)t);
+    CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "0000-01-01T00:00:00Z"));
+    CU_ASSERT(-62167219200LL == (long long)t);
+    CU_ASSERT_EQUAL(0, metalink_parse_date(&t, "9999-12-31T23:59:59Z"));
+    CU_ASSERT(253402300799LL == (long long)t);
+  }
+
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, ""));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15 12:23:23Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-5-15T12:23:23Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-13-15T12:23:23Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-02-29T12:23:23Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "1900-02-29T12:23:23Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-00T12:23:23Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15T24:00:00Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15T12:60:00Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15T12:23:23.Z"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15T12:23:23+1000"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15T12:23:23+24:00"));
+  CU_ASSERT_EQUAL(-1, metalink_parse_date(&t, "2009-05-15T12:23:23Zjunk"));
+}
@@ -28,5 +28,7 @@
 
 void test_metalink_check_safe_path(void);
 void test_metalink_get_version(void);
+void test_metalink_hex_decode(void);
+void test_metalink_parse_date(void);
 
 #endif /* _D_METALINK_HELPER_TEST_H_ */
@@ -33,6 +33,8 @@ void test_metalink_list(void) {
   metalink_list_t *l;
   int a, b, c;
   int *int_ptr_array[3];
+  void **array;
+  int i;
 
   l = metalink_list_new();
   CU_ASSERT_PTR_NOT_NULL(l);
@@ -58,6 +60,28 @@ void test_metalink_list(void) {
   /* clear all data */
   metalink_list_clear(l);
   CU_ASSERT_EQUAL(0, metalink_list_length(l));
+  CU_ASSERT_PTR_NULL(metalink_list_get_data(l, 0));
+  CU_ASSERT_PTR_NULL(metalink_list_release_array(l));
+
+  /* grow beyond the initial capacity */
+  for (i = 0; i < 100; ++i) {
+    CU_ASSERT_EQUAL(0, metalink_list_append(l, i % 2 ? &a : &b));
+  }
+  CU_ASSERT_EQUAL(100, metalink_list_length(l));
+  CU_ASSERT(&a == metalink_list_get_data(l, 99));
+
+  /* take the storage over as a NULL terminated array */
+  array = metalink_list_release_array(l);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(array);
+  CU_ASSERT(&b == array[0]);
+  CU_ASSERT(&a == array[99]);
+  CU_ASSERT_PTR_NULL(array[100]);
+  free(array);
+  CU_ASSERT_EQUAL(0, metalink_list_length(l));
+
+  /* list is still usable */
+  CU_ASSERT_EQUAL(0, metalink_list_append(l, &c));
+  CU_ASSERT_EQUAL(1, metalink_list_length(l));
 
   /* delete list */
   metalink_list_delete(l);
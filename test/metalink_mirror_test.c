@@ -0,0 +1,237 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_mirror_test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+
+#include <metalink/metalink.h>
+
+typedef struct _test_resource {
+  const char *type;
+  const char *location;
+  int priority;
+} test_resource_t;
+
+static metalink_file_t *make_file(const test_resource_t *res, size_t count) {
+  metalink_file_t *file;
+  size_t i;
+
+  file = metalink_file_new();
+  file->resources = calloc(count + 1, sizeof(metalink_resource_t *));
+  for (i = 0; i < count; ++i) {
+    file->resources[i] = metalink_resource_new();
+    metalink_resource_set_url(file->resources[i], "http://example.org/f");
+    if (res[i].type) {
+      metalink_resource_set_type(file->resources[i], res[i].type);
+    }
+    if (res[i].location) {
+      metalink_resource_set_location(file->resources[i], res[i].location);
+    }
+    metalink_resource_set_priority(file->resources[i], res[i].priority);
+  }
+  return file;
+}
+
+static void check_select(const metalink_mirror_index_t *index,
+                         const char *country, const char *const *protocols,
+                         const unsigned char *excluded, size_t max,
+                         const size_t *expected, size_t expected_count) {
+  size_t out[16];
+  size_t n, i;
+
+  n = metalink_mirror_index_select(index, country, protocols, excluded, out,
+                                   max);
+  CU_ASSERT(expected_count == n);
+  for (i = 0; i < n && i < expected_count; ++i) {
+    CU_ASSERT(expected[i] == out[i]);
+  }
+}
+
+void test_metalink_mirror_index(void) {
+  static const test_resource_t res[] = {
+      {"http", "us", 10}, {"https", "jp", 20}, {"ftp", "JP", 5},
+      {"http", "jp", 30}, {"https", "de", 1},  {"http", NULL, 10},
+      {"HTTPS", "jp", 20}};
+  static const char *const web[] = {"https", "http", NULL};
+  static const char *const ftp[] = {"FTP", NULL};
+  static const char *const http[] = {"http", NULL};
+  static const char *const gopher[] = {"gopher", NULL};
+  static const char *const all[] = {"http", "ftp", "https", "http", NULL};
+  static const size_t by_rank[] = {4, 2, 0, 5, 1, 6, 3};
+  static const size_t jp_web[] = {1, 6, 3, 4, 0, 5};
+  static const size_t jp_web_excluded[] = {1, 3, 0, 5};
+  static const size_t jp_ftp[] = {2};
+  static const size_t fr_http[] = {0, 5, 3};
+  static const size_t jp_all[] = {2, 1, 6, 3, 4, 0, 5};
+  /* resources 4 and 6 failed */
+  static const unsigned char excluded[] = {0x0a};
+  metalink_file_t *file;
+  metalink_mirror_index_t *index;
+
+  file = make_file(res, sizeof(res) / sizeof(res[0]));
+  CU_ASSERT_EQUAL_FATAL(0, metalink_mirror_index_new(&index, file));
+  metalink_file_delete(file);
+
+  CU_ASSERT(7 == metalink_mirror_index_get_count(index));
+  check_select(index, NULL, NULL, NULL, 16, by_rank, 7);
+  check_select(index, "", NULL, NULL, 3, by_rank, 3);
+  check_select(index, "jp", web, NULL, 16, jp_web, 6);
+  check_select(index, "Jp", web, NULL, 2, jp_web, 2);
+  check_select(index, "jp", web, excluded, 16, jp_web_excluded, 4);
+  check_select(index, "JP", ftp, NULL, 16, jp_ftp, 1);
+  check_select(index, "fr", http, NULL, 16, fr_http, 3);
+  check_select(index, "jp", gopher, NULL, 16, NULL, 0);
+  check_select(index, "jp", all, NULL, 16, jp_all, 7);
+  check_select(index, "jp", web, NULL, 0, NULL, 0);
+
+  metalink_mirror_index_delete(index);
+
+  /* a file without resources */
+  file = metalink_file_new();
+  CU_ASSERT_EQUAL_FATAL(0, metalink_mirror_index_new(&index, file));
+  metalink_file_delete(file);
+  CU_ASSERT(0 == metalink_mirror_index_get_count(index));
+  check_select(index, "jp", web, NULL, 16, NULL, 0);
+  check_select(index, NULL, NULL, NULL, 16, NULL, 0);
+  metalink_mirror_index_delete(index);
+}
+
+#define MANY_COUNT 3000
+
+/* Returns nonzero if the type of resource is in protocols. */
+static int has_protocol(const metalink_resource_t *resource,
+                        const char *const *protocols) {
+  if (!protocols) {
+    return 1;
+  }
+  for (; *protocols; ++protocols) {
+    if (strcmp(resource->type, *protocols) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Selects the best max resources of file the slow way: two passes over
+ * file->resources in priority order, local ones first.
+ */
+static size_t select_slowly(const metalink_file_t *file, const char *country,
+                            const char *const *protocols,
+                            const unsigned char *excluded, size_t *out,
+                            size_t max) {
+  size_t n = 0, i, j, best;
+  int pass, local;
+  unsigned char *taken;
+
+  taken = calloc(MANY_COUNT, 1);
+  for (pass = 0; pass < 2; ++pass) {
+    while (n < max) {
+      best = MANY_COUNT;
+      for (i = 0; i < MANY_COUNT; ++i) {
+        local = strcmp(file->resources[i]->location, country) == 0;
+        if (taken[i] || local != (pass == 0) ||
+            !has_protocol(file->resources[i], protocols) ||
+            (excluded[i / 8] & (0x80 >> (i % 8)))) {
+          continue;
+        }
+        if (best == MANY_COUNT ||
+            file->resources[i]->priority < file->resources[best]->priority) {
+          best = i;
+        }
+      }
+      if (best == MANY_COUNT) {
+        break;
+      }
+      taken[best] = 1;
+      out[n++] = best;
+    }
+  }
+  free(taken);
+  for (j = n; j < max; ++j) {
+    out[j] = MANY_COUNT;
+  }
+  return n;
+}
+
+void test_metalink_mirror_index_many(void) {
+  static const char *const types[] = {"http", "https", "ftp", "rsync"};
+  static const char *const countries[] = {"jp", "us", "de", "fr", "br",
+                                          "cn", "in", "au", "za"};
+  static const char *const web[] = {"https", "http", NULL};
+  static const char *const ftp[] = {"ftp", NULL};
+  test_resource_t *res;
+  metalink_file_t *file;
+  metalink_mirror_index_t *index;
+  unsigned char excluded[(MANY_COUNT + 7) / 8];
+  size_t out[64], expected[64];
+  size_t i, n, m;
+  unsigned int seed = 12345;
+
+  res = malloc(sizeof(test_resource_t) * MANY_COUNT);
+  memset(excluded, 0, sizeof(excluded));
+  for (i = 0; i < MANY_COUNT; ++i) {
+    seed = seed * 1103515245 + 12345;
+    res[i].type = types[(seed >> 16) % 4];
+    seed = seed * 1103515245 + 12345;
+    res[i].location = countries[(seed >> 16) % 9];
+    seed = seed * 1103515245 + 12345;
+    /* distinct priorities so that the expected order is unique */
+    res[i].priority = (int)((seed >> 16) % 1000) * MANY_COUNT + (int)i;
+    if (i % 7 == 3) {
+      excluded[i / 8] |= (unsigned char)(0x80 >> (i % 8));
+    }
+  }
+  file = make_file(res, MANY_COUNT);
+  free(res);
+  CU_ASSERT_EQUAL_FATAL(0, metalink_mirror_index_new(&index, file));
+
+  for (i = 0; i < 9; ++i) {
+    n = metalink_mirror_index_select(index, countries[i], web, excluded, out,
+                                     64);
+    m = select_slowly(file, countries[i], web, excluded, expected, 64);
+    CU_ASSERT(m == n);
+    CU_ASSERT(0 == memcmp(expected, out, sizeof(size_t) * n));
+
+    n = metalink_mirror_index_select(index, countries[i], ftp, excluded, out,
+                                     64);
+    m = select_slowly(file, countries[i], ftp, excluded, expected, 64);
+    CU_ASSERT(m == n);
+    CU_ASSERT(0 == memcmp(expected, out, sizeof(size_t) * n));
+
+    n = metalink_mirror_index_select(index, countries[i], NULL, excluded, out,
+                                     64);
+    m = select_slowly(file, countries[i], NULL, excluded, expected, 64);
+    CU_ASSERT(m == n);
+    CU_ASSERT(0 == memcmp(expected, out, sizeof(size_t) * n));
+  }
+
+  metalink_mirror_index_delete(index);
+  metalink_file_delete(file);
+}
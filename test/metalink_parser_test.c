@@ -23,6 +23,9 @@
  * THE SOFTWARE.
  */
 /* copyright --> */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -39,6 +42,14 @@ size_t count_array(void **array) {
   return count;
 }
 
+/* the piece hashes of the 2nd file in test1.xml */
+static const unsigned char piece0_digest[] = {
+    0x17, 0x94, 0x63, 0xa8, 0x8d, 0x79, 0xcb, 0xf0, 0xb1, 0x92,
+    0x39, 0x91, 0x70, 0x8a, 0xea, 0xd9, 0x14, 0xf2, 0x61, 0x42};
+static const unsigned char piece1_digest[] = {
+    0xfe, 0xcf, 0x8b, 0xc9, 0xa1, 0x64, 0x75, 0x05, 0xfe, 0x16,
+    0x74, 0x6f, 0x94, 0xe9, 0x7a, 0x47, 0x75, 0x97, 0xdb, 0xf3};
+
 static void validate_result(metalink_t *metalink) {
   metalink_file_t *file;
   metalink_checksum_t *checksum;
@@ -125,6 +136,20 @@ static void validate_result(metalink_t *metalink) {
   CU_ASSERT_STRING_EQUAL("fecf8bc9a1647505fe16746f94e97a477597dbf3",
                          piece_hash->hash);
 
+  /* The same hashes in the binary digest table. */
+  CU_ASSERT_EQUAL(2,
+                  metalink_chunk_checksum_get_piece_count(file->chunk_checksum));
+  CU_ASSERT_EQUAL(
+      20, metalink_chunk_checksum_get_digest_length(file->chunk_checksum));
+  CU_ASSERT(0 == memcmp(piece0_digest, metalink_chunk_checksum_get_digest(
+                                           file->chunk_checksum, 0),
+                        20));
+  CU_ASSERT(0 == memcmp(piece1_digest, metalink_chunk_checksum_get_digest(
+                                           file->chunk_checksum, 1),
+                        20));
+  CU_ASSERT_PTR_NULL(
+      metalink_chunk_checksum_get_digest(file->chunk_checksum, 2));
+
   /* Check that entry which doesn't have type attribute is skipped. */
   CU_ASSERT_EQUAL_FATAL(4, count_array((void **)file->resources));
 
@@ -188,6 +213,843 @@ void test_metalink_parse_file(void) {
   validate_result(metalink);
 }
 
+void test_metalink_parse_file_fallback(void) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+
+  r = metalink_parse_file(LIBMETALINK_TEST_DIR "no-such-file.xml", &metalink);
+  CU_ASSERT_EQUAL(METALINK_ERR_CANNOT_OPEN_FILE, r);
+  CU_ASSERT_PTR_NULL(metalink);
+
+  /* A character device cannot be mapped, so it is read through
+     read(2). It is empty, which is not a well-formed document. */
+  r = metalink_parse_file("/dev/null", &metalink);
+  CU_ASSERT_EQUAL(METALINK_ERR_PARSER_ERROR, r);
+  CU_ASSERT_PTR_NULL(metalink);
+}
+
+void test_metalink_parse_options(void) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+  metalink_parse_options_t *opts;
+  FILE *fp;
+  int fd;
+  char buf[65];
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+
+  /* Read the file in tiny pieces instead of mapping it. */
+  metalink_parse_options_set_mmap(opts, 0);
+  metalink_parse_options_set_read_size(opts, 7);
+  metalink_parse_options_set_fadvise(
+      opts, METALINK_FADVISE_SEQUENTIAL | METALINK_FADVISE_DONTNEED);
+  metalink_parse_options_set_readahead(opts, METALINK_READAHEAD_WHOLE_FILE);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL(0, r);
+  validate_result(metalink);
+
+  /* The document is larger than 64 bytes. */
+  metalink = NULL;
+  metalink_parse_options_set_max_size(opts, 64);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_DOCUMENT_TOO_LARGE, r);
+  CU_ASSERT_PTR_NULL(metalink);
+
+  metalink_parse_options_set_mmap(opts, 1);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_DOCUMENT_TOO_LARGE, r);
+  CU_ASSERT_PTR_NULL(metalink);
+
+  fd = openfile(LIBMETALINK_TEST_DIR "test1.xml", O_RDONLY);
+  r = metalink_parse_fd_ex(fd, &metalink, opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_DOCUMENT_TOO_LARGE, r);
+  CU_ASSERT_PTR_NULL(metalink);
+  close(fd);
+
+  fp = fopen(LIBMETALINK_TEST_DIR "test1.xml", "rb");
+  if (fp == NULL) {
+    CU_FAIL_FATAL("cannot open test1.xml");
+  }
+  r = metalink_parse_fp_ex(fp, &metalink, opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_DOCUMENT_TOO_LARGE, r);
+  CU_ASSERT_PTR_NULL(metalink);
+  fclose(fp);
+
+  memset(buf, ' ', sizeof(buf));
+  r = metalink_parse_memory_ex(buf, sizeof(buf), &metalink, opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_DOCUMENT_TOO_LARGE, r);
+  CU_ASSERT_PTR_NULL(metalink);
+
+  /* NULL options mean the default values. */
+  fd = openfile(LIBMETALINK_TEST_DIR "test1.xml", O_RDONLY);
+  r = metalink_parse_fd_ex(fd, &metalink, NULL);
+  CU_ASSERT_EQUAL(0, r);
+  close(fd);
+  validate_result(metalink);
+
+  metalink_parse_options_delete(opts);
+}
+
+/* Feeds test1.xml to ctx in chunks of chunk_size bytes. */
+static void feed_test1(metalink_parser_context_t *ctx, size_t chunk_size) {
+  metalink_error_t r;
+  int fd;
+
+  fd = openfile(LIBMETALINK_TEST_DIR "test1.xml", O_RDONLY);
+  while (1) {
+    char buf[4096];
+    ssize_t nread;
+    while ((nread = read(fd, buf, chunk_size)) == -1 && errno == EINTR)
+      ;
+    CU_ASSERT_FATAL(nread != -1);
+    if (nread == 0) {
+      break;
+    }
+    r = metalink_parse_update(ctx, buf, nread);
+    CU_ASSERT_EQUAL_FATAL(r, 0);
+  }
+  close(fd);
+}
+
+typedef struct {
+  size_t num_files;
+  size_t max_files;
+  char names[4][32];
+} file_callback_data;
+
+static int collect_file(metalink_file_t *file, void *user_data) {
+  file_callback_data *data = (file_callback_data *)user_data;
+
+  if (data->num_files < 4) {
+    strncpy(data->names[data->num_files], file->name,
+            sizeof(data->names[0]) - 1);
+  }
+  ++data->num_files;
+  metalink_file_delete(file);
+  return data->num_files < data->max_files ? 0 : 1;
+}
+
+#define STOP_TEST_FILE "metalink_parser_test_stop.xml"
+
+/*
+ * Parses a document of many files from memory, through mmap and
+ * through read(2) with opts, whose file callback collects into data,
+ * and makes the callback fail on the first file.
+ */
+static void stop_after_first_file(metalink_parse_options_t *opts,
+                                  file_callback_data *data) {
+  static const char head[] =
+      "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">";
+  static const char entry[] =
+      "<file name=\"file\"><url>http://example.org/file</url></file>";
+  metalink_parse_stats_t stats;
+  metalink_t *metalink = NULL;
+  char doc[sizeof(head) + 100 * sizeof(entry) + 16];
+  size_t length, elements, i;
+  FILE *fp;
+  int use_mmap;
+
+  strcpy(doc, head);
+  for (i = 0; i < 100; ++i) {
+    strcat(doc, entry);
+  }
+  strcat(doc, "</metalink>");
+  length = strlen(doc);
+  fp = fopen(STOP_TEST_FILE, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  CU_ASSERT_EQUAL_FATAL(length, fwrite(doc, 1, length, fp));
+  fclose(fp);
+
+  metalink_parse_options_set_stats(opts, &stats);
+  memset(data, 0, sizeof(*data));
+  data->max_files = 1;
+  CU_ASSERT_EQUAL(METALINK_ERR_CALLBACK_FAILURE,
+                  metalink_parse_memory_ex(doc, length, &metalink, opts));
+  CU_ASSERT_PTR_NULL(metalink);
+  CU_ASSERT_EQUAL(1, data->num_files);
+  for (elements = 0, i = 0; i < METALINK_PARSE_STATS_ELEMENTS; ++i) {
+    elements += stats.elements[i];
+  }
+  CU_ASSERT(elements < 10);
+
+  metalink_parse_options_set_read_size(opts, 256);
+  for (use_mmap = 0; use_mmap < 2; ++use_mmap) {
+    metalink_parse_options_set_mmap(opts, use_mmap);
+    memset(data, 0, sizeof(*data));
+    data->max_files = 1;
+    CU_ASSERT_EQUAL(METALINK_ERR_CALLBACK_FAILURE,
+                    metalink_parse_file_ex(STOP_TEST_FILE, &metalink, opts));
+    CU_ASSERT_EQUAL(1, data->num_files);
+    if (!use_mmap) {
+      CU_ASSERT(stats.input_bytes < length / 2);
+    }
+  }
+
+  metalink_parse_options_set_read_size(opts, 0);
+  metalink_parse_options_set_stats(opts, NULL);
+  remove(STOP_TEST_FILE);
+}
+
+void test_metalink_parse_file_callback(void) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+  metalink_parse_options_t *opts;
+  metalink_parser_context_t *ctx;
+  file_callback_data data;
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+
+  memset(&data, 0, sizeof(data));
+  data.max_files = 100;
+  metalink_parse_options_set_file_callback(opts, collect_file, &data);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  /* Files are handed to the callback, not collected. */
+  CU_ASSERT_PTR_NULL(metalink->files);
+  CU_ASSERT_STRING_EQUAL("libmetalink-0.0.1", metalink->identity);
+  CU_ASSERT_EQUAL(4, data.num_files);
+  CU_ASSERT_STRING_EQUAL("libmetalink-0.0.1.tar.bz2", data.names[0]);
+  CU_ASSERT_STRING_EQUAL("libmetalink-0.0.2a.tar.bz2", data.names[1]);
+  CU_ASSERT_STRING_EQUAL("NoVerificationHash", data.names[2]);
+  CU_ASSERT_STRING_EQUAL("badpref", data.names[3]);
+  metalink_delete(metalink);
+
+  /* Stop after the 2nd file. */
+  metalink = NULL;
+  memset(&data, 0, sizeof(data));
+  data.max_files = 2;
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test2.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_CALLBACK_FAILURE, r);
+  CU_ASSERT_PTR_NULL(metalink);
+  CU_ASSERT_EQUAL(2, data.num_files);
+
+  /* Nothing after the failing file is tokenized or read. */
+  stop_after_first_file(opts, &data);
+
+  /* The parser context keeps a copy of the options. */
+  memset(&data, 0, sizeof(data));
+  data.max_files = 100;
+  ctx = metalink_parser_context_new_ex(opts);
+  metalink_parse_options_delete(opts);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+  feed_test1(ctx, 64);
+  r = metalink_parse_final(ctx, NULL, 0, &metalink);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NULL(metalink->files);
+  CU_ASSERT_EQUAL(4, data.num_files);
+  metalink_delete(metalink);
+}
+
+void test_metalink_parse_skip_fields(void) {
+  static const char doc[] =
+      "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+      "<file name=\"f\">"
+      "<size>12<unknown>5</unknown>34</size>"
+      "<url>http://example.org/f</url>"
+      "<hash type=\"sha-256\">abcd</hash>"
+      "<signature mediatype=\"application/pgp-signature\">sig</signature>"
+      "</file>"
+      "</metalink>";
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+  metalink_parse_options_t *opts;
+  metalink_file_t *file;
+  size_t i;
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+
+  /* Character data around a skipped child element is kept. */
+  r = metalink_parse_memory_ex(doc, sizeof(doc) - 1, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  file = metalink->files[0];
+  CU_ASSERT_EQUAL(1234, file->size);
+  CU_ASSERT_PTR_NOT_NULL(file->resources);
+  CU_ASSERT_PTR_NOT_NULL(file->checksums);
+  CU_ASSERT_PTR_NOT_NULL(file->signature);
+  metalink_delete(metalink);
+
+  metalink_parse_options_set_skip_fields(
+      opts, METALINK_FIELD_RESOURCES | METALINK_FIELD_SIGNATURE);
+  r = metalink_parse_memory_ex(doc, sizeof(doc) - 1, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  file = metalink->files[0];
+  CU_ASSERT_STRING_EQUAL("f", file->name);
+  CU_ASSERT_EQUAL(1234, file->size);
+  CU_ASSERT_PTR_NULL(file->resources);
+  CU_ASSERT_PTR_NULL(file->signature);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(file->checksums);
+  CU_ASSERT_STRING_EQUAL("abcd", file->checksums[0]->hash);
+  metalink_delete(metalink);
+
+  /* A checksum-only scan, for both Metalink versions. */
+  metalink_parse_options_set_skip_fields(
+      opts, METALINK_FIELD_RESOURCES | METALINK_FIELD_METAURLS |
+                METALINK_FIELD_PIECES | METALINK_FIELD_SIGNATURE);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_EQUAL_FATAL(4, count_array((void **)metalink->files));
+  for (i = 0; i < 4; ++i) {
+    CU_ASSERT_PTR_NULL(metalink->files[i]->resources);
+    CU_ASSERT_PTR_NULL(metalink->files[i]->chunk_checksum);
+  }
+  CU_ASSERT_EQUAL(2, count_array((void **)metalink->files[0]->checksums));
+  CU_ASSERT_EQUAL(4294967296LL, metalink->files[1]->size);
+  metalink_delete(metalink);
+
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test2.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_EQUAL_FATAL(4, count_array((void **)metalink->files));
+  for (i = 0; i < 4; ++i) {
+    CU_ASSERT_PTR_NULL(metalink->files[i]->resources);
+    CU_ASSERT_PTR_NULL(metalink->files[i]->metaurls);
+    CU_ASSERT_PTR_NULL(metalink->files[i]->chunk_checksum);
+  }
+  CU_ASSERT_PTR_NOT_NULL(metalink->files[0]->checksums);
+  metalink_delete(metalink);
+
+  /* Skip the checksums only. */
+  metalink_parse_options_set_skip_fields(opts, METALINK_FIELD_CHECKSUMS);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NULL(metalink->files[0]->checksums);
+  CU_ASSERT_PTR_NOT_NULL(metalink->files[0]->resources);
+  CU_ASSERT_PTR_NOT_NULL(metalink->files[1]->chunk_checksum);
+  metalink_delete(metalink);
+
+  metalink_parse_options_delete(opts);
+}
+
+void test_metalink_parse_arena(void) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+  metalink_parse_options_t *opts;
+  metalink_parser_context_t *ctx;
+  file_callback_data data;
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+  metalink_parse_options_set_arena(opts, 1);
+
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL(0, r);
+  CU_ASSERT_PTR_NOT_NULL(metalink->arena);
+  validate_result(metalink);
+
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test2.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NOT_NULL(metalink->arena);
+  CU_ASSERT_EQUAL(4, count_array((void **)metalink->files));
+  CU_ASSERT_STRING_EQUAL("MetalinkEditor/2.0dev", metalink->generator);
+  CU_ASSERT_STRING_EQUAL("en-US", metalink->files[0]->language);
+  CU_ASSERT_STRING_EQUAL("Linux-x86", metalink->files[0]->os);
+  CU_ASSERT_EQUAL(2, count_array((void **)metalink->files[0]->resources));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(metalink->files[1]->chunk_checksum);
+  CU_ASSERT_STRING_EQUAL("sha1", metalink->files[1]->chunk_checksum->type);
+  metalink_delete(metalink);
+
+  /* A context reused for several documents gets a new arena each
+     time. */
+  ctx = metalink_parser_context_new_ex(opts);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+  r = metalink_parse_update(ctx, "<a><b></a>", 10);
+  CU_ASSERT(0 != r);
+  r = metalink_parser_context_reset(ctx);
+  CU_ASSERT_EQUAL(r, 0);
+  feed_test1(ctx, 100);
+  metalink = NULL;
+  r = metalink_parse_finish(ctx, NULL, 0, &metalink);
+  CU_ASSERT_EQUAL(r, 0);
+  CU_ASSERT_PTR_NOT_NULL(metalink->arena);
+  validate_result(metalink);
+  r = metalink_parser_context_reset(ctx);
+  CU_ASSERT_EQUAL(r, 0);
+  feed_test1(ctx, 4096);
+  r = metalink_parse_final(ctx, NULL, 0, &metalink);
+  CU_ASSERT_EQUAL(r, 0);
+  validate_result(metalink);
+
+  /* The callback owns each file, so the arena is not used. */
+  memset(&data, 0, sizeof(data));
+  data.max_files = 100;
+  metalink_parse_options_set_file_callback(opts, collect_file, &data);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NULL(metalink->arena);
+  CU_ASSERT_EQUAL(4, data.num_files);
+  metalink_delete(metalink);
+
+  metalink_parse_options_delete(opts);
+}
+
+void test_metalink_parse_compact_pieces(void) {
+  static const char doc[] =
+      "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+      "<file name=\"f\">"
+      "<pieces length=\"1\" type=\"sha1\">"
+      "<hash>179463a88d79cbf0b1923991708aead914f26142</hash>"
+      "<hash>not a hex string</hash>"
+      "</pieces>"
+      "</file>"
+      "</metalink>";
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+  metalink_parse_options_t *opts;
+  metalink_chunk_checksum_t *chunk_checksum;
+
+  /* A hash which is not hex disables the digest table only. */
+  r = metalink_parse_memory(doc, sizeof(doc) - 1, &metalink);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  chunk_checksum = metalink->files[0]->chunk_checksum;
+  CU_ASSERT_PTR_NOT_NULL_FATAL(chunk_checksum);
+  CU_ASSERT_EQUAL(2, count_array((void **)chunk_checksum->piece_hashes));
+  CU_ASSERT_EQUAL(0, metalink_chunk_checksum_get_piece_count(chunk_checksum));
+  CU_ASSERT_PTR_NULL(metalink_chunk_checksum_get_digest(chunk_checksum, 0));
+  metalink_delete(metalink);
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+  metalink_parse_options_set_compact_pieces(opts, 1);
+
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  chunk_checksum = metalink->files[1]->chunk_checksum;
+  CU_ASSERT_PTR_NOT_NULL_FATAL(chunk_checksum);
+  CU_ASSERT_STRING_EQUAL("sha1", chunk_checksum->type);
+  CU_ASSERT_EQUAL(262144, chunk_checksum->length);
+  CU_ASSERT_PTR_NULL(chunk_checksum->piece_hashes);
+  CU_ASSERT_EQUAL(2, metalink_chunk_checksum_get_piece_count(chunk_checksum));
+  CU_ASSERT(0 == memcmp(piece1_digest,
+                        metalink_chunk_checksum_get_digest(chunk_checksum, 1),
+                        20));
+  metalink_delete(metalink);
+
+  /* Undecodable pieces are dropped altogether. */
+  r = metalink_parse_memory_ex(doc, sizeof(doc) - 1, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NULL(metalink->files[0]->chunk_checksum);
+  metalink_delete(metalink);
+
+  /* The same with the arena. */
+  metalink_parse_options_set_arena(opts, 1);
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test2.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  chunk_checksum = metalink->files[1]->chunk_checksum;
+  CU_ASSERT_PTR_NOT_NULL_FATAL(chunk_checksum);
+  CU_ASSERT_PTR_NULL(chunk_checksum->piece_hashes);
+  CU_ASSERT(0 == memcmp(piece0_digest,
+                        metalink_chunk_checksum_get_digest(chunk_checksum, 0),
+                        20));
+  metalink_delete(metalink);
+
+  metalink_parse_options_delete(opts);
+}
+
+#define INDEX_FILE_COUNT 2000
+
+/*
+ * Returns a Metalink 4 document of INDEX_FILE_COUNT files, where file
+ * i is named "file-i", has identity "pkg-(i / 2)", version "i % 2",
+ * size i + 1 and a sha-256 of i in hex. A last file reuses the name
+ * "file-0".
+ */
+static char *make_index_doc(size_t *len) {
+  char *doc, *p;
+  int i;
+
+  doc = malloc(INDEX_FILE_COUNT * 256 + 256);
+  p = doc;
+  p += sprintf(p, "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">");
+  for (i = 0; i < INDEX_FILE_COUNT; ++i) {
+    p += sprintf(p,
+                 "<file name=\"file-%d\"><identity>pkg-%d</identity>"
+                 "<version>%d</version><size>%d</size>"
+                 "<hash type=\"sha-256\">%064x</hash>"
+                 "<url>http://example.org/%d</url></file>",
+                 i, i / 2, i % 2, i + 1, i, i);
+  }
+  p += sprintf(p, "<file name=\"file-0\"><size>0</size>"
+                  "<url>http://example.org/0</url></file></metalink>");
+  *len = (size_t)(p - doc);
+  return doc;
+}
+
+static void check_file_index(const metalink_t *metalink) {
+  char hash[65];
+  metalink_file_t *file;
+  int i;
+
+  for (i = 0; i < INDEX_FILE_COUNT; i += 97) {
+    sprintf(hash, "file-%d", i);
+    file = metalink_find_file(metalink, hash);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    CU_ASSERT_EQUAL(i + 1, file->size);
+
+    sprintf(hash, "pkg-%d", i / 2);
+    file = metalink_find_file_by_identity(metalink, hash,
+                                          i % 2 ? "1" : "0");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    CU_ASSERT_EQUAL(i + 1, file->size);
+
+    sprintf(hash, "%064X", i);
+    file = metalink_find_file_by_checksum(metalink, "SHA256", hash);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    CU_ASSERT_EQUAL(i + 1, file->size);
+  }
+  /* the first of two files with the same name */
+  CU_ASSERT_EQUAL(1, metalink_find_file(metalink, "file-0")->size);
+
+  CU_ASSERT_PTR_NULL(metalink_find_file(metalink, "file-2000"));
+  CU_ASSERT_PTR_NULL(metalink_find_file(metalink, "FILE-1"));
+  CU_ASSERT_PTR_NULL(metalink_find_file_by_identity(metalink, "pkg-1", NULL));
+  CU_ASSERT_PTR_NULL(metalink_find_file_by_identity(metalink, "pkg-1", "2"));
+  CU_ASSERT_PTR_NULL(metalink_find_file_by_identity(metalink, "pkg-", "11"));
+  sprintf(hash, "%064x", 5);
+  CU_ASSERT_PTR_NULL(metalink_find_file_by_checksum(metalink, "sha-1", hash));
+  CU_ASSERT_PTR_NULL(
+      metalink_find_file_by_checksum(metalink, "sha-256", hash + 1));
+}
+
+void test_metalink_parse_file_index(void) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+  metalink_parse_options_t *opts;
+  char *doc;
+  size_t len;
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+  doc = make_index_doc(&len);
+
+  /* without an index, the lookups scan the files */
+  r = metalink_parse_memory_ex(doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NULL(metalink->file_index);
+  check_file_index(metalink);
+  CU_ASSERT_EQUAL(0, metalink_index_files(metalink));
+  CU_ASSERT_PTR_NOT_NULL(metalink->file_index);
+  check_file_index(metalink);
+  metalink_delete(metalink);
+
+  metalink_parse_options_set_file_index(opts, 1);
+  r = metalink_parse_memory_ex(doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NOT_NULL(metalink->file_index);
+  check_file_index(metalink);
+  metalink_delete(metalink);
+
+  metalink_parse_options_set_arena(opts, 1);
+  r = metalink_parse_memory_ex(doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NOT_NULL(metalink->file_index);
+  check_file_index(metalink);
+  metalink_delete(metalink);
+
+  free(doc);
+  metalink_parse_options_delete(opts);
+}
+
+static const char stats_doc[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+    "<published>2009-05-15T12:23:23Z</published>"
+    "<file name=\"a\">"
+    "<size>10</size>"
+    "<hash type=\"sha-1\">a96cf3f0266b91d87d5124cf94326422800b627d</hash>"
+    "<unknown><nested/></unknown>"
+    "<url priority=\"1\">http://a/</url>"
+    "<url priority=\"2\">http://b/</url>"
+    "</file>"
+    "<file name=\"b\"><url>http://c/</url></file>"
+    "</metalink>";
+
+static size_t stats_elements(const metalink_parse_stats_t *stats,
+                             const char *name) {
+  size_t i;
+  for (i = 0; metalink_parse_stats_element_name(i); ++i) {
+    if (strcmp(metalink_parse_stats_element_name(i), name) == 0) {
+      return stats->elements[i];
+    }
+  }
+  CU_FAIL("unknown element name");
+  return 0;
+}
+
+/* Checks the statistics of parsing stats_doc without skip_fields. */
+static void check_stats_doc(const metalink_parse_stats_t *stats) {
+  CU_ASSERT(sizeof(stats_doc) - 1 == stats->input_bytes);
+  CU_ASSERT(1 == stats_elements(stats, "metalink"));
+  CU_ASSERT(1 == stats_elements(stats, "published"));
+  CU_ASSERT(2 == stats_elements(stats, "file"));
+  CU_ASSERT(1 == stats_elements(stats, "size"));
+  CU_ASSERT(1 == stats_elements(stats, "hash"));
+  CU_ASSERT(3 == stats_elements(stats, "url"));
+  CU_ASSERT(2 == stats_elements(stats, "(other)"));
+  CU_ASSERT(0 == stats_elements(stats, "pieces"));
+  /* <unknown> and <nested> */
+  CU_ASSERT(2 == stats->skipped_elements);
+  /* the contents of <published>, <size>, <hash> and <url> */
+  CU_ASSERT(20 + 2 + 40 + 3 * 9 == stats->text_bytes);
+  CU_ASSERT(1 == stats->allocations[METALINK_OBJECT_METALINK]);
+  CU_ASSERT(2 == stats->allocations[METALINK_OBJECT_FILE]);
+  CU_ASSERT(2 * sizeof(metalink_file_t) ==
+            stats->allocated_bytes[METALINK_OBJECT_FILE]);
+  CU_ASSERT(3 == stats->allocations[METALINK_OBJECT_RESOURCE]);
+  CU_ASSERT(1 == stats->allocations[METALINK_OBJECT_CHECKSUM]);
+  CU_ASSERT(0 == stats->allocations[METALINK_OBJECT_CHUNK_CHECKSUM]);
+  /* the files, two resource lists and a checksum list */
+  CU_ASSERT(4 == stats->allocations[METALINK_OBJECT_ARRAY]);
+  CU_ASSERT(stats->allocations[METALINK_OBJECT_STRING] >= 7);
+  CU_ASSERT(0 == stats->io_ns);
+  CU_ASSERT(stats->xml_ns + stats->pstate_ns > 0);
+}
+
+void test_metalink_parse_stats(void) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+  metalink_parse_options_t *opts;
+  metalink_parser_context_t *ctx;
+  metalink_parse_stats_t stats;
+  size_t len = sizeof(stats_doc) - 1;
+
+  CU_ASSERT_STRING_EQUAL("copyright", metalink_parse_stats_element_name(0));
+  CU_ASSERT_STRING_EQUAL("(other)", metalink_parse_stats_element_name(
+                                        METALINK_PARSE_STATS_ELEMENTS - 1));
+  CU_ASSERT_PTR_NULL(
+      metalink_parse_stats_element_name(METALINK_PARSE_STATS_ELEMENTS));
+  CU_ASSERT_STRING_EQUAL("resource",
+                         metalink_object_type_name(METALINK_OBJECT_RESOURCE));
+  CU_ASSERT_PTR_NULL(metalink_object_type_name(METALINK_OBJECT_MAX));
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+  metalink_parse_options_set_stats(opts, &stats);
+
+  memset(&stats, 0xff, sizeof(stats));
+  r = metalink_parse_memory_ex(stats_doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_stats_doc(&stats);
+  metalink_delete(metalink);
+
+  /* the objects come from the arena but are counted the same */
+  metalink_parse_options_set_arena(opts, 1);
+  r = metalink_parse_memory_ex(stats_doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_stats_doc(&stats);
+  metalink_delete(metalink);
+  metalink_parse_options_set_arena(opts, 0);
+
+  /* the statistics accumulate over the chunks of a document and are
+     cleared for the next one */
+  ctx = metalink_parser_context_new_ex(opts);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(ctx);
+  CU_ASSERT_EQUAL(0, metalink_parse_update(ctx, stats_doc, len / 2));
+  CU_ASSERT_EQUAL_FATAL(
+      0, metalink_parse_finish(ctx, stats_doc + len / 2, len - len / 2,
+                               &metalink));
+  check_stats_doc(&stats);
+  metalink_delete(metalink);
+  CU_ASSERT_EQUAL(0, metalink_parser_context_reset(ctx));
+  CU_ASSERT_EQUAL_FATAL(
+      0, metalink_parse_finish(ctx, stats_doc, len, &metalink));
+  check_stats_doc(&stats);
+  metalink_delete(metalink);
+  metalink_parser_context_delete(ctx);
+
+  /* skipped elements allocate nothing */
+  metalink_parse_options_set_skip_fields(opts, METALINK_FIELD_RESOURCES);
+  r = metalink_parse_memory_ex(stats_doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT(3 == stats_elements(&stats, "url"));
+  CU_ASSERT(2 + 3 == stats.skipped_elements);
+  CU_ASSERT(20 + 2 + 40 == stats.text_bytes);
+  CU_ASSERT(0 == stats.allocations[METALINK_OBJECT_RESOURCE]);
+  metalink_delete(metalink);
+  metalink_parse_options_set_skip_fields(opts, 0);
+
+  r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test2.xml", &metalink,
+                             opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT(6 == stats_elements(&stats, "file"));
+  CU_ASSERT(stats.input_bytes > 0);
+  metalink_delete(metalink);
+
+  metalink_parse_options_delete(opts);
+}
+
+/*
+ * Returns a Metalink 3 document of INDEX_FILE_COUNT files, with
+ * metadata before and after the files.
+ */
+static char *make_v3_doc(size_t *len) {
+  char *doc, *p;
+  int i;
+
+  doc = malloc(INDEX_FILE_COUNT * 256 + 256);
+  p = doc;
+  p += sprintf(p, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                  "<metalink version=\"3.0\""
+                  " xmlns=\"http://www.metalinker.org/\">\n"
+                  "<identity>parallel</identity>\n<files>\n");
+  for (i = 0; i < INDEX_FILE_COUNT; ++i) {
+    p += sprintf(p,
+                 "  <file name=\"file-%d\"><size>%d</size><resources>"
+                 "<url type=\"http\" preference=\"%d\">"
+                 "http://example.org/%d</url></resources></file>\n",
+                 i, i + 1, i % 100, i);
+  }
+  p += sprintf(p, "</files>\n<tags>a,b</tags>\n</metalink>\n");
+  *len = (size_t)(p - doc);
+  return doc;
+}
+
+/* Checks that metalink has the same contents as expected. */
+static void check_same_metalink(const metalink_t *expected,
+                                const metalink_t *metalink) {
+  metalink_file_t **a, **b;
+
+  CU_ASSERT_EQUAL(expected->version, metalink->version);
+  CU_ASSERT_EQUAL(expected->published, metalink->published);
+  CU_ASSERT_EQUAL(!expected->identity, !metalink->identity);
+  if (expected->identity && metalink->identity) {
+    CU_ASSERT_STRING_EQUAL(expected->identity, metalink->identity);
+  }
+  CU_ASSERT_EQUAL(!expected->tags, !metalink->tags);
+  if (expected->tags && metalink->tags) {
+    CU_ASSERT_STRING_EQUAL(expected->tags, metalink->tags);
+  }
+  CU_ASSERT_PTR_NOT_NULL_FATAL(metalink->files);
+  for (a = expected->files, b = metalink->files; *a && *b; ++a, ++b) {
+    CU_ASSERT_STRING_EQUAL((*a)->name, (*b)->name);
+    CU_ASSERT_EQUAL((*a)->size, (*b)->size);
+    CU_ASSERT_EQUAL(count_array((void **)(*a)->resources),
+                    count_array((void **)(*b)->resources));
+    CU_ASSERT_STRING_EQUAL((*a)->resources[0]->url, (*b)->resources[0]->url);
+  }
+  CU_ASSERT_PTR_NULL(*a);
+  CU_ASSERT_PTR_NULL(*b);
+}
+
+/* Parses doc with 4 threads and opts and compares it to expected. */
+static void check_parallel(const metalink_t *expected, const char *doc,
+                           size_t len, metalink_parse_options_t *opts) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+
+  metalink_parse_options_set_threads(opts, 4);
+  r = metalink_parse_memory_ex(doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_same_metalink(expected, metalink);
+  if (metalink->file_index) {
+    check_file_index(metalink);
+  }
+  metalink_delete(metalink);
+}
+
+#define PARALLEL_TEST_FILE "metalink_parser_test_parallel.xml"
+
+void test_metalink_parse_parallel(void) {
+  metalink_error_t r;
+  metalink_t *expected = NULL, *metalink = NULL;
+  metalink_parse_options_t *opts;
+  metalink_parse_stats_t stats;
+  char *doc, *p;
+  size_t len;
+  FILE *fp;
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+
+  doc = make_index_doc(&len);
+  r = metalink_parse_memory(doc, len, &expected);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_parallel(expected, doc, len, opts);
+  metalink_parse_options_set_file_index(opts, 1);
+  check_parallel(expected, doc, len, opts);
+  metalink_parse_options_set_arena(opts, 1);
+  check_parallel(expected, doc, len, opts);
+  metalink_parse_options_set_compact_pieces(opts, 1);
+  metalink_parse_options_set_file_index(opts, 0);
+  check_parallel(expected, doc, len, opts);
+
+  /* The elements around the files are counted by every shard, the
+     files only once. */
+  metalink_parse_options_set_stats(opts, &stats);
+  check_parallel(expected, doc, len, opts);
+  CU_ASSERT(INDEX_FILE_COUNT + 1 == stats_elements(&stats, "file"));
+  CU_ASSERT(INDEX_FILE_COUNT + 1 == stats.allocations[METALINK_OBJECT_FILE]);
+  CU_ASSERT(stats.input_bytes >= len);
+
+  /* So are they when a mapped file is parsed. */
+  fp = fopen(PARALLEL_TEST_FILE, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  CU_ASSERT_EQUAL_FATAL(len, fwrite(doc, 1, len, fp));
+  fclose(fp);
+  r = metalink_parse_file_ex(PARALLEL_TEST_FILE, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_same_metalink(expected, metalink);
+  metalink_delete(metalink);
+  CU_ASSERT(stats_elements(&stats, "metalink") > 1);
+  remove(PARALLEL_TEST_FILE);
+  metalink_parse_options_set_stats(opts, NULL);
+
+  /* one thread per processor */
+  metalink_parse_options_set_threads(opts, 0);
+  r = metalink_parse_memory_ex(doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_same_metalink(expected, metalink);
+  metalink_delete(metalink);
+
+  /* A comment makes the document parsed serially. */
+  p = strstr(doc + len / 2, "http://");
+  memcpy(p, "<!---->", 7);
+  metalink_delete(expected);
+  expected = NULL;
+  r = metalink_parse_memory(doc, len, &expected);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_parallel(expected, doc, len, opts);
+
+  metalink_delete(expected);
+  free(doc);
+
+  /* an error in a file near the end of the document */
+  doc = make_index_doc(&len);
+  p = strstr(doc + len - len / 8, "</file>");
+  memcpy(p, "</fil>", 6);
+  r = metalink_parse_memory_ex(doc, len, &metalink, opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_PARSER_ERROR, r);
+  free(doc);
+
+  /* Metalink version 3 */
+  doc = make_v3_doc(&len);
+  metalink_parse_options_set_arena(opts, 0);
+  expected = NULL;
+  r = metalink_parse_memory(doc, len, &expected);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_EQUAL(INDEX_FILE_COUNT,
+                  count_array((void **)expected->files));
+  check_parallel(expected, doc, len, opts);
+  metalink_delete(expected);
+  free(doc);
+
+  metalink_parse_options_delete(opts);
+}
+
 void test_metalink_parse_fp(void) {
   metalink_error_t r;
   metalink_t *metalink;
@@ -266,6 +1128,52 @@ void test_metalink_parse_update(void) {
   validate_result(metalink);
 }
 
+void test_metalink_parser_context_reset(void) {
+  static const char partial[] =
+      "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\"><file name=\"a\">"
+      "<size>";
+  metalink_error_t r;
+  metalink_t *metalink;
+  metalink_parser_context_t *ctx;
+
+  ctx = metalink_parser_context_new();
+  CU_ASSERT_FATAL(NULL != ctx);
+
+  feed_test1(ctx, 4096);
+  metalink = NULL;
+  r = metalink_parse_finish(ctx, 0, 0, &metalink);
+  CU_ASSERT_EQUAL(r, 0);
+  validate_result(metalink);
+
+  /* A failed document must not affect the next one. */
+  r = metalink_parser_context_reset(ctx);
+  CU_ASSERT_EQUAL(r, 0);
+  r = metalink_parse_update(ctx, "<a><b></a>", 10);
+  CU_ASSERT(0 != r);
+
+  r = metalink_parser_context_reset(ctx);
+  CU_ASSERT_EQUAL(r, 0);
+  feed_test1(ctx, 100);
+  metalink = NULL;
+  r = metalink_parse_finish(ctx, 0, 0, &metalink);
+  CU_ASSERT_EQUAL(r, 0);
+  validate_result(metalink);
+
+  /* Abandon a document halfway. */
+  r = metalink_parser_context_reset(ctx);
+  CU_ASSERT_EQUAL(r, 0);
+  r = metalink_parse_update(ctx, partial, sizeof(partial) - 1);
+  CU_ASSERT_EQUAL(r, 0);
+
+  r = metalink_parser_context_reset(ctx);
+  CU_ASSERT_EQUAL(r, 0);
+  feed_test1(ctx, 4096);
+  metalink = NULL;
+  r = metalink_parse_final(ctx, 0, 0, &metalink);
+  CU_ASSERT_EQUAL(r, 0);
+  validate_result(metalink);
+}
+
 void test_metalink_parse_update_fail(void) {
   metalink_error_t r;
   metalink_t *metalink;
@@ -30,6 +30,16 @@ size_t count_array(void **array);
 
 void test_metalink_parse_file(void);
 
+void test_metalink_parse_file_fallback(void);
+void test_metalink_parse_options(void);
+void test_metalink_parse_file_callback(void);
+void test_metalink_parse_skip_fields(void);
+void test_metalink_parse_arena(void);
+void test_metalink_parse_compact_pieces(void);
+void test_metalink_parse_file_index(void);
+void test_metalink_parse_stats(void);
+void test_metalink_parse_parallel(void);
+
 void test_metalink_parse_fp(void);
 
 void test_metalink_parse_fd(void);
@@ -39,5 +49,6 @@ void test_metalink_parse_memory(void);
 void test_metalink_parse_update(void);
 
 void test_metalink_parse_update_fail(void);
+void test_metalink_parser_context_reset(void);
 
 #endif /* _D_METALINK_PARSER_TEST_H_ */
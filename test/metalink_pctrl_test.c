@@ -109,6 +109,7 @@ void test_metalink_pctrl_resource_transaction(void) {
 void test_metalink_pctrl_checksum_transaction(void) {
   metalink_pctrl_t *ctrl;
   metalink_checksum_t *checksum;
+  char *hash;
 
   ctrl = new_metalink_pctrl();
   CU_ASSERT_PTR_NOT_NULL(ctrl);
@@ -126,6 +127,16 @@ void test_metalink_pctrl_checksum_transaction(void) {
   CU_ASSERT_STRING_EQUAL("234f3611ad77aaf1241a0dc8ac708007935844d5",
                          checksum->hash);
 
+  /* The take setter stores the string without copying it. */
+  hash =
+      metalink_pctrl_strdup(ctrl, "234f3611ad77aaf1241a0dc8ac708007935844d5");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(hash);
+  CU_ASSERT_EQUAL(0, metalink_pctrl_checksum_take_hash(ctrl, hash));
+  CU_ASSERT(hash == checksum->hash);
+  CU_ASSERT_EQUAL(METALINK_ERR_BAD_ALLOC,
+                  metalink_pctrl_checksum_take_hash(ctrl, NULL));
+  CU_ASSERT(hash == checksum->hash);
+
   /* Commit appends ctrl->temp_checksum to ctrl->checksums. */
   CU_ASSERT_EQUAL(0, metalink_pctrl_commit_checksum_transaction(ctrl));
   checksum = NULL;
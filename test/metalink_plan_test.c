@@ -0,0 +1,232 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_plan_test.h"
+
+#include "metalink_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif /* HAVE_PTHREAD */
+
+#include <CUnit/CUnit.h>
+
+#include <metalink/metalink.h>
+
+static metalink_file_t *make_file(long long size, int piece_length,
+                                  const int *maxconnections,
+                                  size_t count) {
+  metalink_file_t *file;
+  size_t i;
+
+  file = metalink_file_new();
+  metalink_file_set_size(file, size);
+  if (piece_length) {
+    file->chunk_checksum = metalink_chunk_checksum_new();
+    metalink_chunk_checksum_set_length(file->chunk_checksum, piece_length);
+  }
+  file->resources = calloc(count + 1, sizeof(metalink_resource_t *));
+  for (i = 0; i < count; ++i) {
+    file->resources[i] = metalink_resource_new();
+    metalink_resource_set_url(file->resources[i], "http://example.org/f");
+    metalink_resource_set_priority(file->resources[i], (int)(count - i));
+    metalink_resource_set_maxconnections(file->resources[i],
+                                         maxconnections[i]);
+  }
+  return file;
+}
+
+static void check_connections(const metalink_plan_t *plan,
+                              const size_t *expected, size_t count) {
+  size_t i;
+  CU_ASSERT(count == metalink_plan_get_connection_count(plan));
+  for (i = 0; i < count; ++i) {
+    CU_ASSERT(expected[i] == metalink_plan_get_connection_resource(plan, i));
+  }
+}
+
+void test_metalink_plan(void) {
+  /* resources are ranked 2, 1, 0 */
+  static const int maxconnections[] = {1, 0, 2};
+  static const size_t four[] = {2, 1, 0, 2};
+  static const size_t five[] = {2, 1, 0, 2, 1};
+  static const size_t two[] = {2, 1};
+  static const size_t selected[] = {0, 1, 9};
+  metalink_file_t *file;
+  metalink_plan_t *plan;
+  metalink_segment_t segment;
+  unsigned char taken[11];
+  size_t i;
+
+  file = make_file(10001, 1000, maxconnections, 3);
+
+  CU_ASSERT_EQUAL_FATAL(0, metalink_plan_new(&plan, file, NULL, 0, 0));
+  check_connections(plan, four, 4);
+  CU_ASSERT(11 == metalink_plan_get_segment_count(plan));
+  /* connection 3 starts with the last two segments */
+  CU_ASSERT(1 == metalink_plan_next(plan, 3, &segment));
+  CU_ASSERT(2 == segment.resource);
+  CU_ASSERT(9 == segment.index);
+  CU_ASSERT(9 == segment.first_piece);
+  CU_ASSERT(1 == segment.piece_count);
+  CU_ASSERT(9000 == segment.offset);
+  CU_ASSERT(1000 == segment.length);
+  CU_ASSERT(1 == metalink_plan_next(plan, 3, &segment));
+  CU_ASSERT(10 == segment.index);
+  CU_ASSERT(10000 == segment.offset);
+  CU_ASSERT(1 == segment.length);
+  /* then steals from one of the others, which hold three each */
+  CU_ASSERT(1 == metalink_plan_next(plan, 3, &segment));
+  CU_ASSERT(2 == segment.resource);
+  CU_ASSERT(1 == segment.index);
+  CU_ASSERT(1 == metalink_plan_next(plan, 3, &segment));
+  CU_ASSERT(2 == segment.index);
+  /* connection 0 lost segments 1 and 2 */
+  CU_ASSERT(1 == metalink_plan_next(plan, 0, &segment));
+  CU_ASSERT(0 == segment.index);
+  CU_ASSERT(0 == metalink_plan_next(plan, 4, &segment));
+  metalink_plan_delete(plan);
+
+  /* a single worker takes every segment exactly once */
+  CU_ASSERT_EQUAL_FATAL(0, metalink_plan_new(&plan, file, NULL, 0, 0));
+  memset(taken, 0, sizeof(taken));
+  while (metalink_plan_next(plan, 1, &segment)) {
+    CU_ASSERT(1 == segment.resource);
+    CU_ASSERT(segment.index < 11);
+    ++taken[segment.index];
+  }
+  for (i = 0; i < 11; ++i) {
+    CU_ASSERT(1 == taken[i]);
+  }
+  metalink_plan_delete(plan);
+
+  /* a total limit lets resources without one have several */
+  CU_ASSERT_EQUAL_FATAL(0, metalink_plan_new(&plan, file, NULL, 0, 5));
+  check_connections(plan, five, 5);
+  metalink_plan_delete(plan);
+
+  metalink_file_set_maxconnections(file, 2);
+  CU_ASSERT_EQUAL_FATAL(0, metalink_plan_new(&plan, file, NULL, 0, 5));
+  check_connections(plan, two, 2);
+  CU_ASSERT(11 == metalink_plan_get_segment_count(plan));
+  metalink_plan_delete(plan);
+  metalink_file_set_maxconnections(file, 0);
+
+  /* resources picked by the caller, in its order; 9 does not exist */
+  CU_ASSERT_EQUAL_FATAL(0, metalink_plan_new(&plan, file, selected, 3, 0));
+  check_connections(plan, selected, 2);
+  metalink_plan_delete(plan);
+
+  CU_ASSERT(METALINK_ERR_NO_RESOURCES ==
+            metalink_plan_new(&plan, file, selected + 2, 1, 0));
+  metalink_file_set_size(file, 0);
+  CU_ASSERT(METALINK_ERR_UNKNOWN_FILE_SIZE ==
+            metalink_plan_new(&plan, file, NULL, 0, 0));
+  metalink_file_delete(file);
+
+  /* without a chunk checksum, pieces are 1 MiB and segments grow with
+     the file */
+  file = make_file(100LL * 1024 * 1024 + 1, 0, maxconnections, 3);
+  CU_ASSERT_EQUAL_FATAL(0, metalink_plan_new(&plan, file, NULL, 0, 0));
+  CU_ASSERT(4 == metalink_plan_get_connection_count(plan));
+  CU_ASSERT(17 == metalink_plan_get_segment_count(plan));
+  CU_ASSERT(1 == metalink_plan_next(plan, 3, &segment));
+  CU_ASSERT(13 == segment.index);
+  CU_ASSERT(78 == segment.first_piece);
+  CU_ASSERT(6 == segment.piece_count);
+  CU_ASSERT(78LL * 1024 * 1024 == segment.offset);
+  CU_ASSERT(6LL * 1024 * 1024 == segment.length);
+  metalink_plan_delete(plan);
+  metalink_file_delete(file);
+}
+
+#define THREAD_CONNECTIONS 8
+
+typedef struct _plan_worker {
+  metalink_plan_t *plan;
+  size_t connection;
+  unsigned char *taken;
+} plan_worker_t;
+
+static void *plan_work(void *arg) {
+  plan_worker_t *worker = arg;
+  metalink_segment_t segment;
+  while (metalink_plan_next(worker->plan, worker->connection, &segment)) {
+    ++worker->taken[segment.index];
+  }
+  return NULL;
+}
+
+void test_metalink_plan_threads(void) {
+  static const int maxconnections[] = {THREAD_CONNECTIONS};
+  metalink_file_t *file;
+  metalink_plan_t *plan;
+  plan_worker_t workers[THREAD_CONNECTIONS];
+#ifdef HAVE_PTHREAD
+  pthread_t threads[THREAD_CONNECTIONS];
+  int started[THREAD_CONNECTIONS];
+#endif /* HAVE_PTHREAD */
+  size_t count, i, j, sum;
+
+  file = make_file(100000LL * 1024, 1024, maxconnections, 1);
+  CU_ASSERT_EQUAL_FATAL(0, metalink_plan_new(&plan, file, NULL, 0, 0));
+  metalink_file_delete(file);
+  CU_ASSERT_FATAL(THREAD_CONNECTIONS ==
+                  metalink_plan_get_connection_count(plan));
+  count = metalink_plan_get_segment_count(plan);
+  CU_ASSERT(count >= THREAD_CONNECTIONS * 4);
+
+  for (i = 0; i < THREAD_CONNECTIONS; ++i) {
+    workers[i].plan = plan;
+    workers[i].connection = i;
+    workers[i].taken = calloc(count, 1);
+  }
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < THREAD_CONNECTIONS; ++i) {
+    started[i] = pthread_create(&threads[i], NULL, plan_work, &workers[i]);
+  }
+  for (i = 0; i < THREAD_CONNECTIONS; ++i) {
+    if (started[i] == 0) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+#endif /* HAVE_PTHREAD */
+  /* anything left over if threads could not be started */
+  plan_work(&workers[0]);
+
+  for (j = 0; j < count; ++j) {
+    sum = 0;
+    for (i = 0; i < THREAD_CONNECTIONS; ++i) {
+      sum += workers[i].taken[j];
+    }
+    CU_ASSERT(1 == sum);
+  }
+  for (i = 0; i < THREAD_CONNECTIONS; ++i) {
+    free(workers[i].taken);
+  }
+  metalink_plan_delete(plan);
+}
@@ -0,0 +1,503 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_snapshot_test.h"
+
+#include "metalink_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+
+#include <metalink/metalink.h>
+
+#define SNAPSHOT_TEST_FILE "metalink_snapshot_test.bin"
+#define SNAPSHOT_DAMAGED_FILE "metalink_snapshot_test.bad"
+#define CACHE_TEST_DIR "metalink_cache_test.d"
+#define CACHE_TEST_FILE "metalink_cache_test.xml"
+
+/* the fields test1.xml and test2.xml lack */
+static const char extra_doc[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+    "<file name=\"extra\">"
+    "<description>extra file</description>"
+    "<copyright>none</copyright>"
+    "<logo>http://example.org/logo.png</logo>"
+    "<language>en</language><language>ja</language>"
+    "<os>Linux</os><os>FreeBSD</os>"
+    "<signature mediatype=\"application/pgp-signature\">sig</signature>"
+    "<pieces length=\"1024\" type=\"sha1\">"
+    "<hash>not hex</hash><hash>either</hash>"
+    "</pieces>"
+    "<url>http://example.org/extra</url>"
+    "</file>"
+    "</metalink>";
+
+static void check_string(const char *expected, const char *actual) {
+  CU_ASSERT_EQUAL(!expected, !actual);
+  if (expected && actual) {
+    CU_ASSERT_STRING_EQUAL(expected, actual);
+  }
+}
+
+static void check_string_list(char **expected, char **actual) {
+  CU_ASSERT_EQUAL(!expected, !actual);
+  if (!expected || !actual) {
+    return;
+  }
+  for (; *expected && *actual; ++expected, ++actual) {
+    CU_ASSERT_STRING_EQUAL(*expected, *actual);
+  }
+  CU_ASSERT_PTR_NULL(*expected);
+  CU_ASSERT_PTR_NULL(*actual);
+}
+
+static void check_chunk_checksum(const metalink_chunk_checksum_t *expected,
+                                 const metalink_chunk_checksum_t *actual) {
+  metalink_piece_hash_t **a, **b;
+  size_t count;
+
+  CU_ASSERT_EQUAL_FATAL(!expected, !actual);
+  if (!expected) {
+    return;
+  }
+  check_string(expected->type, actual->type);
+  CU_ASSERT_EQUAL(expected->length, actual->length);
+  count = metalink_chunk_checksum_get_piece_count(expected);
+  CU_ASSERT_EQUAL(count, metalink_chunk_checksum_get_piece_count(actual));
+  CU_ASSERT_EQUAL_FATAL(!expected->piece_hashes, !actual->piece_hashes);
+  if (count > 0) {
+    CU_ASSERT_EQUAL(expected->digest_length, actual->digest_length);
+    CU_ASSERT(memcmp(expected->digests, actual->digests,
+                     count * expected->digest_length) == 0);
+    /* Only the digest table is kept. */
+    if (actual->piece_hashes) {
+      CU_ASSERT_PTR_NULL(actual->piece_hashes[0]);
+    }
+  } else if (expected->piece_hashes) {
+    for (a = expected->piece_hashes, b = actual->piece_hashes; *a && *b;
+         ++a, ++b) {
+      CU_ASSERT_EQUAL((*a)->piece, (*b)->piece);
+      check_string((*a)->hash, (*b)->hash);
+    }
+    CU_ASSERT_PTR_NULL(*a);
+    CU_ASSERT_PTR_NULL(*b);
+  }
+}
+
+static void check_file(const metalink_file_t *expected,
+                       const metalink_file_t *actual) {
+  metalink_resource_t **ra, **rb;
+  metalink_metaurl_t **ma, **mb;
+  metalink_checksum_t **ca, **cb;
+
+  check_string(expected->name, actual->name);
+  check_string(expected->description, actual->description);
+  CU_ASSERT_EQUAL(expected->size, actual->size);
+  check_string(expected->version, actual->version);
+  check_string(expected->copyright, actual->copyright);
+  check_string(expected->identity, actual->identity);
+  check_string(expected->logo, actual->logo);
+  check_string(expected->publisher_name, actual->publisher_name);
+  check_string(expected->publisher_url, actual->publisher_url);
+  check_string_list(expected->languages, actual->languages);
+  check_string(expected->language, actual->language);
+  check_string_list(expected->oses, actual->oses);
+  check_string(expected->os, actual->os);
+  CU_ASSERT_EQUAL(expected->maxconnections, actual->maxconnections);
+  CU_ASSERT_EQUAL_FATAL(!expected->signature, !actual->signature);
+  if (expected->signature) {
+    check_string(expected->signature->mediatype,
+                 actual->signature->mediatype);
+    check_string(expected->signature->signature,
+                 actual->signature->signature);
+  }
+  CU_ASSERT_EQUAL_FATAL(!expected->resources, !actual->resources);
+  if (expected->resources) {
+    for (ra = expected->resources, rb = actual->resources; *ra && *rb;
+         ++ra, ++rb) {
+      check_string((*ra)->url, (*rb)->url);
+      check_string((*ra)->type, (*rb)->type);
+      check_string((*ra)->location, (*rb)->location);
+      CU_ASSERT_EQUAL((*ra)->preference, (*rb)->preference);
+      CU_ASSERT_EQUAL((*ra)->priority, (*rb)->priority);
+      CU_ASSERT_EQUAL((*ra)->maxconnections, (*rb)->maxconnections);
+    }
+    CU_ASSERT_PTR_NULL(*ra);
+    CU_ASSERT_PTR_NULL(*rb);
+  }
+  CU_ASSERT_EQUAL_FATAL(!expected->metaurls, !actual->metaurls);
+  if (expected->metaurls) {
+    for (ma = expected->metaurls, mb = actual->metaurls; *ma && *mb;
+         ++ma, ++mb) {
+      check_string((*ma)->url, (*mb)->url);
+      check_string((*ma)->mediatype, (*mb)->mediatype);
+      check_string((*ma)->name, (*mb)->name);
+      CU_ASSERT_EQUAL((*ma)->priority, (*mb)->priority);
+    }
+    CU_ASSERT_PTR_NULL(*ma);
+    CU_ASSERT_PTR_NULL(*mb);
+  }
+  CU_ASSERT_EQUAL_FATAL(!expected->checksums, !actual->checksums);
+  if (expected->checksums) {
+    for (ca = expected->checksums, cb = actual->checksums; *ca && *cb;
+         ++ca, ++cb) {
+      check_string((*ca)->type, (*cb)->type);
+      check_string((*ca)->hash, (*cb)->hash);
+    }
+    CU_ASSERT_PTR_NULL(*ca);
+    CU_ASSERT_PTR_NULL(*cb);
+  }
+  check_chunk_checksum(expected->chunk_checksum, actual->chunk_checksum);
+}
+
+static void check_metalink(const metalink_t *expected,
+                           const metalink_t *actual) {
+  metalink_file_t **a, **b;
+
+  CU_ASSERT_EQUAL(expected->version, actual->version);
+  check_string(expected->generator, actual->generator);
+  check_string(expected->origin, actual->origin);
+  CU_ASSERT_EQUAL(expected->origin_dynamic, actual->origin_dynamic);
+  CU_ASSERT_EQUAL(expected->published, actual->published);
+  CU_ASSERT_EQUAL(expected->updated, actual->updated);
+  check_string(expected->identity, actual->identity);
+  check_string(expected->tags, actual->tags);
+  CU_ASSERT_EQUAL(!expected->file_index, !actual->file_index);
+  CU_ASSERT_EQUAL_FATAL(!expected->files, !actual->files);
+  if (!expected->files) {
+    return;
+  }
+  for (a = expected->files, b = actual->files; *a && *b; ++a, ++b) {
+    check_file(*a, *b);
+    if (actual->file_index && (*b)->name) {
+      CU_ASSERT_PTR_NOT_NULL(metalink_find_file(actual, (*b)->name));
+    }
+  }
+  CU_ASSERT_PTR_NULL(*a);
+  CU_ASSERT_PTR_NULL(*b);
+}
+
+/* Saves metalink, loads it again and compares the two. */
+static void check_round_trip(const metalink_t *metalink) {
+  metalink_error_t r;
+  metalink_t *loaded = NULL;
+  struct stat st;
+  mode_t mask;
+
+  r = metalink_save_snapshot(metalink, SNAPSHOT_TEST_FILE);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  /* The snapshot gets the mode of any new file, not that of mkstemp. */
+  mask = umask(0);
+  umask(mask);
+  CU_ASSERT_EQUAL_FATAL(0, stat(SNAPSHOT_TEST_FILE, &st));
+  CU_ASSERT_EQUAL(0666 & ~mask, st.st_mode & 0777);
+  r = metalink_load_snapshot(SNAPSHOT_TEST_FILE, &loaded);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  check_metalink(metalink, loaded);
+  metalink_delete(loaded);
+}
+
+void test_metalink_snapshot(void) {
+  metalink_parse_options_t *opts;
+  metalink_error_t r;
+  metalink_t *metalink;
+  int mode;
+
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+  for (mode = 0; mode < 4; ++mode) {
+    metalink_parse_options_set_compact_pieces(opts, mode == 1);
+    metalink_parse_options_set_arena(opts, mode == 2);
+    metalink_parse_options_set_file_index(opts, mode == 3);
+
+    r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test1.xml", &metalink,
+                               opts);
+    CU_ASSERT_EQUAL_FATAL(0, r);
+    check_round_trip(metalink);
+    metalink_delete(metalink);
+
+    r = metalink_parse_file_ex(LIBMETALINK_TEST_DIR "test2.xml", &metalink,
+                               opts);
+    CU_ASSERT_EQUAL_FATAL(0, r);
+    check_round_trip(metalink);
+    metalink_delete(metalink);
+
+    r = metalink_parse_memory_ex(extra_doc, sizeof(extra_doc) - 1, &metalink,
+                                 opts);
+    CU_ASSERT_EQUAL_FATAL(0, r);
+    if (mode != 1) {
+      /* The piece hashes are not hex, so they are kept as strings. */
+      CU_ASSERT_PTR_NOT_NULL(metalink->files[0]->chunk_checksum);
+    }
+    check_round_trip(metalink);
+    metalink_delete(metalink);
+  }
+  metalink_parse_options_delete(opts);
+
+  /* a metalink without files */
+  metalink = metalink_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(metalink);
+  metalink_set_generator(metalink, "generator");
+  metalink_set_published(metalink, 1234567890);
+  check_round_trip(metalink);
+  metalink_delete(metalink);
+  remove(SNAPSHOT_TEST_FILE);
+}
+
+/* Writes len bytes of data to path. */
+static void write_file(const char *path, const char *data, size_t len) {
+  FILE *fp;
+  fp = fopen(path, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  CU_ASSERT_EQUAL(len, fwrite(data, 1, len, fp));
+  fclose(fp);
+}
+
+/* Loads the snapshot at path, which must either work or be rejected. */
+static void check_damaged(const char *path) {
+  metalink_error_t r;
+  metalink_t *metalink = NULL;
+
+  r = metalink_load_snapshot(path, &metalink);
+  CU_ASSERT(r == 0 || r == METALINK_ERR_BAD_SNAPSHOT);
+  if (r == 0) {
+    metalink_delete(metalink);
+  }
+}
+
+void test_metalink_snapshot_damaged(void) {
+  metalink_error_t r;
+  metalink_t *metalink;
+  char *data;
+  long len;
+  long i;
+  FILE *fp;
+
+  r = metalink_parse_file(LIBMETALINK_TEST_DIR "test2.xml", &metalink);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  r = metalink_save_snapshot(metalink, SNAPSHOT_TEST_FILE);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  metalink_delete(metalink);
+
+  fp = fopen(SNAPSHOT_TEST_FILE, "rb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  rewind(fp);
+  data = malloc((size_t)len);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+  CU_ASSERT_EQUAL((size_t)len, fread(data, 1, (size_t)len, fp));
+  fclose(fp);
+
+  /* every byte flipped in turn */
+  for (i = 0; i < len; ++i) {
+    data[i] ^= 0xff;
+    write_file(SNAPSHOT_DAMAGED_FILE, data, (size_t)len);
+    check_damaged(SNAPSHOT_DAMAGED_FILE);
+    data[i] ^= 0xff;
+  }
+  /* truncated */
+  for (i = 0; i < len; i += 7) {
+    write_file(SNAPSHOT_DAMAGED_FILE, data, (size_t)i);
+    metalink = NULL;
+    r = metalink_load_snapshot(SNAPSHOT_DAMAGED_FILE, &metalink);
+    CU_ASSERT_EQUAL(METALINK_ERR_BAD_SNAPSHOT, r);
+  }
+  free(data);
+
+  r = metalink_load_snapshot(LIBMETALINK_TEST_DIR "test2.xml", &metalink);
+  CU_ASSERT_EQUAL(METALINK_ERR_BAD_SNAPSHOT, r);
+  r = metalink_load_snapshot(LIBMETALINK_TEST_DIR "no-such-file", &metalink);
+  CU_ASSERT_EQUAL(METALINK_ERR_CANNOT_OPEN_FILE, r);
+  r = metalink_load_snapshot("/dev/null", &metalink);
+  CU_ASSERT_EQUAL(METALINK_ERR_BAD_SNAPSHOT, r);
+  remove(SNAPSHOT_TEST_FILE);
+  remove(SNAPSHOT_DAMAGED_FILE);
+}
+
+/* Copies the file at src to dest. */
+static void copy_file(const char *dest, const char *src) {
+  char buf[4096];
+  size_t n;
+  FILE *in, *out;
+  in = fopen(src, "rb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(in);
+  out = fopen(dest, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(out);
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    CU_ASSERT_EQUAL(n, fwrite(buf, 1, n, out));
+  }
+  fclose(in);
+  fclose(out);
+}
+
+/* Removes the cache directory and its entries. */
+static void remove_cache_dir(void) {
+  char path[512];
+  struct dirent *ent;
+  DIR *dir;
+  dir = opendir(CACHE_TEST_DIR);
+  if (!dir) {
+    return;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] != '.') {
+      sprintf(path, "%s/%.256s", CACHE_TEST_DIR, ent->d_name);
+      remove(path);
+    }
+  }
+  closedir(dir);
+  rmdir(CACHE_TEST_DIR);
+}
+
+/*
+ * Parses path with opts, which collect statistics in stats, and
+ * compares the result with a parse of expected_path without the cache.
+ * hit tells whether the result is to come from the cache.
+ */
+static void check_cached_file(const char *path, const char *expected_path,
+                              metalink_parse_options_t *opts,
+                              const metalink_parse_stats_t *stats, int hit) {
+  metalink_parse_options_t *plain;
+  metalink_error_t r;
+  metalink_t *expected, *metalink;
+
+  plain = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(plain);
+  metalink_parse_options_set_arena(plain, 1);
+  metalink_parse_options_set_compact_pieces(plain, 1);
+  r = metalink_parse_file_ex(expected_path, &expected, plain);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  metalink_parse_options_delete(plain);
+
+  r = metalink_parse_file_ex(path, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_EQUAL(hit, stats->input_bytes == 0);
+  CU_ASSERT_PTR_NOT_NULL(metalink->arena);
+  check_metalink(expected, metalink);
+  metalink_delete(expected);
+  metalink_delete(metalink);
+}
+
+void test_metalink_parse_cache(void) {
+  static const char *const paths[] = {CACHE_TEST_FILE,
+                                      LIBMETALINK_TEST_DIR "test1.xml"};
+  metalink_batch_result_t results[2];
+  metalink_parse_stats_t stats;
+  metalink_parse_options_t *opts;
+  metalink_error_t r;
+  metalink_t *metalink;
+  int i;
+
+  remove_cache_dir();
+  CU_ASSERT_EQUAL_FATAL(0, mkdir(CACHE_TEST_DIR, 0700));
+  copy_file(CACHE_TEST_FILE, LIBMETALINK_TEST_DIR "test2.xml");
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+  metalink_parse_options_set_stats(opts, &stats);
+  CU_ASSERT_EQUAL(0, metalink_parse_options_set_cache_dir(opts,
+                                                         CACHE_TEST_DIR));
+
+  /* parsed once, then loaded */
+  check_cached_file(CACHE_TEST_FILE, LIBMETALINK_TEST_DIR "test2.xml", opts,
+                    &stats, 0);
+  check_cached_file(CACHE_TEST_FILE, LIBMETALINK_TEST_DIR "test2.xml", opts,
+                    &stats, 1);
+  /* A different file at the same path is parsed again. */
+  remove(CACHE_TEST_FILE);
+  copy_file(CACHE_TEST_FILE, LIBMETALINK_TEST_DIR "test1.xml");
+  check_cached_file(CACHE_TEST_FILE, LIBMETALINK_TEST_DIR "test1.xml", opts,
+                    &stats, 0);
+  check_cached_file(CACHE_TEST_FILE, LIBMETALINK_TEST_DIR "test1.xml", opts,
+                    &stats, 1);
+  /* Other fields make another entry. */
+  metalink_parse_options_set_skip_fields(opts, METALINK_FIELD_PIECES);
+  for (i = 0; i < 2; ++i) {
+    r = metalink_parse_file_ex(CACHE_TEST_FILE, &metalink, opts);
+    CU_ASSERT_EQUAL_FATAL(0, r);
+    CU_ASSERT_EQUAL(i == 1, stats.input_bytes == 0);
+    CU_ASSERT_PTR_NULL(metalink->files[1]->chunk_checksum);
+    metalink_delete(metalink);
+  }
+  metalink_parse_options_set_skip_fields(opts, 0);
+
+  /* the index follows the options, not the entry */
+  metalink_parse_options_set_file_index(opts, 1);
+  r = metalink_parse_file_ex(CACHE_TEST_FILE, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_EQUAL(0, stats.input_bytes);
+  CU_ASSERT_PTR_NOT_NULL(metalink->file_index);
+  metalink_delete(metalink);
+  metalink_parse_options_set_file_index(opts, 0);
+
+  /* The size limit holds for cached files, too. */
+  metalink_parse_options_set_max_size(opts, 100);
+  r = metalink_parse_file_ex(CACHE_TEST_FILE, &metalink, opts);
+  CU_ASSERT_EQUAL(METALINK_ERR_DOCUMENT_TOO_LARGE, r);
+  metalink_parse_options_set_max_size(opts, 0);
+
+  /* documents in memory are found by their contents */
+  for (i = 0; i < 2; ++i) {
+    r = metalink_parse_memory_ex(extra_doc, sizeof(extra_doc) - 1, &metalink,
+                                 opts);
+    CU_ASSERT_EQUAL_FATAL(0, r);
+    CU_ASSERT_EQUAL(i == 1, stats.input_bytes == 0);
+    CU_ASSERT_STRING_EQUAL("extra", metalink->files[0]->name);
+    /* compact_pieces drops the piece hashes, which are not hex */
+    CU_ASSERT_PTR_NULL(metalink->files[0]->chunk_checksum);
+    metalink_delete(metalink);
+  }
+
+  r = metalink_parse_batch(paths, 2, opts, results);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  for (i = 0; i < 2; ++i) {
+    CU_ASSERT_EQUAL(0, results[i].error);
+    CU_ASSERT_PTR_NOT_NULL(results[i].metalink);
+    metalink_delete(results[i].metalink);
+  }
+
+  /* Without a usable directory, documents are just parsed. */
+  CU_ASSERT_EQUAL(0, metalink_parse_options_set_cache_dir(
+                         opts, CACHE_TEST_DIR "/no-such-dir"));
+  check_cached_file(CACHE_TEST_FILE, CACHE_TEST_FILE, opts, &stats, 0);
+  check_cached_file(CACHE_TEST_FILE, CACHE_TEST_FILE, opts, &stats, 0);
+  CU_ASSERT_EQUAL(0, metalink_parse_options_set_cache_dir(opts, NULL));
+  r = metalink_parse_file_ex(CACHE_TEST_FILE, &metalink, opts);
+  CU_ASSERT_EQUAL_FATAL(0, r);
+  CU_ASSERT_PTR_NULL(metalink->arena);
+  metalink_delete(metalink);
+
+  metalink_parse_options_delete(opts);
+  remove(CACHE_TEST_FILE);
+  remove_cache_dir();
+}
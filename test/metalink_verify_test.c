@@ -0,0 +1,768 @@
+/* <!-- copyright */
+/*
+ * libmetalink
+ *
+ * Copyright (c) 2012 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/* copyright --> */
+#include "metalink_verify_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+
+#include <metalink/metalink.h>
+
+#include "metalink_digest.h"
+#include "metalink_helper.h"
+
+#define VERIFY_TEST_FILE "metalink_verify_test.dat"
+#define VERIFY_TEST_LENGTH 4500
+#define VERIFY_TEST_PIECE_LENGTH 1024
+#define VERIFY_TEST_PIECE_COUNT 5
+
+/* sha-1 of each piece of the bytes written by write_test_file() */
+static const char *piece_sha1[VERIFY_TEST_PIECE_COUNT] = {
+    "d3dd0215dd1aa52851f13ab3a9b8906ac3d0f473",
+    "18459cc7d2f32e0e0b66cfbd82e9cefa80b385a3",
+    "2a0b4107aae707513f9532d39df210da3797c9c1",
+    "b08c5d8a1798d73f87d36e7336a94d75884373e4",
+    "bc581bfb64e14e31714fb94d1ffd0dbea4adb049"};
+
+static void check_digest(const char *name, const void *data, size_t len,
+                         const char *expected) {
+  metalink_digest_algo_t algo;
+  metalink_digest_t digest;
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  unsigned char expected_md[METALINK_DIGEST_MAX_LENGTH];
+  size_t i;
+
+  CU_ASSERT_EQUAL_FATAL(0, metalink_digest_algo_from_name(&algo, name));
+  CU_ASSERT_EQUAL(strlen(expected), metalink_digest_length(algo) * 2);
+  metalink_hex_decode(expected_md, expected, strlen(expected));
+
+  metalink_digest_init(&digest, algo);
+  metalink_digest_update(&digest, data, len);
+  metalink_digest_final(&digest, md);
+  CU_ASSERT(0 == memcmp(expected_md, md, metalink_digest_length(algo)));
+
+  /* feed the same data in uneven pieces */
+  metalink_digest_init(&digest, algo);
+  for (i = 0; i < len; i += i % 7 + 1) {
+    metalink_digest_update(&digest, (const unsigned char *)data + i,
+                           i + i % 7 + 1 < len ? i % 7 + 1 : len - i);
+  }
+  metalink_digest_final(&digest, md);
+  CU_ASSERT(0 == memcmp(expected_md, md, metalink_digest_length(algo)));
+}
+
+static void check_digests(void) {
+  unsigned char data[1000];
+  size_t i;
+
+  for (i = 0; i < sizeof(data); ++i) {
+    data[i] = (unsigned char)(i * 13 + 1);
+  }
+
+  check_digest("md5", "abc", 3, "900150983cd24fb0d6963f7d28e17f72");
+  check_digest("md5", data, sizeof(data), "5768521d9b2cf47a0fda2ced91ce650d");
+  check_digest("sha-1", "abc", 3, "a9993e364706816aba3e25717850c26c9cd0d89d");
+  check_digest("sha1", data, sizeof(data),
+               "54dbdbfec6ddb4dfc3996c9d7d14e50098054df1");
+  check_digest(
+      "sha-256", "abc", 3,
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  check_digest(
+      "SHA256", data, sizeof(data),
+      "7bb2fa7ff0db797646f30a289a3774ea64034902ab739bad37e4d9af29509239");
+  check_digest("sha-384", "abc", 3,
+               "cb00753f45a35e8bb5a03d699ac65007272c32ab0eded163"
+               "1a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7");
+  check_digest("sha-384", data, sizeof(data),
+               "237b682cfe7d1e20822298283643e9871562dcd9de145353"
+               "5633aeb3d272d765faa4d1fb707a007e65400a9d20461ea2");
+  check_digest("sha-512", "abc", 3,
+               "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+               "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f");
+  check_digest("sha-512", data, sizeof(data),
+               "d14270cf0199a09f200decb1cc9643a4479147d5ddfd709fcb47fa63bef73411"
+               "96595d4a2087168fde35d1a7cf60db53b0d1dec5e1a890cccee921f77e117ebc");
+}
+
+/* Checks update_multi against 8 messages hashed one by one. */
+static void check_digest_multi(void) {
+  unsigned char data[8][1000];
+  const unsigned char *ptrs[8];
+  metalink_digest_t digests[8], single;
+  metalink_digest_t *digest_ptrs[8];
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  unsigned char expected[METALINK_DIGEST_MAX_LENGTH];
+  size_t i, j;
+
+  for (i = 0; i < 8; ++i) {
+    for (j = 0; j < sizeof(data[i]); ++j) {
+      data[i][j] = (unsigned char)(j * (i + 3) + i);
+    }
+    ptrs[i] = data[i];
+    digest_ptrs[i] = &digests[i];
+    metalink_digest_init(&digests[i], METALINK_DIGEST_SHA256);
+  }
+  /* whole blocks, then a partial block, then the rest */
+  metalink_digest_update_multi(digest_ptrs, ptrs, 8, 640);
+  for (i = 0; i < 8; ++i) {
+    ptrs[i] += 640;
+  }
+  metalink_digest_update_multi(digest_ptrs, ptrs, 8, 100);
+  for (i = 0; i < 8; ++i) {
+    ptrs[i] += 100;
+  }
+  metalink_digest_update_multi(digest_ptrs, ptrs, 8, 260);
+  for (i = 0; i < 8; ++i) {
+    metalink_digest_final(&digests[i], md);
+    metalink_digest_init(&single, METALINK_DIGEST_SHA256);
+    metalink_digest_update(&single, data[i], sizeof(data[i]));
+    metalink_digest_final(&single, expected);
+    CU_ASSERT(0 == memcmp(expected, md, 32));
+  }
+}
+
+void test_metalink_digest(void) {
+  static const char *backends[] = {"scalar", "sha-ni", "avx2"};
+  metalink_digest_algo_t algo;
+  size_t i;
+
+  for (i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+    /* skip what this CPU does not support */
+    if (metalink_digest_set_backend(backends[i]) != 0) {
+      continue;
+    }
+    CU_ASSERT_STRING_EQUAL(backends[i],
+                           metalink_digest_get_backend(METALINK_DIGEST_SHA256));
+    CU_ASSERT_STRING_EQUAL("scalar",
+                           metalink_digest_get_backend(METALINK_DIGEST_MD5));
+    check_digests();
+    check_digest_multi();
+  }
+  CU_ASSERT_EQUAL(-1, metalink_digest_set_backend("sha-3"));
+  CU_ASSERT_EQUAL(0, metalink_digest_set_backend("auto"));
+
+  CU_ASSERT_EQUAL(-1, metalink_digest_algo_from_name(&algo, "crc32"));
+  CU_ASSERT_EQUAL(-1, metalink_digest_algo_from_name(&algo, "sha-1-extra"));
+  CU_ASSERT_EQUAL(-1, metalink_digest_algo_from_name(&algo, NULL));
+}
+
+/* Stores the hex digest of data in out. */
+static void digest_hex(char *out, metalink_digest_algo_t algo,
+                       const unsigned char *data, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  metalink_digest_t digest;
+  unsigned char md[METALINK_DIGEST_MAX_LENGTH];
+  size_t i;
+
+  metalink_digest_init(&digest, algo);
+  metalink_digest_update(&digest, data, len);
+  metalink_digest_final(&digest, md);
+  for (i = 0; i < metalink_digest_length(algo); ++i) {
+    out[i * 2] = hex[md[i] >> 4];
+    out[i * 2 + 1] = hex[md[i] & 0xf];
+  }
+  out[i * 2] = '\0';
+}
+
+static void write_test_file(size_t length) {
+  FILE *fp;
+  size_t i;
+
+  fp = fopen(VERIFY_TEST_FILE, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  for (i = 0; i < length; ++i) {
+    fputc((int)((i * 7 + i / 251) & 0xff), fp);
+  }
+  fclose(fp);
+}
+
+static metalink_file_t *new_test_file(void) {
+  metalink_file_t *file;
+  metalink_chunk_checksum_t *chunk_checksum;
+  metalink_piece_hash_t **piece_hashes;
+  size_t i;
+
+  file = metalink_file_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+  chunk_checksum = metalink_chunk_checksum_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(chunk_checksum);
+  metalink_chunk_checksum_set_type(chunk_checksum, "sha-1");
+  metalink_chunk_checksum_set_length(chunk_checksum,
+                                     VERIFY_TEST_PIECE_LENGTH);
+  piece_hashes =
+      calloc(VERIFY_TEST_PIECE_COUNT + 1, sizeof(metalink_piece_hash_t *));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(piece_hashes);
+  for (i = 0; i < VERIFY_TEST_PIECE_COUNT; ++i) {
+    piece_hashes[i] = metalink_piece_hash_new();
+    metalink_piece_hash_set_piece(piece_hashes[i], (int)i);
+    metalink_piece_hash_set_hash(piece_hashes[i], piece_sha1[i]);
+  }
+  metalink_chunk_checksum_set_piece_hashes(chunk_checksum, piece_hashes);
+  file->chunk_checksum = chunk_checksum;
+  return file;
+}
+
+void test_metalink_verify_pieces(void) {
+  metalink_file_t *file;
+  metalink_chunk_checksum_t *chunk_checksum;
+  unsigned char *bitmap = NULL;
+  unsigned char table[VERIFY_TEST_PIECE_COUNT * 20];
+  size_t i;
+
+  write_test_file(VERIFY_TEST_LENGTH);
+  file = new_test_file();
+  chunk_checksum = file->chunk_checksum;
+
+  /* piece hashes decoded from hex, size taken from the local file */
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(file, VERIFY_TEST_FILE, 1,
+                                            &bitmap));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(bitmap);
+  CU_ASSERT_EQUAL(0, bitmap[0]);
+  free(bitmap);
+
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(file, VERIFY_TEST_FILE, 0,
+                                            &bitmap));
+  CU_ASSERT_EQUAL(0, bitmap[0]);
+  free(bitmap);
+
+  /* the binary digest table with a corrupt third piece */
+  for (i = 0; i < VERIFY_TEST_PIECE_COUNT; ++i) {
+    metalink_hex_decode(table + i * 20, piece_sha1[i], 40);
+  }
+  table[2 * 20] ^= 1;
+  chunk_checksum->digests = table;
+  chunk_checksum->digest_length = 20;
+  chunk_checksum->piece_count = VERIFY_TEST_PIECE_COUNT;
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(file, VERIFY_TEST_FILE, 4,
+                                            &bitmap));
+  CU_ASSERT_EQUAL(0x20, bitmap[0]);
+  free(bitmap);
+  chunk_checksum->digests = NULL;
+  chunk_checksum->piece_count = 0;
+
+  /* a truncated local file fails the pieces it does not cover */
+  metalink_file_set_size(file, VERIFY_TEST_LENGTH);
+  write_test_file(VERIFY_TEST_LENGTH - 500);
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(file, VERIFY_TEST_FILE, 3,
+                                            &bitmap));
+  CU_ASSERT_EQUAL(0x18, bitmap[0]);
+  free(bitmap);
+  write_test_file(3000);
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(file, VERIFY_TEST_FILE, 3,
+                                            &bitmap));
+  CU_ASSERT_EQUAL(0x38, bitmap[0]);
+  free(bitmap);
+
+  CU_ASSERT_EQUAL(METALINK_ERR_CANNOT_OPEN_FILE,
+                  metalink_verify_pieces(file, VERIFY_TEST_FILE ".missing",
+                                         1, &bitmap));
+
+  metalink_chunk_checksum_set_type(chunk_checksum, "crc32");
+  CU_ASSERT_EQUAL(METALINK_ERR_UNSUPPORTED_HASH,
+                  metalink_verify_pieces(file, VERIFY_TEST_FILE, 1, &bitmap));
+  metalink_chunk_checksum_set_type(chunk_checksum, "sha-256");
+  CU_ASSERT_EQUAL(METALINK_ERR_NO_PIECE_HASHES,
+                  metalink_verify_pieces(file, VERIFY_TEST_FILE, 1, &bitmap));
+
+  metalink_file_delete(file);
+  file = metalink_file_new();
+  CU_ASSERT_EQUAL(METALINK_ERR_NO_PIECE_HASHES,
+                  metalink_verify_pieces(file, VERIFY_TEST_FILE, 1, &bitmap));
+  metalink_file_delete(file);
+  remove(VERIFY_TEST_FILE);
+}
+
+/*
+ * Writes a metalink 3 document with the piece hashes of the test file
+ * in the order given by pieces, and returns its length.
+ */
+static size_t write_v3_document(char *buf, size_t size, const int *pieces) {
+  size_t length;
+  size_t i;
+
+  length = (size_t)snprintf(
+      buf, size,
+      "<metalink version=\"3.0\" xmlns=\"http://www.metalinker.org/\">"
+      "<files><file name=\"" VERIFY_TEST_FILE "\"><size>%d</size>"
+      "<verification><pieces length=\"%d\" type=\"sha1\">",
+      VERIFY_TEST_LENGTH, VERIFY_TEST_PIECE_LENGTH);
+  for (i = 0; i < VERIFY_TEST_PIECE_COUNT; ++i) {
+    length += (size_t)snprintf(buf + length, size - length,
+                               "<hash piece=\"%d\">%s</hash>", pieces[i],
+                               piece_sha1[pieces[i]]);
+  }
+  length += (size_t)snprintf(buf + length, size - length,
+                             "</pieces></verification></file></files>"
+                             "</metalink>");
+  return length;
+}
+
+void test_metalink_verify_pieces_out_of_order(void) {
+  static const int shuffled[VERIFY_TEST_PIECE_COUNT] = {4, 2, 0, 3, 1};
+  static const int repeated[VERIFY_TEST_PIECE_COUNT] = {0, 1, 1, 3, 4};
+  metalink_parse_options_t *opts;
+  metalink_t *metalink;
+  metalink_chunk_checksum_t *chunk_checksum;
+  unsigned char *digests;
+  unsigned char *bitmap = NULL;
+  char doc[1024];
+  size_t length;
+
+  write_test_file(VERIFY_TEST_LENGTH);
+  opts = metalink_parse_options_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(opts);
+
+  /* the digest table is in piece order, whatever the document order */
+  length = write_v3_document(doc, sizeof(doc), shuffled);
+  CU_ASSERT_FATAL(length < sizeof(doc));
+  CU_ASSERT_EQUAL_FATAL(0, metalink_parse_memory(doc, length, &metalink));
+  chunk_checksum = metalink->files[0]->chunk_checksum;
+  CU_ASSERT_EQUAL(VERIFY_TEST_PIECE_COUNT,
+                  metalink_chunk_checksum_get_piece_count(chunk_checksum));
+  CU_ASSERT_EQUAL(4, chunk_checksum->piece_hashes[0]->piece);
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(metalink->files[0],
+                                            VERIFY_TEST_FILE, 1, &bitmap));
+  CU_ASSERT_EQUAL(0, bitmap[0]);
+  free(bitmap);
+
+  /* so are the hex strings when there is no table */
+  digests = chunk_checksum->digests;
+  chunk_checksum->digests = NULL;
+  chunk_checksum->piece_count = 0;
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(metalink->files[0],
+                                            VERIFY_TEST_FILE, 1, &bitmap));
+  CU_ASSERT_EQUAL(0, bitmap[0]);
+  free(bitmap);
+  chunk_checksum->digests = digests;
+  metalink_delete(metalink);
+
+  metalink_parse_options_set_compact_pieces(opts, 1);
+  CU_ASSERT_EQUAL_FATAL(
+      0, metalink_parse_memory_ex(doc, length, &metalink, opts));
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(metalink->files[0],
+                                            VERIFY_TEST_FILE, 1, &bitmap));
+  CU_ASSERT_EQUAL(0, bitmap[0]);
+  free(bitmap);
+  metalink_delete(metalink);
+
+  /* a repeated piece leaves another one without a hash */
+  length = write_v3_document(doc, sizeof(doc), repeated);
+  CU_ASSERT_FATAL(length < sizeof(doc));
+  CU_ASSERT_EQUAL_FATAL(
+      0, metalink_parse_memory_ex(doc, length, &metalink, opts));
+  CU_ASSERT_PTR_NULL(metalink->files[0]->chunk_checksum);
+  metalink_delete(metalink);
+
+  CU_ASSERT_EQUAL_FATAL(0, metalink_parse_memory(doc, length, &metalink));
+  CU_ASSERT_EQUAL(0, metalink_chunk_checksum_get_piece_count(
+                         metalink->files[0]->chunk_checksum));
+  CU_ASSERT_EQUAL(METALINK_ERR_NO_PIECE_HASHES,
+                  metalink_verify_pieces(metalink->files[0],
+                                         VERIFY_TEST_FILE, 1, &bitmap));
+  metalink_delete(metalink);
+
+  metalink_parse_options_delete(opts);
+  remove(VERIFY_TEST_FILE);
+}
+
+void test_metalink_verify_pieces_multi_buffer(void) {
+  metalink_file_t *file;
+  metalink_chunk_checksum_t *chunk_checksum;
+  metalink_piece_hash_t **piece_hashes;
+  unsigned char *bitmap = NULL;
+  unsigned char data[19 * 1024];
+  char hash[METALINK_DIGEST_MAX_LENGTH * 2 + 1];
+  FILE *fp;
+  size_t i;
+
+  /* hash 8 pieces at once if the CPU can; any backend must pass */
+  metalink_digest_set_backend("avx2");
+  for (i = 0; i < sizeof(data); ++i) {
+    data[i] = (unsigned char)(i * 7 + i / 251);
+  }
+  fp = fopen(VERIFY_TEST_FILE, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  fwrite(data, 1, sizeof(data), fp);
+  fclose(fp);
+
+  file = metalink_file_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+  metalink_file_set_size(file, sizeof(data));
+  chunk_checksum = metalink_chunk_checksum_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(chunk_checksum);
+  metalink_chunk_checksum_set_type(chunk_checksum, "sha-256");
+  metalink_chunk_checksum_set_length(chunk_checksum, 1024);
+  piece_hashes = calloc(20, sizeof(metalink_piece_hash_t *));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(piece_hashes);
+  for (i = 0; i < 19; ++i) {
+    digest_hex(hash, METALINK_DIGEST_SHA256, data + i * 1024, 1024);
+    /* pieces 3 and 17 do not match */
+    if (i == 3 || i == 17) {
+      hash[0] = hash[0] == '0' ? '1' : '0';
+    }
+    piece_hashes[i] = metalink_piece_hash_new();
+    metalink_piece_hash_set_piece(piece_hashes[i], (int)i);
+    metalink_piece_hash_set_hash(piece_hashes[i], hash);
+  }
+  metalink_chunk_checksum_set_piece_hashes(chunk_checksum, piece_hashes);
+  file->chunk_checksum = chunk_checksum;
+
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(file, VERIFY_TEST_FILE, 2,
+                                            &bitmap));
+  CU_ASSERT_EQUAL(0x10, bitmap[0]);
+  CU_ASSERT_EQUAL(0, bitmap[1]);
+  CU_ASSERT_EQUAL(0x40, bitmap[2]);
+  free(bitmap);
+
+  /* a short file makes a batch fall back to one piece at a time */
+  fp = fopen(VERIFY_TEST_FILE, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  fwrite(data, 1, 12 * 1024 + 10, fp);
+  fclose(fp);
+  CU_ASSERT_EQUAL(0, metalink_verify_pieces(file, VERIFY_TEST_FILE, 1,
+                                            &bitmap));
+  CU_ASSERT_EQUAL(0x10, bitmap[0]);
+  CU_ASSERT_EQUAL(0x0f, bitmap[1]);
+  CU_ASSERT_EQUAL(0xe0, bitmap[2]);
+  free(bitmap);
+
+  metalink_file_delete(file);
+  metalink_digest_set_backend("auto");
+  remove(VERIFY_TEST_FILE);
+}
+
+/* spans several read blocks, ending with a partial block and piece */
+#define VERIFY_FILE_TEST_LENGTH (5 * 1024 * 1024 + 4321)
+#define VERIFY_FILE_TEST_PIECE_LENGTH (256 * 1024)
+
+static metalink_checksum_t *new_checksum(const char *type,
+                                         metalink_digest_algo_t algo,
+                                         const unsigned char *data,
+                                         size_t len) {
+  metalink_checksum_t *checksum;
+  char hash[METALINK_DIGEST_MAX_LENGTH * 2 + 1];
+
+  checksum = metalink_checksum_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(checksum);
+  metalink_checksum_set_type(checksum, type);
+  digest_hex(hash, algo, data, len);
+  metalink_checksum_set_hash(checksum, hash);
+  return checksum;
+}
+
+void test_metalink_verify_file(void) {
+  metalink_file_t *file;
+  metalink_chunk_checksum_t *chunk_checksum;
+  metalink_piece_hash_t **piece_hashes;
+  unsigned char *data;
+  unsigned char *bitmap = NULL;
+  char hash[METALINK_DIGEST_MAX_LENGTH * 2 + 1];
+  size_t i, piece_count, len;
+  int bad = -1;
+  FILE *fp;
+
+  data = malloc(VERIFY_FILE_TEST_LENGTH);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+  for (i = 0; i < VERIFY_FILE_TEST_LENGTH; ++i) {
+    data[i] = (unsigned char)(i * 7 + i / 251);
+  }
+  fp = fopen(VERIFY_TEST_FILE, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  fwrite(data, 1, VERIFY_FILE_TEST_LENGTH, fp);
+  fclose(fp);
+
+  file = metalink_file_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+  file->checksums = calloc(6, sizeof(metalink_checksum_t *));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(file->checksums);
+  file->checksums[0] = new_checksum("md5", METALINK_DIGEST_MD5, data,
+                                    VERIFY_FILE_TEST_LENGTH);
+  file->checksums[1] = new_checksum("sha-1", METALINK_DIGEST_SHA1, data,
+                                    VERIFY_FILE_TEST_LENGTH);
+  file->checksums[2] = new_checksum("sha-256", METALINK_DIGEST_SHA256, data,
+                                    VERIFY_FILE_TEST_LENGTH);
+  /* the same algorithm again, and one which is not supported */
+  file->checksums[3] = new_checksum("sha256", METALINK_DIGEST_SHA256, data,
+                                    VERIFY_FILE_TEST_LENGTH);
+  file->checksums[4] = new_checksum("crc32", METALINK_DIGEST_MD5, data, 1);
+
+  /* whole-file checksums only */
+  CU_ASSERT_EQUAL(0, metalink_verify_file(file, VERIFY_TEST_FILE, &bad,
+                                          NULL));
+  CU_ASSERT_EQUAL(0, bad);
+
+  /* piece hashes requested without a chunk checksum */
+  CU_ASSERT_EQUAL(METALINK_ERR_NO_PIECE_HASHES,
+                  metalink_verify_file(file, VERIFY_TEST_FILE, &bad,
+                                       &bitmap));
+
+  piece_count = (VERIFY_FILE_TEST_LENGTH + VERIFY_FILE_TEST_PIECE_LENGTH - 1) /
+                VERIFY_FILE_TEST_PIECE_LENGTH;
+  chunk_checksum = metalink_chunk_checksum_new();
+  CU_ASSERT_PTR_NOT_NULL_FATAL(chunk_checksum);
+  metalink_chunk_checksum_set_type(chunk_checksum, "sha-1");
+  metalink_chunk_checksum_set_length(chunk_checksum,
+                                     VERIFY_FILE_TEST_PIECE_LENGTH);
+  piece_hashes = calloc(piece_count + 1, sizeof(metalink_piece_hash_t *));
+  CU_ASSERT_PTR_NOT_NULL_FATAL(piece_hashes);
+  for (i = 0; i < piece_count; ++i) {
+    len = VERIFY_FILE_TEST_LENGTH - i * VERIFY_FILE_TEST_PIECE_LENGTH;
+    if (len > VERIFY_FILE_TEST_PIECE_LENGTH) {
+      len = VERIFY_FILE_TEST_PIECE_LENGTH;
+    }
+    digest_hex(hash, METALINK_DIGEST_SHA1,
+               data + i * VERIFY_FILE_TEST_PIECE_LENGTH, len);
+    piece_hashes[i] = metalink_piece_hash_new();
+    metalink_piece_hash_set_piece(piece_hashes[i], (int)i);
+    metalink_piece_hash_set_hash(piece_hashes[i], hash);
+  }
+  metalink_chunk_checksum_set_piece_hashes(chunk_checksum, piece_hashes);
+  file->chunk_checksum = chunk_checksum;
+
+  bad = -1;
+  CU_ASSERT_EQUAL(0, metalink_verify_file(file, VERIFY_TEST_FILE, &bad,
+                                          &bitmap));
+  CU_ASSERT_EQUAL(0, bad);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(bitmap);
+  for (i = 0; i < (piece_count + 7) / 8; ++i) {
+    CU_ASSERT_EQUAL(0, bitmap[i]);
+  }
+  free(bitmap);
+
+  /* flip one byte in the 10th piece */
+  fp = fopen(VERIFY_TEST_FILE, "r+b");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  fseek(fp, 9 * VERIFY_FILE_TEST_PIECE_LENGTH + 100, SEEK_SET);
+  fputc(data[9 * VERIFY_FILE_TEST_PIECE_LENGTH + 100] ^ 0xff, fp);
+  fclose(fp);
+  CU_ASSERT_EQUAL(0, metalink_verify_file(file, VERIFY_TEST_FILE, &bad,
+                                          &bitmap));
+  CU_ASSERT_EQUAL(4, bad);
+  CU_ASSERT_EQUAL(0, bitmap[0]);
+  CU_ASSERT_EQUAL(0x40, bitmap[1]);
+  CU_ASSERT_EQUAL(0, bitmap[2]);
+  free(bitmap);
+
+  /* a truncated file fails every checksum and the missing pieces */
+  metalink_file_set_size(file, VERIFY_FILE_TEST_LENGTH);
+  fp = fopen(VERIFY_TEST_FILE, "wb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+  fwrite(data, 1, 20 * VERIFY_FILE_TEST_PIECE_LENGTH, fp);
+  fclose(fp);
+  CU_ASSERT_EQUAL(0, metalink_verify_file(file, VERIFY_TEST_FILE, &bad,
+                                          &bitmap));
+  CU_ASSERT_EQUAL(4, bad);
+  CU_ASSERT_EQUAL(0, bitmap[0]);
+  CU_ASSERT_EQUAL(0, bitmap[1]);
+  CU_ASSERT_EQUAL(0x08, bitmap[2]);
+  free(bitmap);
+
+  /* keep only the unsupported checksum */
+  for (i = 0; i < 4; ++i) {
+    metalink_checksum_delete(file->checksums[i]);
+  }
+  file->checksums[0] = file->checksums[4];
+  file->checksums[1] = NULL;
+  CU_ASSERT_EQUAL(METALINK_ERR_NO_CHECKSUMS,
+                  metalink_verify_file(file, VERIFY_TEST_FILE, &bad, NULL));
+  CU_ASSERT_EQUAL(METALINK_ERR_CANNOT_OPEN_FILE,
+                  metalink_verify_file(file, VERIFY_TEST_FILE ".missing", &bad,
+                                       &bitmap));
+
+  metalink_file_delete(file);
+  free(data);
+  remove(VERIFY_TEST_FILE);
+}
+
+typedef struct {
+  /* the pieces reported so far in order, and whether they were good */
+  size_t pieces[16];
+  int good[16];
+  size_t count;
+  /* reset bad pieces from within the callback */
+  metalink_verifier_t *reset;
+} piece_results_t;
+
+static int record_piece(size_t index, int good, void *user_data) {
+  piece_results_t *results = user_data;
+  if (results->count < 16) {
+    results->pieces[results->count] = index;
+    results->good[results->count] = good;
+  }
+  ++results->count;
+  if (!good && results->reset) {
+    metalink_verifier_reset_piece(results->reset, index);
+  }
+  return 0;
+}
+
+static int fail_piece(size_t index, int good, void *user_data) {
+  (void)index;
+  (void)good;
+  (void)user_data;
+  return 1;
+}
+
+void test_metalink_verifier(void) {
+  metalink_file_t *file;
+  metalink_verifier_t *verifier;
+  piece_results_t results;
+  unsigned char data[VERIFY_TEST_LENGTH];
+  unsigned char corrupt[100];
+  size_t i;
+
+  for (i = 0; i < VERIFY_TEST_LENGTH; ++i) {
+    data[i] = (unsigned char)(i * 7 + i / 251);
+  }
+  file = new_test_file();
+  metalink_file_set_size(file, VERIFY_TEST_LENGTH);
+  memset(&results, 0, sizeof(results));
+  CU_ASSERT_EQUAL_FATAL(0, metalink_verifier_new(&verifier, file,
+                                                 record_piece, &results));
+  /* the verifier keeps its own copy of the piece hashes */
+  metalink_file_delete(file);
+  CU_ASSERT_EQUAL(VERIFY_TEST_PIECE_COUNT,
+                  metalink_verifier_get_piece_count(verifier));
+
+  /* the last piece, which is short, written in order */
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 4096, data + 4096,
+                                             200));
+  CU_ASSERT_EQUAL(METALINK_PIECE_INCOMPLETE,
+                  metalink_verifier_get_piece_status(verifier, 4));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 4296, data + 4296,
+                                             VERIFY_TEST_LENGTH - 4296));
+  CU_ASSERT_EQUAL(1, results.count);
+  CU_ASSERT_EQUAL(4, results.pieces[0]);
+  CU_ASSERT(results.good[0]);
+  CU_ASSERT_EQUAL(METALINK_PIECE_GOOD,
+                  metalink_verifier_get_piece_status(verifier, 4));
+
+  /* the second piece in reverse order with overlapping writes */
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 1800, data + 1800,
+                                             248));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 1500, data + 1500,
+                                             400));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 1100, data + 1100,
+                                             300));
+  CU_ASSERT_EQUAL(1, results.count);
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 1024, data + 1024,
+                                             600));
+  CU_ASSERT_EQUAL(2, results.count);
+  CU_ASSERT_EQUAL(1, results.pieces[1]);
+  CU_ASSERT(results.good[1]);
+
+  /* one write spanning pieces 0, 2 and 3, with a corrupt third piece */
+  memcpy(corrupt, data + 2100, sizeof(corrupt));
+  data[2100] ^= 0xff;
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 0, data, 4096));
+  data[2100] ^= 0xff;
+  CU_ASSERT_EQUAL(5, results.count);
+  CU_ASSERT_EQUAL(0, results.pieces[2]);
+  CU_ASSERT(results.good[2]);
+  CU_ASSERT_EQUAL(2, results.pieces[3]);
+  CU_ASSERT(!results.good[3]);
+  CU_ASSERT_EQUAL(3, results.pieces[4]);
+  CU_ASSERT(results.good[4]);
+  CU_ASSERT_EQUAL(METALINK_PIECE_BAD,
+                  metalink_verifier_get_piece_status(verifier, 2));
+
+  /* completed pieces ignore further data until they are reset */
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 2048, data + 2048,
+                                             1024));
+  CU_ASSERT_EQUAL(5, results.count);
+  metalink_verifier_reset_piece(verifier, 2);
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 2048, data + 2048,
+                                             1024));
+  CU_ASSERT_EQUAL(6, results.count);
+  CU_ASSERT_EQUAL(2, results.pieces[5]);
+  CU_ASSERT(results.good[5]);
+  CU_ASSERT_EQUAL(METALINK_PIECE_GOOD,
+                  metalink_verifier_get_piece_status(verifier, 2));
+
+  /* data beyond the end of file is ignored */
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, VERIFY_TEST_LENGTH,
+                                             data, 10));
+  CU_ASSERT_EQUAL(6, results.count);
+  metalink_verifier_delete(verifier);
+
+  /* a bad piece reset from within the callback can be written again */
+  file = new_test_file();
+  metalink_file_set_size(file, VERIFY_TEST_LENGTH);
+  memset(&results, 0, sizeof(results));
+  CU_ASSERT_EQUAL_FATAL(0, metalink_verifier_new(&verifier, file,
+                                                 record_piece, &results));
+  results.reset = verifier;
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 0, corrupt, 100));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 100, data + 100,
+                                             924));
+  CU_ASSERT_EQUAL(1, results.count);
+  CU_ASSERT(!results.good[0]);
+  CU_ASSERT_EQUAL(METALINK_PIECE_INCOMPLETE,
+                  metalink_verifier_get_piece_status(verifier, 0));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 0, data, 1024));
+  CU_ASSERT_EQUAL(2, results.count);
+  CU_ASSERT(results.good[1]);
+  metalink_verifier_delete(verifier);
+
+  CU_ASSERT_EQUAL_FATAL(0, metalink_verifier_new(&verifier, file,
+                                                 fail_piece, NULL));
+  CU_ASSERT_EQUAL(METALINK_ERR_CALLBACK_FAILURE,
+                  metalink_verifier_write(verifier, 0, data, 1024));
+  metalink_verifier_delete(verifier);
+
+  /* data beyond the last piece of a file larger than the pieces cover */
+  metalink_file_set_size(file, VERIFY_TEST_LENGTH * 10);
+  memset(&results, 0, sizeof(results));
+  CU_ASSERT_EQUAL_FATAL(0, metalink_verifier_new(&verifier, file,
+                                                 record_piece, &results));
+  CU_ASSERT_EQUAL(VERIFY_TEST_PIECE_COUNT,
+                  metalink_verifier_get_piece_count(verifier));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 5000, data, 1024));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier,
+                                             VERIFY_TEST_LENGTH * 5, data,
+                                             1024));
+  CU_ASSERT_EQUAL(0, results.count);
+  metalink_verifier_delete(verifier);
+
+  /* pieces beyond the end of a short file are not counted */
+  metalink_file_set_size(file, 1500);
+  memset(&results, 0, sizeof(results));
+  CU_ASSERT_EQUAL_FATAL(0, metalink_verifier_new(&verifier, file,
+                                                 record_piece, &results));
+  CU_ASSERT_EQUAL(2, metalink_verifier_get_piece_count(verifier));
+  CU_ASSERT_EQUAL(0, metalink_verifier_write(verifier, 0, data, 4096));
+  CU_ASSERT_EQUAL(2, results.count);
+  CU_ASSERT(results.good[0]);
+  CU_ASSERT_EQUAL(METALINK_PIECE_INCOMPLETE,
+                  metalink_verifier_get_piece_status(verifier, 2));
+  metalink_verifier_delete(verifier);
+
+  metalink_chunk_checksum_set_type(file->chunk_checksum, "crc32");
+  CU_ASSERT_EQUAL(METALINK_ERR_UNSUPPORTED_HASH,
+                  metalink_verifier_new(&verifier, file, NULL, NULL));
+  metalink_file_delete(file);
+}